@@ -0,0 +1,98 @@
+// Measures the memory footprint of cached avatars and the throughput of
+// cache lookups by id and by name/address.
+//
+// usage: stationchat_avatar_bench [avatar count] [lookup count]
+
+#include "easylogging++.h"
+
+#include "ChatAvatar.hpp"
+#include "ChatAvatarService.hpp"
+#include "InMemoryChatStorage.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+INITIALIZE_EASYLOGGINGPP
+
+namespace {
+
+const char16_t* kGalaxies[] = {u"SWG+Bria", u"SWG+Chimaera", u"SWG+Eclipse", u"SWG+Flurry", u"SWG+Intrepid",
+    u"SWG+Kettemoor", u"SWG+Scylla", u"SWG+Starsider"};
+
+std::u16string AvatarName(uint32_t index) {
+    auto digits = std::to_string(index);
+    return u"avatar" + std::u16string{std::begin(digits), std::end(digits)};
+}
+
+template <typename FnT>
+double OperationsPerSecond(uint32_t count, FnT&& fn) {
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < count; ++i) {
+        fn(i);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return count / elapsed.count();
+}
+
+} // namespace
+
+int main(int argc, const char* argv[]) {
+    uint32_t avatarCount = argc > 1 ? static_cast<uint32_t>(std::strtoul(argv[1], nullptr, 10)) : 100000;
+    uint32_t lookupCount = argc > 2 ? static_cast<uint32_t>(std::strtoul(argv[2], nullptr, 10)) : 1000000;
+    const uint32_t galaxyCount = sizeof(kGalaxies) / sizeof(kGalaxies[0]);
+
+    el::Loggers::reconfigureAllLoggers(el::ConfigurationType::Enabled, "false");
+
+    InMemoryChatStorage storage;
+    ChatAvatarService avatarService{&storage, &storage};
+
+    for (uint32_t i = 0; i < avatarCount; ++i) {
+        avatarService.AdoptStoredAvatar(i + 1, i + 1, AvatarName(i), kGalaxies[i % galaxyCount], 0);
+    }
+
+    avatarService.RefreshCacheUsage();
+
+    std::cout << "avatars:              " << avatarService.GetResidentCount() << "\n"
+              << "sizeof(ChatAvatar):   " << sizeof(ChatAvatar) << " bytes\n"
+              << "sizeof(details):      " << sizeof(ChatAvatarDetails) << " bytes (allocated on demand)\n"
+              << "resident bytes:       " << avatarService.GetResidentBytes() << "\n"
+              << "bytes per avatar:     " << avatarService.GetResidentBytes() / std::max(avatarCount, 1u) << "\n";
+
+    if (avatarCount == 0) {
+        return 0;
+    }
+
+    std::mt19937 rng{42};
+    std::uniform_int_distribution<uint32_t> pick{0, avatarCount - 1};
+
+    std::vector<uint32_t> ids(lookupCount);
+    for (auto& id : ids) {
+        id = pick(rng);
+    }
+
+    std::vector<std::u16string> names(lookupCount);
+    for (uint32_t i = 0; i < lookupCount; ++i) {
+        names[i] = AvatarName(ids[i]);
+    }
+
+    uint64_t found = 0;
+
+    auto byId = OperationsPerSecond(lookupCount, [&](uint32_t i) {
+        found += avatarService.GetCachedAvatar(ids[i] + 1) != nullptr;
+    });
+
+    auto byName = OperationsPerSecond(lookupCount, [&](uint32_t i) {
+        found += avatarService.GetCachedAvatar(names[i], kGalaxies[ids[i] % galaxyCount]) != nullptr;
+    });
+
+    std::cout << "lookups by id:        " << static_cast<uint64_t>(byId) << " ops/s\n"
+              << "lookups by name:      " << static_cast<uint64_t>(byName) << " ops/s\n"
+              << "hits:                 " << found << " / " << 2ull * lookupCount << "\n";
+
+    return found == 2ull * lookupCount ? 0 : 1;
+}
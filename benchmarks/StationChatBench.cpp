@@ -0,0 +1,443 @@
+// Drives a gateway node in-process with simulated game servers and avatars
+// and reports requests per second, p50/p99 handling latency and heap
+// allocations per request for each phase of a typical session: a login storm,
+// room chat, tells, mail and a logout storm.
+//
+// Requests reach the gateway over the udp stub's in-process loopback, and each
+// one is timed until its response arrives back at the simulated game server,
+// so latency covers decoding, the handler and any work it hands to the
+// database workers or the login pipeline, as well as sending the response.
+// Storage is in-memory by default; with --storage mariadb requests run against
+// the database named in the configuration file, so point it at a scratch copy
+// of the schema.
+//
+// usage: stationchat_bench [--storage memory|mariadb] [--config swgchat.cfg] [--servers N] ...
+
+#include "easylogging++.h"
+
+#include "AsyncLog.hpp"
+#include "ChatAvatar.hpp"
+#include "ChatAvatarService.hpp"
+#include "ChatEnums.hpp"
+#include "GatewayNode.hpp"
+#include "Serialization.hpp"
+#include "StationChatConfig.hpp"
+#include "UdpLibrary.hpp"
+
+#include <boost/program_options.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+INITIALIZE_EASYLOGGINGPP
+
+namespace {
+
+std::atomic<uint64_t> allocationCount{0};
+
+} // namespace
+
+void* operator new(std::size_t size) {
+    ++allocationCount;
+    if (auto p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+
+    throw std::bad_alloc{};
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+namespace {
+
+struct BenchOptions {
+    std::string configFile;
+    uint32_t servers = 4;
+    uint32_t avatars = 2000;
+    uint32_t rooms = 16;
+    uint32_t roomMessages = 20000;
+    uint32_t tells = 20000;
+    uint32_t mails = 2000;
+    uint32_t seed = 42;
+    bool verbose = false;
+};
+
+bool ParseOptions(int argc, const char* argv[], BenchOptions& options, StationChatConfig& config) {
+    namespace po = boost::program_options;
+
+    po::options_description generic("Benchmark options");
+    generic.add_options()
+        ("help,h", "produces help message")
+        ("config,c", po::value<std::string>(&options.configFile)->default_value("etc/stationapi/swgchat.cfg"),
+            "configuration file providing the database settings for --storage mariadb")
+        ("storage", po::value<std::string>(&config.storageBackend)->default_value("memory"),
+            "chat storage to run against: memory, or mariadb for the database in the configuration file")
+        ("servers", po::value<uint32_t>(&options.servers)->default_value(4), "simulated game servers")
+        ("avatars", po::value<uint32_t>(&options.avatars)->default_value(2000), "avatars spread over the servers")
+        ("rooms", po::value<uint32_t>(&options.rooms)->default_value(16), "chat rooms the avatars join")
+        ("room_messages", po::value<uint32_t>(&options.roomMessages)->default_value(20000), "room messages sent")
+        ("tells", po::value<uint32_t>(&options.tells)->default_value(20000), "instant messages sent")
+        ("mails", po::value<uint32_t>(&options.mails)->default_value(2000), "persistent messages sent")
+        ("seed", po::value<uint32_t>(&options.seed)->default_value(42), "seed for picking senders and recipients")
+        ("verbose,v", po::bool_switch(&options.verbose), "keeps the gateway's logging enabled")
+        ;
+
+    po::options_description database("Database");
+    database.add_options()
+        ("database_host", po::value<std::string>(&config.chatDatabaseHost)->default_value("127.0.0.1"))
+        ("database_port", po::value<uint16_t>(&config.chatDatabasePort)->default_value(3306))
+        ("database_user", po::value<std::string>(&config.chatDatabaseUser)->default_value(""))
+        ("database_password", po::value<std::string>(&config.chatDatabasePassword)->default_value(""))
+        ("database_schema", po::value<std::string>(&config.chatDatabaseSchema)->default_value(""))
+        ("database_socket", po::value<std::string>(&config.chatDatabaseSocket)->default_value(""))
+        ;
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, generic), vm);
+    po::notify(vm);
+
+    if (vm.count("help")) {
+        std::cout << generic << "\n";
+        return false;
+    }
+
+    if (config.storageBackend == "mariadb") {
+        std::ifstream ifs(options.configFile.c_str());
+        if (!ifs) {
+            throw std::runtime_error("Cannot open configuration file: " + options.configFile);
+        }
+
+        po::store(po::parse_config_file(ifs, database, true), vm);
+        po::notify(vm);
+    }
+
+    if (options.servers == 0 || options.avatars < options.servers || options.rooms == 0) {
+        throw std::runtime_error("need at least one server, one avatar per server and one room");
+    }
+
+    // The udp stub only connects within this process, so the port is free.
+    config.gatewayAddress = "127.0.0.1";
+    config.gatewayPort = 5001;
+    config.websiteIntegration.enabled = false;
+    config.snapshotFile.clear();
+
+    return true;
+}
+
+std::u16string ToU16(const std::string& value) { return std::u16string{std::begin(value), std::end(value)}; }
+
+/** Encodes a request the way a game server puts it on the wire.
+ */
+class RequestWriter {
+public:
+    explicit RequestWriter(ChatRequestType type)
+        : track_{++lastTrack_} {
+        write(stream_, type);
+        write(stream_, track_);
+    }
+
+    template <typename T>
+    RequestWriter& operator<<(const T& value) {
+        write(stream_, value);
+        return *this;
+    }
+
+    std::string Str() const { return stream_.str(); }
+    uint32_t Track() const { return track_; }
+
+private:
+    static uint32_t lastTrack_;
+    uint32_t track_;
+    std::ostringstream stream_{std::ios::out | std::ios::binary};
+};
+
+uint32_t RequestWriter::lastTrack_ = 0;
+
+struct GameServer {
+    std::u16string address;
+    UdpConnection* connection = nullptr;
+};
+
+struct Avatar {
+    uint32_t server;
+    std::u16string name;
+    uint32_t avatarId = 0;
+    uint32_t room = 0;
+};
+
+struct PhaseResult {
+    std::string name;
+    std::vector<uint32_t> latencies;
+    uint64_t allocations = 0;
+    double seconds = 0;
+};
+
+class Bench : public UdpConnectionHandler {
+public:
+    Bench(const BenchOptions& options, StationChatConfig& config)
+        : options_{options}
+        , node_{config}
+        , gatewayPort_{config.gatewayPort}
+        , rng_{options.seed} {
+        UdpManager::Params params{};
+        manager_ = new UdpManager(&params);
+    }
+
+    ~Bench() {
+        for (auto& server : servers_) {
+            server.connection->SetHandler(nullptr);
+            server.connection->Disconnect();
+        }
+
+        node_.Tick();
+
+        for (auto& server : servers_) {
+            server.connection->Release();
+        }
+
+        manager_->Release();
+    }
+
+    void Run() {
+        Setup();
+
+        Phase("login storm", options_.avatars, [this](uint32_t i) { Login(avatars_[i]); });
+
+        for (auto& avatar : avatars_) {
+            auto stored = node_.GetAvatarService()->GetAvatar(avatar.name, servers_[avatar.server].address);
+            if (!stored) {
+                throw std::runtime_error("Avatar was not created during the login storm; check the storage settings");
+            }
+
+            avatar.avatarId = stored->GetAvatarId();
+        }
+
+        CreateRooms();
+
+        Phase("enter room", options_.avatars, [this](uint32_t i) { EnterRoom(avatars_[i]); });
+        Phase("room chat", options_.roomMessages, [this](uint32_t) { SendRoomMessage(PickAvatar()); });
+        Phase("tells", options_.tells, [this](uint32_t) { SendTell(PickAvatar(), PickAvatar()); });
+        Phase("mail", options_.mails, [this](uint32_t) { SendMail(PickAvatar(), PickAvatar()); });
+        Phase("logout storm", options_.avatars, [this](uint32_t i) { Logout(avatars_[i]); });
+
+        Report();
+    }
+
+private:
+    void Setup() {
+        for (uint32_t i = 0; i < options_.servers; ++i) {
+            GameServer server;
+            server.address = ToU16("SWG+Bench" + std::to_string(i));
+            server.connection = manager_->EstablishConnection("127.0.0.1", gatewayPort_);
+            server.connection->SetHandler(this);
+            servers_.push_back(server);
+
+            Deliver(server, RequestWriter{ChatRequestType::SETAPIVERSION} << uint32_t{2});
+
+            // Each game server logs in its SYSTEM avatar, which routes the
+            // galaxy's traffic to this connection.
+            Deliver(server, RequestWriter{ChatRequestType::LOGINAVATAR} << uint32_t{0} << std::u16string{u"SYSTEM"}
+                                                                     << server.address << std::u16string{}
+                                                                     << int32_t{0} << int32_t{0});
+        }
+
+        for (uint32_t i = 0; i < options_.avatars; ++i) {
+            Avatar avatar;
+            avatar.server = i % options_.servers;
+            avatar.name = ToU16("bench" + std::to_string(i));
+            avatar.room = i % options_.rooms;
+            avatars_.push_back(avatar);
+        }
+    }
+
+    void CreateRooms() {
+        for (uint32_t i = 0; i < options_.rooms; ++i) {
+            auto& creator = avatars_[i % avatars_.size()];
+            auto& server = servers_[creator.server];
+
+            roomAddresses_.push_back(server.address + u"+bench+room" + ToU16(std::to_string(i)));
+
+            Deliver(server, RequestWriter{ChatRequestType::CREATEROOM}
+                                << creator.avatarId << ToU16("room" + std::to_string(i)) << std::u16string{u"bench"}
+                                << std::u16string{} << uint32_t{0} << uint32_t{0}
+                                << (server.address + u"+bench") << server.address);
+        }
+    }
+
+    void Login(const Avatar& avatar) {
+        auto& server = servers_[avatar.server];
+        Deliver(server, RequestWriter{ChatRequestType::LOGINAVATAR} << uint32_t{1} << avatar.name << server.address
+                                                                 << std::u16string{u"bench"} << int32_t{0}
+                                                                 << int32_t{0});
+    }
+
+    void Logout(const Avatar& avatar) {
+        Deliver(servers_[avatar.server], RequestWriter{ChatRequestType::LOGOUTAVATAR} << avatar.avatarId);
+    }
+
+    void EnterRoom(const Avatar& avatar) {
+        auto& server = servers_[avatar.server];
+        Deliver(server, RequestWriter{ChatRequestType::ENTERROOM} << avatar.avatarId << roomAddresses_[avatar.room]
+                                                               << std::u16string{} << false << true
+                                                               << server.address);
+    }
+
+    void SendRoomMessage(const Avatar& avatar) {
+        auto& server = servers_[avatar.server];
+        Deliver(server, RequestWriter{ChatRequestType::SENDROOMMESSAGE}
+                            << avatar.avatarId << roomAddresses_[avatar.room]
+                            << std::u16string{u"anyone up for a krayt dragon run?"} << std::u16string{}
+                            << server.address);
+    }
+
+    void SendTell(const Avatar& from, const Avatar& to) {
+        auto& server = servers_[from.server];
+        Deliver(server, RequestWriter{ChatRequestType::SENDINSTANTMESSAGE}
+                            << from.avatarId << to.name << servers_[to.server].address
+                            << std::u16string{u"meet at the cantina"} << std::u16string{} << server.address);
+    }
+
+    void SendMail(const Avatar& from, const Avatar& to) {
+        Deliver(servers_[from.server], RequestWriter{ChatRequestType::SENDPERSISTENTMESSAGE}
+                                           << uint16_t{1} << from.avatarId << to.name << servers_[to.server].address
+                                           << std::u16string{u"guild meeting"}
+                                           << std::u16string{u"Guild hall on Lok, 20:00 server time."}
+                                           << std::u16string{} << std::u16string{u"bench"} << false << uint32_t{0});
+    }
+
+    const Avatar& PickAvatar() {
+        std::uniform_int_distribution<uint32_t> pick{0, static_cast<uint32_t>(avatars_.size() - 1)};
+        return avatars_[pick(rng_)];
+    }
+
+    // Handlers that await the database only queue work on the first tick, so
+    // the gateway keeps ticking until the response for this request is back.
+    void Deliver(const GameServer& server, const RequestWriter& request) {
+        auto data = request.Str();
+        server.connection->Send(cUdpChannelReliable1, data.data(), static_cast<uint32_t>(data.size()));
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+        while (lastAnswered_ != request.Track()) {
+            if (server.connection->GetStatus() != UdpConnection::cStatusConnected
+                || std::chrono::steady_clock::now() > deadline) {
+                throw std::runtime_error("The gateway did not answer request " + std::to_string(request.Track()));
+            }
+
+            node_.Tick();
+            manager_->GiveTime();
+        }
+    }
+
+    void OnRoutePacket(UdpConnection*, const uchar* data, int length) override {
+        // Responses carry the request's track after their type; messages the
+        // gateway pushes unprompted carry track 0.
+        uint32_t track = 0;
+        if (length >= static_cast<int>(sizeof(uint16_t) + sizeof(track))) {
+            std::memcpy(&track, data + sizeof(uint16_t), sizeof(track));
+        }
+
+        if (track != 0) {
+            lastAnswered_ = track;
+        }
+    }
+
+    template <typename FnT>
+    void Phase(const std::string& name, uint32_t count, FnT&& fn) {
+        PhaseResult result;
+        result.name = name;
+        result.latencies.reserve(count);
+
+        auto allocationsBefore = allocationCount.load();
+        auto phaseStart = std::chrono::steady_clock::now();
+
+        for (uint32_t i = 0; i < count; ++i) {
+            auto start = std::chrono::steady_clock::now();
+            fn(i);
+            auto elapsed = std::chrono::steady_clock::now() - start;
+
+            result.latencies.push_back(static_cast<uint32_t>(
+                std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count()));
+        }
+
+        std::chrono::duration<double> phaseTime = std::chrono::steady_clock::now() - phaseStart;
+        result.seconds = phaseTime.count();
+
+        // The latency samples were reserved up front, so every counted
+        // allocation belongs to the requests themselves.
+        result.allocations = allocationCount.load() - allocationsBefore;
+
+        results_.push_back(std::move(result));
+    }
+
+    void Report() {
+        std::cout << std::left << std::setw(16) << "phase" << std::right << std::setw(10) << "requests"
+                  << std::setw(12) << "req/s" << std::setw(10) << "p50 us" << std::setw(10) << "p99 us"
+                  << std::setw(14) << "allocs/req" << "\n";
+
+        for (auto& result : results_) {
+            auto& samples = result.latencies;
+            if (samples.empty()) {
+                continue;
+            }
+
+            std::sort(std::begin(samples), std::end(samples));
+
+            std::cout << std::left << std::setw(16) << result.name << std::right << std::setw(10) << samples.size()
+                      << std::setw(12) << static_cast<uint64_t>(samples.size() / std::max(result.seconds, 1e-9))
+                      << std::setw(10) << samples[samples.size() / 2] << std::setw(10)
+                      << samples[std::min(samples.size() - 1, samples.size() * 99 / 100)] << std::setw(14)
+                      << std::fixed << std::setprecision(1)
+                      << static_cast<double>(result.allocations) / samples.size() << "\n";
+        }
+    }
+
+    const BenchOptions& options_;
+    GatewayNode node_;
+    uint16_t gatewayPort_;
+    UdpManager* manager_;
+    uint32_t lastAnswered_ = 0;
+    std::mt19937 rng_;
+    std::vector<GameServer> servers_;
+    std::vector<Avatar> avatars_;
+    std::vector<std::u16string> roomAddresses_;
+    std::vector<PhaseResult> results_;
+};
+
+} // namespace
+
+int main(int argc, const char* argv[]) {
+    BenchOptions options;
+    StationChatConfig config;
+
+    try {
+        if (!ParseOptions(argc, argv, options, config)) {
+            return 0;
+        }
+
+        if (!options.verbose) {
+            el::Loggers::reconfigureAllLoggers(el::ConfigurationType::Enabled, "false");
+            AsyncLogger::Instance().SetRequestSampling(0, 0);
+        }
+
+        Bench bench{options, config};
+        bench.Run();
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
@@ -3,6 +3,7 @@
 #include <atomic>
 #include <cstdint>
 #include <cstring>
+#include <deque>
 #include <string>
 
 using uchar = unsigned char;
@@ -10,11 +11,15 @@ using uchar = unsigned char;
 constexpr int cUdpChannelReliable1 = 0;
 
 class UdpConnection;
+class UdpManager;
 
 class UdpConnectionHandler {
 public:
     virtual ~UdpConnectionHandler() = default;
     virtual void OnRoutePacket(UdpConnection* connection, const uchar* data, int length) = 0;
+
+    // Called once when a connection transitions to cStatusDisconnected.
+    virtual void OnTerminated(UdpConnection* connection) {}
 };
 
 class UdpManagerHandler {
@@ -49,18 +54,28 @@ public:
     void Send(int channel, const char* data, uint32_t length);
 
     Status GetStatus() const;
+    int TotalPendingBytes() const;
     const UdpIpAddress& GetDestinationIp() const;
     uint16_t GetDestinationPort() const;
 
     void SetDestination(const std::string& address, uint16_t port);
     void SimulateIncoming(const uchar* data, int length);
+    void SimulatePendingBytes(int pendingBytes);
 
 private:
+    friend class UdpManager;
+
     std::atomic<int> refCount_;
     Status status_;
     UdpConnectionHandler* handler_;
     UdpIpAddress destination_;
     uint16_t destinationPort_;
+    int pendingBytes_;
+
+    // Set for connections made with UdpManager::EstablishConnection: the
+    // manager that delivers this side's incoming data, and the other side.
+    UdpManager* manager_;
+    UdpConnection* peer_;
 };
 
 class UdpManager {
@@ -79,8 +94,30 @@ public:
 
     UdpConnection* CreateConnection();
 
+    /** Connects to the manager listening on serverPort in this process; the
+     * stub has no network, so the address is not consulted. Data sent on
+     * either side is delivered by the receiving manager's GiveTime, as with
+     * the real library. When nothing listens on the port the connection is
+     * returned already disconnected.
+     */
+    UdpConnection* EstablishConnection(const char* serverAddress, int serverPort, int timeout = 0);
+
 private:
+    friend class UdpConnection;
+
+    enum class EventType { CONNECT, DATA, DISCONNECT };
+
+    struct Event {
+        EventType type;
+        UdpConnection* connection;
+        std::string data;
+    };
+
+    // Takes over one reference to the connection.
+    static void Enqueue(UdpManager* manager, EventType type, UdpConnection* connection, std::string data = {});
+
     UdpManagerHandler* handler_;
     uint16_t listenPort_;
+    std::deque<Event> inbox_;
 };
 
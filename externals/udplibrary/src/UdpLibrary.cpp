@@ -1,11 +1,20 @@
 #include "UdpLibrary.hpp"
 
 #include <algorithm>
+#include <map>
+#include <mutex>
+#include <set>
 #include <utility>
 
 namespace {
 constexpr std::size_t UDP_ADDRESS_BUFFER = 256;
-}
+
+// Connections made with EstablishConnection cross threads, so the loopback
+// state, every manager's inbox and the peer links share one lock.
+std::mutex loopbackMutex;
+std::map<uint16_t, UdpManager*> listeningManagers;
+std::set<UdpManager*> liveManagers;
+} // namespace
 
 UdpIpAddress::UdpIpAddress() : address_{"0.0.0.0"} {}
 
@@ -30,7 +39,10 @@ UdpConnection::UdpConnection()
     , status_{cStatusConnected}
     , handler_{nullptr}
     , destination_{"0.0.0.0"}
-    , destinationPort_{0} {}
+    , destinationPort_{0}
+    , pendingBytes_{0}
+    , manager_{nullptr}
+    , peer_{nullptr} {}
 
 void UdpConnection::AddRef() { ++refCount_; }
 
@@ -42,16 +54,61 @@ void UdpConnection::Release() {
 
 void UdpConnection::SetHandler(UdpConnectionHandler* handler) { handler_ = handler; }
 
-void UdpConnection::Disconnect() { status_ = cStatusDisconnected; }
+void UdpConnection::Disconnect() {
+    if (status_ == cStatusDisconnected) {
+        return;
+    }
+
+    status_ = cStatusDisconnected;
+
+    UdpConnection* peer = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(loopbackMutex);
+        std::swap(peer, peer_);
+    }
+
+    // The other side learns of it on its own manager's next GiveTime; the
+    // reference this side held on it passes to that event.
+    if (peer != nullptr) {
+        UdpManager::Enqueue(peer->manager_, UdpManager::EventType::DISCONNECT, peer);
+    }
+
+    if (handler_ != nullptr) {
+        handler_->OnTerminated(this);
+    }
+}
+
+void UdpConnection::Send(int, const char* data, uint32_t length) {
+    // The open-source stub does not implement real networking. Only
+    // connections made with EstablishConnection deliver anything, and only
+    // within this process; everything else is dropped so that the rest of the
+    // application can be tested without the proprietary dependency.
+    if (status_ != cStatusConnected) {
+        return;
+    }
+
+    UdpConnection* peer = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(loopbackMutex);
+        peer = peer_;
+        if (peer != nullptr) {
+            peer->AddRef();
+        }
+    }
 
-void UdpConnection::Send(int, const char*, uint32_t) {
-    // The open-source stub does not implement real networking. This method is
-    // intentionally a no-op so that the rest of the application can be tested
-    // without the proprietary dependency.
+    if (peer != nullptr) {
+        UdpManager::Enqueue(peer->manager_, UdpManager::EventType::DATA, peer, std::string{data, length});
+    }
 }
 
 UdpConnection::Status UdpConnection::GetStatus() const { return status_; }
 
+int UdpConnection::TotalPendingBytes() const {
+    // Nothing is ever queued by the stub; tests set a backlog explicitly with
+    // SimulatePendingBytes.
+    return pendingBytes_;
+}
+
 const UdpIpAddress& UdpConnection::GetDestinationIp() const { return destination_; }
 
 uint16_t UdpConnection::GetDestinationPort() const { return destinationPort_; }
@@ -69,16 +126,76 @@ void UdpConnection::SimulateIncoming(const uchar* data, int length) {
     handler_->OnRoutePacket(this, data, length);
 }
 
+void UdpConnection::SimulatePendingBytes(int pendingBytes) { pendingBytes_ = pendingBytes; }
+
 UdpManager::UdpManager(const Params* params)
     : handler_{params != nullptr ? params->handler : nullptr}
-    , listenPort_{params != nullptr ? params->port : 0} {}
+    , listenPort_{static_cast<uint16_t>(params != nullptr ? params->port : 0)} {
+    std::lock_guard<std::mutex> lock(loopbackMutex);
+    liveManagers.insert(this);
+    if (listenPort_ != 0) {
+        listeningManagers.emplace(listenPort_, this);
+    }
+}
 
-UdpManager::~UdpManager() = default;
+UdpManager::~UdpManager() {
+    std::deque<Event> pending;
+    {
+        std::lock_guard<std::mutex> lock(loopbackMutex);
+        liveManagers.erase(this);
+
+        auto listening = listeningManagers.find(listenPort_);
+        if (listening != std::end(listeningManagers) && listening->second == this) {
+            listeningManagers.erase(listening);
+        }
+
+        pending.swap(inbox_);
+    }
+
+    for (auto& event : pending) {
+        event.connection->Release();
+    }
+}
 
 void UdpManager::Release() { delete this; }
 
 void UdpManager::GiveTime() {
-    // Nothing to do in the stub implementation.
+    std::deque<Event> events;
+    {
+        std::lock_guard<std::mutex> lock(loopbackMutex);
+        events.swap(inbox_);
+    }
+
+    for (auto& event : events) {
+        switch (event.type) {
+        case EventType::CONNECT:
+            if (handler_ != nullptr) {
+                handler_->OnConnectRequest(event.connection);
+            }
+            break;
+        case EventType::DATA:
+            event.connection->SimulateIncoming(
+                reinterpret_cast<const uchar*>(event.data.data()), static_cast<int>(event.data.size()));
+            break;
+        case EventType::DISCONNECT:
+            event.connection->Disconnect();
+            break;
+        }
+
+        event.connection->Release();
+    }
+}
+
+void UdpManager::Enqueue(UdpManager* manager, EventType type, UdpConnection* connection, std::string data) {
+    {
+        std::lock_guard<std::mutex> lock(loopbackMutex);
+        if (liveManagers.count(manager) != 0) {
+            manager->inbox_.push_back(Event{type, connection, std::move(data)});
+            return;
+        }
+    }
+
+    connection->Release();
 }
 
 UdpConnection* UdpManager::CreateConnection() {
@@ -92,3 +209,41 @@ UdpConnection* UdpManager::CreateConnection() {
     return connection;
 }
 
+
+UdpConnection* UdpManager::EstablishConnection(const char* serverAddress, int serverPort, int) {
+    auto* connection = new UdpConnection();
+    connection->SetDestination(serverAddress != nullptr ? serverAddress : "", static_cast<uint16_t>(serverPort));
+    connection->manager_ = this;
+
+    UdpManager* server = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(loopbackMutex);
+        auto listening = listeningManagers.find(static_cast<uint16_t>(serverPort));
+        if (listening != std::end(listeningManagers)) {
+            server = listening->second;
+        }
+    }
+
+    if (server == nullptr) {
+        connection->status_ = UdpConnection::cStatusDisconnected;
+        return connection;
+    }
+
+    // Each side holds a reference on the other until either disconnects; the
+    // server side's own reference goes to the connect event.
+    auto* accepted = new UdpConnection();
+    accepted->SetDestination("127.0.0.1", listenPort_);
+    accepted->manager_ = server;
+
+    {
+        std::lock_guard<std::mutex> lock(loopbackMutex);
+        connection->peer_ = accepted;
+        accepted->AddRef();
+        accepted->peer_ = connection;
+        connection->AddRef();
+    }
+
+    Enqueue(server, EventType::CONNECT, accepted);
+
+    return connection;
+}
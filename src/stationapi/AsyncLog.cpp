@@ -0,0 +1,152 @@
+
+#include "AsyncLog.hpp"
+
+#include "StringUtils.hpp"
+
+#include <chrono>
+#include <sstream>
+
+bool asynclog::Argument<std::u16string>::Print(std::ostream& os, PayloadReader& reader) {
+    uint16_t count;
+    auto value = reader.ReadString(sizeof(char16_t), count);
+    if (!value) {
+        return false;
+    }
+
+    std::u16string wide(count, u'\0');
+    std::memcpy(&wide[0], value, count * sizeof(char16_t));
+
+    os << FromWideString(wide);
+    return true;
+}
+
+AsyncLogger& AsyncLogger::Instance() {
+    static AsyncLogger logger;
+    return logger;
+}
+
+AsyncLogger::AsyncLogger()
+    : dropped_{&GetMetricsRegistry().Counter(
+          "stationapi_log_records_dropped_total", "Log records dropped because a logging thread's ring was full")}
+    , sampledOut_{&GetMetricsRegistry().Counter(
+          "stationapi_log_records_sampled_out_total", "Per request log lines suppressed by sampling or rate limits")} {}
+
+AsyncLogger::~AsyncLogger() { Stop(); }
+
+void AsyncLogger::Start() {
+    if (thread_.joinable()) {
+        return;
+    }
+
+    stopRequested_ = false;
+    thread_ = std::thread([this]() { Run(); });
+    running_.store(true, std::memory_order_release);
+}
+
+void AsyncLogger::Stop() {
+    if (!thread_.joinable()) {
+        return;
+    }
+
+    // New records are written synchronously from here on, while the writer
+    // thread empties the rings before it exits.
+    running_.store(false, std::memory_order_release);
+    stopRequested_ = true;
+    thread_.join();
+}
+
+void AsyncLogger::SetRequestSampling(uint32_t sampleEvery, uint32_t maxPerSecond) {
+    sampleEvery_ = sampleEvery;
+    maxPerSecond_ = maxPerSecond;
+}
+
+bool AsyncLogger::ShouldLogRequest(std::atomic<uint32_t>& callCount) {
+    auto sampleEvery = sampleEvery_.load(std::memory_order_relaxed);
+    if (sampleEvery == 0 || (sampleEvery > 1 && callCount.fetch_add(1, std::memory_order_relaxed) % sampleEvery != 0)) {
+        sampledOut_->Increment();
+        return false;
+    }
+
+    auto maxPerSecond = maxPerSecond_.load(std::memory_order_relaxed);
+    if (maxPerSecond > 0) {
+        auto second = std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+
+        if (rateWindow_.exchange(second, std::memory_order_relaxed) != second) {
+            rateWindowCount_.store(0, std::memory_order_relaxed);
+        }
+
+        if (rateWindowCount_.fetch_add(1, std::memory_order_relaxed) >= maxPerSecond) {
+            sampledOut_->Increment();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+uint64_t AsyncLogger::GetDroppedCount() const { return dropped_->Value(); }
+
+AsyncLogger::Ring* AsyncLogger::GetThreadRing() {
+    thread_local Ring* ring = nullptr;
+    if (ring == nullptr) {
+        std::lock_guard<std::mutex> lock(ringsMutex_);
+        rings_.push_back(std::make_unique<Ring>());
+        ring = rings_.back().get();
+    }
+
+    return ring;
+}
+
+void AsyncLogger::Write(const Record& record) {
+    std::ostringstream os;
+    record.decode(os, record.payload, record.size);
+
+    switch (record.level) {
+    case el::Level::Trace:
+        LOG(TRACE) << os.str();
+        break;
+    case el::Level::Debug:
+        LOG(DEBUG) << os.str();
+        break;
+    case el::Level::Warning:
+        LOG(WARNING) << os.str();
+        break;
+    case el::Level::Error:
+        LOG(ERROR) << os.str();
+        break;
+    default:
+        LOG(INFO) << os.str();
+        break;
+    }
+}
+
+bool AsyncLogger::Drain() {
+    std::vector<Ring*> rings;
+    {
+        std::lock_guard<std::mutex> lock(ringsMutex_);
+        for (auto& ring : rings_) {
+            rings.push_back(ring.get());
+        }
+    }
+
+    bool wroteAny = false;
+    for (auto ring : rings) {
+        while (ring->ConsumeOne([this](const Record& record) { Write(record); })) {
+            wroteAny = true;
+        }
+    }
+
+    return wroteAny;
+}
+
+void AsyncLogger::Run() {
+    while (!stopRequested_) {
+        if (!Drain()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    while (Drain()) {
+    }
+}
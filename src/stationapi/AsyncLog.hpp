@@ -0,0 +1,383 @@
+
+#pragma once
+
+#include "Metrics.hpp"
+
+#include "easylogging++.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace asynclog {
+
+/** Bounded byte buffer that log arguments are captured into. Once an argument
+ * does not fit, it and every later argument are left out of the record.
+ */
+class PayloadWriter {
+public:
+    PayloadWriter(char* data, std::size_t capacity)
+        : data_{data}
+        , capacity_{capacity} {}
+
+    bool Write(const void* value, std::size_t length) {
+        if (full_ || size_ + length > capacity_) {
+            full_ = true;
+            return false;
+        }
+
+        std::memcpy(data_ + size_, value, length);
+        size_ += length;
+        return true;
+    }
+
+    // Strings are clipped to the remaining space rather than dropped.
+    void WriteString(const void* value, std::size_t length, std::size_t unitSize) {
+        if (full_ || size_ + sizeof(uint16_t) > capacity_) {
+            full_ = true;
+            return;
+        }
+
+        auto units = std::min<std::size_t>(length, (capacity_ - size_ - sizeof(uint16_t)) / unitSize);
+        auto count = static_cast<uint16_t>(std::min<std::size_t>(units, UINT16_MAX));
+
+        Write(&count, sizeof(count));
+        Write(value, count * unitSize);
+
+        if (count < length) {
+            full_ = true;
+        }
+    }
+
+    std::size_t Size() const { return size_; }
+
+private:
+    char* data_;
+    std::size_t capacity_;
+    std::size_t size_ = 0;
+    bool full_ = false;
+};
+
+class PayloadReader {
+public:
+    PayloadReader(const char* data, std::size_t size)
+        : data_{data}
+        , size_{size} {}
+
+    bool Read(void* value, std::size_t length) {
+        if (offset_ + length > size_) {
+            return false;
+        }
+
+        std::memcpy(value, data_ + offset_, length);
+        offset_ += length;
+        return true;
+    }
+
+    const char* ReadString(std::size_t unitSize, uint16_t& count) {
+        if (!Read(&count, sizeof(count)) || offset_ + count * unitSize > size_) {
+            return nullptr;
+        }
+
+        auto value = data_ + offset_;
+        offset_ += count * unitSize;
+        return value;
+    }
+
+private:
+    const char* data_;
+    std::size_t size_;
+    std::size_t offset_ = 0;
+};
+
+// Character arrays are taken to be string literals and captured by pointer;
+// every other string is copied into the record.
+template <typename T>
+struct Argument {
+    static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value, "unsupported async log argument");
+
+    static void Encode(PayloadWriter& writer, const T& value) { writer.Write(&value, sizeof(T)); }
+
+    static bool Print(std::ostream& os, PayloadReader& reader) {
+        T value;
+        if (!reader.Read(&value, sizeof(T))) {
+            return false;
+        }
+
+        Stream(os, value);
+        return true;
+    }
+
+private:
+    template <typename U = T, typename std::enable_if_t<std::is_enum<U>::value, int> = 0>
+    static void Stream(std::ostream& os, const U& value) {
+        os << static_cast<std::underlying_type_t<U>>(value);
+    }
+
+    template <typename U = T, typename std::enable_if_t<!std::is_enum<U>::value, int> = 0>
+    static void Stream(std::ostream& os, const U& value) {
+        os << +value;
+    }
+};
+
+template <>
+struct Argument<bool> {
+    static void Encode(PayloadWriter& writer, bool value) {
+        uint8_t flag = value ? 1 : 0;
+        writer.Write(&flag, sizeof(flag));
+    }
+
+    static bool Print(std::ostream& os, PayloadReader& reader) {
+        uint8_t flag;
+        if (!reader.Read(&flag, sizeof(flag))) {
+            return false;
+        }
+
+        os << (flag ? "true" : "false");
+        return true;
+    }
+};
+
+template <std::size_t N>
+struct Argument<char[N]> {
+    static void Encode(PayloadWriter& writer, const char (&value)[N]) {
+        const char* literal = value;
+        writer.Write(&literal, sizeof(literal));
+    }
+
+    static bool Print(std::ostream& os, PayloadReader& reader) {
+        const char* literal;
+        if (!reader.Read(&literal, sizeof(literal))) {
+            return false;
+        }
+
+        os << literal;
+        return true;
+    }
+};
+
+template <>
+struct Argument<std::string> {
+    static void Encode(PayloadWriter& writer, const std::string& value) {
+        writer.WriteString(value.data(), value.size(), sizeof(char));
+    }
+
+    static bool Print(std::ostream& os, PayloadReader& reader) {
+        uint16_t count;
+        auto value = reader.ReadString(sizeof(char), count);
+        if (!value) {
+            return false;
+        }
+
+        os.write(value, count);
+        return true;
+    }
+};
+
+template <>
+struct Argument<const char*> {
+    static void Encode(PayloadWriter& writer, const char* value) {
+        if (value == nullptr) {
+            value = "(null)";
+        }
+
+        writer.WriteString(value, std::strlen(value), sizeof(char));
+    }
+
+    static bool Print(std::ostream& os, PayloadReader& reader) { return Argument<std::string>::Print(os, reader); }
+};
+
+template <>
+struct Argument<char*> : Argument<const char*> {};
+
+// Wide strings are converted to UTF-8 on the writer thread.
+template <>
+struct Argument<std::u16string> {
+    static void Encode(PayloadWriter& writer, const std::u16string& value) {
+        writer.WriteString(value.data(), value.size(), sizeof(char16_t));
+    }
+
+    static bool Print(std::ostream& os, PayloadReader& reader);
+};
+
+using DecodeFn = void (*)(std::ostream& os, const char* payload, std::size_t size);
+
+template <typename... Args>
+void Decode(std::ostream& os, const char* payload, std::size_t size) {
+    PayloadReader reader{payload, size};
+
+    bool complete = true;
+    int expand[] = {0, (complete = complete && Argument<std::remove_cv_t<Args>>::Print(os, reader), 0)...};
+    (void)expand;
+
+    if (!complete) {
+        os << "...";
+    }
+}
+
+} // namespace asynclog
+
+/** Log backend that keeps formatting and I/O off the calling thread.
+ *
+ * Each logging thread gets a preallocated single-producer ring of fixed-size
+ * records. A call captures its arguments into the next free record, deferring
+ * number formatting and wide-string conversion, and a background thread
+ * formats the records and hands them to easylogging++. When a ring is full the
+ * record is dropped and counted rather than blocking the caller.
+ *
+ * Until Start is called, and after Stop, records are written synchronously.
+ */
+class AsyncLogger {
+public:
+    static constexpr std::size_t kPayloadSize = 240;
+    static constexpr std::size_t kRingCapacity = 2048;
+
+    static AsyncLogger& Instance();
+
+    ~AsyncLogger();
+
+    void Start();
+
+    /** Writes every captured record and stops the background thread.
+     */
+    void Stop();
+
+    /** Per request log lines are written for one call in sampleEvery (0
+     * suppresses them) and at most maxPerSecond times a second (0 is
+     * unlimited).
+     */
+    void SetRequestSampling(uint32_t sampleEvery, uint32_t maxPerSecond);
+
+    bool ShouldLogRequest(std::atomic<uint32_t>& callCount);
+
+    template <typename... Args>
+    void Log(el::Level level, const Args&... args) {
+        if (!running_.load(std::memory_order_acquire)) {
+            Record record;
+            record.level = level;
+            record.decode = &asynclog::Decode<Args...>;
+            record.size = static_cast<uint16_t>(Capture(record, args...));
+            Write(record);
+            return;
+        }
+
+        auto ring = GetThreadRing();
+        auto record = ring->Claim();
+        if (record == nullptr) {
+            dropped_->Increment();
+            return;
+        }
+
+        record->level = level;
+        record->decode = &asynclog::Decode<Args...>;
+        record->size = static_cast<uint16_t>(Capture(*record, args...));
+        ring->Publish();
+    }
+
+    uint64_t GetDroppedCount() const;
+
+private:
+    struct Record {
+        el::Level level;
+        asynclog::DecodeFn decode;
+        uint16_t size;
+        char payload[kPayloadSize];
+    };
+
+    class Ring {
+    public:
+        Ring()
+            : records_(kRingCapacity) {}
+
+        Record* Claim() {
+            auto head = head_.load(std::memory_order_relaxed);
+            if (head - tail_.load(std::memory_order_acquire) >= kRingCapacity) {
+                return nullptr;
+            }
+
+            return &records_[head % kRingCapacity];
+        }
+
+        void Publish() { head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+        // Consumer side; returns false when the ring is empty.
+        template <typename FunctorT>
+        bool ConsumeOne(FunctorT&& fn) {
+            auto tail = tail_.load(std::memory_order_relaxed);
+            if (tail == head_.load(std::memory_order_acquire)) {
+                return false;
+            }
+
+            fn(records_[tail % kRingCapacity]);
+            tail_.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+    private:
+        std::vector<Record> records_;
+        std::atomic<uint64_t> head_{0};
+        std::atomic<uint64_t> tail_{0};
+    };
+
+    AsyncLogger();
+
+    template <typename... Args>
+    static std::size_t Capture(Record& record, const Args&... args) {
+        asynclog::PayloadWriter writer{record.payload, kPayloadSize};
+
+        int expand[] = {0, (asynclog::Argument<std::remove_cv_t<Args>>::Encode(writer, args), 0)...};
+        (void)expand;
+
+        return writer.Size();
+    }
+
+    Ring* GetThreadRing();
+    void Write(const Record& record);
+    bool Drain();
+    void Run();
+
+    std::atomic<bool> running_{false};
+    std::atomic<bool> stopRequested_{false};
+    std::thread thread_;
+
+    std::mutex ringsMutex_;
+    std::vector<std::unique_ptr<Ring>> rings_;
+
+    std::atomic<uint32_t> sampleEvery_{1};
+    std::atomic<uint32_t> maxPerSecond_{0};
+    std::atomic<int64_t> rateWindow_{0};
+    std::atomic<uint32_t> rateWindowCount_{0};
+
+    MetricCounter* dropped_;
+    MetricCounter* sampledOut_;
+};
+
+/** Logs through the asynchronous backend, e.g.
+ * ASYNC_LOG(INFO, "LOGINAVATAR request received ", request.name);
+ */
+#define ASYNC_LOG(LEVEL, ...) AsyncLogger::Instance().Log(ASYNC_LOG_LEVEL_##LEVEL, __VA_ARGS__)
+
+#define ASYNC_LOG_LEVEL_TRACE el::Level::Trace
+#define ASYNC_LOG_LEVEL_DEBUG el::Level::Debug
+#define ASYNC_LOG_LEVEL_INFO el::Level::Info
+#define ASYNC_LOG_LEVEL_WARNING el::Level::Warning
+#define ASYNC_LOG_LEVEL_ERROR el::Level::Error
+
+/** Per request INFO line subject to the configured sampling and rate limit.
+ */
+#define REQUEST_LOG(...)                                                                \
+    do {                                                                                \
+        static std::atomic<uint32_t> requestLogCalls_{0};                               \
+        if (AsyncLogger::Instance().ShouldLogRequest(requestLogCalls_)) {                \
+            AsyncLogger::Instance().Log(el::Level::Info, __VA_ARGS__);                   \
+        }                                                                               \
+    } while (false)
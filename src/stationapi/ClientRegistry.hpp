@@ -0,0 +1,68 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+/** Hashed routing table from keys (e.g. interned addresses) to the client
+ * currently serving them. A client may own any number of keys; registering a
+ * key that belongs to another client moves it. Removing a client drops all of
+ * its keys, so lookups never return a destroyed client as long as the owner
+ * calls RemoveClient before destroying it.
+ */
+template <typename KeyT, typename ClientT>
+class ClientRegistry {
+public:
+    void Register(const KeyT& key, ClientT* client) {
+        auto& owner = clientsByKey_[key];
+        if (owner == client) {
+            return;
+        }
+
+        if (owner) {
+            EraseKey(owner, key);
+        }
+
+        owner = client;
+        keysByClient_[client].push_back(key);
+    }
+
+    void RemoveClient(const ClientT* client) {
+        auto find_iter = keysByClient_.find(client);
+        if (find_iter == std::end(keysByClient_)) {
+            return;
+        }
+
+        for (const auto& key : find_iter->second) {
+            clientsByKey_.erase(key);
+        }
+
+        keysByClient_.erase(find_iter);
+    }
+
+    ClientT* Find(const KeyT& key) const {
+        auto find_iter = clientsByKey_.find(key);
+        return find_iter != std::end(clientsByKey_) ? find_iter->second : nullptr;
+    }
+
+    std::size_t KeyCount() const { return clientsByKey_.size(); }
+    std::size_t ClientCount() const { return keysByClient_.size(); }
+
+private:
+    void EraseKey(const ClientT* client, const KeyT& key) {
+        auto find_iter = keysByClient_.find(client);
+        if (find_iter == std::end(keysByClient_)) {
+            return;
+        }
+
+        auto& keys = find_iter->second;
+        keys.erase(std::remove(std::begin(keys), std::end(keys), key), std::end(keys));
+        if (keys.empty()) {
+            keysByClient_.erase(find_iter);
+        }
+    }
+
+    std::unordered_map<KeyT, ClientT*> clientsByKey_;
+    std::unordered_map<const ClientT*, std::vector<KeyT>> keysByClient_;
+};
@@ -1,4 +1,5 @@
 #include "MariaDB.hpp"
+#include "Metrics.hpp"
 
 #include <mysql.h>
 
@@ -52,6 +53,7 @@ struct MariaDBStatement {
     std::vector<unsigned long> currentLengths;
     bool executed{false};
     bool isSelect{false};
+    bool streamResults{false};
     std::string lastQuery;
     MYSQL* connectionHandleAtExecution{nullptr};
 };
@@ -310,6 +312,67 @@ void ClearResult(MariaDBStatement* stmt) {
     stmt->currentLengths.clear();
 }
 
+struct DatabaseMetrics {
+    MetricCounter& queries = GetMetricsRegistry().Counter("stationapi_db_queries_total", "Database queries executed");
+    MetricCounter& errors = GetMetricsRegistry().Counter("stationapi_db_errors_total", "Database queries that failed");
+    MetricHistogram& queryDuration = GetMetricsRegistry().Histogram("stationapi_db_query_duration_microseconds",
+        "Time to execute a database query and fetch its first row");
+};
+
+DatabaseMetrics& GetDatabaseMetrics() {
+    static DatabaseMetrics metrics;
+    return metrics;
+}
+
+// Sends the statement's query and positions it on the first row, if any.
+int ExecuteStatement(MariaDBStatement* stmt) {
+    stmt->connectionHandleAtExecution = stmt->connection->handle;
+
+    ClearResult(stmt);
+    stmt->lastQuery = RenderQuery(stmt);
+
+    if (mysql_query(stmt->connection->handle, stmt->lastQuery.c_str()) != 0) {
+        SetError(stmt->connection, mysql_error(stmt->connection->handle));
+        return MARIADB_ERROR;
+    }
+
+    SetError(stmt->connection, "OK");
+
+    stmt->executed = true;
+    auto fieldCount = mysql_field_count(stmt->connection->handle);
+    stmt->isSelect = fieldCount > 0;
+    if (stmt->isSelect) {
+        stmt->result = stmt->streamResults ? mysql_use_result(stmt->connection->handle)
+                                           : mysql_store_result(stmt->connection->handle);
+        if (!stmt->result) {
+            SetError(stmt->connection, mysql_error(stmt->connection->handle));
+            stmt->executed = false;
+            stmt->currentRow = nullptr;
+            stmt->currentLengths.clear();
+            return MARIADB_ERROR;
+        }
+        stmt->currentRow = mysql_fetch_row(stmt->result);
+        if (!stmt->currentRow) {
+            stmt->currentLengths.clear();
+            if (stmt->streamResults && mysql_errno(stmt->connection->handle) != 0) {
+                SetError(stmt->connection, mysql_error(stmt->connection->handle));
+                return MARIADB_ERROR;
+            }
+            SetError(stmt->connection, "OK");
+            return MARIADB_DONE;
+        }
+        auto lengths = mysql_fetch_lengths(stmt->result);
+        stmt->currentLengths.assign(lengths, lengths + mysql_num_fields(stmt->result));
+        SetError(stmt->connection, "OK");
+        return MARIADB_ROW;
+    }
+
+    SetError(stmt->connection, "OK");
+    stmt->currentRow = nullptr;
+    stmt->currentLengths.clear();
+    return MARIADB_DONE;
+}
+
 } // namespace
 
 int mariadb_open(const char* connectionString, MariaDBConnection** db) {
@@ -525,7 +588,10 @@ int mariadb_step(MariaDBStatement* stmt) {
         return MARIADB_ERROR;
     }
 
-    if (!EnsureConnection(stmt->connection)) {
+    // Rows of an executed statement are read from the result set, so the
+    // connection only needs to be verified before a query is sent. Pinging
+    // between rows would cost a round trip per row and breaks streamed results.
+    if (!stmt->executed && !EnsureConnection(stmt->connection)) {
         return MARIADB_ERROR;
     }
 
@@ -537,46 +603,16 @@ int mariadb_step(MariaDBStatement* stmt) {
     }
 
     if (!stmt->executed) {
-        stmt->connectionHandleAtExecution = stmt->connection->handle;
-
-        ClearResult(stmt);
-        stmt->lastQuery = RenderQuery(stmt);
-
-        if (mysql_query(stmt->connection->handle, stmt->lastQuery.c_str()) != 0) {
-            SetError(stmt->connection, mysql_error(stmt->connection->handle));
-            return MARIADB_ERROR;
-        }
+        auto& metrics = GetDatabaseMetrics();
+        ScopedMetricTimer timer{metrics.queryDuration};
 
-        SetError(stmt->connection, "OK");
-
-        stmt->executed = true;
-        auto fieldCount = mysql_field_count(stmt->connection->handle);
-        stmt->isSelect = fieldCount > 0;
-        if (stmt->isSelect) {
-            stmt->result = mysql_store_result(stmt->connection->handle);
-            if (!stmt->result) {
-                SetError(stmt->connection, mysql_error(stmt->connection->handle));
-                stmt->executed = false;
-                stmt->currentRow = nullptr;
-                stmt->currentLengths.clear();
-                return MARIADB_ERROR;
-            }
-            stmt->currentRow = mysql_fetch_row(stmt->result);
-            if (!stmt->currentRow) {
-                stmt->currentLengths.clear();
-                SetError(stmt->connection, "OK");
-                return MARIADB_DONE;
-            }
-            auto lengths = mysql_fetch_lengths(stmt->result);
-            stmt->currentLengths.assign(lengths, lengths + mysql_num_fields(stmt->result));
-            SetError(stmt->connection, "OK");
-            return MARIADB_ROW;
+        metrics.queries.Increment();
+        auto result = ExecuteStatement(stmt);
+        if (result == MARIADB_ERROR) {
+            metrics.errors.Increment();
         }
 
-        SetError(stmt->connection, "OK");
-        stmt->currentRow = nullptr;
-        stmt->currentLengths.clear();
-        return MARIADB_DONE;
+        return result;
     }
 
     if (!stmt->isSelect || !stmt->result) {
@@ -587,6 +623,10 @@ int mariadb_step(MariaDBStatement* stmt) {
     stmt->currentRow = mysql_fetch_row(stmt->result);
     if (!stmt->currentRow) {
         stmt->currentLengths.clear();
+        if (stmt->streamResults && mysql_errno(stmt->connection->handle) != 0) {
+            SetError(stmt->connection, mysql_error(stmt->connection->handle));
+            return MARIADB_ERROR;
+        }
         SetError(stmt->connection, "OK");
         return MARIADB_DONE;
     }
@@ -596,6 +636,15 @@ int mariadb_step(MariaDBStatement* stmt) {
     return MARIADB_ROW;
 }
 
+int mariadb_stream_results(MariaDBStatement* stmt) {
+    if (!stmt || stmt->executed) {
+        return MARIADB_ERROR;
+    }
+
+    stmt->streamResults = true;
+    return MARIADB_OK;
+}
+
 int mariadb_finalize(MariaDBStatement* stmt) {
     if (!stmt) {
         return MARIADB_OK;
@@ -42,6 +42,12 @@ int mariadb_bind_int(MariaDBStatement* stmt, int index, int value);
 int mariadb_bind_text(MariaDBStatement* stmt, int index, const char* value, int length, void (*)(void*));
 int mariadb_bind_blob(MariaDBStatement* stmt, int index, const void* value, int length, void (*)(void*));
 
+// Switches a prepared statement to streamed results (mysql_use_result). Rows are
+// pulled from the server as mariadb_step advances instead of being buffered up
+// front, so the connection must not run any other statement until this one has
+// returned MARIADB_DONE or has been finalized.
+int mariadb_stream_results(MariaDBStatement* stmt);
+
 int mariadb_step(MariaDBStatement* stmt);
 int mariadb_finalize(MariaDBStatement* stmt);
 
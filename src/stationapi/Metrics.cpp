@@ -0,0 +1,175 @@
+
+#include "Metrics.hpp"
+
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+uint32_t FloorLog2(uint64_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+    return 63 - static_cast<uint32_t>(__builtin_clzll(value));
+#else
+    uint32_t result = 0;
+    while (value >>= 1) {
+        ++result;
+    }
+    return result;
+#endif
+}
+
+void WriteSeriesName(std::ostream& os, const std::string& name, const std::string& labels) {
+    os << name;
+    if (!labels.empty()) {
+        os << '{' << labels << '}';
+    }
+}
+
+} // namespace
+
+void MetricHistogram::Observe(uint64_t value) {
+    buckets_[BucketFor(value)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(value, std::memory_order_relaxed);
+}
+
+std::size_t MetricHistogram::BucketFor(uint64_t value) {
+    if (value < kSubBuckets) {
+        return static_cast<std::size_t>(value);
+    }
+
+    auto magnitude = FloorLog2(value);
+    if (magnitude > kMaxMagnitude) {
+        return kBoundedBuckets;
+    }
+
+    auto subBucket = (value >> (magnitude - kSubBucketBits)) & (kSubBuckets - 1);
+    return kSubBuckets + (magnitude - kSubBucketBits) * kSubBuckets + static_cast<std::size_t>(subBucket);
+}
+
+uint64_t MetricHistogram::BucketUpperBound(std::size_t bucket) {
+    if (bucket < kSubBuckets) {
+        return bucket;
+    }
+
+    if (bucket >= kBoundedBuckets) {
+        return std::numeric_limits<uint64_t>::max();
+    }
+
+    auto offset = bucket - kSubBuckets;
+    auto shift = static_cast<uint32_t>(offset / kSubBuckets);
+    auto subBucket = static_cast<uint64_t>(offset % kSubBuckets);
+
+    return ((kSubBuckets + subBucket + 1) << shift) - 1;
+}
+
+MetricCounter& MetricsRegistry::Counter(const std::string& name, const std::string& help, const std::string& labels) {
+    return *FindOrCreate(name, help, labels, MetricType::COUNTER).counter;
+}
+
+MetricGauge& MetricsRegistry::Gauge(const std::string& name, const std::string& help, const std::string& labels) {
+    return *FindOrCreate(name, help, labels, MetricType::GAUGE).gauge;
+}
+
+MetricHistogram& MetricsRegistry::Histogram(
+    const std::string& name, const std::string& help, const std::string& labels) {
+    return *FindOrCreate(name, help, labels, MetricType::HISTOGRAM).histogram;
+}
+
+MetricsRegistry::Series& MetricsRegistry::FindOrCreate(
+    const std::string& name, const std::string& help, const std::string& labels, MetricType type) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto family = families_.find(name);
+    if (family == std::end(families_)) {
+        family = families_.emplace(name, Family{type, help, {}}).first;
+    } else if (family->second.type != type) {
+        throw std::logic_error("metric " + name + " registered with a different type");
+    }
+
+    for (auto& series : family->second.series) {
+        if (series->labels == labels) {
+            return *series;
+        }
+    }
+
+    auto series = std::make_unique<Series>();
+    series->labels = labels;
+
+    switch (type) {
+    case MetricType::COUNTER:
+        series->counter = std::make_unique<MetricCounter>();
+        break;
+    case MetricType::GAUGE:
+        series->gauge = std::make_unique<MetricGauge>();
+        break;
+    case MetricType::HISTOGRAM:
+        series->histogram = std::make_unique<MetricHistogram>();
+        break;
+    }
+
+    family->second.series.push_back(std::move(series));
+    return *family->second.series.back();
+}
+
+std::string MetricsRegistry::RenderPrometheus() const {
+    std::ostringstream os;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    for (auto& entry : families_) {
+        auto& name = entry.first;
+        auto& family = entry.second;
+
+        os << "# HELP " << name << ' ' << family.help << '\n';
+
+        switch (family.type) {
+        case MetricType::COUNTER:
+            os << "# TYPE " << name << " counter\n";
+            for (auto& series : family.series) {
+                WriteSeriesName(os, name, series->labels);
+                os << ' ' << series->counter->Value() << '\n';
+            }
+            break;
+        case MetricType::GAUGE:
+            os << "# TYPE " << name << " gauge\n";
+            for (auto& series : family.series) {
+                WriteSeriesName(os, name, series->labels);
+                os << ' ' << series->gauge->Value() << '\n';
+            }
+            break;
+        case MetricType::HISTOGRAM:
+            os << "# TYPE " << name << " histogram\n";
+            for (auto& series : family.series) {
+                auto& histogram = *series->histogram;
+                auto separator = series->labels.empty() ? "" : ",";
+
+                uint64_t cumulative = 0;
+                for (std::size_t bucket = 0; bucket < MetricHistogram::kBoundedBuckets; ++bucket) {
+                    cumulative += histogram.BucketValue(bucket);
+                    os << name << "_bucket{" << series->labels << separator << "le=\""
+                       << MetricHistogram::BucketUpperBound(bucket) << "\"} " << cumulative << '\n';
+                }
+
+                cumulative += histogram.BucketValue(MetricHistogram::kBoundedBuckets);
+                os << name << "_bucket{" << series->labels << separator << "le=\"+Inf\"} " << cumulative << '\n';
+
+                WriteSeriesName(os, name + "_sum", series->labels);
+                os << ' ' << histogram.Sum() << '\n';
+                // Report the bucket total as the count so that a scrape racing
+                // with Observe stays self-consistent.
+                WriteSeriesName(os, name + "_count", series->labels);
+                os << ' ' << cumulative << '\n';
+            }
+            break;
+        }
+    }
+
+    return os.str();
+}
+
+MetricsRegistry& GetMetricsRegistry() {
+    static MetricsRegistry registry;
+    return registry;
+}
@@ -0,0 +1,129 @@
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/** Monotonically increasing count. Updates are relaxed atomics, so any thread
+ * may record without locking.
+ */
+class MetricCounter {
+public:
+    void Increment(uint64_t amount = 1) { value_.fetch_add(amount, std::memory_order_relaxed); }
+    uint64_t Value() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> value_{0};
+};
+
+class MetricGauge {
+public:
+    void Set(int64_t value) { value_.store(value, std::memory_order_relaxed); }
+    void Add(int64_t amount) { value_.fetch_add(amount, std::memory_order_relaxed); }
+    int64_t Value() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<int64_t> value_{0};
+};
+
+/** Log-linear histogram in the style of HDR histograms: every power of two is
+ * split into kSubBuckets equal buckets, bounding the relative error of a
+ * recorded value by 1 / kSubBuckets. Values above 2^kMaxMagnitude land in a
+ * final overflow bucket.
+ */
+class MetricHistogram {
+public:
+    static constexpr uint32_t kSubBucketBits = 1;
+    static constexpr uint32_t kSubBuckets = 1u << kSubBucketBits;
+    static constexpr uint32_t kMaxMagnitude = 25;
+    static constexpr std::size_t kBoundedBuckets = kSubBuckets + (kMaxMagnitude - kSubBucketBits + 1) * kSubBuckets;
+    static constexpr std::size_t kBucketCount = kBoundedBuckets + 1;
+
+    void Observe(uint64_t value);
+    void Observe(std::chrono::microseconds elapsed) {
+        Observe(elapsed.count() > 0 ? static_cast<uint64_t>(elapsed.count()) : 0);
+    }
+
+    uint64_t Count() const { return count_.load(std::memory_order_relaxed); }
+    uint64_t Sum() const { return sum_.load(std::memory_order_relaxed); }
+    uint64_t BucketValue(std::size_t bucket) const { return buckets_[bucket].load(std::memory_order_relaxed); }
+
+    static std::size_t BucketFor(uint64_t value);
+
+    /** Largest value recorded in a bucket; UINT64_MAX for the overflow bucket.
+     */
+    static uint64_t BucketUpperBound(std::size_t bucket);
+
+private:
+    std::array<std::atomic<uint64_t>, kBucketCount> buckets_{};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_{0};
+};
+
+/** Records the time from construction to destruction into a histogram, in
+ * microseconds.
+ */
+class ScopedMetricTimer {
+public:
+    explicit ScopedMetricTimer(MetricHistogram& histogram)
+        : histogram_{histogram}
+        , start_{std::chrono::steady_clock::now()} {}
+
+    ~ScopedMetricTimer() {
+        histogram_.Observe(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start_));
+    }
+
+private:
+    MetricHistogram& histogram_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+/** Named metrics exported in the Prometheus text format.
+ *
+ * Registration takes a lock and returns a reference that stays valid for the
+ * lifetime of the registry; callers keep it and record without locking.
+ * Registering the same name and labels again returns the existing metric.
+ * Labels are given in exposition form, e.g. type="LOGINAVATAR".
+ */
+class MetricsRegistry {
+public:
+    MetricCounter& Counter(const std::string& name, const std::string& help, const std::string& labels = "");
+    MetricGauge& Gauge(const std::string& name, const std::string& help, const std::string& labels = "");
+    MetricHistogram& Histogram(const std::string& name, const std::string& help, const std::string& labels = "");
+
+    std::string RenderPrometheus() const;
+
+private:
+    enum class MetricType { COUNTER, GAUGE, HISTOGRAM };
+
+    struct Series {
+        std::string labels;
+        std::unique_ptr<MetricCounter> counter;
+        std::unique_ptr<MetricGauge> gauge;
+        std::unique_ptr<MetricHistogram> histogram;
+    };
+
+    struct Family {
+        MetricType type;
+        std::string help;
+        std::vector<std::unique_ptr<Series>> series;
+    };
+
+    Series& FindOrCreate(const std::string& name, const std::string& help, const std::string& labels, MetricType type);
+
+    mutable std::mutex mutex_;
+    std::map<std::string, Family> families_;
+};
+
+/** Process wide registry exported by the metrics endpoint.
+ */
+MetricsRegistry& GetMetricsRegistry();
@@ -0,0 +1,108 @@
+
+#include "MetricsServer.hpp"
+
+#include "Metrics.hpp"
+
+#include <boost/asio.hpp>
+
+#include <istream>
+#include <thread>
+
+namespace {
+
+class MetricsSession : public std::enable_shared_from_this<MetricsSession> {
+public:
+    MetricsSession(
+        boost::asio::ip::tcp::socket socket, MetricsRegistry& registry, const std::function<void()>& reloadHandler)
+        : socket_{std::move(socket)}
+        , registry_{registry}
+        , reloadHandler_{reloadHandler} {}
+
+    void Start() {
+        auto self = shared_from_this();
+        boost::asio::async_read_until(socket_, request_, "\r\n\r\n",
+            [this, self](const boost::system::error_code& error, std::size_t) {
+                if (error) {
+                    return;
+                }
+
+                std::string requestLine;
+                std::istream stream{&request_};
+                std::getline(stream, requestLine);
+
+                std::string body;
+                std::string status = "200 OK";
+                std::string contentType = "text/plain; version=0.0.4";
+
+                if (reloadHandler_ && requestLine.compare(0, 16, "POST /-/reload H") == 0) {
+                    reloadHandler_();
+                    status = "202 Accepted";
+                    contentType = "text/plain";
+                    body = "Reload requested\n";
+                } else {
+                    body = registry_.RenderPrometheus();
+                }
+
+                response_ = "HTTP/1.0 " + status + "\r\n"
+                            "Content-Type: " + contentType + "\r\n"
+                            "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                            "Connection: close\r\n\r\n" + body;
+
+                boost::asio::async_write(socket_, boost::asio::buffer(response_),
+                    [this, self](const boost::system::error_code&, std::size_t) {
+                        boost::system::error_code ignored;
+                        socket_.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignored);
+                    });
+            });
+    }
+
+private:
+    boost::asio::ip::tcp::socket socket_;
+    MetricsRegistry& registry_;
+    const std::function<void()>& reloadHandler_;
+    boost::asio::streambuf request_{8192};
+    std::string response_;
+};
+
+} // namespace
+
+struct MetricsServer::Impl {
+    Impl(MetricsRegistry& registry_, const std::string& address, uint16_t port, std::function<void()> reloadHandler_)
+        : registry{registry_}
+        , reloadHandler{std::move(reloadHandler_)}
+        , acceptor{ioContext, boost::asio::ip::tcp::endpoint{boost::asio::ip::make_address(address), port}} {}
+
+    void Accept() {
+        acceptor.async_accept([this](const boost::system::error_code& error, boost::asio::ip::tcp::socket socket) {
+            if (!error) {
+                std::make_shared<MetricsSession>(std::move(socket), registry, reloadHandler)->Start();
+            }
+
+            if (acceptor.is_open()) {
+                Accept();
+            }
+        });
+    }
+
+    MetricsRegistry& registry;
+    std::function<void()> reloadHandler;
+    boost::asio::io_context ioContext;
+    boost::asio::ip::tcp::acceptor acceptor;
+    std::thread thread;
+};
+
+MetricsServer::MetricsServer(
+    MetricsRegistry& registry, const std::string& address, uint16_t port, std::function<void()> reloadHandler)
+    : impl_{std::make_unique<Impl>(registry, address, port, std::move(reloadHandler))} {
+    impl_->Accept();
+    impl_->thread = std::thread([this]() { impl_->ioContext.run(); });
+}
+
+MetricsServer::~MetricsServer() {
+    impl_->ioContext.stop();
+    if (impl_->thread.joinable()) {
+        impl_->thread.join();
+    }
+}
+
+uint16_t MetricsServer::GetPort() const { return impl_->acceptor.local_endpoint().port(); }
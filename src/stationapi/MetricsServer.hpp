@@ -0,0 +1,35 @@
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+class MetricsRegistry;
+
+/** Serves a registry in the Prometheus text format over plain HTTP. Every
+ * request, whatever its path, receives the current metrics, except for
+ * `POST /-/reload` when a reload handler is given; that calls the handler from
+ * the server thread instead. Meant to be bound to a loopback address and
+ * scraped by a local agent.
+ */
+class MetricsServer {
+public:
+    MetricsServer(MetricsRegistry& registry, const std::string& address, uint16_t port,
+        std::function<void()> reloadHandler = {});
+    ~MetricsServer();
+
+    MetricsServer(const MetricsServer&) = delete;
+    MetricsServer& operator=(const MetricsServer&) = delete;
+
+    /** Port the server is bound to, which differs from the requested port
+     * when that was 0.
+     */
+    uint16_t GetPort() const;
+
+private:
+    // Keeps boost::asio out of every translation unit that owns a server.
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
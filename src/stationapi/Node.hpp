@@ -1,21 +1,26 @@
 
 #pragma once
 
+#include "NodeClient.hpp"
+#include "TimerWheel.hpp"
 #include "UdpLibrary.hpp"
 
 #include <algorithm>
+#include <chrono>
 #include <cstdint>
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include <stdexcept>
 
 template <typename NodeT, typename ClientT>
-class Node : public UdpManagerHandler
+class Node : public UdpManagerHandler, public NodeClientListener
 {
 public:
     explicit Node(NodeT *node, const std::string &listenAddress, uint16_t listenPort, bool bindToIp = false)
         : node_{node}
+        , timers_{std::chrono::milliseconds(10)}
     {
 
         UdpManager::Params params{};
@@ -44,26 +49,90 @@ public:
     {
         udpManager_->GiveTime();
 
-        auto remove_iter = std::remove_if(std::begin(clients_), std::end(clients_), [](auto &client)
-                                          { return client->GetConnection()->GetStatus() == UdpConnection::cStatusDisconnected; });
+        // Only clients reported as terminated since the last tick are visited,
+        // so idle connections cost nothing here.
+        if (!terminatedClients_.empty())
+        {
+            std::vector<NodeClient *> terminated;
+            terminated.swap(terminatedClients_);
 
-        if (remove_iter != std::end(clients_))
-            clients_.erase(remove_iter, clients_.end());
+            for (auto client : terminated)
+            {
+                auto find_iter = clients_.find(client);
+                if (find_iter == std::end(clients_))
+                    continue;
+
+                OnClientDisconnected(find_iter->second.get());
+                clients_.erase(find_iter);
+            }
+        }
+
+        timers_.Advance(std::chrono::steady_clock::now());
 
         OnTick();
+
+        // Everything queued by this tick's handlers goes out now, which also
+        // bounds how long a batched message waits to one tick.
+        if (!pendingFlushClients_.empty())
+        {
+            std::vector<NodeClient *> pending;
+            pending.swap(pendingFlushClients_);
+
+            for (auto client : pending)
+            {
+                if (clients_.find(client) != std::end(clients_))
+                    client->Flush();
+            }
+        }
+    }
+
+    std::size_t GetClientCount() const { return clients_.size(); }
+
+protected:
+    /** Deferred and periodic work for this node. Due timers fire on the tick
+     * thread right before OnTick, with a resolution of 10ms.
+     */
+    TimerWheel &GetTimers() { return timers_; }
+
+    template <typename FunctorT>
+    void ForEachClient(FunctorT&& fn)
+    {
+        for (auto& entry : clients_)
+        {
+            fn(entry.second.get());
+        }
     }
 
 private:
     virtual void OnTick() = 0;
 
+    // Called for each disconnected client right before it is destroyed.
+    virtual void OnClientDisconnected(ClientT *client) {}
+
     void OnConnectRequest(UdpConnection *connection) override
     {
         AddClient(std::make_unique<ClientT>(connection, node_));
     }
 
-    void AddClient(std::unique_ptr<ClientT> client) { clients_.push_back(std::move(client)); }
+    void OnClientTerminated(NodeClient *client) override { terminatedClients_.push_back(client); }
+
+    void OnClientPendingFlush(NodeClient *client) override { pendingFlushClients_.push_back(client); }
+
+    void AddClient(std::unique_ptr<ClientT> client)
+    {
+        client->SetListener(this);
+
+        if (client->GetConnection()->GetStatus() == UdpConnection::cStatusDisconnected)
+            terminatedClients_.push_back(client.get());
+
+        NodeClient *key = client.get();
+        clients_.emplace(key, std::move(client));
+    }
 
-    std::vector<std::unique_ptr<ClientT>> clients_;
+    std::unordered_map<const NodeClient *, std::unique_ptr<ClientT>> clients_;
+    std::vector<NodeClient *> terminatedClients_;
+    std::vector<NodeClient *> pendingFlushClients_;
     NodeT *node_;
+    TimerWheel timers_;
     UdpManager *udpManager_;
 };
@@ -2,8 +2,21 @@
 #include "NodeClient.hpp"
 #include "StreamUtils.hpp"
 
-NodeClient::NodeClient(UdpConnection* connection)
+#include "easylogging++.h"
+
+#include <algorithm>
+#include <atomic>
+
+namespace {
+
+std::atomic<uint32_t> nextConnectionId{1};
+
+} // namespace
+
+NodeClient::NodeClient(UdpConnection* connection, CaptureSource captureSource)
     : connection_{connection}
+    , connectionId_{nextConnectionId++}
+    , captureSource_{captureSource}
     , ostream_{std::stringstream::out | std::stringstream::binary}
     , istream_{std::stringstream::in | std::stringstream::binary} {
     connection_->AddRef();
@@ -15,16 +28,156 @@ NodeClient::~NodeClient() {
     connection_->Release();
 }
 
-void NodeClient::Send(const char* data, uint32_t length) {
+void NodeClient::EnableBatching(uint32_t maxPacketSize) {
+    FlushBatch();
+    maxBatchSize_ = maxPacketSize;
+}
+
+void NodeClient::Flush() {
+    FlushBatch();
+
+    if (!congested_ && deferred_.empty()) {
+        return;
+    }
+
+    UpdateCongestion();
+
+    while (!congested_ && !deferred_.empty()) {
+        auto data = std::move(deferred_.front());
+        deferred_.pop_front();
+        deferredBytes_ -= data.size();
+
+        Transmit(data.data(), static_cast<uint32_t>(data.size()));
+        UpdateCongestion();
+    }
+
+    FlushBatch();
+
+    // Congested clients are revisited every tick until their backlog drains.
+    if ((congested_ || !deferred_.empty()) && listener_) {
+        listener_->OnClientPendingFlush(this);
+    }
+}
+
+uint32_t NodeClient::GetQueuedBytes() const {
+    return static_cast<uint32_t>(std::max(connection_->TotalPendingBytes(), 0)) +
+        static_cast<uint32_t>(pendingBatch_.size());
+}
+
+void NodeClient::Send(const char* data, uint32_t length, SendPriority priority) {
     logNetworkMessage(
         connection_, "Message To ->", reinterpret_cast<const unsigned char*>(data), length);
+
+    // Deferred messages keep their relative order, so once any are held back
+    // every later deferrable message queues behind them.
+    if (priority == SendPriority::DEFERRABLE && (congested_ || !deferred_.empty())) {
+        Defer(data, length);
+        return;
+    }
+
+    Transmit(data, length);
+    UpdateCongestion();
+}
+
+void NodeClient::Transmit(const char* data, uint32_t length) {
+    if (maxBatchSize_ == 0) {
+        SendPacket(data, length);
+        return;
+    }
+
+    const std::size_t recordSize = sizeof(uint32_t) + length;
+    if (!pendingBatch_.empty() && pendingBatch_.size() + recordSize > maxBatchSize_) {
+        FlushBatch();
+    }
+
+    bool wasEmpty = pendingBatch_.empty();
+
+    pendingBatch_.append(reinterpret_cast<const char*>(&length), sizeof(uint32_t));
+    pendingBatch_.append(data, length);
+
+    // A message larger than the packet limit still goes out, alone in its batch.
+    if (pendingBatch_.size() >= maxBatchSize_) {
+        FlushBatch();
+    } else if (wasEmpty && listener_) {
+        listener_->OnClientPendingFlush(this);
+    }
+}
+
+void NodeClient::Defer(const char* data, uint32_t length) {
+    bool wasEmpty = deferred_.empty();
+
+    deferred_.emplace_back(data, length);
+    deferredBytes_ += length;
+
+    // Newer deferrable updates supersede older ones, so overflow drops from
+    // the front of the queue.
+    while (!deferred_.empty() &&
+        ((limits_.maxDeferredMessages > 0 && deferred_.size() > limits_.maxDeferredMessages) ||
+            (limits_.maxDeferredBytes > 0 && deferredBytes_ > limits_.maxDeferredBytes))) {
+        deferredBytes_ -= deferred_.front().size();
+        deferred_.pop_front();
+        ++droppedCount_;
+    }
+
+    if (wasEmpty && listener_) {
+        listener_->OnClientPendingFlush(this);
+    }
+}
+
+void NodeClient::FlushBatch() {
+    if (pendingBatch_.empty()) {
+        return;
+    }
+
+    SendPacket(pendingBatch_.data(), static_cast<uint32_t>(pendingBatch_.size()));
+    pendingBatch_.clear();
+}
+
+void NodeClient::SendPacket(const char* data, uint32_t length) {
     connection_->Send(cUdpChannelReliable1, data, length);
 }
 
+void NodeClient::UpdateCongestion() {
+    if (limits_.highWatermarkBytes == 0 && limits_.disconnectBytes == 0) {
+        congested_ = false;
+        return;
+    }
+
+    auto queuedBytes = GetQueuedBytes();
+
+    if (limits_.disconnectBytes > 0 && queuedBytes >= limits_.disconnectBytes
+        && connection_->GetStatus() == UdpConnection::cStatusConnected) {
+        LOG(WARNING) << "Disconnecting slow peer " << connection_->GetDestinationIp().GetAddress(nullptr)
+                     << ":" << connection_->GetDestinationPort() << " with " << queuedBytes
+                     << " bytes queued";
+        congested_ = true;
+        connection_->Disconnect();
+        return;
+    }
+
+    if (limits_.highWatermarkBytes == 0) {
+        return;
+    }
+
+    if (!congested_ && queuedBytes >= limits_.highWatermarkBytes) {
+        congested_ = true;
+        ++congestionCount_;
+    } else if (congested_ && queuedBytes <= limits_.lowWatermarkBytes) {
+        congested_ = false;
+    }
+}
+
 void NodeClient::OnRoutePacket(UdpConnection* connection, const uchar* data, int length) {
     logNetworkMessage(connection, "Message From <-", data, length);
+    GetPacketCapture().Record(captureSource_, connectionId_, data, length);
 
     istream_.clear();
     istream_.str({reinterpret_cast<const char*>(data), static_cast<uint32_t>(length)});
     OnIncoming(istream_);
 }
+
+void NodeClient::OnTerminated(UdpConnection* connection) {
+    if (listener_) {
+        listener_->OnClientTerminated(this);
+    }
+}
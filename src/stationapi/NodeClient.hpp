@@ -1,35 +1,120 @@
 
 #pragma once
 
+#include "PacketCapture.hpp"
 #include "UdpLibrary.hpp"
 
+#include <cstdint>
+#include <deque>
 #include <sstream>
+#include <string>
+
+class NodeClient;
+
+enum class SendPriority {
+    CRITICAL, // responses and anything the peer cannot recover without
+    DEFERRABLE // state such as presence that later updates supersede
+};
+
+/** Outbound limits for a single connection; a limit of 0 disables it.
+ *
+ * Once the data queued to a peer reaches the high watermark the connection is
+ * congested: deferrable messages are held back locally until the backlog
+ * drains below the low watermark, and the oldest of them are dropped when the
+ * deferred queue overflows. A peer whose backlog reaches disconnectBytes is
+ * disconnected so it cannot grow memory without bound.
+ */
+struct SendQueueLimits {
+    uint32_t highWatermarkBytes = 0;
+    uint32_t lowWatermarkBytes = 0;
+    uint32_t maxDeferredMessages = 0;
+    uint32_t maxDeferredBytes = 0;
+    uint32_t disconnectBytes = 0;
+};
+
+class NodeClientListener {
+public:
+    virtual ~NodeClientListener() = default;
+    virtual void OnClientTerminated(NodeClient* client) = 0;
+
+    // Called when a client holds queued output that should be flushed at the
+    // end of the current tick.
+    virtual void OnClientPendingFlush(NodeClient* client) = 0;
+};
 
 class NodeClient : public UdpConnectionHandler {
 public:
-    explicit NodeClient(UdpConnection* connection);
+    explicit NodeClient(UdpConnection* connection, CaptureSource captureSource = CaptureSource::UNKNOWN);
 
     virtual ~NodeClient();
 
     template <typename T>
-    void Send(const T& message) {
+    void Send(const T& message, SendPriority priority = SendPriority::CRITICAL) {
         ostream_.clear();
         ostream_.str("");
         write(ostream_, message);
         auto data = ostream_.str();
-        Send(data.c_str(), data.length());
+        Send(data.c_str(), data.length(), priority);
     }
 
     UdpConnection* GetConnection() { return connection_; }
 
+    /** Process-unique id, used to tell connections apart in packet captures.
+     */
+    uint32_t GetConnectionId() const { return connectionId_; }
+
+    void SetListener(NodeClientListener* listener) { listener_ = listener; }
+
+    /** Packs outgoing messages as [uint32 length][payload] records into
+     * packets of up to maxPacketSize bytes instead of sending one packet per
+     * message. Only enable this for peers that negotiated batched packets; a
+     * size of 0 flushes anything queued and restores one message per packet.
+     */
+    void EnableBatching(uint32_t maxPacketSize);
+    bool IsBatching() const { return maxBatchSize_ > 0; }
+
+    void SetSendQueueLimits(const SendQueueLimits& limits) { limits_ = limits; }
+    const SendQueueLimits& GetSendQueueLimits() const { return limits_; }
+
+    /** Sends any batched messages as a single packet and releases deferred
+     * messages if the connection is no longer congested.
+     */
+    void Flush();
+
+    /** Bytes waiting to be delivered to the peer, including any open batch.
+     */
+    uint32_t GetQueuedBytes() const;
+    bool IsCongested() const { return congested_; }
+    std::size_t GetDeferredCount() const { return deferred_.size(); }
+    std::size_t GetDeferredBytes() const { return deferredBytes_; }
+    uint64_t GetDroppedCount() const { return droppedCount_; }
+    uint64_t GetCongestionCount() const { return congestionCount_; }
+
 private:
-    void Send(const char* data, uint32_t length);
+    void Send(const char* data, uint32_t length, SendPriority priority);
+    void Transmit(const char* data, uint32_t length);
+    void Defer(const char* data, uint32_t length);
+    void FlushBatch();
+    void SendPacket(const char* data, uint32_t length);
+    void UpdateCongestion();
 
     virtual void OnIncoming(std::istringstream& istream) = 0;
 
     void OnRoutePacket(UdpConnection* connection, const uchar* data, int length) override;
+    void OnTerminated(UdpConnection* connection) override;
 
     std::ostringstream ostream_;
     std::istringstream istream_;
+    std::string pendingBatch_;
+    uint32_t maxBatchSize_ = 0;
+    SendQueueLimits limits_;
+    std::deque<std::string> deferred_;
+    std::size_t deferredBytes_ = 0;
+    uint64_t droppedCount_ = 0;
+    uint64_t congestionCount_ = 0;
+    bool congested_ = false;
     UdpConnection* connection_;
+    uint32_t connectionId_;
+    CaptureSource captureSource_;
+    NodeClientListener* listener_ = nullptr;
 };
@@ -0,0 +1,73 @@
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Which listener a captured packet arrived on.
+enum class CaptureSource : uint8_t {
+    UNKNOWN = 0,
+    GATEWAY = 1,
+    REGISTRAR = 2
+};
+
+struct CapturedPacket {
+    uint64_t timestamp = 0; // microseconds since the unix epoch
+    uint32_t connectionId = 0;
+    CaptureSource source = CaptureSource::UNKNOWN;
+    std::vector<unsigned char> data;
+};
+
+/** Records incoming packets to a compact binary file for later replay.
+ *
+ * The file starts with the 4 byte magic "SCPC" and a uint16 format version,
+ * followed by one record per packet:
+ *
+ *   uint64 timestamp, uint32 connectionId, uint8 source, uint32 length, data
+ *
+ * All integers are written in host byte order, matching the wire protocol.
+ */
+class PacketCapture {
+public:
+    static constexpr uint16_t kFormatVersion = 1;
+
+    /** Starts writing to path, replacing any existing file. Capturing stops
+     * on its own once maxBytes have been written (0 is unbounded).
+     */
+    void Start(const std::string& path, uint64_t maxBytes = 0);
+    void Stop();
+
+    bool IsCapturing() const { return capturing_; }
+
+    void Record(CaptureSource source, uint32_t connectionId, const unsigned char* data, int length);
+
+    uint64_t GetBytesWritten() const { return bytesWritten_; }
+
+private:
+    std::mutex mutex_;
+    std::ofstream file_;
+    std::atomic<bool> capturing_{false};
+    uint64_t maxBytes_ = 0;
+    uint64_t bytesWritten_ = 0;
+};
+
+PacketCapture& GetPacketCapture();
+
+/** Reads back the packets written by a PacketCapture.
+ */
+class PacketCaptureReader {
+public:
+    explicit PacketCaptureReader(const std::string& path);
+
+    /** Returns false at the end of the capture. A truncated final record,
+     * as left by a server that was killed mid-write, also ends the capture.
+     */
+    bool Next(CapturedPacket& packet);
+
+private:
+    std::ifstream file_;
+};
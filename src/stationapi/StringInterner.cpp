@@ -0,0 +1,26 @@
+#include "StringInterner.hpp"
+
+StringInterner::StringInterner() { Intern(u""); }
+
+StringInterner::Id StringInterner::Intern(const std::u16string& value) {
+    auto find_iter = ids_.find(value);
+    if (find_iter != std::end(ids_)) {
+        return find_iter->second;
+    }
+
+    auto id = static_cast<Id>(strings_.size());
+    auto inserted = ids_.emplace(value, id).first;
+    strings_.push_back(&inserted->first);
+
+    return id;
+}
+
+bool StringInterner::Find(const std::u16string& value, Id& id) const {
+    auto find_iter = ids_.find(value);
+    if (find_iter == std::end(ids_)) {
+        return false;
+    }
+
+    id = find_iter->second;
+    return true;
+}
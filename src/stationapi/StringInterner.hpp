@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/** Maps strings to small, stable integer ids so that repeated values are
+ * stored once and can be compared and hashed as integers.
+ *
+ * Ids are handed out in insertion order and never reused; id 0 is always the
+ * empty string so default initialized ids resolve to "". References returned
+ * by Resolve remain valid for the lifetime of the interner. Not thread safe.
+ */
+class StringInterner {
+public:
+    using Id = uint32_t;
+
+    StringInterner();
+
+    Id Intern(const std::u16string& value);
+
+    /** Looks up a string without adding it; returns false if it was never
+     * interned.
+     */
+    bool Find(const std::u16string& value, Id& id) const;
+
+    const std::u16string& Resolve(Id id) const { return *strings_[id]; }
+
+    std::size_t Size() const { return strings_.size(); }
+
+private:
+    // Map nodes are never erased, so the keys double as the id -> string table.
+    std::unordered_map<std::u16string, Id> ids_;
+    std::vector<const std::u16string*> strings_;
+};
@@ -0,0 +1,273 @@
+#include "TimerWheel.hpp"
+
+#include "Metrics.hpp"
+
+#include <stdexcept>
+
+constexpr uint32_t TimerWheel::kLevelZeroBits;
+constexpr uint32_t TimerWheel::kLevelBits;
+constexpr uint32_t TimerWheel::kLevels;
+constexpr uint32_t TimerWheel::kLevelZeroSlots;
+constexpr uint32_t TimerWheel::kLevelSlots;
+constexpr uint32_t TimerWheel::kSlotCount;
+constexpr uint32_t TimerWheel::kFiringSlot;
+constexpr int32_t TimerWheel::kNone;
+
+namespace {
+
+// Ticks covered by the levels up to and including the given one.
+uint64_t LevelSpan(uint32_t level) { return uint64_t{1} << (8 + 6 * level); }
+
+} // namespace
+
+TimerWheel::TimerWheel(Clock::duration resolution, Clock::time_point start)
+    : resolution_{resolution}
+    , start_{start}
+    , now_{start} {
+    if (resolution_ <= Clock::duration::zero()) {
+        throw std::runtime_error("Timer wheel resolution must be positive");
+    }
+
+    heads_.fill(kNone);
+}
+
+TimerWheel::TimerId TimerWheel::Schedule(Clock::duration delay, Callback callback) {
+    if (delay < Clock::duration::zero()) {
+        delay = Clock::duration::zero();
+    }
+
+    return Add(now_ + delay, Clock::duration::zero(), std::move(callback));
+}
+
+TimerWheel::TimerId TimerWheel::SchedulePeriodic(Clock::duration interval, Callback callback) {
+    if (interval <= Clock::duration::zero()) {
+        throw std::runtime_error("Periodic timer interval must be positive");
+    }
+
+    return Add(now_ + interval, interval, std::move(callback));
+}
+
+bool TimerWheel::Cancel(TimerId id) {
+    auto index = Find(id);
+    if (index == kNone) {
+        return false;
+    }
+
+    Unlink(index);
+    Release(index);
+    return true;
+}
+
+bool TimerWheel::IsScheduled(TimerId id) const { return Find(id) != kNone; }
+
+std::size_t TimerWheel::Advance(Clock::time_point now) {
+    if (now > now_) {
+        now_ = now;
+    }
+
+    if (now_ < start_) {
+        return 0;
+    }
+
+    const auto target = static_cast<uint64_t>((now_ - start_) / resolution_);
+    std::size_t fired = 0;
+
+    while (currentTick_ <= target) {
+        if (pending_ == 0) {
+            currentTick_ = target + 1;
+            break;
+        }
+
+        const auto tick = currentTick_;
+
+        // Higher levels go first so that what they hand down to a slot that
+        // turns on this same tick is handed down again.
+        for (uint32_t level = kLevels - 1; level > 0; --level) {
+            auto below = LevelSpan(level - 1);
+            if ((tick & (below - 1)) == 0) {
+                Cascade(kLevelZeroSlots + (level - 1) * kLevelSlots
+                    + static_cast<uint32_t>((tick / below) & (kLevelSlots - 1)));
+            }
+        }
+
+        auto slot = static_cast<uint32_t>(tick & (kLevelZeroSlots - 1));
+        while (heads_[slot] != kNone) {
+            auto index = heads_[slot];
+            Unlink(index);
+            Link(index, kFiringSlot);
+        }
+
+        // Timers scheduled by the callbacks below land on later ticks only.
+        currentTick_ = tick + 1;
+
+        while (heads_[kFiringSlot] != kNone) {
+            auto index = heads_[kFiringSlot];
+            Unlink(index);
+            Fire(index, now_);
+            ++fired;
+        }
+    }
+
+    return fired;
+}
+
+TimerWheel::TimerId TimerWheel::Add(Clock::time_point dueTime, Clock::duration interval, Callback callback) {
+    int32_t index;
+    if (!freeEntries_.empty()) {
+        index = freeEntries_.back();
+        freeEntries_.pop_back();
+    } else {
+        index = static_cast<int32_t>(entries_.size());
+        entries_.emplace_back();
+    }
+
+    auto& entry = entries_[index];
+    entry.callback = std::move(callback);
+    entry.dueTime = dueTime;
+    entry.interval = interval;
+    entry.dueTick = TickFor(dueTime);
+    entry.active = true;
+    ++pending_;
+
+    Place(index);
+
+    return (static_cast<uint64_t>(entry.generation) << 32) | static_cast<uint32_t>(index + 1);
+}
+
+void TimerWheel::Place(int32_t index) {
+    auto due = entries_[index].dueTick;
+    if (due < currentTick_) {
+        due = currentTick_;
+    }
+
+    auto delta = due - currentTick_;
+    if (delta < LevelSpan(0)) {
+        Link(index, static_cast<uint32_t>(due & (kLevelZeroSlots - 1)));
+        return;
+    }
+
+    // Beyond the last level the timer waits at its far end and is placed
+    // again, by its real due tick, when that slot turns.
+    if (delta >= LevelSpan(kLevels - 1)) {
+        due = currentTick_ + LevelSpan(kLevels - 1) - 1;
+        delta = due - currentTick_;
+    }
+
+    uint32_t level = 1;
+    while (delta >= LevelSpan(level)) {
+        ++level;
+    }
+
+    auto slot = (due / LevelSpan(level - 1)) & (kLevelSlots - 1);
+    Link(index, kLevelZeroSlots + (level - 1) * kLevelSlots + static_cast<uint32_t>(slot));
+}
+
+void TimerWheel::Link(int32_t index, uint32_t slot) {
+    auto& entry = entries_[index];
+    entry.slot = slot;
+    entry.prev = kNone;
+    entry.next = heads_[slot];
+
+    if (entry.next != kNone) {
+        entries_[entry.next].prev = index;
+    }
+
+    heads_[slot] = index;
+}
+
+void TimerWheel::Unlink(int32_t index) {
+    auto& entry = entries_[index];
+
+    if (entry.prev != kNone) {
+        entries_[entry.prev].next = entry.next;
+    } else {
+        heads_[entry.slot] = entry.next;
+    }
+
+    if (entry.next != kNone) {
+        entries_[entry.next].prev = entry.prev;
+    }
+
+    entry.prev = kNone;
+    entry.next = kNone;
+}
+
+void TimerWheel::Release(int32_t index) {
+    auto& entry = entries_[index];
+    entry.callback = nullptr;
+    entry.active = false;
+    ++entry.generation;
+
+    --pending_;
+    freeEntries_.push_back(index);
+}
+
+void TimerWheel::Cascade(uint32_t slot) {
+    auto index = heads_[slot];
+    heads_[slot] = kNone;
+
+    while (index != kNone) {
+        auto next = entries_[index].next;
+        Place(index);
+        index = next;
+    }
+}
+
+void TimerWheel::Fire(int32_t index, Clock::time_point now) {
+    auto& entry = entries_[index];
+
+    if (lagHistogram_) {
+        lagHistogram_->Observe(std::chrono::duration_cast<std::chrono::microseconds>(now - entry.dueTime));
+    }
+
+    auto callback = std::move(entry.callback);
+
+    if (entry.interval == Clock::duration::zero()) {
+        Release(index);
+        callback();
+        return;
+    }
+
+    // Periodic timers are placed again before running, so the callback can
+    // cancel its own timer; entries_ may grow while it runs.
+    auto next = entry.dueTime + entry.interval;
+    if (next <= now) {
+        next = now + entry.interval;
+    }
+
+    entry.dueTime = next;
+    entry.dueTick = TickFor(next);
+    Place(index);
+
+    auto generation = entry.generation;
+    callback();
+
+    if (entries_[index].active && entries_[index].generation == generation) {
+        entries_[index].callback = std::move(callback);
+    }
+}
+
+int32_t TimerWheel::Find(TimerId id) const {
+    auto position = static_cast<uint32_t>(id & 0xffffffff);
+    if (position == 0 || position > entries_.size()) {
+        return kNone;
+    }
+
+    auto index = static_cast<int32_t>(position - 1);
+    const auto& entry = entries_[index];
+    if (!entry.active || entry.generation != static_cast<uint32_t>(id >> 32)) {
+        return kNone;
+    }
+
+    return index;
+}
+
+uint64_t TimerWheel::TickFor(Clock::time_point time) const {
+    if (time <= start_) {
+        return 0;
+    }
+
+    // Rounded up, so a timer never fires before it is due.
+    auto elapsed = time - start_;
+    return static_cast<uint64_t>((elapsed + resolution_ - Clock::duration{1}) / resolution_);
+}
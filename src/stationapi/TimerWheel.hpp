@@ -0,0 +1,115 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+class MetricHistogram;
+
+/** Hierarchical timer wheel for deferred and periodic work on a node's tick
+ * thread. Time is cut into ticks of a fixed resolution; the first level holds
+ * one slot per tick for the next 256 ticks and each of the three levels above
+ * it covers 64 times the span of the one below. Timers further out than the
+ * last level are parked at its far end and placed again as it turns.
+ *
+ * Scheduling and cancelling unlink a timer from a slot list and are O(1);
+ * advancing costs one slot per elapsed tick plus, every 256 ticks, moving the
+ * timers of one higher slot down. Timers never fire before they are due, and
+ * callbacks run from Advance, where they may schedule and cancel timers,
+ * including their own. Not thread safe.
+ */
+class TimerWheel {
+public:
+    using Clock = std::chrono::steady_clock;
+    using Callback = std::function<void()>;
+
+    /** Identifies a scheduled timer; 0 is never handed out. Ids are not
+     * reused, so cancelling a timer that already fired is harmless.
+     */
+    using TimerId = uint64_t;
+
+    explicit TimerWheel(Clock::duration resolution, Clock::time_point start = Clock::now());
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    /** Runs the callback once, on the first Advance at least delay after the
+     * wheel's current time.
+     */
+    TimerId Schedule(Clock::duration delay, Callback callback);
+
+    /** Runs the callback every interval until cancelled, first one interval
+     * from now. Periods missed while the node was stalled are skipped rather
+     * than run back to back.
+     */
+    TimerId SchedulePeriodic(Clock::duration interval, Callback callback);
+
+    /** Returns false when the timer already fired or was cancelled.
+     */
+    bool Cancel(TimerId id);
+
+    bool IsScheduled(TimerId id) const;
+
+    /** Fires every timer due by now and returns how many ran.
+     */
+    std::size_t Advance(Clock::time_point now);
+
+    std::size_t GetPendingCount() const { return pending_; }
+
+    /** Records how late each timer fires, in microseconds. The lag includes
+     * up to one resolution of rounding as well as time the node spent away
+     * from its tick.
+     */
+    void SetLagHistogram(MetricHistogram* histogram) { lagHistogram_ = histogram; }
+
+private:
+    static constexpr uint32_t kLevelZeroBits = 8;
+    static constexpr uint32_t kLevelBits = 6;
+    static constexpr uint32_t kLevels = 4;
+    static constexpr uint32_t kLevelZeroSlots = 1u << kLevelZeroBits;
+    static constexpr uint32_t kLevelSlots = 1u << kLevelBits;
+    static constexpr uint32_t kSlotCount = kLevelZeroSlots + (kLevels - 1) * kLevelSlots;
+
+    // Holds the timers of the tick being fired, so that callbacks can cancel
+    // them like any other.
+    static constexpr uint32_t kFiringSlot = kSlotCount;
+    static constexpr int32_t kNone = -1;
+
+    struct Entry {
+        Callback callback;
+        Clock::time_point dueTime{};
+        Clock::duration interval{};
+        uint64_t dueTick = 0;
+        uint32_t generation = 1;
+        uint32_t slot = 0;
+        int32_t prev = kNone;
+        int32_t next = kNone;
+        bool active = false;
+    };
+
+    TimerId Add(Clock::time_point dueTime, Clock::duration interval, Callback callback);
+    void Place(int32_t index);
+    void Link(int32_t index, uint32_t slot);
+    void Unlink(int32_t index);
+    void Release(int32_t index);
+    void Cascade(uint32_t slot);
+    void Fire(int32_t index, Clock::time_point now);
+    int32_t Find(TimerId id) const;
+    uint64_t TickFor(Clock::time_point time) const;
+
+    const Clock::duration resolution_;
+    const Clock::time_point start_;
+
+    // The next tick to fire; every earlier tick has been fired.
+    uint64_t currentTick_ = 0;
+    Clock::time_point now_;
+
+    std::vector<Entry> entries_;
+    std::vector<int32_t> freeEntries_;
+    std::array<int32_t, kSlotCount + 1> heads_;
+    std::size_t pending_ = 0;
+    MetricHistogram* lagHistogram_ = nullptr;
+};
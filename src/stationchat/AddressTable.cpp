@@ -0,0 +1,6 @@
+#include "AddressTable.hpp"
+
+StringInterner& GetAddressTable() {
+    static StringInterner addressTable;
+    return addressTable;
+}
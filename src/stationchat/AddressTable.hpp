@@ -0,0 +1,18 @@
+#pragma once
+
+#include "StringInterner.hpp"
+
+#include <string>
+
+using AddressId = StringInterner::Id;
+
+/** Process wide table of gateway addresses and room prefixes. Thousands of
+ * avatars share a handful of game server addresses, so they are stored and
+ * compared as ids; the strings are only resolved for the wire and storage.
+ * Only accessed from the gateway thread.
+ */
+StringInterner& GetAddressTable();
+
+inline AddressId InternAddress(const std::u16string& address) { return GetAddressTable().Intern(address); }
+
+inline const std::u16string& ResolveAddress(AddressId id) { return GetAddressTable().Resolve(id); }
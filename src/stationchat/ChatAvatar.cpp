@@ -1,20 +1,32 @@
 #include "ChatAvatar.hpp"
 #include "ChatAvatarService.hpp"
-#include "ChatRoom.hpp"
 
 #include <algorithm>
 
+const ChatAvatarDetails ChatAvatar::kEmptyDetails{};
+
 ChatAvatar::ChatAvatar(ChatAvatarService * avatarService)
     : avatarService_{avatarService} {}
 
 ChatAvatar::ChatAvatar(ChatAvatarService* avatarService, const std::u16string& name, const std::u16string& address, uint32_t userId,
     uint32_t attributes, const std::u16string& loginLocation)
-    : avatarService_{avatarService}
-    , userId_{userId}
-    , name_{name}
-    , address_{address}
+    : userId_{userId}
     , attributes_{attributes}
-    , loginLocation_{loginLocation} {}
+    , addressId_{InternAddress(address)}
+    , avatarService_{avatarService}
+    , name_{name} {
+    if (!loginLocation.empty()) {
+        MutableDetails().loginLocation = loginLocation;
+    }
+}
+
+ChatAvatarDetails& ChatAvatar::MutableDetails() {
+    if (!details_) {
+        details_ = std::make_unique<ChatAvatarDetails>();
+    }
+
+    return *details_;
+}
 
 void ChatAvatar::SetAttributes(const uint32_t attributes) { attributes_ = attributes; }
 
@@ -1,15 +1,16 @@
 
 #pragma once
 
+#include "AddressTable.hpp"
 #include "Serialization.hpp"
 
 #include <cstdint>
+#include <memory>
 #include <string>
 #include <vector>
 
 class ChatAvatar;
 class ChatAvatarService;
-class ChatRoom;
 
 enum class AvatarAttribute : uint32_t {
     INVISIBLE = 1 << 0,
@@ -35,6 +36,20 @@ struct IgnoreContact {
     const ChatAvatar* ignored;
 };
 
+/** Session details that are empty for most cached avatars. Allocated on the
+ * first write so that offline avatars only pay for a null pointer.
+ */
+struct ChatAvatarDetails {
+    std::u16string loginLocation;
+    std::u16string server;
+    std::u16string gateway;
+    std::u16string email;
+    std::u16string statusMessage;
+    uint32_t serverId = 0;
+    uint32_t gatewayId = 0;
+    uint32_t inboxLimit = 0;
+};
+
 class ChatAvatar {
 public:
     explicit ChatAvatar(ChatAvatarService* avatarService);
@@ -49,17 +64,18 @@ public:
     const uint32_t GetAvatarId() const { return avatarId_; }
     const uint32_t GetUserId() const { return userId_; }
     const std::u16string& GetName() const { return name_; }
-    const std::u16string& GetAddress() const { return address_; }
+    const std::u16string& GetAddress() const { return ResolveAddress(addressId_); }
+    AddressId GetAddressId() const { return addressId_; }
     const uint32_t GetAttributes() const { return attributes_; }
     void SetAttributes(const uint32_t attributes);
-    const std::u16string& GetLoginLocation() const { return loginLocation_; }
-    const std::u16string& GetServer() const { return server_; }
-    const std::u16string& GetGateway() const { return gateway_; }
-    const uint32_t GetServerId() const { return serverId_; }
-    const uint32_t GetGatewayId() const { return gatewayId_; }
-    const std::u16string& GetEmail() const { return email_; }
-    const uint32_t GetInboxLimit() const { return inboxLimit_; }
-    const std::u16string& GetStatusMessage() const { return statusMessage_; }
+    const std::u16string& GetLoginLocation() const { return Details().loginLocation; }
+    const std::u16string& GetServer() const { return Details().server; }
+    const std::u16string& GetGateway() const { return Details().gateway; }
+    const uint32_t GetServerId() const { return Details().serverId; }
+    const uint32_t GetGatewayId() const { return Details().gatewayId; }
+    const std::u16string& GetEmail() const { return Details().email; }
+    const uint32_t GetInboxLimit() const { return Details().inboxLimit; }
+    const std::u16string& GetStatusMessage() const { return Details().statusMessage; }
     const bool IsOnline() const { return isOnline_; }
 
     void AddFriend(ChatAvatar* avatar, const std::u16string& comment = u"");
@@ -77,28 +93,31 @@ public:
 
 private:
     friend class ChatAvatarService;
+    friend class ChatStateSnapshot;
 
-    ChatAvatarService* avatarService_;
+    const ChatAvatarDetails& Details() const { return details_ ? *details_ : kEmptyDetails; }
+    ChatAvatarDetails& MutableDetails();
 
+    static const ChatAvatarDetails kEmptyDetails;
+
+    // Hot fields read by cache lookups and fan-out are kept together at the
+    // front of the object.
     uint32_t avatarId_ = 0;
     uint32_t userId_ = 0;
-    std::u16string name_ = u"";
-    std::u16string address_ = u"";
     uint32_t attributes_ = 0;
-    std::u16string loginLocation_ = u"";
-    std::u16string server_ = u"";
-    std::u16string gateway_ = u"";
-    uint32_t serverId_ = 0;
-    uint32_t gatewayId_ = 0;
-    std::u16string email_ = u"";
-    uint32_t inboxLimit_ = 0;
-    std::u16string statusMessage_ = u"";
+    AddressId addressId_ = 0;
     bool isOnline_ = false;
+    bool contactsLoaded_ = true;
+    bool footprintStale_ = false;
+    uint32_t footprint_ = 0;
+    uint64_t lastAccess_ = 0;
+    ChatAvatarService* avatarService_;
+    std::u16string name_;
 
     std::vector<FriendContact> friendList_;
     std::vector<IgnoreContact> ignoreList_;
 
-    std::vector<ChatRoom*> rooms_;
+    std::unique_ptr<ChatAvatarDetails> details_;
 };
 
 template <typename StreamT>
@@ -1,23 +1,27 @@
 #include "ChatAvatarService.hpp"
 #include "ChatAvatar.hpp"
-#include "MariaDB.hpp"
-#include "StringUtils.hpp"
+#include "ChatStorage.hpp"
 
 #include <easylogging++.h>
 
-ChatAvatarService::ChatAvatarService(MariaDBConnection* db)
-    : db_{db} {}
+#include <algorithm>
+
+ChatAvatarService::ChatAvatarService(AvatarStore* avatarStore, ContactStore* contactStore)
+    : avatarStore_{avatarStore}
+    , contactStore_{contactStore} {}
 
 ChatAvatarService::~ChatAvatarService() {}
 
 ChatAvatar* ChatAvatarService::GetAvatar(const std::u16string& name, const std::u16string& address) {
     ChatAvatar* avatar = GetCachedAvatar(name, address);
 
-    if (!avatar) {
+    if (avatar) {
+        TouchAvatar(avatar);
+        EnsureContactsLoaded(avatar);
+    } else {
         auto loadedAvatar = LoadStoredAvatar(name, address);
         if (loadedAvatar != nullptr) {
-            avatar = loadedAvatar.get();
-            avatarCache_.emplace_back(std::move(loadedAvatar));
+            avatar = CacheAvatar(std::move(loadedAvatar));
 
             LoadFriendList(avatar);
             LoadIgnoreList(avatar);
@@ -30,11 +34,13 @@ ChatAvatar* ChatAvatarService::GetAvatar(const std::u16string& name, const std::
 ChatAvatar* ChatAvatarService::GetAvatar(uint32_t avatarId) {
     ChatAvatar* avatar = GetCachedAvatar(avatarId);
 
-    if (!avatar) {
+    if (avatar) {
+        TouchAvatar(avatar);
+        EnsureContactsLoaded(avatar);
+    } else {
         auto loadedAvatar = LoadStoredAvatar(avatarId);
         if (loadedAvatar != nullptr) {
-            avatar = loadedAvatar.get();
-            avatarCache_.emplace_back(std::move(loadedAvatar));
+            avatar = CacheAvatar(std::move(loadedAvatar));
 
             LoadFriendList(avatar);
             LoadIgnoreList(avatar);
@@ -52,11 +58,64 @@ ChatAvatar* ChatAvatarService::CreateAvatar(const std::u16string& name, const st
 
     InsertAvatar(avatar);
 
-    avatarCache_.emplace_back(std::move(tmp));
+    return CacheAvatar(std::move(tmp));
+}
+
+ChatAvatar* ChatAvatarService::AdoptStoredAvatar(uint32_t avatarId, uint32_t userId,
+    const std::u16string& name, const std::u16string& address, uint32_t attributes) {
+    ChatAvatar* avatar = GetCachedAvatar(avatarId);
+
+    if (!avatar) {
+        auto tmp = std::make_unique<ChatAvatar>(this);
+        tmp->avatarId_ = avatarId;
+        tmp->userId_ = userId;
+        tmp->name_ = name;
+        tmp->addressId_ = InternAddress(address);
+        tmp->attributes_ = attributes;
+        tmp->contactsLoaded_ = false;
+
+        avatar = CacheAvatar(std::move(tmp));
+    }
+
+    return avatar;
+}
+
+ChatAvatar* ChatAvatarService::AdoptCreatedAvatar(const StoredAvatar& stored, const std::u16string& loginLocation) {
+    ChatAvatar* avatar = GetCachedAvatar(stored.avatarId);
+
+    if (!avatar) {
+        auto tmp = std::make_unique<ChatAvatar>(
+            this, stored.name, stored.address, stored.userId, stored.attributes, loginLocation);
+        tmp->avatarId_ = stored.avatarId;
+
+        avatar = CacheAvatar(std::move(tmp));
+    }
 
     return avatar;
 }
 
+void ChatAvatarService::AdoptContacts(ChatAvatar* avatar, const StoredContacts& contacts) {
+    if (avatar->contactsLoaded_) {
+        return;
+    }
+
+    avatar->contactsLoaded_ = true;
+    MarkFootprintStale(avatar);
+
+    for (const auto& contact : contacts.friends) {
+        const auto& stored = contact.first;
+        auto friendAvatar = AdoptStoredAvatar(
+            stored.avatarId, stored.userId, stored.name, stored.address, stored.attributes);
+        avatar->friendList_.emplace_back(friendAvatar, contact.second);
+    }
+
+    for (const auto& stored : contacts.ignores) {
+        auto ignoreAvatar = AdoptStoredAvatar(
+            stored.avatarId, stored.userId, stored.name, stored.address, stored.attributes);
+        avatar->ignoreList_.emplace_back(ignoreAvatar);
+    }
+}
+
 void ChatAvatarService::DestroyAvatar(ChatAvatar* avatar) {
     DeleteAvatar(avatar);
     LogoutAvatar(avatar);
@@ -65,6 +124,7 @@ void ChatAvatarService::DestroyAvatar(ChatAvatar* avatar) {
 
 void ChatAvatarService::LoginAvatar(ChatAvatar* avatar) {
     avatar->isOnline_ = true;
+    MarkFootprintStale(avatar);
 
     if (!IsOnline(avatar)) {
         onlineAvatars_.push_back(avatar);
@@ -85,162 +145,230 @@ void ChatAvatarService::PersistAvatar(const ChatAvatar* avatar) { UpdateAvatar(a
 
 void ChatAvatarService::PersistFriend(
     uint32_t srcAvatarId, uint32_t destAvatarId, const std::u16string& comment) {
-    MariaDBStatement* stmt;
-    char sql[] = "INSERT INTO friend (avatar_id, friend_avatar_id, comment) VALUES (@avatar_id, "
-                 "@friend_avatar_id, @comment)";
-
-    auto result = mariadb_prepare(db_, sql, -1, &stmt, 0);
-    if (result != MARIADB_OK) {
-        throw MariaDBException{result, mariadb_errmsg(db_)};
-    }
+    contactStore_->InsertFriend(srcAvatarId, destAvatarId, comment);
+}
 
-    int avatarIdIdx = mariadb_bind_parameter_index(stmt, "@avatar_id");
-    int friendAvatarIdIdx = mariadb_bind_parameter_index(stmt, "@friend_avatar_id");
-    int commentIdx = mariadb_bind_parameter_index(stmt, "@comment");
+void ChatAvatarService::PersistIgnore(uint32_t srcAvatarId, uint32_t destAvatarId) {
+    contactStore_->InsertIgnore(srcAvatarId, destAvatarId);
+}
 
-    std::string commentStr = FromWideString(comment);
+void ChatAvatarService::RemoveFriend(uint32_t srcAvatarId, uint32_t destAvatarId) {
+    contactStore_->DeleteFriend(srcAvatarId, destAvatarId);
+}
 
-    mariadb_bind_int(stmt, avatarIdIdx, srcAvatarId);
-    mariadb_bind_int(stmt, friendAvatarIdIdx, destAvatarId);
-    mariadb_bind_text(stmt, commentIdx, commentStr.c_str(), -1, 0);
+void ChatAvatarService::RemoveIgnore(uint32_t srcAvatarId, uint32_t destAvatarId) {
+    contactStore_->DeleteIgnore(srcAvatarId, destAvatarId);
+}
 
-    result = mariadb_step(stmt);
-    if (result != MARIADB_DONE) {
-        throw MariaDBException{result, mariadb_errmsg(db_)};
-    }
+void ChatAvatarService::UpdateFriendComment(
+    uint32_t srcAvatarId, uint32_t destAvatarId, const std::u16string& comment) {
+    contactStore_->UpdateFriendComment(srcAvatarId, destAvatarId, comment);
 }
 
-void ChatAvatarService::PersistIgnore(uint32_t srcAvatarId, uint32_t destAvatarId) {
-    MariaDBStatement* stmt;
-    char sql[] = "INSERT INTO ignore (avatar_id, ignore_avatar_id, comment) VALUES (@avatar_id, "
-                 "@ignore_avatar_id)";
+void ChatAvatarService::SetCacheLimits(std::size_t maxEntries, std::size_t maxBytes) {
+    maxCacheEntries_ = maxEntries;
+    maxCacheBytes_ = maxBytes;
+}
 
-    auto result = mariadb_prepare(db_, sql, -1, &stmt, 0);
-    if (result != MARIADB_OK) {
-        throw MariaDBException{result, mariadb_errmsg(db_)};
+bool ChatAvatarService::RefreshCacheUsage() {
+    for (auto avatar : staleFootprints_) {
+        avatar->footprintStale_ = false;
+        ChargeFootprint(avatar);
     }
 
-    int avatarIdIdx = mariadb_bind_parameter_index(stmt, "@avatar_id");
-    int ignoreAvatarIdIdx = mariadb_bind_parameter_index(stmt, "@ignore_avatar_id");
+    staleFootprints_.clear();
 
-    mariadb_bind_int(stmt, avatarIdIdx, srcAvatarId);
-    mariadb_bind_int(stmt, ignoreAvatarIdIdx, destAvatarId);
+    return IsOverCapacity();
+}
 
-    result = mariadb_step(stmt);
-    if (result != MARIADB_DONE) {
-        throw MariaDBException{result, mariadb_errmsg(db_)};
+std::size_t ChatAvatarService::EvictIdleAvatars(const std::unordered_set<const ChatAvatar*>& pinned) {
+    if (!IsOverCapacity()) {
+        return 0;
     }
-}
 
-void ChatAvatarService::RemoveFriend(uint32_t srcAvatarId, uint32_t destAvatarId) {
-    MariaDBStatement* stmt;
+    auto referenced = pinned;
+    for (auto onlineAvatar : onlineAvatars_) {
+        for (const auto& contact : onlineAvatar->friendList_) {
+            referenced.insert(contact.frnd);
+        }
 
-    char sql[] = "DELETE FROM friend WHERE avatar_id = @avatar_id AND friend_avatar_id = "
-                 "@friend_avatar_id";
+        for (const auto& contact : onlineAvatar->ignoreList_) {
+            referenced.insert(contact.ignored);
+        }
+    }
 
-    auto result = mariadb_prepare(db_, sql, -1, &stmt, 0);
-    if (result != MARIADB_OK) {
-        throw MariaDBException{result, mariadb_errmsg(db_)};
+    std::vector<std::pair<uint64_t, ChatAvatar*>> candidates;
+    for (const auto& avatar : avatarCache_) {
+        if (!avatar->isOnline_ && referenced.count(avatar.get()) == 0) {
+            candidates.emplace_back(avatar->lastAccess_, avatar.get());
+        }
     }
 
-    int avatarIdIdx = mariadb_bind_parameter_index(stmt, "@avatar_id");
-    int friendAvatarIdIdx = mariadb_bind_parameter_index(stmt, "@friend_avatar_id");
+    std::sort(std::begin(candidates), std::end(candidates));
 
-    mariadb_bind_int(stmt, avatarIdIdx, srcAvatarId);
-    mariadb_bind_int(stmt, friendAvatarIdIdx, destAvatarId);
+    auto targetEntries = maxCacheEntries_ - maxCacheEntries_ / 10;
+    auto targetBytes = maxCacheBytes_ - maxCacheBytes_ / 10;
+    auto entries = avatarCache_.size();
+    auto bytes = residentBytes_;
 
-    result = mariadb_step(stmt);
-    if (result != MARIADB_DONE) {
-        throw MariaDBException{result, mariadb_errmsg(db_)};
-    }
-}
+    std::unordered_set<const ChatAvatar*> evicted;
+    for (const auto& candidate : candidates) {
+        if ((maxCacheEntries_ == 0 || entries <= targetEntries) && (maxCacheBytes_ == 0 || bytes <= targetBytes)) {
+            break;
+        }
 
-void ChatAvatarService::RemoveIgnore(uint32_t srcAvatarId, uint32_t destAvatarId) {
-    MariaDBStatement* stmt;
+        auto avatar = candidate.second;
 
-    char sql[] = "DELETE FROM ignore WHERE avatar_id = @avatar_id AND ignore_avatar_id = "
-                 "@ignore_avatar_id";
+        evicted.insert(avatar);
+        --entries;
+        bytes -= std::min<std::size_t>(bytes, avatar->footprint_);
+    }
 
-    auto result = mariadb_prepare(db_, sql, -1, &stmt, 0);
-    if (result != MARIADB_OK) {
-        throw MariaDBException{result, mariadb_errmsg(db_)};
+    if (evicted.empty()) {
+        LOG(WARNING) << "Avatar cache is over its limit but every cached avatar is in use - resident: "
+                     << avatarCache_.size() << ", bytes: " << residentBytes_;
+        return 0;
     }
 
-    int avatarIdIdx = mariadb_bind_parameter_index(stmt, "@avatar_id");
-    int ignoreAvatarIdIdx = mariadb_bind_parameter_index(stmt, "@ignore_avatar_id");
+    // Remaining offline avatars may still point at evicted ones; drop their
+    // contact lists so they are reloaded from storage the next time around.
+    for (const auto& avatar : avatarCache_) {
+        if (evicted.count(avatar.get()) != 0) {
+            continue;
+        }
 
-    mariadb_bind_int(stmt, avatarIdIdx, srcAvatarId);
-    mariadb_bind_int(stmt, ignoreAvatarIdIdx, destAvatarId);
+        auto referencesEvicted
+            = std::any_of(std::begin(avatar->friendList_), std::end(avatar->friendList_),
+                  [&evicted](const auto& contact) { return evicted.count(contact.frnd) != 0; })
+            || std::any_of(std::begin(avatar->ignoreList_), std::end(avatar->ignoreList_),
+                  [&evicted](const auto& contact) { return evicted.count(contact.ignored) != 0; });
+
+        if (referencesEvicted) {
+            avatar->friendList_.clear();
+            avatar->ignoreList_.clear();
+            avatar->contactsLoaded_ = false;
+            MarkFootprintStale(avatar.get());
+        }
+    }
 
-    result = mariadb_step(stmt);
-    if (result != MARIADB_DONE) {
-        throw MariaDBException{result, mariadb_errmsg(db_)};
+    for (auto avatar : evicted) {
+        UnindexAvatar(avatar);
     }
+
+    staleFootprints_.erase(std::remove_if(std::begin(staleFootprints_), std::end(staleFootprints_),
+                               [&evicted](const ChatAvatar* avatar) { return evicted.count(avatar) != 0; }),
+        std::end(staleFootprints_));
+
+    avatarCache_.erase(std::remove_if(std::begin(avatarCache_), std::end(avatarCache_),
+                           [&evicted](const auto& avatar) { return evicted.count(avatar.get()) != 0; }),
+        std::end(avatarCache_));
+
+    residentBytes_ = bytes;
+    evictedCount_ += evicted.size();
+
+    LOG(INFO) << "Evicted " << evicted.size() << " idle avatars - resident: " << avatarCache_.size()
+              << ", bytes: " << residentBytes_ << ", total evicted: " << evictedCount_;
+
+    return evicted.size();
 }
 
-void ChatAvatarService::UpdateFriendComment(
-    uint32_t srcAvatarId, uint32_t destAvatarId, const std::u16string& comment) {
-    MariaDBStatement* stmt;
-    char sql[] = "UDPATE friend SET comment = @comment WHERE avatar_id = @avatar_id AND "
-                 "friend_avatar_id = @friend_avatar_id";
+ChatAvatar* ChatAvatarService::CacheAvatar(std::unique_ptr<ChatAvatar> avatar) {
+    auto cachedAvatar = avatar.get();
+    TouchAvatar(cachedAvatar);
+
+    ChargeFootprint(cachedAvatar);
+    IndexAvatar(cachedAvatar);
+    avatarCache_.emplace_back(std::move(avatar));
+
+    return cachedAvatar;
+}
+
+std::size_t ChatAvatarService::EstimateFootprint(const ChatAvatar* avatar) {
+    auto stringBytes = [](const std::u16string& value) { return value.capacity() * sizeof(char16_t); };
+
+    // Owning pointer plus one node in each lookup index.
+    constexpr std::size_t kIndexBytes = sizeof(std::unique_ptr<ChatAvatar>) + 2 * (4 * sizeof(void*));
+
+    auto bytes = kIndexBytes + sizeof(ChatAvatar) + stringBytes(avatar->name_)
+        + avatar->friendList_.capacity() * sizeof(FriendContact)
+        + avatar->ignoreList_.capacity() * sizeof(IgnoreContact);
 
-    auto result = mariadb_prepare(db_, sql, -1, &stmt, 0);
-    if (result != MARIADB_OK) {
-        throw MariaDBException{result, mariadb_errmsg(db_)};
+    for (const auto& contact : avatar->friendList_) {
+        bytes += stringBytes(contact.comment);
     }
 
-    int commentIdx = mariadb_bind_parameter_index(stmt, "@comment");
-    int avatarIdIdx = mariadb_bind_parameter_index(stmt, "@avatar_id");
-    int friendAvatarIdIdx = mariadb_bind_parameter_index(stmt, "@friend_avatar_id");
+    if (avatar->details_) {
+        const auto& details = *avatar->details_;
+        bytes += sizeof(ChatAvatarDetails) + stringBytes(details.loginLocation) + stringBytes(details.server)
+            + stringBytes(details.gateway) + stringBytes(details.email) + stringBytes(details.statusMessage);
+    }
 
-    std::string commentStr = FromWideString(comment);
+    return bytes;
+}
 
-    mariadb_bind_text(stmt, commentIdx, commentStr.c_str(), -1, 0);
-    mariadb_bind_int(stmt, avatarIdIdx, srcAvatarId);
-    mariadb_bind_int(stmt, friendAvatarIdIdx, destAvatarId);
+void ChatAvatarService::ChargeFootprint(ChatAvatar* avatar) {
+    auto footprint = static_cast<uint32_t>(EstimateFootprint(avatar));
+    residentBytes_ = residentBytes_ - std::min<std::size_t>(residentBytes_, avatar->footprint_) + footprint;
+    avatar->footprint_ = footprint;
+}
 
-    result = mariadb_step(stmt);
-    if (result != MARIADB_DONE) {
-        throw MariaDBException{result, mariadb_errmsg(db_)};
+void ChatAvatarService::ReleaseFootprint(ChatAvatar* avatar) {
+    residentBytes_ -= std::min<std::size_t>(residentBytes_, avatar->footprint_);
+    avatar->footprint_ = 0;
+
+    if (avatar->footprintStale_) {
+        avatar->footprintStale_ = false;
+        staleFootprints_.erase(std::remove(std::begin(staleFootprints_), std::end(staleFootprints_), avatar),
+            std::end(staleFootprints_));
     }
 }
 
+bool ChatAvatarService::IsOverCapacity() const {
+    return (maxCacheEntries_ != 0 && avatarCache_.size() > maxCacheEntries_)
+        || (maxCacheBytes_ != 0 && residentBytes_ > maxCacheBytes_);
+}
+
 ChatAvatar* ChatAvatarService::GetCachedAvatar(
     const std::u16string& name, const std::u16string& address) {
-    ChatAvatar* avatar = nullptr;
-
-    // First look for the avatar in the cache
-    auto find_iter = std::find_if(
-        std::begin(avatarCache_), std::end(avatarCache_), [name, address](const auto& avatar) {
-            return avatar->name_.compare(name) == 0 && avatar->address_.compare(address) == 0;
-        });
-
-    if (find_iter != std::end(avatarCache_)) {
-        avatar = find_iter->get();
+    // An address that was never interned cannot belong to a cached avatar
+    AddressId addressId;
+    if (!GetAddressTable().Find(address, addressId)) {
+        return nullptr;
     }
 
-    return avatar;
+    auto find_iter = avatarsByName_.find(NameKey{&name, addressId});
+    return find_iter != std::end(avatarsByName_) ? find_iter->second : nullptr;
 }
 
 ChatAvatar* ChatAvatarService::GetCachedAvatar(uint32_t avatarId) {
-    ChatAvatar* avatar = nullptr;
+    auto find_iter = avatarsById_.find(avatarId);
+    return find_iter != std::end(avatarsById_) ? find_iter->second : nullptr;
+}
 
-    // First look for the avatar in the cache
-    auto find_iter = std::find_if(std::begin(avatarCache_), std::end(avatarCache_),
-        [avatarId](const auto& avatar) { return avatar->avatarId_ == avatarId; });
+void ChatAvatarService::IndexAvatar(ChatAvatar* avatar) {
+    avatarsById_[avatar->avatarId_] = avatar;
+    avatarsByName_[NameKey{&avatar->name_, avatar->addressId_}] = avatar;
+}
 
-    if (find_iter != std::end(avatarCache_)) {
-        avatar = find_iter->get();
+void ChatAvatarService::UnindexAvatar(const ChatAvatar* avatar) {
+    auto id_iter = avatarsById_.find(avatar->avatarId_);
+    if (id_iter != std::end(avatarsById_) && id_iter->second == avatar) {
+        avatarsById_.erase(id_iter);
     }
 
-    return avatar;
+    auto name_iter = avatarsByName_.find(NameKey{&avatar->name_, avatar->addressId_});
+    if (name_iter != std::end(avatarsByName_) && name_iter->second == avatar) {
+        avatarsByName_.erase(name_iter);
+    }
 }
 
 void ChatAvatarService::RemoveCachedAvatar(uint32_t avatarId) {
-    auto remove_iter = std::remove_if(std::begin(avatarCache_), std::end(avatarCache_),
+    auto remove_iter = std::find_if(std::begin(avatarCache_), std::end(avatarCache_),
                                   [avatarId](const auto& avatar) { return avatar->avatarId_ == avatarId; });
 
     if (remove_iter != std::end(avatarCache_)) {
+        UnindexAvatar(remove_iter->get());
+        ReleaseFootprint(remove_iter->get());
         avatarCache_.erase(remove_iter);
     }
 }
@@ -259,223 +387,78 @@ void ChatAvatarService::RemoveAsFriendOrIgnoreFromAll(const ChatAvatar* avatar)
 
 std::unique_ptr<ChatAvatar> ChatAvatarService::LoadStoredAvatar(
     const std::u16string& name, const std::u16string& address) {
-    std::unique_ptr<ChatAvatar> avatar{nullptr};
-
-    MariaDBStatement* stmt;
-
-    char sql[] = "SELECT id, user_id, name, address, attributes FROM avatar WHERE name = @name AND "
-                 "address = @address";
-
-    auto result = mariadb_prepare(db_, sql, -1, &stmt, 0);
-    if (result != MARIADB_OK) {
-        throw MariaDBException{result, mariadb_errmsg(db_)};
-    }
-
-    std::string nameStr = FromWideString(name);
-    std::string addressStr = FromWideString(address);
-
-    int nameIdx = mariadb_bind_parameter_index(stmt, "@name");
-    int addressIdx = mariadb_bind_parameter_index(stmt, "@address");
-
-    mariadb_bind_text(stmt, nameIdx, nameStr.c_str(), -1, 0);
-    mariadb_bind_text(stmt, addressIdx, addressStr.c_str(), -1, 0);
-
-    if (mariadb_step(stmt) == MARIADB_ROW) {
-        avatar = std::make_unique<ChatAvatar>(this);
-        avatar->avatarId_ = mariadb_column_int(stmt, 0);
-        avatar->userId_ = mariadb_column_int(stmt, 1);
-
-        auto tmp = std::string(reinterpret_cast<const char*>(mariadb_column_text(stmt, 2)));
-        avatar->name_ = std::u16string{std::begin(tmp), std::end(tmp)};
-
-        tmp = std::string(reinterpret_cast<const char*>(mariadb_column_text(stmt, 3)));
-        avatar->address_ = std::u16string(std::begin(tmp), std::end(tmp));
-
-        avatar->attributes_ = mariadb_column_int(stmt, 4);
-    }
-
-    mariadb_finalize(stmt);
-
-    return avatar;
+    auto stored = avatarStore_->FindAvatar(name, address);
+    return stored ? MakeAvatar(*stored) : nullptr;
 }
 
 std::unique_ptr<ChatAvatar> ChatAvatarService::LoadStoredAvatar(uint32_t avatarId) {
-    std::unique_ptr<ChatAvatar> avatar{nullptr};
-
-    MariaDBStatement* stmt;
-
-    char sql[] = "SELECT id, user_id, name, address, attributes FROM avatar WHERE id = @avatar_id";
-
-    auto result = mariadb_prepare(db_, sql, -1, &stmt, 0);
-    if (result != MARIADB_OK) {
-        throw MariaDBException{result, mariadb_errmsg(db_)};
-    }
-
-    int avatarIdIdx = mariadb_bind_parameter_index(stmt, "@avatar_id");
-
-    mariadb_bind_int(stmt, avatarIdIdx, avatarId);
-
-    if (mariadb_step(stmt) == MARIADB_ROW) {
-        avatar = std::make_unique<ChatAvatar>(this);
-        avatar->avatarId_ = mariadb_column_int(stmt, 0);
-        avatar->userId_ = mariadb_column_int(stmt, 1);
-
-        auto tmp = std::string(reinterpret_cast<const char*>(mariadb_column_text(stmt, 2)));
-        avatar->name_ = std::u16string{std::begin(tmp), std::end(tmp)};
-
-        tmp = std::string(reinterpret_cast<const char*>(mariadb_column_text(stmt, 3)));
-        avatar->address_ = std::u16string(std::begin(tmp), std::end(tmp));
-
-        avatar->attributes_ = mariadb_column_int(stmt, 4);
-    }
-
-    mariadb_finalize(stmt);
+    auto stored = avatarStore_->FindAvatar(avatarId);
+    return stored ? MakeAvatar(*stored) : nullptr;
+}
 
+std::unique_ptr<ChatAvatar> ChatAvatarService::MakeAvatar(const StoredAvatar& stored) {
+    auto avatar = std::make_unique<ChatAvatar>(this);
+    avatar->avatarId_ = stored.avatarId;
+    avatar->userId_ = stored.userId;
+    avatar->name_ = stored.name;
+    avatar->addressId_ = InternAddress(stored.address);
+    avatar->attributes_ = stored.attributes;
     return avatar;
 }
 
+StoredAvatar ChatAvatarService::ToStoredAvatar(const ChatAvatar* avatar) {
+    StoredAvatar stored;
+    stored.avatarId = avatar->avatarId_;
+    stored.userId = avatar->userId_;
+    stored.name = avatar->name_;
+    stored.address = avatar->GetAddress();
+    stored.attributes = avatar->attributes_;
+    return stored;
+}
+
 void ChatAvatarService::InsertAvatar(ChatAvatar* avatar) {
     CHECK_NOTNULL(avatar);
-    MariaDBStatement* stmt;
-
-    char sql[] = "INSERT INTO avatar (user_id, name, address, attributes) VALUES (@user_id, @name, "
-                 "@address, @attributes)";
-
-    auto result = mariadb_prepare(db_, sql, -1, &stmt, 0);
-    if (result != MARIADB_OK) {
-        throw MariaDBException{result, mariadb_errmsg(db_)};
-    }
-
-    std::string nameStr = FromWideString(avatar->name_);
-    std::string addressStr = FromWideString(avatar->address_);
-
-    int userIdIdx = mariadb_bind_parameter_index(stmt, "@user_id");
-    int nameIdx = mariadb_bind_parameter_index(stmt, "@name");
-    int addressIdx = mariadb_bind_parameter_index(stmt, "@address");
-    int attributesIdx = mariadb_bind_parameter_index(stmt, "@attributes");
-
-    mariadb_bind_int(stmt, userIdIdx, avatar->userId_);
-    mariadb_bind_text(stmt, nameIdx, nameStr.c_str(), -1, 0);
-    mariadb_bind_text(stmt, addressIdx, addressStr.c_str(), -1, 0);
-    mariadb_bind_int(stmt, attributesIdx, avatar->attributes_);
-
-    result = mariadb_step(stmt);
-    if (result != MARIADB_DONE) {
-        throw MariaDBException{result, mariadb_errmsg(db_)};
-    }
-
-    avatar->avatarId_ = static_cast<uint32_t>(mariadb_last_insert_rowid(db_));
-
-    mariadb_finalize(stmt);
+    avatar->avatarId_ = avatarStore_->InsertAvatar(ToStoredAvatar(avatar));
 }
 
 void ChatAvatarService::UpdateAvatar(const ChatAvatar* avatar) {
     CHECK_NOTNULL(avatar);
-    MariaDBStatement* stmt;
-
-    char sql[] = "UPDATE avatar SET user_id = @user_id, name = @name, address = @address, "
-                 "attributes = @attributes "
-                 "WHERE id = @avatar_id";
-
-    auto result = mariadb_prepare(db_, sql, -1, &stmt, 0);
-    if (result != MARIADB_OK) {
-        throw MariaDBException{result, mariadb_errmsg(db_)};
-    }
-
-    std::string nameStr = FromWideString(avatar->name_);
-    std::string addressStr = FromWideString(avatar->address_);
-
-    int userIdIdx = mariadb_bind_parameter_index(stmt, "@user_id");
-    int nameIdx = mariadb_bind_parameter_index(stmt, "@name");
-    int addressIdx = mariadb_bind_parameter_index(stmt, "@address");
-    int attributesIdx = mariadb_bind_parameter_index(stmt, "@attributes");
-    int avatarIdIdx = mariadb_bind_parameter_index(stmt, "@avatar_id");
-
-    mariadb_bind_int(stmt, userIdIdx, avatar->userId_);
-    mariadb_bind_text(stmt, nameIdx, nameStr.c_str(), -1, 0);
-    mariadb_bind_text(stmt, addressIdx, addressStr.c_str(), -1, 0);
-    mariadb_bind_int(stmt, attributesIdx, avatar->attributes_);
-    mariadb_bind_int(stmt, avatarIdIdx, avatar->avatarId_);
-
-    result = mariadb_step(stmt);
-    if (result != MARIADB_DONE) {
-        throw MariaDBException{result, mariadb_errmsg(db_)};
-    }
-
-    mariadb_finalize(stmt);
+    avatarStore_->UpdateAvatar(ToStoredAvatar(avatar));
 }
 
 void ChatAvatarService::DeleteAvatar(ChatAvatar* avatar) {
     CHECK_NOTNULL(avatar);
-    MariaDBStatement* stmt;
-
-    char sql[] = "DELETE FROM avatar WHERE id = @avatar_id";
+    avatarStore_->DeleteAvatar(avatar->avatarId_);
+}
 
-    auto result = mariadb_prepare(db_, sql, -1, &stmt, 0);
-    if (result != MARIADB_OK) {
-        throw MariaDBException{result, mariadb_errmsg(db_)};
+void ChatAvatarService::EnsureContactsLoaded(ChatAvatar* avatar) {
+    if (avatar->contactsLoaded_) {
+        return;
     }
 
-    int avatarIdIdx = mariadb_bind_parameter_index(stmt, "@avatar_id");
-
-    mariadb_bind_int(stmt, avatarIdIdx, avatar->avatarId_);
-
-    result = mariadb_step(stmt);
-    if (result != MARIADB_DONE) {
-        throw MariaDBException{result, mariadb_errmsg(db_)};
-    }
+    avatar->contactsLoaded_ = true;
 
-    mariadb_finalize(stmt);
+    LoadFriendList(avatar);
+    LoadIgnoreList(avatar);
 }
 
 void ChatAvatarService::LoadFriendList(ChatAvatar* avatar) {
-    MariaDBStatement* stmt;
-
-    char sql[] = "SELECT friend_avatar_id, comment FROM friend WHERE avatar_id = @avatar_id";
-
-    auto result = mariadb_prepare(db_, sql, -1, &stmt, 0);
-    if (result != MARIADB_OK) {
-        throw MariaDBException{result, mariadb_errmsg(db_)};
-    }
-
-    int avatarIdIdx = mariadb_bind_parameter_index(stmt, "@avatar_id");
-
-    mariadb_bind_int(stmt, avatarIdIdx, avatar->avatarId_);
-
-    uint32_t tmpFriendId;
-    std::string tmpComment;
-    while (mariadb_step(stmt) == MARIADB_ROW) {
-        tmpFriendId = mariadb_column_int(stmt, 0);
-        tmpComment = reinterpret_cast<const char*>(mariadb_column_text(stmt, 1));
-
-        auto friendAvatar = GetAvatar(tmpFriendId);
-
-        avatar->friendList_.emplace_back(friendAvatar, ToWideString(tmpComment));
-    }
+    // Contacts are cached without their own contact lists, so loading one
+    // avatar no longer pulls in its friends-of-friends.
+    contactStore_->ForEachFriend(
+        avatar->avatarId_, [this, avatar](const StoredAvatar& stored, const std::u16string& comment) {
+            auto friendAvatar = AdoptStoredAvatar(
+                stored.avatarId, stored.userId, stored.name, stored.address, stored.attributes);
+            avatar->friendList_.emplace_back(friendAvatar, comment);
+        });
 }
 
 void ChatAvatarService::LoadIgnoreList(ChatAvatar* avatar) {
-    MariaDBStatement* stmt;
-
-    char sql[] = "SELECT ignore_avatar_id FROM ignore WHERE avatar_id = @avatar_id";
-
-    auto result = mariadb_prepare(db_, sql, -1, &stmt, 0);
-    if (result != MARIADB_OK) {
-        throw MariaDBException{result, mariadb_errmsg(db_)};
-    }
-
-    int avatarIdIdx = mariadb_bind_parameter_index(stmt, "@avatar_id");
-
-    mariadb_bind_int(stmt, avatarIdIdx, avatar->avatarId_);
-
-    uint32_t tmpIgnoreId;
-    while (mariadb_step(stmt) == MARIADB_ROW) {
-        tmpIgnoreId = mariadb_column_int(stmt, 0);
-
-        auto ignoreAvatar = GetAvatar(tmpIgnoreId);
-
+    contactStore_->ForEachIgnore(avatar->avatarId_, [this, avatar](const StoredAvatar& stored) {
+        auto ignoreAvatar = AdoptStoredAvatar(
+            stored.avatarId, stored.userId, stored.name, stored.address, stored.attributes);
         avatar->ignoreList_.emplace_back(ignoreAvatar);
-    }
+    });
 }
 
 bool ChatAvatarService::IsOnline(const ChatAvatar * avatar) const {
@@ -9,12 +9,16 @@
 #include <memory>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 
-struct MariaDBConnection;
+class AvatarStore;
+class ContactStore;
+struct StoredAvatar;
+struct StoredContacts;
 
 class ChatAvatarService {
 public:
-    explicit ChatAvatarService(MariaDBConnection* db);
+    ChatAvatarService(AvatarStore* avatarStore, ContactStore* contactStore);
     ~ChatAvatarService();
     
     ChatAvatar* GetAvatar(const std::u16string& name, const std::u16string& address);
@@ -26,6 +30,26 @@ public:
 
     void DestroyAvatar(ChatAvatar* avatar);
 
+    /** Caches an avatar row that was read as part of a bulk query. Friend and
+     * ignore lists are loaded the first time the avatar is requested through
+     * GetAvatar, so bulk loads do not pull in the whole contact graph.
+     */
+    ChatAvatar* AdoptStoredAvatar(uint32_t avatarId, uint32_t userId, const std::u16string& name,
+        const std::u16string& address, uint32_t attributes);
+
+    /** Caches an avatar that was just inserted into storage off the gateway
+     * thread; a new avatar starts out with empty contact lists.
+     */
+    ChatAvatar* AdoptCreatedAvatar(const StoredAvatar& stored, const std::u16string& loginLocation);
+
+    /** Gives an avatar cached without its contact lists the ones read for it
+     * by a bulk query. An avatar that loaded its own lists in the meantime
+     * keeps those.
+     */
+    void AdoptContacts(ChatAvatar* avatar, const StoredContacts& contacts);
+
+    bool AreContactsLoaded(const ChatAvatar* avatar) const { return avatar->contactsLoaded_; }
+
     void LoginAvatar(ChatAvatar* avatar);
     void LogoutAvatar(ChatAvatar* avatar);
 
@@ -39,27 +63,104 @@ public:
     void UpdateFriendComment(uint32_t srcAvatarId, uint32_t destAvatarId, const std::u16string& comment);
 
     const std::vector<ChatAvatar*>& GetOnlineAvatars() const { return onlineAvatars_; }
-    
-private:
+
+    /** Bounds the avatar cache; a limit of 0 disables that bound.
+     */
+    void SetCacheLimits(std::size_t maxEntries, std::size_t maxBytes);
+
+    /** Re-estimates the memory held by the avatars used since the last
+     * refresh, the only ones whose footprint can have changed, and returns
+     * true when the cache is over one of its limits.
+     */
+    bool RefreshCacheUsage();
+
+    /** Evicts the least recently used avatars that are offline, not in the
+     * pinned set and not on an online avatar's friend or ignore list, until
+     * the cache is back under 90% of its limits. Offline avatars whose contact
+     * lists referenced an evicted avatar reload those lists on next use.
+     *
+     * Returns the number of evicted avatars. Must only be called between
+     * requests, as handlers hold raw avatar pointers.
+     */
+    std::size_t EvictIdleAvatars(const std::unordered_set<const ChatAvatar*>& pinned);
+
+    std::size_t GetResidentCount() const { return avatarCache_.size(); }
+    std::size_t GetResidentBytes() const { return residentBytes_; }
+    uint64_t GetEvictedCount() const { return evictedCount_; }
+
+    /** Cache-only lookups; these never touch storage or load contact lists.
+     */
     ChatAvatar* GetCachedAvatar(const std::u16string& name, const std::u16string& address);
     ChatAvatar* GetCachedAvatar(uint32_t avatarId);
 
+private:
+    friend class ChatStateSnapshot;
+
+    /** Index key that borrows the name from the cached avatar it refers to.
+     */
+    struct NameKey {
+        const std::u16string* name;
+        AddressId address;
+
+        bool operator==(const NameKey& other) const { return address == other.address && *name == *other.name; }
+    };
+
+    struct NameKeyHash {
+        std::size_t operator()(const NameKey& key) const {
+            return std::hash<std::u16string>{}(*key.name) ^ (static_cast<std::size_t>(key.address) * 0x9E3779B97F4A7C15ull);
+        }
+    };
+
+    void IndexAvatar(ChatAvatar* avatar);
+    void UnindexAvatar(const ChatAvatar* avatar);
+
+    ChatAvatar* CacheAvatar(std::unique_ptr<ChatAvatar> avatar);
+    void TouchAvatar(ChatAvatar* avatar) {
+        avatar->lastAccess_ = ++accessClock_;
+        MarkFootprintStale(avatar);
+    }
+
+    void MarkFootprintStale(ChatAvatar* avatar) {
+        if (!avatar->footprintStale_) {
+            avatar->footprintStale_ = true;
+            staleFootprints_.push_back(avatar);
+        }
+    }
+
+    bool IsOverCapacity() const;
+    static std::size_t EstimateFootprint(const ChatAvatar* avatar);
+    void ChargeFootprint(ChatAvatar* avatar);
+    void ReleaseFootprint(ChatAvatar* avatar);
+
     void RemoveCachedAvatar(uint32_t avatarId);
     void RemoveAsFriendOrIgnoreFromAll(const ChatAvatar* avatar);
     
     std::unique_ptr<ChatAvatar> LoadStoredAvatar(const std::u16string& name, const std::u16string& address);
     std::unique_ptr<ChatAvatar> LoadStoredAvatar(uint32_t avatarId);
+    std::unique_ptr<ChatAvatar> MakeAvatar(const StoredAvatar& stored);
+    static StoredAvatar ToStoredAvatar(const ChatAvatar* avatar);
 
     void InsertAvatar(ChatAvatar* avatar);
     void UpdateAvatar(const ChatAvatar* avatar);
     void DeleteAvatar(ChatAvatar* avatar);
 
+    void EnsureContactsLoaded(ChatAvatar* avatar);
     void LoadFriendList(ChatAvatar* avatar);
     void LoadIgnoreList(ChatAvatar* avatar);
 
     bool IsOnline(const ChatAvatar* avatar) const;
 
     std::vector<std::unique_ptr<ChatAvatar>> avatarCache_;
+    std::unordered_map<uint32_t, ChatAvatar*> avatarsById_;
+    std::unordered_map<NameKey, ChatAvatar*, NameKeyHash> avatarsByName_;
     std::vector<ChatAvatar*> onlineAvatars_;
-    MariaDBConnection* db_;
+    AvatarStore* avatarStore_;
+    ContactStore* contactStore_;
+
+    std::size_t maxCacheEntries_ = 0;
+    std::size_t maxCacheBytes_ = 0;
+    std::size_t residentBytes_ = 0;
+    std::vector<ChatAvatar*> staleFootprints_;
+    uint64_t evictedCount_ = 0;
+    uint64_t accessClock_ = 0;
 };
@@ -249,4 +249,5 @@ struct ChatResultException {
         , message{text} {}
 };
 
-const char* ToString(ChatResultCode code);
\ No newline at end of file
+const char* ToString(ChatResultCode code);
+const char* ToString(ChatRequestType type);
\ No newline at end of file
@@ -14,7 +14,7 @@ ChatRoom::ChatRoom(ChatRoomService* roomService, uint32_t roomId, const ChatAvat
     : roomService_{roomService}
     , roomId_{roomId}
     , creatorName_{creator->GetName()}
-    , creatorAddress_{creator->GetAddress()}
+    , creatorAddressId_{creator->GetAddressId()}
     , roomName_{roomName}
     , roomTopic_{roomTopic}
     , roomPassword_{roomPassword}
@@ -66,6 +66,12 @@ void ChatRoom::EnterRoom(ChatAvatar* avatar, const std::u16string& password) {
     avatars_.push_back(avatar);
 }
 
+void ChatRoom::AddRemoteMember(ChatAvatar* avatar) {
+    if (!IsInRoom(avatar)) {
+        avatars_.push_back(avatar);
+    }
+}
+
 bool ChatRoom::IsInRoom(ChatAvatar* avatar) const { return IsInRoom(avatar->GetAvatarId()); }
 
 bool ChatRoom::IsInRoom(uint32_t avatarId) const {
@@ -95,17 +101,13 @@ std::vector<uint32_t> ChatRoom::GetAvatarIds(const ChatAvatar * srcAvatar) const
     return avatarIds;
 }
 
-std::vector<std::u16string> ChatRoom::GetConnectedAddresses() const {
-    std::vector<std::u16string> connectedAddresses;
+std::vector<AddressId> ChatRoom::GetConnectedAddresses() const {
+    std::vector<AddressId> connectedAddresses;
 
-    std::u16string address;
     for (auto avatar : avatars_) {
-        address = avatar->GetAddress();
-        if (connectedAddresses.empty()
-            || std::none_of(std::begin(connectedAddresses), std::end(connectedAddresses),
-                   [&address](const auto& connectedAddress) {
-                       return connectedAddress.compare(address) == 0;
-                   })) {
+        auto address = avatar->GetAddressId();
+        if (std::find(std::begin(connectedAddresses), std::end(connectedAddresses), address)
+            == std::end(connectedAddresses)) {
             connectedAddresses.push_back(address);
         }
     }
@@ -113,17 +115,14 @@ std::vector<std::u16string> ChatRoom::GetConnectedAddresses() const {
     return connectedAddresses;
 }
 
-std::vector<std::u16string> ChatRoom::GetRemoteAddresses() const {
-    std::vector<std::u16string> connectedAddresses;
+std::vector<AddressId> ChatRoom::GetRemoteAddresses() const {
+    std::vector<AddressId> connectedAddresses;
 
-    std::u16string address;
     for (auto avatar : avatars_) {
-        address = avatar->GetAddress();
-        if (creatorAddress_.compare(address) != 0 && (connectedAddresses.empty()
-            || std::none_of(std::begin(connectedAddresses), std::end(connectedAddresses),
-                            [&address](const auto& connectedAddress) {
-            return connectedAddress.compare(address) == 0;
-        }))) {
+        auto address = avatar->GetAddressId();
+        if (address != creatorAddressId_
+            && std::find(std::begin(connectedAddresses), std::end(connectedAddresses), address)
+                == std::end(connectedAddresses)) {
             connectedAddresses.push_back(address);
         }
     }
@@ -194,7 +193,7 @@ void ChatRoom::AddAdministrator(uint32_t srcAvatarId, ChatAvatar* administrator)
         administrators_.push_back(administrator);
 
         if (IsPersistent()) {
-            roomService_->PersistBanned(administrator->GetAvatarId(), roomId_);
+            roomService_->PersistRoomMember(this, RoomRole::ADMINISTRATOR, administrator->GetAvatarId());
         }
     }
 }
@@ -211,7 +210,7 @@ void ChatRoom::AddModerator(uint32_t srcAvatarId, ChatAvatar* moderator) {
     moderators_.push_back(moderator);
 
     if (IsPersistent()) {
-        roomService_->PersistBanned(moderator->GetAvatarId(), roomId_);
+        roomService_->PersistRoomMember(this, RoomRole::MODERATOR, moderator->GetAvatarId());
     }
 }
 
@@ -227,7 +226,7 @@ void ChatRoom::AddBanned(uint32_t srcAvatarId, ChatAvatar* banned) {
     banned_.push_back(banned);
 
     if (IsPersistent()) {
-        roomService_->PersistBanned(banned->GetAvatarId(), roomId_);
+        roomService_->PersistRoomMember(this, RoomRole::BANNED, banned->GetAvatarId());
     }
 }
 
@@ -255,7 +254,7 @@ void ChatRoom::RemoveAdministrator(uint32_t srcAvatarId, uint32_t avatarId) {
         [avatarId](auto administrator) { return administrator->GetAvatarId() == avatarId; }));
 
     if (IsPersistent()) {
-        roomService_->DeleteAdministrator(avatarId, roomId_);
+        roomService_->DeleteRoomMember(this, RoomRole::ADMINISTRATOR, avatarId);
     }
 }
 
@@ -272,7 +271,7 @@ void ChatRoom::RemoveModerator(uint32_t srcAvatarId, uint32_t avatarId) {
         [avatarId](auto moderator) { return moderator->GetAvatarId() == avatarId; }));
 
     if (IsPersistent()) {
-        roomService_->DeleteModerator(avatarId, roomId_);
+        roomService_->DeleteRoomMember(this, RoomRole::MODERATOR, avatarId);
     }
 }
 
@@ -289,7 +288,7 @@ void ChatRoom::RemoveBanned(uint32_t srcAvatarId, uint32_t avatarId) {
         [avatarId](auto banned) { return banned->GetAvatarId() == avatarId; }));
 
     if (IsPersistent()) {
-        roomService_->DeleteBanned(avatarId, roomId_);
+        roomService_->DeleteRoomMember(this, RoomRole::BANNED, avatarId);
     }
 }
 
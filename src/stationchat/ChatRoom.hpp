@@ -1,6 +1,7 @@
 
 #pragma once
 
+#include "AddressTable.hpp"
 #include "ChatEnums.hpp"
 
 #include <string>
@@ -36,14 +37,19 @@ public:
     bool IsInRoom(uint32_t avatarId) const;
     void LeaveRoom(ChatAvatar* avatar);
 
+    /** Adds an avatar that entered through another cluster gateway, which
+     * has already checked the password, bans and invitations.
+     */
+    void AddRemoteMember(ChatAvatar* avatar);
+
     uint32_t GetCreatorId() const { return creatorId_; }
     const std::u16string& GetCreatorName() const { return creatorName_; }
-    const std::u16string& GetCreatorAddress() const { return creatorAddress_; }
+    const std::u16string& GetCreatorAddress() const { return ResolveAddress(creatorAddressId_); }
     const std::u16string& GetRoomName() const { return roomName_; }
     const std::u16string& GetRoomAddress() const { return roomAddress_; }
     const std::u16string& GetRoomTopic() const { return roomTopic_; }
     const std::u16string& GetRoomPassword() const { return roomPassword_; }
-    const std::u16string& GetRoomPrefix() const { return roomPrefix_; }
+    const std::u16string& GetRoomPrefix() const { return ResolveAddress(roomPrefixId_); }
     uint32_t GetRoomAttributes() const { return roomAttributes_; }
     uint32_t GetCurrentRoomSize() const { return avatars_.size(); }
     uint32_t GetMaxRoomSize() const { return maxRoomSize_; }
@@ -65,8 +71,8 @@ public:
     /* Returns the addresses of the different game servers currently with avatars
     * connected to this room.
     */
-    std::vector<std::u16string> GetConnectedAddresses() const;
-    std::vector<std::u16string> GetRemoteAddresses() const;
+    std::vector<AddressId> GetConnectedAddresses() const;
+    std::vector<AddressId> GetRemoteAddresses() const;
 
     bool IsCreator(uint32_t avatarId) const;
     bool IsModerator(uint32_t avatarId) const;
@@ -90,13 +96,14 @@ public:
 
 private:
     friend class ChatRoomService;
+    friend class ChatStateSnapshot;
     ChatRoomService* roomService_;
     std::u16string creatorName_;
-    std::u16string creatorAddress_;
+    AddressId creatorAddressId_ = 0;
     std::u16string roomName_;
     std::u16string roomTopic_;
     std::u16string roomPassword_;
-    std::u16string roomPrefix_ = u"";
+    AddressId roomPrefixId_ = 0;
     std::u16string roomAddress_;
 
     uint32_t creatorId_;
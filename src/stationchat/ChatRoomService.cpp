@@ -6,71 +6,60 @@
 
 #include "easylogging++.h"
 
-ChatRoomService::ChatRoomService(ChatAvatarService* avatarService, MariaDBConnection* db)
+#include <chrono>
+#include <unordered_set>
+
+ChatRoomService::ChatRoomService(ChatAvatarService* avatarService, RoomStore* roomStore)
     : avatarService_{avatarService}
-    , db_{db} {}
+    , roomStore_{roomStore} {}
 
 ChatRoomService::~ChatRoomService() {}
 
 void ChatRoomService::LoadRoomsFromStorage(const std::u16string& baseAddress) {
-    rooms_.clear();
-
-    MariaDBStatement* stmt;
-
-    char sql[] = "SELECT id, creator_id, creator_name, creator_address, room_name, room_topic, "
-                 "room_password, room_prefix, room_address, room_attributes, room_max_size, "
-                 "room_message_id, created_at, node_level FROM room WHERE room_address LIKE @baseAddress||'%'";
-
-    if (mariadb_prepare(db_, sql, -1, &stmt, 0) != MARIADB_OK) {
-        throw std::runtime_error("Error preparing SQL statement");
-    }
+    using Clock = std::chrono::steady_clock;
 
-    int baseAddressIdx = mariadb_bind_parameter_index(stmt, "@baseAddress");
+    rooms_.clear();
 
     auto baseAddressStr = FromWideString(baseAddress);
     LOG(INFO) << "Loading rooms for base address: " << baseAddressStr;
-    mariadb_bind_text(stmt, baseAddressIdx, baseAddressStr.c_str(), -1, 0);
 
-    while (mariadb_step(stmt) == MARIADB_ROW) {
-        auto room = std::make_unique<ChatRoom>();
-        std::string tmp;
-        room->roomId_ = nextRoomId_++;
-        room->dbId_ = mariadb_column_int(stmt, 0);
-        room->creatorId_ = mariadb_column_int(stmt, 1);
+    // Rooms and each of their role tables are read with one streamed pass
+    // apiece and stitched together in memory, so the number of storage round
+    // trips does not grow with the number of persistent rooms.
+    RoomsByDbId roomsByDbId;
 
-        tmp = std::string(reinterpret_cast<const char*>(mariadb_column_text(stmt, 2)));
-        room->creatorName_ = std::u16string{std::begin(tmp), std::end(tmp)};
+    auto phaseStart = Clock::now();
+    const auto loadStart = phaseStart;
+    auto elapsedMs = [&phaseStart]() {
+        auto now = Clock::now();
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - phaseStart).count();
+        phaseStart = now;
+        return elapsed;
+    };
 
-        tmp = std::string(reinterpret_cast<const char*>(mariadb_column_text(stmt, 3)));
-        room->creatorAddress_ = std::u16string{std::begin(tmp), std::end(tmp)};
+    LoadRooms(baseAddress, roomsByDbId);
+    auto roomsMs = elapsedMs();
 
-        tmp = std::string(reinterpret_cast<const char*>(mariadb_column_text(stmt, 4)));
-        room->roomName_ = std::u16string{std::begin(tmp), std::end(tmp)};
+    auto moderatorCount = LoadRoomMembers(baseAddress, RoomRole::MODERATOR, roomsByDbId, &ChatRoom::moderators_);
+    auto moderatorsMs = elapsedMs();
 
-        tmp = std::string(reinterpret_cast<const char*>(mariadb_column_text(stmt, 5)));
-        room->roomTopic_ = std::u16string{std::begin(tmp), std::end(tmp)};
+    auto administratorCount
+        = LoadRoomMembers(baseAddress, RoomRole::ADMINISTRATOR, roomsByDbId, &ChatRoom::administrators_);
+    auto administratorsMs = elapsedMs();
 
-        tmp = std::string(reinterpret_cast<const char*>(mariadb_column_text(stmt, 6)));
-        room->roomPassword_ = std::u16string{std::begin(tmp), std::end(tmp)};
+    auto bannedCount = LoadRoomMembers(baseAddress, RoomRole::BANNED, roomsByDbId, &ChatRoom::banned_);
+    auto bannedMs = elapsedMs();
 
-        tmp = std::string(reinterpret_cast<const char*>(mariadb_column_text(stmt, 7)));
-        room->roomPrefix_ = std::u16string{std::begin(tmp), std::end(tmp)};
+    auto invitedCount = LoadRoomMembers(baseAddress, RoomRole::INVITED, roomsByDbId, &ChatRoom::invited_);
+    auto invitedMs = elapsedMs();
 
-        tmp = std::string(reinterpret_cast<const char*>(mariadb_column_text(stmt, 8)));
-        room->roomAddress_ = std::u16string{std::begin(tmp), std::end(tmp)};
-
-        room->roomAttributes_ = mariadb_column_int(stmt, 9);
-        room->maxRoomSize_ = mariadb_column_int(stmt, 10);
-        room->roomMessageId_ = mariadb_column_int(stmt, 11);
-        room->createTime_ = mariadb_column_int(stmt, 12);
-        room->nodeLevel_ = mariadb_column_int(stmt, 13);
-
-        if (!RoomExists(room->GetRoomAddress())) {
-            rooms_.emplace_back(std::move(room));
-        }
-    }
+    auto totalMs = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - loadStart).count();
 
     LOG(INFO) << "Rooms currently loaded: " << rooms_.size();
+    LOG(INFO) << "Room load timings (ms) - rooms: " << roomsMs << ", moderators: " << moderatorsMs
+              << " (" << moderatorCount << "), administrators: " << administratorsMs << " ("
+              << administratorCount << "), bans: " << bannedMs << " (" << bannedCount
+              << "), invites: " << invitedMs << " (" << invitedCount << "), total: " << totalMs;
 }
 
 ChatRoom* ChatRoomService::CreateRoom(const ChatAvatar* creator,
@@ -106,71 +95,43 @@ void ChatRoomService::DestroyRoom(ChatRoom* room) {
         [room](const auto& trackedRoom) { return trackedRoom->GetRoomId() == room->GetRoomId(); }));
 }
 
+ChatRoom* ChatRoomService::AddMirroredRoom(const ChatAvatar* creator, const std::u16string& roomName,
+    const std::u16string& roomTopic, const std::u16string& roomPassword, uint32_t roomAttributes,
+    uint32_t maxRoomSize, const std::u16string& roomAddress, const std::u16string& srcAddress) {
+    rooms_.emplace_back(std::make_unique<ChatRoom>(this, nextRoomId_++, creator, roomName, roomTopic, roomPassword,
+        roomAttributes, maxRoomSize, roomAddress, srcAddress));
+    return rooms_.back().get();
+}
+
+void ChatRoomService::RemoveMirroredRoom(ChatRoom* room) {
+    rooms_.erase(std::remove_if(std::begin(rooms_), std::end(rooms_),
+                     [room](const auto& trackedRoom) { return trackedRoom.get() == room; }),
+        std::end(rooms_));
+}
+
 ChatResultCode ChatRoomService::PersistNewRoom(ChatRoom& room) {
-    ChatResultCode result = ChatResultCode::SUCCESS;
-    MariaDBStatement* stmt;
-
-    char sql[] = "INSERT INTO room (creator_id, creator_name, creator_address, room_name, "
-                 "room_topic, room_password, room_prefix, room_address, room_attributes, "
-                 "room_max_size, room_message_id, created_at, node_level) VALUES (@creator_id, "
-                 "@creator_name, @creator_address, @room_name, @room_topic, @room_password, "
-                 "@room_prefix, @room_address, @room_attributes, @room_max_size, @room_message_id, "
-                 "@created_at, @node_level)";
-
-    if (mariadb_prepare(db_, sql, -1, &stmt, 0) != MARIADB_OK) {
-        result = ChatResultCode::DBFAIL;
-    } else {
-        int creatorIdIdx = mariadb_bind_parameter_index(stmt, "@creator_id");
-        int creatorNameIdx = mariadb_bind_parameter_index(stmt, "@creator_name");
-        int creatorAddressIdx = mariadb_bind_parameter_index(stmt, "@creator_address");
-        int roomNameIdx = mariadb_bind_parameter_index(stmt, "@room_name");
-        int roomTopicIdx = mariadb_bind_parameter_index(stmt, "@room_topic");
-        int roomPasswordIdx = mariadb_bind_parameter_index(stmt, "@room_password");
-        int roomPrefixIdx = mariadb_bind_parameter_index(stmt, "@room_prefix");
-        int roomAddressIdx = mariadb_bind_parameter_index(stmt, "@room_address");
-        int roomAttributesIdx = mariadb_bind_parameter_index(stmt, "@room_attributes");
-        int roomMaxSizeIdx = mariadb_bind_parameter_index(stmt, "@room_max_size");
-        int roomMessageIdIdx = mariadb_bind_parameter_index(stmt, "@room_message_id");
-        int createdAtIdx = mariadb_bind_parameter_index(stmt, "@created_at");
-        int nodeLevelIdx = mariadb_bind_parameter_index(stmt, "@node_level");
-
-        mariadb_bind_int(stmt, creatorIdIdx, room.creatorId_);
-
-        auto creatorName = FromWideString(room.creatorName_);
-        mariadb_bind_text(stmt, creatorNameIdx, creatorName.c_str(), -1, 0);
-
-        auto creatorAddress = FromWideString(room.creatorAddress_);
-        mariadb_bind_text(stmt, creatorAddressIdx, creatorAddress.c_str(), -1, 0);
-
-        auto roomName = FromWideString(room.roomName_);
-        mariadb_bind_text(stmt, roomNameIdx, roomName.c_str(), -1, 0);
-
-        auto roomTopic = FromWideString(room.roomTopic_);
-        mariadb_bind_text(stmt, roomTopicIdx, roomTopic.c_str(), -1, 0);
-
-        auto roomPassword = FromWideString(room.roomPassword_);
-        mariadb_bind_text(stmt, roomPasswordIdx, roomPassword.c_str(), -1, 0);
-
-        auto roomPrefix = FromWideString(room.roomPrefix_);
-        mariadb_bind_text(stmt, roomPrefixIdx, roomPrefix.c_str(), -1, 0);
-
-        auto roomAddress = FromWideString(room.roomAddress_);
-        mariadb_bind_text(stmt, roomAddressIdx, roomAddress.c_str(), -1, 0);
-
-        mariadb_bind_int(stmt, roomAttributesIdx, room.roomAttributes_);
-        mariadb_bind_int(stmt, roomMaxSizeIdx, room.maxRoomSize_);
-        mariadb_bind_int(stmt, roomMessageIdIdx, room.roomMessageId_);
-        mariadb_bind_int(stmt, createdAtIdx, room.createTime_);
-        mariadb_bind_int(stmt, nodeLevelIdx, room.nodeLevel_);
-
-        if (mariadb_step(stmt) != MARIADB_DONE) {
-            result = ChatResultCode::DBFAIL;
-        } else {
-            room.dbId_ = static_cast<uint32_t>(mariadb_last_insert_rowid(db_));
-        }
+    StoredRoom stored;
+    stored.creatorId = room.creatorId_;
+    stored.creatorName = room.creatorName_;
+    stored.creatorAddress = room.GetCreatorAddress();
+    stored.roomName = room.roomName_;
+    stored.roomTopic = room.roomTopic_;
+    stored.roomPassword = room.roomPassword_;
+    stored.roomPrefix = room.GetRoomPrefix();
+    stored.roomAddress = room.roomAddress_;
+    stored.roomAttributes = room.roomAttributes_;
+    stored.maxRoomSize = room.maxRoomSize_;
+    stored.roomMessageId = room.roomMessageId_;
+    stored.createTime = room.createTime_;
+    stored.nodeLevel = room.nodeLevel_;
+
+    try {
+        room.dbId_ = roomStore_->InsertRoom(stored);
+    } catch (const MariaDBException&) {
+        return ChatResultCode::DBFAIL;
     }
 
-    return result;
+    return ChatResultCode::SUCCESS;
 }
 
 std::vector<ChatRoom*> ChatRoomService::GetRoomSummaries(
@@ -220,200 +181,76 @@ std::vector<ChatRoom*> ChatRoomService::GetJoinedRooms(const ChatAvatar * avatar
     return rooms;
 }
 
-void ChatRoomService::DeleteRoom(ChatRoom* room) {
-    MariaDBStatement* stmt;
-    char sql[] = "DELETE FROM room WHERE id = @id";
-
-    auto result = mariadb_prepare(db_, sql, -1, &stmt, 0);
-    if (result != MARIADB_OK) {
-        throw MariaDBException{result, mariadb_errmsg(db_)};
-    }
-
-    int idIdx = mariadb_bind_parameter_index(stmt, "@id");
-    mariadb_bind_int(stmt, idIdx, room->dbId_);
-
-    result = mariadb_step(stmt);
-    if (result != MARIADB_DONE) {
-        throw MariaDBException{result, mariadb_errmsg(db_)};
-    }
-}
-
-void ChatRoomService::LoadModerators(ChatRoom * room) {
-    MariaDBStatement* stmt;
-    char sql[] = "SELECT moderator_avatar_id FROM room_moderator WHERE room_id = @room_id";
-
-    auto result = mariadb_prepare(db_, sql, -1, &stmt, 0);
-    if (result != MARIADB_OK) {
-        throw MariaDBException{result, mariadb_errmsg(db_)};
-    }
-
-    int roomIdIdx = mariadb_bind_parameter_index(stmt, "@room_id");
-    mariadb_bind_int(stmt, roomIdIdx, room->GetRoomId());
-
-    while (mariadb_step(stmt) == MARIADB_ROW) {
-        uint32_t moderatorId = mariadb_column_int(stmt, 0);
-        room->moderators_.push_back(avatarService_->GetAvatar(moderatorId));
-    }
-}
-
-void ChatRoomService::PersistModerator(uint32_t moderatorId, uint32_t roomId) {
-    MariaDBStatement* stmt;
-    char sql[] = "INSERT OR IGNORE INTO room_moderator (moderator_avatar_id, room_id) VALUES (@moderator_avatar_id, @room_id)";
-
-    auto result = mariadb_prepare(db_, sql, -1, &stmt, 0);
-    if (result != MARIADB_OK) {
-        throw MariaDBException{result, mariadb_errmsg(db_)};
-    }
-
-    int moderatorAvatarIdIdx = mariadb_bind_parameter_index(stmt, "@moderator_avatar_id");
-    int roomIdIdx = mariadb_bind_parameter_index(stmt, "@room_id");
-
-    mariadb_bind_int(stmt, moderatorAvatarIdIdx, moderatorId);
-    mariadb_bind_int(stmt, roomIdIdx, roomId);
-
-    result = mariadb_step(stmt);
-    if (result != MARIADB_DONE) {
-        throw MariaDBException{result, mariadb_errmsg(db_)};
-    }
-}
-
-void ChatRoomService::DeleteModerator(uint32_t moderatorId, uint32_t roomId) {
-    MariaDBStatement* stmt;
-    char sql[] = "DELETE FROM room_moderator WHERE moderator_avatar_id = @moderator_avatar_id AND room_id = @room_id";
+void ChatRoomService::CollectReferencedAvatars(std::unordered_set<const ChatAvatar*>& avatars) const {
+    for (const auto& room : rooms_) {
+        avatars.insert(std::begin(room->avatars_), std::end(room->avatars_));
 
-    auto result = mariadb_prepare(db_, sql, -1, &stmt, 0);
-    if (result != MARIADB_OK) {
-        throw MariaDBException{result, mariadb_errmsg(db_)};
-    }
-
-    int moderatorAvatarIdIdx = mariadb_bind_parameter_index(stmt, "@moderator_avatar_id");
-    int roomIdIdx = mariadb_bind_parameter_index(stmt, "@room_id");
-
-    mariadb_bind_int(stmt, moderatorAvatarIdIdx, moderatorId);
-    mariadb_bind_int(stmt, roomIdIdx, roomId);
-
-    result = mariadb_step(stmt);
-    if (result != MARIADB_DONE) {
-        throw MariaDBException{result, mariadb_errmsg(db_)};
-    }
-}
-
-void ChatRoomService::LoadAdministrators(ChatRoom * room) {
-    MariaDBStatement* stmt;
-    char sql[] = "SELECT administrator_avatar_id FROM room_administrator WHERE room_id = @room_id";
-
-    auto result = mariadb_prepare(db_, sql, -1, &stmt, 0);
-    if (result != MARIADB_OK) {
-        throw MariaDBException{result, mariadb_errmsg(db_)};
-    }
-
-    int roomIdIdx = mariadb_bind_parameter_index(stmt, "@room_id");
-    mariadb_bind_int(stmt, roomIdIdx, room->GetRoomId());
-
-    while (mariadb_step(stmt) == MARIADB_ROW) {
-        uint32_t administratorId = mariadb_column_int(stmt, 0);
-        room->administrators_.push_back(avatarService_->GetAvatar(administratorId));
+        for (auto members : {&ChatRoom::administrators_, &ChatRoom::moderators_, &ChatRoom::tempModerators_,
+                 &ChatRoom::banned_, &ChatRoom::invited_, &ChatRoom::voice_}) {
+            const auto& list = (*room).*members;
+            avatars.insert(std::begin(list), std::end(list));
+        }
     }
 }
 
-void ChatRoomService::PersistAdministrator(uint32_t administratorId, uint32_t roomId) {
-    MariaDBStatement* stmt;
-    char sql[] = "INSERT OR IGNORE INTO room_administrator (administrator_avatar_id, room_id) VALUES (@administrator_avatar_id, @room_id)";
-
-    auto result = mariadb_prepare(db_, sql, -1, &stmt, 0);
-    if (result != MARIADB_OK) {
-        throw MariaDBException{result, mariadb_errmsg(db_)};
-    }
-
-    int administratorAvatarIdIdx = mariadb_bind_parameter_index(stmt, "@administrator_avatar_id");
-    int roomIdIdx = mariadb_bind_parameter_index(stmt, "@room_id");
+void ChatRoomService::LoadRooms(const std::u16string& baseAddress, RoomsByDbId& roomsByDbId) {
+    std::unordered_set<std::u16string> loadedAddresses;
 
-    mariadb_bind_int(stmt, administratorAvatarIdIdx, administratorId);
-    mariadb_bind_int(stmt, roomIdIdx, roomId);
+    roomStore_->ForEachRoom(baseAddress, [this, &roomsByDbId, &loadedAddresses](const StoredRoom& stored) {
+        if (!loadedAddresses.insert(stored.roomAddress).second) {
+            return;
+        }
 
-    result = mariadb_step(stmt);
-    if (result != MARIADB_DONE) {
-        throw MariaDBException{result, mariadb_errmsg(db_)};
-    }
+        auto room = std::make_unique<ChatRoom>();
+        room->roomService_ = this;
+        room->roomId_ = nextRoomId_++;
+        room->dbId_ = stored.dbId;
+        room->creatorId_ = stored.creatorId;
+        room->creatorName_ = stored.creatorName;
+        room->creatorAddressId_ = InternAddress(stored.creatorAddress);
+        room->roomName_ = stored.roomName;
+        room->roomTopic_ = stored.roomTopic;
+        room->roomPassword_ = stored.roomPassword;
+        room->roomPrefixId_ = InternAddress(stored.roomPrefix);
+        room->roomAddress_ = stored.roomAddress;
+        room->roomAttributes_ = stored.roomAttributes;
+        room->maxRoomSize_ = stored.maxRoomSize;
+        room->roomMessageId_ = stored.roomMessageId;
+        room->createTime_ = stored.createTime;
+        room->nodeLevel_ = stored.nodeLevel;
+
+        roomsByDbId.emplace(room->dbId_, room.get());
+        rooms_.emplace_back(std::move(room));
+    });
 }
 
-void ChatRoomService::DeleteAdministrator(uint32_t administratorId, uint32_t roomId) {
-    MariaDBStatement* stmt;
-    char sql[] = "DELETE FROM room_administrator WHERE administrator_avatar_id = @administrator_avatar_id AND room_id = @room_id";
-
-    auto result = mariadb_prepare(db_, sql, -1, &stmt, 0);
-    if (result != MARIADB_OK) {
-        throw MariaDBException{result, mariadb_errmsg(db_)};
-    }
-
-    int administratorAvatarIdIdx = mariadb_bind_parameter_index(stmt, "@administrator_avatar_id");
-    int roomIdIdx = mariadb_bind_parameter_index(stmt, "@room_id");
-
-    mariadb_bind_int(stmt, administratorAvatarIdIdx, administratorId);
-    mariadb_bind_int(stmt, roomIdIdx, roomId);
-
-    result = mariadb_step(stmt);
-    if (result != MARIADB_DONE) {
-        throw MariaDBException{result, mariadb_errmsg(db_)};
-    }
-}
+std::size_t ChatRoomService::LoadRoomMembers(const std::u16string& baseAddress, RoomRole role,
+    const RoomsByDbId& roomsByDbId, std::vector<const ChatAvatar*> ChatRoom::*members) {
+    std::size_t count = 0;
 
-void ChatRoomService::LoadBanned(ChatRoom * room) {
-    MariaDBStatement* stmt;
-    char sql[] = "SELECT banned_avatar_id FROM room_ban WHERE room_id = @room_id";
+    roomStore_->ForEachRoomMember(
+        baseAddress, role, [this, &roomsByDbId, members, &count](uint32_t roomDbId, const StoredAvatar& stored) {
+            auto find_iter = roomsByDbId.find(roomDbId);
+            if (find_iter == std::end(roomsByDbId)) {
+                return;
+            }
 
-    auto result = mariadb_prepare(db_, sql, -1, &stmt, 0);
-    if (result != MARIADB_OK) {
-        throw MariaDBException{result, mariadb_errmsg(db_)};
-    }
+            auto avatar = avatarService_->AdoptStoredAvatar(
+                stored.avatarId, stored.userId, stored.name, stored.address, stored.attributes);
 
-    int roomIdIdx = mariadb_bind_parameter_index(stmt, "@room_id");
-    mariadb_bind_int(stmt, roomIdIdx, room->GetRoomId());
+            (find_iter->second->*members).push_back(avatar);
+            ++count;
+        });
 
-    while (mariadb_step(stmt) == MARIADB_ROW) {
-        uint32_t bannedId = mariadb_column_int(stmt, 0);
-        room->banned_.push_back(avatarService_->GetAvatar(bannedId));
-    }
+    return count;
 }
 
-void ChatRoomService::PersistBanned(uint32_t bannedId, uint32_t roomId) {
-    MariaDBStatement* stmt;
-    char sql[] = "INSERT OR IGNORE INTO room_ban (banned_avatar_id, room_id) VALUES (@banned_avatar_id, @room_id)";
-
-    auto result = mariadb_prepare(db_, sql, -1, &stmt, 0);
-    if (result != MARIADB_OK) {
-        throw MariaDBException{result, mariadb_errmsg(db_)};
-    }
-
-    int bannedAvatarIdIdx = mariadb_bind_parameter_index(stmt, "@moderator_avatar_id");
-    int roomIdIdx = mariadb_bind_parameter_index(stmt, "@room_id");
-
-    mariadb_bind_int(stmt, bannedAvatarIdIdx, bannedId);
-    mariadb_bind_int(stmt, roomIdIdx, roomId);
+void ChatRoomService::DeleteRoom(ChatRoom* room) { roomStore_->DeleteRoom(room->dbId_); }
 
-    result = mariadb_step(stmt);
-    if (result != MARIADB_DONE) {
-        throw MariaDBException{result, mariadb_errmsg(db_)};
-    }
+void ChatRoomService::PersistRoomMember(const ChatRoom* room, RoomRole role, uint32_t avatarId) {
+    roomStore_->InsertRoomMember(room->dbId_, role, avatarId);
 }
 
-void ChatRoomService::DeleteBanned(uint32_t bannedId, uint32_t roomId) {
-    MariaDBStatement* stmt;
-    char sql[] = "DELETE FROM room_ban WHERE banned_avatar_id = @banned_avatar_id AND room_id = @room_id";
-
-    auto result = mariadb_prepare(db_, sql, -1, &stmt, 0);
-    if (result != MARIADB_OK) {
-        throw MariaDBException{result, mariadb_errmsg(db_)};
-    }
-
-    int bannedAvatarIdIdx = mariadb_bind_parameter_index(stmt, "@banned_avatar_id");
-    int roomIdIdx = mariadb_bind_parameter_index(stmt, "@room_id");
-
-    mariadb_bind_int(stmt, bannedAvatarIdIdx, bannedId);
-    mariadb_bind_int(stmt, roomIdIdx, roomId);
-
-    result = mariadb_step(stmt);
-    if (result != MARIADB_DONE) {
-        throw MariaDBException{result, mariadb_errmsg(db_)};
-    }
+void ChatRoomService::DeleteRoomMember(const ChatRoom* room, RoomRole role, uint32_t avatarId) {
+    roomStore_->DeleteRoomMember(room->dbId_, role, avatarId);
 }
@@ -3,21 +3,22 @@
 
 #include "ChatEnums.hpp"
 #include "ChatRoom.hpp"
+#include "ChatStorage.hpp"
 
 #include <boost/optional.hpp>
 
 #include <cstdint>
 #include <memory>
 #include <set>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
-struct MariaDBConnection;
-
 class ChatAvatarService;
 
 class ChatRoomService {
 public:
-    ChatRoomService(ChatAvatarService* avatarService, MariaDBConnection* db);
+    ChatRoomService(ChatAvatarService* avatarService, RoomStore* roomStore);
     ~ChatRoomService();
 
     void LoadRoomsFromStorage(const std::u16string& baseAddress);
@@ -29,6 +30,15 @@ public:
 
     void DestroyRoom(ChatRoom* room);
 
+    /** Adds a room created through another cluster gateway. That gateway has
+     * already stored it if it is persistent, so the mirror is only held in
+     * memory, and RemoveMirroredRoom drops it without touching storage.
+     */
+    ChatRoom* AddMirroredRoom(const ChatAvatar* creator, const std::u16string& roomName,
+        const std::u16string& roomTopic, const std::u16string& roomPassword, uint32_t roomAttributes,
+        uint32_t maxRoomSize, const std::u16string& roomAddress, const std::u16string& srcAddress);
+    void RemoveMirroredRoom(ChatRoom* room);
+
     ChatResultCode PersistNewRoom(ChatRoom& avatar);
 
     std::vector<ChatRoom*> GetRoomSummaries(
@@ -39,21 +49,24 @@ public:
 
     std::vector<ChatRoom*> GetJoinedRooms(const ChatAvatar* avatar);
 
+    /** Adds every avatar a room holds a pointer to (members and role lists).
+     */
+    void CollectReferencedAvatars(std::unordered_set<const ChatAvatar*>& avatars) const;
+
 private:
     friend class ChatRoom;
+    friend class ChatStateSnapshot;
+    using RoomsByDbId = std::unordered_map<int32_t, ChatRoom*>;
+
     void DeleteRoom(ChatRoom* room);
-    void LoadModerators(ChatRoom* room);
-    void PersistModerator(uint32_t moderatorId, uint32_t roomId);
-    void DeleteModerator(uint32_t moderatorId, uint32_t roomId);
-    void LoadAdministrators(ChatRoom* room);
-    void PersistAdministrator(uint32_t administratorId, uint32_t roomId);
-    void DeleteAdministrator(uint32_t administratorId, uint32_t roomId);
-    void LoadBanned(ChatRoom* room);
-    void PersistBanned(uint32_t bannedId, uint32_t roomId);
-    void DeleteBanned(uint32_t bannedId, uint32_t roomId);
+    void LoadRooms(const std::u16string& baseAddress, RoomsByDbId& roomsByDbId);
+    std::size_t LoadRoomMembers(const std::u16string& baseAddress, RoomRole role,
+        const RoomsByDbId& roomsByDbId, std::vector<const ChatAvatar*> ChatRoom::*members);
+    void PersistRoomMember(const ChatRoom* room, RoomRole role, uint32_t avatarId);
+    void DeleteRoomMember(const ChatRoom* room, RoomRole role, uint32_t avatarId);
 
     uint32_t nextRoomId_ = 0;
     std::vector<std::unique_ptr<ChatRoom>> rooms_;
     ChatAvatarService* avatarService_;
-    MariaDBConnection* db_;
+    RoomStore* roomStore_;
 };
@@ -0,0 +1,776 @@
+#include "ChatStateSnapshot.hpp"
+
+#include "ChatAvatar.hpp"
+#include "ChatAvatarService.hpp"
+#include "ChatRoom.hpp"
+#include "ChatRoomService.hpp"
+#include "MariaDB.hpp"
+#include "StringUtils.hpp"
+
+#include "easylogging++.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+struct StringRef {
+    uint32_t offset;
+    uint32_t length;
+};
+
+struct SnapshotHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t createdAt;
+    uint32_t avatarCount;
+    uint32_t contactCount;
+    uint32_t roomCount;
+    uint32_t memberCount;
+    uint32_t stringUnits;
+    uint32_t reserved;
+    uint64_t checksum;
+};
+
+enum AvatarFlags : uint32_t {
+    CONTACTS_DEFERRED = 1 << 0,
+};
+
+struct AvatarRecord {
+    uint32_t avatarId;
+    uint32_t userId;
+    uint32_t attributes;
+    uint32_t flags;
+    StringRef name;
+    StringRef address;
+};
+
+enum class ContactKind : uint32_t { FRIEND = 0, IGNORE = 1 };
+
+struct ContactRecord {
+    uint32_t avatarId;
+    uint32_t contactId;
+    uint32_t kind;
+    StringRef comment;
+};
+
+struct RoomRecord {
+    int32_t dbId;
+    uint32_t creatorId;
+    uint32_t attributes;
+    uint32_t maxRoomSize;
+    uint32_t messageId;
+    uint32_t createTime;
+    uint32_t nodeLevel;
+    StringRef creatorName;
+    StringRef creatorAddress;
+    StringRef roomName;
+    StringRef roomTopic;
+    StringRef roomPassword;
+    StringRef roomPrefix;
+    StringRef roomAddress;
+};
+
+enum class MemberRole : uint32_t { ADMINISTRATOR = 0, MODERATOR, TEMP_MODERATOR, BANNED, INVITED, VOICE, COUNT };
+
+struct MemberRecord {
+    uint32_t roomIndex;
+    uint32_t avatarId;
+    uint32_t role;
+};
+
+static_assert(sizeof(SnapshotHeader) == 48, "snapshot header layout changed");
+static_assert(sizeof(AvatarRecord) == 32, "avatar record layout changed");
+static_assert(sizeof(ContactRecord) == 20, "contact record layout changed");
+static_assert(sizeof(RoomRecord) == 84, "room record layout changed");
+static_assert(sizeof(MemberRecord) == 12, "member record layout changed");
+
+constexpr std::size_t kReconcileBatchSize = 500;
+
+uint64_t Fnv1a(const char* data, std::size_t length) {
+    uint64_t hash = 14695981039346656037ull;
+    for (std::size_t i = 0; i < length; ++i) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+class StringPool {
+public:
+    StringRef Add(const std::u16string& value) {
+        if (value.empty()) {
+            return {0, 0};
+        }
+
+        StringRef ref{static_cast<uint32_t>(units_.size()), static_cast<uint32_t>(value.size())};
+        units_.insert(std::end(units_), std::begin(value), std::end(value));
+        return ref;
+    }
+
+    const std::vector<char16_t>& Units() const { return units_; }
+
+private:
+    std::vector<char16_t> units_;
+};
+
+/** Read-only view of a snapshot file, memory mapped where the platform allows.
+ */
+class SnapshotFile {
+public:
+    explicit SnapshotFile(const std::string& path) {
+#ifndef _WIN32
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0) {
+            void* mapped = mmap(nullptr, static_cast<std::size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped != MAP_FAILED) {
+                data_ = static_cast<const char*>(mapped);
+                size_ = static_cast<std::size_t>(info.st_size);
+                mapped_ = true;
+            }
+        }
+
+        close(fd);
+#else
+        std::ifstream file(path, std::ios::binary);
+        if (file) {
+            buffer_.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+            data_ = buffer_.data();
+            size_ = buffer_.size();
+        }
+#endif
+    }
+
+    ~SnapshotFile() {
+#ifndef _WIN32
+        if (mapped_) {
+            munmap(const_cast<char*>(data_), size_);
+        }
+#endif
+    }
+
+    SnapshotFile(const SnapshotFile&) = delete;
+    SnapshotFile& operator=(const SnapshotFile&) = delete;
+
+    const char* Data() const { return data_; }
+    std::size_t Size() const { return size_; }
+
+private:
+    const char* data_ = nullptr;
+    std::size_t size_ = 0;
+    bool mapped_ = false;
+    std::vector<char> buffer_;
+};
+
+/** Bounds-checked accessors over a validated snapshot image.
+ */
+class SnapshotView {
+public:
+    bool Open(const char* data, std::size_t size, std::string& error) {
+        if (size < sizeof(SnapshotHeader)) {
+            error = "file is smaller than the snapshot header";
+            return false;
+        }
+
+        header_ = reinterpret_cast<const SnapshotHeader*>(data);
+        if (header_->magic != ChatStateSnapshot::kMagic) {
+            error = "bad magic";
+            return false;
+        }
+
+        if (header_->version != ChatStateSnapshot::kVersion || header_->headerSize != sizeof(SnapshotHeader)) {
+            error = "unsupported version " + std::to_string(header_->version);
+            return false;
+        }
+
+        uint64_t expected = sizeof(SnapshotHeader);
+        expected += static_cast<uint64_t>(header_->avatarCount) * sizeof(AvatarRecord);
+        expected += static_cast<uint64_t>(header_->contactCount) * sizeof(ContactRecord);
+        expected += static_cast<uint64_t>(header_->roomCount) * sizeof(RoomRecord);
+        expected += static_cast<uint64_t>(header_->memberCount) * sizeof(MemberRecord);
+        expected += static_cast<uint64_t>(header_->stringUnits) * sizeof(char16_t);
+
+        if (expected != size) {
+            error = "size mismatch";
+            return false;
+        }
+
+        auto payload = data + sizeof(SnapshotHeader);
+        if (Fnv1a(payload, size - sizeof(SnapshotHeader)) != header_->checksum) {
+            error = "checksum mismatch";
+            return false;
+        }
+
+        avatars_ = reinterpret_cast<const AvatarRecord*>(payload);
+        contacts_ = reinterpret_cast<const ContactRecord*>(avatars_ + header_->avatarCount);
+        rooms_ = reinterpret_cast<const RoomRecord*>(contacts_ + header_->contactCount);
+        members_ = reinterpret_cast<const MemberRecord*>(rooms_ + header_->roomCount);
+        strings_ = reinterpret_cast<const char16_t*>(members_ + header_->memberCount);
+
+        return true;
+    }
+
+    const SnapshotHeader& Header() const { return *header_; }
+    const AvatarRecord& Avatar(uint32_t index) const { return avatars_[index]; }
+    const ContactRecord& Contact(uint32_t index) const { return contacts_[index]; }
+    const RoomRecord& Room(uint32_t index) const { return rooms_[index]; }
+    const MemberRecord& Member(uint32_t index) const { return members_[index]; }
+
+    bool IsValid(const StringRef& ref) const {
+        return static_cast<uint64_t>(ref.offset) + ref.length <= header_->stringUnits;
+    }
+
+    std::u16string String(const StringRef& ref) const {
+        return std::u16string{strings_ + ref.offset, ref.length};
+    }
+
+private:
+    const SnapshotHeader* header_ = nullptr;
+    const AvatarRecord* avatars_ = nullptr;
+    const ContactRecord* contacts_ = nullptr;
+    const RoomRecord* rooms_ = nullptr;
+    const MemberRecord* members_ = nullptr;
+    const char16_t* strings_ = nullptr;
+};
+
+template <typename T>
+void AppendRecords(std::vector<char>& out, const std::vector<T>& records) {
+    auto bytes = reinterpret_cast<const char*>(records.data());
+    out.insert(std::end(out), bytes, bytes + records.size() * sizeof(T));
+}
+
+std::string JoinIds(std::vector<uint32_t>::const_iterator begin, std::vector<uint32_t>::const_iterator end) {
+    std::ostringstream ids;
+    for (auto iter = begin; iter != end; ++iter) {
+        if (iter != begin) {
+            ids << ',';
+        }
+        ids << *iter;
+    }
+    return ids.str();
+}
+
+std::u16string ReadTextColumn(MariaDBStatement* stmt, int column) {
+    auto text = reinterpret_cast<const char*>(mariadb_column_text(stmt, column));
+    return text ? ToWideString(text) : std::u16string{};
+}
+
+template <typename RowHandlerT>
+void RunQuery(MariaDBConnection* db, const std::string& sql, RowHandlerT&& onRow) {
+    MariaDBStatement* stmt;
+    auto result = mariadb_prepare(db, sql.c_str(), -1, &stmt, 0);
+    if (result != MARIADB_OK) {
+        throw MariaDBException{result, mariadb_errmsg(db)};
+    }
+
+    mariadb_stream_results(stmt);
+
+    while ((result = mariadb_step(stmt)) == MARIADB_ROW) {
+        onRow(stmt);
+    }
+
+    mariadb_finalize(stmt);
+
+    if (result != MARIADB_DONE) {
+        throw MariaDBException{result, mariadb_errmsg(db)};
+    }
+}
+
+ReconciledContact ReadContactColumns(MariaDBStatement* stmt) {
+    ReconciledContact contact;
+    contact.avatarId = mariadb_column_int(stmt, 1);
+    contact.userId = mariadb_column_int(stmt, 2);
+    contact.name = ReadTextColumn(stmt, 3);
+    contact.address = ReadTextColumn(stmt, 4);
+    contact.attributes = mariadb_column_int(stmt, 5);
+    return contact;
+}
+
+} // namespace
+
+std::vector<const ChatAvatar*> ChatRoom::*ChatStateSnapshot::RoleMembers(uint32_t role) {
+    switch (static_cast<MemberRole>(role)) {
+    case MemberRole::ADMINISTRATOR: return &ChatRoom::administrators_;
+    case MemberRole::MODERATOR: return &ChatRoom::moderators_;
+    case MemberRole::TEMP_MODERATOR: return &ChatRoom::tempModerators_;
+    case MemberRole::BANNED: return &ChatRoom::banned_;
+    case MemberRole::INVITED: return &ChatRoom::invited_;
+    case MemberRole::VOICE: return &ChatRoom::voice_;
+    default: return nullptr;
+    }
+}
+
+std::vector<char> ChatStateSnapshot::Capture(const ChatAvatarService& avatarService, const ChatRoomService& roomService) {
+    StringPool strings;
+    std::vector<AvatarRecord> avatars;
+    std::vector<ContactRecord> contacts;
+    std::vector<RoomRecord> rooms;
+    std::vector<MemberRecord> members;
+
+    avatars.reserve(avatarService.avatarCache_.size());
+
+    for (const auto& avatar : avatarService.avatarCache_) {
+        AvatarRecord record{};
+        record.avatarId = avatar->avatarId_;
+        record.userId = avatar->userId_;
+        record.attributes = avatar->attributes_;
+        record.flags = avatar->contactsLoaded_ ? 0u : static_cast<uint32_t>(CONTACTS_DEFERRED);
+        record.name = strings.Add(avatar->name_);
+        record.address = strings.Add(avatar->GetAddress());
+        avatars.push_back(record);
+
+        for (const auto& contact : avatar->friendList_) {
+            contacts.push_back({avatar->avatarId_, contact.frnd->GetAvatarId(),
+                static_cast<uint32_t>(ContactKind::FRIEND), strings.Add(contact.comment)});
+        }
+
+        for (const auto& contact : avatar->ignoreList_) {
+            contacts.push_back({avatar->avatarId_, contact.ignored->GetAvatarId(),
+                static_cast<uint32_t>(ContactKind::IGNORE), StringRef{0, 0}});
+        }
+    }
+
+    for (const auto& room : roomService.rooms_) {
+        auto roomIndex = static_cast<uint32_t>(rooms.size());
+
+        RoomRecord record{};
+        record.dbId = room->dbId_;
+        record.creatorId = room->creatorId_;
+        record.attributes = room->roomAttributes_;
+        record.maxRoomSize = room->maxRoomSize_;
+        record.messageId = room->roomMessageId_;
+        record.createTime = room->createTime_;
+        record.nodeLevel = room->nodeLevel_;
+        record.creatorName = strings.Add(room->creatorName_);
+        record.creatorAddress = strings.Add(room->GetCreatorAddress());
+        record.roomName = strings.Add(room->roomName_);
+        record.roomTopic = strings.Add(room->roomTopic_);
+        record.roomPassword = strings.Add(room->roomPassword_);
+        record.roomPrefix = strings.Add(room->GetRoomPrefix());
+        record.roomAddress = strings.Add(room->roomAddress_);
+        rooms.push_back(record);
+
+        for (uint32_t role = 0; role < static_cast<uint32_t>(MemberRole::COUNT); ++role) {
+            for (auto member : (*room).*RoleMembers(role)) {
+                members.push_back({roomIndex, member->GetAvatarId(), role});
+            }
+        }
+    }
+
+    SnapshotHeader header{};
+    header.magic = kMagic;
+    header.version = kVersion;
+    header.headerSize = sizeof(SnapshotHeader);
+    header.createdAt = static_cast<uint32_t>(std::time(nullptr));
+    header.avatarCount = static_cast<uint32_t>(avatars.size());
+    header.contactCount = static_cast<uint32_t>(contacts.size());
+    header.roomCount = static_cast<uint32_t>(rooms.size());
+    header.memberCount = static_cast<uint32_t>(members.size());
+    header.stringUnits = static_cast<uint32_t>(strings.Units().size());
+
+    std::vector<char> out(sizeof(SnapshotHeader));
+    AppendRecords(out, avatars);
+    AppendRecords(out, contacts);
+    AppendRecords(out, rooms);
+    AppendRecords(out, members);
+    AppendRecords(out, strings.Units());
+
+    header.checksum = Fnv1a(out.data() + sizeof(SnapshotHeader), out.size() - sizeof(SnapshotHeader));
+    std::memcpy(out.data(), &header, sizeof(SnapshotHeader));
+
+    return out;
+}
+
+bool ChatStateSnapshot::WriteFile(const std::string& path, const std::vector<char>& data) {
+    const auto tmpPath = path + ".tmp";
+
+#ifndef _WIN32
+    int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    const char* next = data.data();
+    std::size_t remaining = data.size();
+    while (remaining > 0) {
+        auto written = ::write(fd, next, remaining);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            close(fd);
+            return false;
+        }
+
+        next += written;
+        remaining -= static_cast<std::size_t>(written);
+    }
+
+    // The contents must reach the disk before the rename does, or a crash can
+    // leave the new name pointing at an empty file.
+    if (fsync(fd) != 0) {
+        close(fd);
+        return false;
+    }
+
+    if (close(fd) != 0) {
+        return false;
+    }
+#else
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            return false;
+        }
+
+        file.write(data.data(), static_cast<std::streamsize>(data.size()));
+        file.flush();
+        if (!file) {
+            return false;
+        }
+    }
+
+    std::remove(path.c_str());
+#endif
+
+    return std::rename(tmpPath.c_str(), path.c_str()) == 0;
+}
+
+bool ChatStateSnapshot::Restore(const std::string& path, ChatAvatarService& avatarService,
+    ChatRoomService& roomService, std::vector<SnapshotContacts>& restoredContacts) {
+    SnapshotFile file{path};
+    if (!file.Data()) {
+        LOG(INFO) << "No state snapshot found at " << path << ", starting cold";
+        return false;
+    }
+
+    SnapshotView view;
+    std::string error;
+    if (!view.Open(file.Data(), file.Size(), error)) {
+        LOG(WARNING) << "Ignoring state snapshot " << path << ": " << error;
+        return false;
+    }
+
+    const auto& header = view.Header();
+
+    // Validate every cross reference before touching the services so that a
+    // damaged file can never leave them half populated.
+    std::unordered_map<uint32_t, uint32_t> avatarIndexById;
+    avatarIndexById.reserve(header.avatarCount);
+    for (uint32_t i = 0; i < header.avatarCount; ++i) {
+        const auto& record = view.Avatar(i);
+        if (!view.IsValid(record.name) || !view.IsValid(record.address)
+            || !avatarIndexById.emplace(record.avatarId, i).second) {
+            LOG(WARNING) << "Ignoring state snapshot " << path << ": invalid avatar record " << i;
+            return false;
+        }
+    }
+
+    for (uint32_t i = 0; i < header.contactCount; ++i) {
+        const auto& record = view.Contact(i);
+        if (!view.IsValid(record.comment) || record.kind > static_cast<uint32_t>(ContactKind::IGNORE)
+            || avatarIndexById.count(record.avatarId) == 0 || avatarIndexById.count(record.contactId) == 0) {
+            LOG(WARNING) << "Ignoring state snapshot " << path << ": invalid contact record " << i;
+            return false;
+        }
+    }
+
+    for (uint32_t i = 0; i < header.roomCount; ++i) {
+        const auto& record = view.Room(i);
+        if (!view.IsValid(record.creatorName) || !view.IsValid(record.creatorAddress) || !view.IsValid(record.roomName)
+            || !view.IsValid(record.roomTopic) || !view.IsValid(record.roomPassword) || !view.IsValid(record.roomPrefix)
+            || !view.IsValid(record.roomAddress)) {
+            LOG(WARNING) << "Ignoring state snapshot " << path << ": invalid room record " << i;
+            return false;
+        }
+    }
+
+    for (uint32_t i = 0; i < header.memberCount; ++i) {
+        const auto& record = view.Member(i);
+        if (record.roomIndex >= header.roomCount || record.role >= static_cast<uint32_t>(MemberRole::COUNT)
+            || avatarIndexById.count(record.avatarId) == 0) {
+            LOG(WARNING) << "Ignoring state snapshot " << path << ": invalid room member record " << i;
+            return false;
+        }
+    }
+
+    std::vector<ChatAvatar*> avatars(header.avatarCount);
+    restoredContacts.clear();
+    restoredContacts.resize(header.avatarCount);
+
+    for (uint32_t i = 0; i < header.avatarCount; ++i) {
+        const auto& record = view.Avatar(i);
+        avatars[i] = avatarService.AdoptStoredAvatar(record.avatarId, record.userId, view.String(record.name),
+            view.String(record.address), record.attributes);
+        avatars[i]->contactsLoaded_ = (record.flags & CONTACTS_DEFERRED) == 0;
+
+        restoredContacts[i].avatarId = record.avatarId;
+        restoredContacts[i].contactsLoaded = avatars[i]->contactsLoaded_;
+    }
+
+    for (uint32_t i = 0; i < header.contactCount; ++i) {
+        const auto& record = view.Contact(i);
+        auto ownerIndex = avatarIndexById[record.avatarId];
+        auto owner = avatars[ownerIndex];
+        auto contact = avatars[avatarIndexById[record.contactId]];
+
+        if (record.kind == static_cast<uint32_t>(ContactKind::FRIEND)) {
+            owner->friendList_.emplace_back(contact, view.String(record.comment));
+            restoredContacts[ownerIndex].friends.push_back(record.contactId);
+        } else {
+            owner->ignoreList_.emplace_back(contact);
+            restoredContacts[ownerIndex].ignores.push_back(record.contactId);
+        }
+    }
+
+    std::vector<ChatRoom*> rooms(header.roomCount);
+    std::unordered_set<std::u16string> roomAddresses;
+
+    for (uint32_t i = 0; i < header.roomCount; ++i) {
+        const auto& record = view.Room(i);
+        auto room = std::make_unique<ChatRoom>();
+        room->roomService_ = &roomService;
+        room->roomId_ = roomService.nextRoomId_++;
+        room->dbId_ = record.dbId;
+        room->creatorId_ = record.creatorId;
+        room->roomAttributes_ = record.attributes;
+        room->maxRoomSize_ = record.maxRoomSize;
+        room->roomMessageId_ = record.messageId;
+        room->createTime_ = record.createTime;
+        room->nodeLevel_ = record.nodeLevel;
+        room->creatorName_ = view.String(record.creatorName);
+        room->creatorAddressId_ = InternAddress(view.String(record.creatorAddress));
+        room->roomName_ = view.String(record.roomName);
+        room->roomTopic_ = view.String(record.roomTopic);
+        room->roomPassword_ = view.String(record.roomPassword);
+        room->roomPrefixId_ = InternAddress(view.String(record.roomPrefix));
+        room->roomAddress_ = view.String(record.roomAddress);
+
+        if (roomAddresses.insert(room->roomAddress_).second) {
+            rooms[i] = room.get();
+            roomService.rooms_.emplace_back(std::move(room));
+        }
+    }
+
+    for (uint32_t i = 0; i < header.memberCount; ++i) {
+        const auto& record = view.Member(i);
+        if (auto room = rooms[record.roomIndex]) {
+            auto members = RoleMembers(record.role);
+            (room->*members).push_back(avatars[avatarIndexById[record.avatarId]]);
+        }
+    }
+
+    LOG(INFO) << "Restored state snapshot " << path << " - avatars: " << header.avatarCount
+              << ", contacts: " << header.contactCount << ", rooms: " << roomService.rooms_.size()
+              << ", age: " << (static_cast<int64_t>(std::time(nullptr)) - header.createdAt) << "s";
+
+    return true;
+}
+
+void ChatStateSnapshot::ApplyReconciliation(const ReconciledAvatar& reconciled, ChatAvatarService& avatarService) {
+    auto avatar = avatarService.GetCachedAvatar(reconciled.avatarId);
+    if (!avatar) {
+        return;
+    }
+
+    if (!reconciled.exists) {
+        // The avatar was deleted while the gateway was down; drop it from the
+        // in-memory contact lists and the lookups, so the next login for its
+        // name goes to storage. Rooms may still point at it, so the cache
+        // entry itself is kept until eviction finds it unreferenced.
+        avatarService.UnindexAvatar(avatar);
+
+        for (auto& cachedAvatar : avatarService.avatarCache_) {
+            auto& friends = cachedAvatar->friendList_;
+            friends.erase(std::remove_if(std::begin(friends), std::end(friends),
+                              [avatar](const auto& contact) { return contact.frnd == avatar; }),
+                std::end(friends));
+
+            auto& ignores = cachedAvatar->ignoreList_;
+            ignores.erase(std::remove_if(std::begin(ignores), std::end(ignores),
+                              [avatar](const auto& contact) { return contact.ignored == avatar; }),
+                std::end(ignores));
+        }
+
+        return;
+    }
+
+    // Sessions that logged in since the restore own these values now.
+    if (!avatar->isOnline_) {
+        avatar->userId_ = reconciled.userId;
+        avatar->attributes_ = reconciled.attributes;
+    }
+
+    if (!reconciled.contactsChecked) {
+        return;
+    }
+
+    avatarService.MarkFootprintStale(avatar);
+
+    for (auto removedId : reconciled.removedFriends) {
+        auto& friends = avatar->friendList_;
+        friends.erase(std::remove_if(std::begin(friends), std::end(friends),
+                          [removedId](const auto& contact) { return contact.frnd->GetAvatarId() == removedId; }),
+            std::end(friends));
+    }
+
+    for (auto removedId : reconciled.removedIgnores) {
+        auto& ignores = avatar->ignoreList_;
+        ignores.erase(std::remove_if(std::begin(ignores), std::end(ignores),
+                          [removedId](const auto& contact) { return contact.ignored->GetAvatarId() == removedId; }),
+            std::end(ignores));
+    }
+
+    for (const auto& added : reconciled.addedFriends) {
+        auto contact = avatarService.AdoptStoredAvatar(added.avatarId, added.userId, added.name, added.address, added.attributes);
+        if (!avatar->IsFriend(contact)) {
+            avatar->friendList_.emplace_back(contact, added.comment);
+        }
+    }
+
+    for (const auto& added : reconciled.addedIgnores) {
+        auto contact = avatarService.AdoptStoredAvatar(added.avatarId, added.userId, added.name, added.address, added.attributes);
+        if (!avatar->IsIgnored(contact)) {
+            avatar->ignoreList_.emplace_back(contact);
+        }
+    }
+}
+
+SnapshotReconciler::SnapshotReconciler(const std::string& connectionString, std::vector<SnapshotContacts> restored)
+    : restored_{std::move(restored)} {
+    thread_ = std::thread{&SnapshotReconciler::Run, this, connectionString};
+}
+
+SnapshotReconciler::~SnapshotReconciler() {
+    stopRequested_ = true;
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void SnapshotReconciler::TakeResults(std::vector<ReconciledAvatar>& results) {
+    std::lock_guard<std::mutex> lock(pendingMutex_);
+    results.swap(pending_);
+    pending_.clear();
+}
+
+void SnapshotReconciler::Run(std::string connectionString) {
+    MariaDBConnection* db = nullptr;
+    if (mariadb_open(connectionString.c_str(), &db) != MARIADB_OK) {
+        LOG(ERROR) << "Snapshot reconciliation could not open the database: " << mariadb_errmsg(db);
+        finished_ = true;
+        return;
+    }
+
+    std::size_t reconciledCount = 0;
+
+    try {
+        for (std::size_t batchStart = 0; batchStart < restored_.size() && !stopRequested_;
+             batchStart += kReconcileBatchSize) {
+            auto batchEnd = std::min(batchStart + kReconcileBatchSize, restored_.size());
+
+            std::vector<uint32_t> ids;
+            std::unordered_map<uint32_t, ReconciledAvatar> batch;
+            for (auto i = batchStart; i < batchEnd; ++i) {
+                ids.push_back(restored_[i].avatarId);
+                auto& reconciled = batch[restored_[i].avatarId];
+                reconciled.avatarId = restored_[i].avatarId;
+                reconciled.contactsChecked = restored_[i].contactsLoaded;
+            }
+
+            auto idList = JoinIds(std::begin(ids), std::end(ids));
+
+            RunQuery(db, "SELECT id, user_id, attributes FROM avatar WHERE id IN (" + idList + ")",
+                [&batch](MariaDBStatement* stmt) {
+                    auto& reconciled = batch[mariadb_column_int(stmt, 0)];
+                    reconciled.exists = true;
+                    reconciled.userId = mariadb_column_int(stmt, 1);
+                    reconciled.attributes = mariadb_column_int(stmt, 2);
+                });
+
+            std::unordered_map<uint32_t, std::vector<ReconciledContact>> storedFriends;
+            RunQuery(db,
+                "SELECT f.avatar_id, a.id, a.user_id, a.name, a.address, a.attributes, f.comment FROM friend f "
+                "JOIN avatar a ON a.id = f.friend_avatar_id WHERE f.avatar_id IN (" + idList + ")",
+                [&storedFriends](MariaDBStatement* stmt) {
+                    auto contact = ReadContactColumns(stmt);
+                    contact.comment = ReadTextColumn(stmt, 6);
+                    storedFriends[mariadb_column_int(stmt, 0)].push_back(std::move(contact));
+                });
+
+            std::unordered_map<uint32_t, std::vector<ReconciledContact>> storedIgnores;
+            RunQuery(db,
+                "SELECT i.avatar_id, a.id, a.user_id, a.name, a.address, a.attributes FROM `ignore` i "
+                "JOIN avatar a ON a.id = i.ignore_avatar_id WHERE i.avatar_id IN (" + idList + ")",
+                [&storedIgnores](MariaDBStatement* stmt) {
+                    storedIgnores[mariadb_column_int(stmt, 0)].push_back(ReadContactColumns(stmt));
+                });
+
+            std::vector<ReconciledAvatar> results;
+            for (auto i = batchStart; i < batchEnd; ++i) {
+                const auto& snapshot = restored_[i];
+                auto& reconciled = batch[snapshot.avatarId];
+
+                if (reconciled.exists && reconciled.contactsChecked) {
+                    auto diff = [](const std::vector<uint32_t>& snapshotIds, const std::vector<ReconciledContact>& stored,
+                                    std::vector<ReconciledContact>& added, std::vector<uint32_t>& removed) {
+                        std::unordered_set<uint32_t> storedIds;
+                        for (const auto& contact : stored) {
+                            storedIds.insert(contact.avatarId);
+                            if (std::find(std::begin(snapshotIds), std::end(snapshotIds), contact.avatarId)
+                                == std::end(snapshotIds)) {
+                                added.push_back(contact);
+                            }
+                        }
+
+                        for (auto id : snapshotIds) {
+                            if (storedIds.count(id) == 0) {
+                                removed.push_back(id);
+                            }
+                        }
+                    };
+
+                    diff(snapshot.friends, storedFriends[snapshot.avatarId], reconciled.addedFriends,
+                        reconciled.removedFriends);
+                    diff(snapshot.ignores, storedIgnores[snapshot.avatarId], reconciled.addedIgnores,
+                        reconciled.removedIgnores);
+                }
+
+                results.push_back(std::move(reconciled));
+            }
+
+            reconciledCount += results.size();
+
+            std::lock_guard<std::mutex> lock(pendingMutex_);
+            std::move(std::begin(results), std::end(results), std::back_inserter(pending_));
+        }
+    } catch (const MariaDBException& e) {
+        LOG(ERROR) << "Snapshot reconciliation failed: [" << e.code << "] " << e.message;
+    }
+
+    mariadb_close(db);
+
+    LOG(INFO) << "Snapshot reconciliation read " << reconciledCount << " of " << restored_.size() << " avatars";
+    finished_ = true;
+}
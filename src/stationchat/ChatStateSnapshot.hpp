@@ -0,0 +1,103 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class ChatAvatar;
+class ChatAvatarService;
+class ChatRoom;
+class ChatRoomService;
+
+/** Contact lists of a restored avatar as they were recorded in the snapshot,
+ * used as the baseline when reconciling against the database.
+ */
+struct SnapshotContacts {
+    uint32_t avatarId = 0;
+    bool contactsLoaded = false;
+    std::vector<uint32_t> friends;
+    std::vector<uint32_t> ignores;
+};
+
+struct ReconciledContact {
+    uint32_t avatarId = 0;
+    uint32_t userId = 0;
+    uint32_t attributes = 0;
+    std::u16string name;
+    std::u16string address;
+    std::u16string comment;
+};
+
+/** Difference between the snapshot and the database for a single avatar.
+ */
+struct ReconciledAvatar {
+    uint32_t avatarId = 0;
+    bool exists = false;
+    uint32_t userId = 0;
+    uint32_t attributes = 0;
+    bool contactsChecked = false;
+    std::vector<ReconciledContact> addedFriends;
+    std::vector<uint32_t> removedFriends;
+    std::vector<ReconciledContact> addedIgnores;
+    std::vector<uint32_t> removedIgnores;
+};
+
+/** Compact binary image of the avatar cache, the friend/ignore graph and the
+ * room directory used to warm a gateway after a restart.
+ *
+ * The file is a fixed header followed by arrays of fixed-size records and a
+ * trailing UTF-16 string pool referenced by offset, so it can be validated and
+ * read in place from a memory mapping. The header carries a format version and
+ * an FNV-1a checksum of everything after it.
+ */
+class ChatStateSnapshot {
+public:
+    static constexpr uint32_t kMagic = 0x4E534353; // "SCSN"
+    static constexpr uint32_t kVersion = 1;
+
+    static std::vector<char> Capture(const ChatAvatarService& avatarService, const ChatRoomService& roomService);
+
+    /** Writes to a temporary file next to path and renames it into place so a
+     * crash mid-write never leaves a truncated snapshot behind.
+     */
+    static bool WriteFile(const std::string& path, const std::vector<char>& data);
+
+    /** Loads a snapshot into empty services. Returns false and leaves the
+     * services untouched when the file is missing, from another version or
+     * fails validation.
+     */
+    static bool Restore(const std::string& path, ChatAvatarService& avatarService,
+        ChatRoomService& roomService, std::vector<SnapshotContacts>& restoredContacts);
+
+    static void ApplyReconciliation(const ReconciledAvatar& reconciled, ChatAvatarService& avatarService);
+
+private:
+    static std::vector<const ChatAvatar*> ChatRoom::*RoleMembers(uint32_t role);
+};
+
+/** Re-reads restored avatars from the database on a background thread with its
+ * own connection. Results are diffs against the snapshot and are picked up and
+ * applied on the gateway thread, so changes made by live requests after the
+ * restore are preserved.
+ */
+class SnapshotReconciler {
+public:
+    SnapshotReconciler(const std::string& connectionString, std::vector<SnapshotContacts> restored);
+    ~SnapshotReconciler();
+
+    void TakeResults(std::vector<ReconciledAvatar>& results);
+    bool IsFinished() const { return finished_; }
+
+private:
+    void Run(std::string connectionString);
+
+    std::vector<SnapshotContacts> restored_;
+    std::vector<ReconciledAvatar> pending_;
+    std::mutex pendingMutex_;
+    std::atomic<bool> stopRequested_{false};
+    std::atomic<bool> finished_{false};
+    std::thread thread_;
+};
@@ -0,0 +1,176 @@
+#pragma once
+
+#include "PersistentMessage.hpp"
+
+#include <boost/optional.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct StoredAvatar {
+    uint32_t avatarId = 0;
+    uint32_t userId = 0;
+    std::u16string name;
+    std::u16string address;
+    uint32_t attributes = 0;
+};
+
+/** An avatar's contact lists, as read for it by a bulk query.
+ */
+struct StoredContacts {
+    std::vector<std::pair<StoredAvatar, std::u16string>> friends;
+    std::vector<StoredAvatar> ignores;
+};
+
+struct StoredRoom {
+    uint32_t dbId = 0;
+    uint32_t creatorId = 0;
+    std::u16string creatorName;
+    std::u16string creatorAddress;
+    std::u16string roomName;
+    std::u16string roomTopic;
+    std::u16string roomPassword;
+    std::u16string roomPrefix;
+    std::u16string roomAddress;
+    uint32_t roomAttributes = 0;
+    uint32_t maxRoomSize = 0;
+    uint32_t roomMessageId = 0;
+    uint32_t createTime = 0;
+    uint32_t nodeLevel = 0;
+};
+
+enum class RoomRole { MODERATOR, ADMINISTRATOR, BANNED, INVITED };
+
+struct AvatarKey {
+    std::u16string name;
+    std::u16string address;
+};
+
+/** Storage interfaces used by the chat services, one per domain. A storage
+ * object is only used by one thread, either the gateway thread or a database
+ * worker with a connection of its own; failures are reported by throwing.
+ */
+class AvatarStore {
+public:
+    virtual ~AvatarStore() = default;
+
+    virtual boost::optional<StoredAvatar> FindAvatar(const std::u16string& name, const std::u16string& address) = 0;
+    virtual boost::optional<StoredAvatar> FindAvatar(uint32_t avatarId) = 0;
+
+    /** Looks up many avatars at once; the result lines up with keys. Backends
+     * that can answer this in one query override it.
+     */
+    virtual std::vector<boost::optional<StoredAvatar>> FindAvatars(const std::vector<AvatarKey>& keys) {
+        std::vector<boost::optional<StoredAvatar>> avatars;
+        for (const auto& key : keys) {
+            avatars.push_back(FindAvatar(key.name, key.address));
+        }
+
+        return avatars;
+    }
+
+    /** Stores a new avatar and returns the id assigned to it.
+     */
+    virtual uint32_t InsertAvatar(const StoredAvatar& avatar) = 0;
+
+    /** Stores many new avatars at once; the ids returned line up with the
+     * avatars. Backends that can write these in one statement override it.
+     */
+    virtual std::vector<uint32_t> InsertAvatars(const std::vector<StoredAvatar>& avatars) {
+        std::vector<uint32_t> avatarIds;
+        for (const auto& avatar : avatars) {
+            avatarIds.push_back(InsertAvatar(avatar));
+        }
+
+        return avatarIds;
+    }
+
+    virtual void UpdateAvatar(const StoredAvatar& avatar) = 0;
+    virtual void DeleteAvatar(uint32_t avatarId) = 0;
+};
+
+class ContactStore {
+public:
+    using FriendVisitor = std::function<void(const StoredAvatar& avatar, const std::u16string& comment)>;
+    using IgnoreVisitor = std::function<void(const StoredAvatar& avatar)>;
+    using OwnedFriendVisitor
+        = std::function<void(uint32_t ownerId, const StoredAvatar& avatar, const std::u16string& comment)>;
+    using OwnedIgnoreVisitor = std::function<void(uint32_t ownerId, const StoredAvatar& avatar)>;
+
+    virtual ~ContactStore() = default;
+
+    virtual void ForEachFriend(uint32_t avatarId, const FriendVisitor& visitor) = 0;
+    virtual void ForEachIgnore(uint32_t avatarId, const IgnoreVisitor& visitor) = 0;
+
+    /** Visit the contacts of several avatars at once, along with the avatar
+     * each contact belongs to. Backends that can answer these in one query
+     * override them.
+     */
+    virtual void ForEachFriendOf(const std::vector<uint32_t>& avatarIds, const OwnedFriendVisitor& visitor) {
+        for (auto avatarId : avatarIds) {
+            ForEachFriend(avatarId, [avatarId, &visitor](const StoredAvatar& avatar, const std::u16string& comment) {
+                visitor(avatarId, avatar, comment);
+            });
+        }
+    }
+
+    virtual void ForEachIgnoreOf(const std::vector<uint32_t>& avatarIds, const OwnedIgnoreVisitor& visitor) {
+        for (auto avatarId : avatarIds) {
+            ForEachIgnore(avatarId, [avatarId, &visitor](const StoredAvatar& avatar) { visitor(avatarId, avatar); });
+        }
+    }
+
+    virtual void InsertFriend(uint32_t avatarId, uint32_t friendId, const std::u16string& comment) = 0;
+    virtual void UpdateFriendComment(uint32_t avatarId, uint32_t friendId, const std::u16string& comment) = 0;
+    virtual void DeleteFriend(uint32_t avatarId, uint32_t friendId) = 0;
+
+    virtual void InsertIgnore(uint32_t avatarId, uint32_t ignoreId) = 0;
+    virtual void DeleteIgnore(uint32_t avatarId, uint32_t ignoreId) = 0;
+};
+
+class RoomStore {
+public:
+    using RoomVisitor = std::function<void(const StoredRoom& room)>;
+    using MemberVisitor = std::function<void(uint32_t roomDbId, const StoredAvatar& avatar)>;
+
+    virtual ~RoomStore() = default;
+
+    /** Visits every room whose address starts with baseAddress.
+     */
+    virtual void ForEachRoom(const std::u16string& baseAddress, const RoomVisitor& visitor) = 0;
+    virtual void ForEachRoomMember(
+        const std::u16string& baseAddress, RoomRole role, const MemberVisitor& visitor) = 0;
+
+    /** Stores a new room and returns the id assigned to it.
+     */
+    virtual uint32_t InsertRoom(const StoredRoom& room) = 0;
+    virtual void DeleteRoom(uint32_t roomDbId) = 0;
+
+    virtual void InsertRoomMember(uint32_t roomId, RoomRole role, uint32_t avatarId) = 0;
+    virtual void DeleteRoomMember(uint32_t roomId, RoomRole role, uint32_t avatarId) = 0;
+};
+
+class MailStore {
+public:
+    virtual ~MailStore() = default;
+
+    /** Stores a new message and returns the id assigned to it.
+     */
+    virtual uint32_t InsertMessage(const PersistentMessage& message) = 0;
+
+    /** Headers of the avatar's messages that are new, unread or read.
+     */
+    virtual std::vector<PersistentHeader> GetMessageHeaders(uint32_t avatarId) = 0;
+    virtual boost::optional<PersistentMessage> LoadMessage(uint32_t avatarId, uint32_t messageId) = 0;
+
+    virtual void UpdateMessageStatus(uint32_t avatarId, uint32_t messageId, PersistentState status) = 0;
+    virtual void BulkUpdateMessageStatus(
+        uint32_t avatarId, const std::u16string& category, PersistentState status) = 0;
+};
+
+/** A storage backend; see MariaDBChatStorage and InMemoryChatStorage.
+ */
+class ChatStorage : public AvatarStore, public ContactStore, public RoomStore, public MailStore {};
@@ -0,0 +1,806 @@
+#include "ClusterReplicator.hpp"
+
+#include "ChatAvatar.hpp"
+#include "ChatAvatarService.hpp"
+#include "ChatRoom.hpp"
+#include "ChatRoomService.hpp"
+#include "ChatStorage.hpp"
+#include "DatabaseExecutor.hpp"
+#include "GatewayNode.hpp"
+#include "Message.hpp"
+#include "Metrics.hpp"
+#include "Serialization.hpp"
+#include "StationChatConfig.hpp"
+#include "StringUtils.hpp"
+
+#include "easylogging++.h"
+
+#include <boost/asio.hpp>
+
+#include <algorithm>
+#include <array>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+constexpr uint32_t kReplicationMagic = 0x53524550; // "SREP"
+constexpr uint16_t kReplicationVersion = 1;
+
+// Keeps a batch inside one unfragmented datagram on common networks; an event
+// larger than this is sent in a batch of its own.
+constexpr std::size_t kMaxBatchBytes = 1200;
+constexpr std::size_t kBatchHeaderBytes = sizeof(uint32_t) + sizeof(uint16_t) + 2 * sizeof(uint64_t) + sizeof(uint16_t);
+
+constexpr std::chrono::milliseconds kGapTimeout{500};
+constexpr std::size_t kMaxPendingBatches = 256;
+
+// Events held back behind an avatar lookup; past this, received events are
+// dropped like a lost batch.
+constexpr std::size_t kMaxWaitingEvents = 4096;
+
+// Datagrams read in one tick; the rest wait in the socket buffer, so a flood
+// cannot keep the tick from returning.
+constexpr std::size_t kMaxDatagramsPerTick = 256;
+
+struct ReplicationMetrics {
+    MetricCounter& eventsSent = GetMetricsRegistry().Counter(
+        "stationchat_replication_events_sent_total", "Events sent to other cluster gateways");
+    MetricCounter& batchesSent = GetMetricsRegistry().Counter(
+        "stationchat_replication_batches_sent_total", "Event batches sent to each cluster gateway");
+    MetricCounter& eventsApplied = GetMetricsRegistry().Counter(
+        "stationchat_replication_events_applied_total", "Events received from other cluster gateways and applied");
+    MetricCounter& batchesSkipped = GetMetricsRegistry().Counter(
+        "stationchat_replication_batches_skipped_total", "Batches from other cluster gateways that never arrived");
+    MetricCounter& datagramsRejected = GetMetricsRegistry().Counter(
+        "stationchat_replication_datagrams_rejected_total", "Datagrams dropped for not coming from a cluster gateway");
+};
+
+ReplicationMetrics& GetReplicationMetrics() {
+    static ReplicationMetrics metrics;
+    return metrics;
+}
+
+template <typename StreamT>
+void WriteHeader(StreamT& stream, uint64_t origin, uint64_t sequence, uint16_t eventCount) {
+    write(stream, kReplicationMagic);
+    write(stream, kReplicationVersion);
+    write(stream, origin);
+    write(stream, sequence);
+    write(stream, eventCount);
+}
+
+std::string EncodeEvent(const ReplicationEvent& event) {
+    std::ostringstream stream;
+    write(stream, event.type);
+    write(stream, event.avatarName);
+    write(stream, event.avatarAddress);
+
+    switch (event.type) {
+    case ReplicationEventType::AVATAR_LOGIN:
+        write(stream, event.userId);
+        write(stream, event.avatarAttributes);
+        write(stream, event.loginLocation);
+        break;
+    case ReplicationEventType::AVATAR_LOGOUT:
+        break;
+    case ReplicationEventType::ROOM_CREATE:
+        write(stream, event.roomAddress);
+        write(stream, event.roomName);
+        write(stream, event.roomTopic);
+        write(stream, event.roomPassword);
+        write(stream, event.roomAttributes);
+        write(stream, event.maxRoomSize);
+        break;
+    case ReplicationEventType::ROOM_DESTROY:
+    case ReplicationEventType::ROOM_ENTER:
+    case ReplicationEventType::ROOM_LEAVE:
+        write(stream, event.roomAddress);
+        break;
+    case ReplicationEventType::ROOM_MESSAGE:
+        write(stream, event.roomAddress);
+        write(stream, event.message);
+        write(stream, event.oob);
+        break;
+    }
+
+    return stream.str();
+}
+
+// Datagrams come off the network, so a string length is checked against what
+// is left of the datagram before anything is allocated for it.
+template <typename StreamT>
+void ReadText(StreamT& stream, std::u16string& value) {
+    uint32_t length = 0;
+    read(stream, length);
+
+    auto available = std::max<std::streamsize>(stream.rdbuf()->in_avail(), 0);
+    if (!stream || static_cast<uint64_t>(available) < uint64_t{length} * sizeof(uint16_t)) {
+        stream.setstate(std::ios::failbit);
+        return;
+    }
+
+    value.resize(length);
+    for (auto& character : value) {
+        uint16_t tmp = 0;
+        read(stream, tmp);
+        character = tmp;
+    }
+}
+
+template <typename StreamT>
+bool ReadEvent(StreamT& stream, ReplicationEvent& event) {
+    read(stream, event.type);
+    ReadText(stream, event.avatarName);
+    ReadText(stream, event.avatarAddress);
+
+    switch (event.type) {
+    case ReplicationEventType::AVATAR_LOGIN:
+        read(stream, event.userId);
+        read(stream, event.avatarAttributes);
+        ReadText(stream, event.loginLocation);
+        break;
+    case ReplicationEventType::AVATAR_LOGOUT:
+        break;
+    case ReplicationEventType::ROOM_CREATE:
+        ReadText(stream, event.roomAddress);
+        ReadText(stream, event.roomName);
+        ReadText(stream, event.roomTopic);
+        ReadText(stream, event.roomPassword);
+        read(stream, event.roomAttributes);
+        read(stream, event.maxRoomSize);
+        break;
+    case ReplicationEventType::ROOM_DESTROY:
+    case ReplicationEventType::ROOM_ENTER:
+    case ReplicationEventType::ROOM_LEAVE:
+        ReadText(stream, event.roomAddress);
+        break;
+    case ReplicationEventType::ROOM_MESSAGE:
+        ReadText(stream, event.roomAddress);
+        ReadText(stream, event.message);
+        ReadText(stream, event.oob);
+        break;
+    default:
+        return false;
+    }
+
+    return static_cast<bool>(stream);
+}
+
+uint64_t DrawOrigin() {
+    std::random_device device;
+    return (static_cast<uint64_t>(device()) << 32) | device();
+}
+
+} // namespace
+
+std::string EncodeReplicationBatch(const ReplicationBatch& batch) {
+    std::ostringstream stream;
+    WriteHeader(stream, batch.origin, batch.sequence, static_cast<uint16_t>(batch.events.size()));
+    for (const auto& event : batch.events) {
+        stream << EncodeEvent(event);
+    }
+
+    return stream.str();
+}
+
+bool DecodeReplicationBatch(const char* data, std::size_t length, ReplicationBatch& batch) {
+    std::istringstream stream{std::string{data, length}};
+
+    uint32_t magic = 0;
+    uint16_t version = 0;
+    read(stream, magic);
+    read(stream, version);
+
+    if (!stream || magic != kReplicationMagic || version != kReplicationVersion) {
+        return false;
+    }
+
+    ReplicationBatch decoded;
+    uint16_t eventCount = 0;
+    read(stream, decoded.origin);
+    read(stream, decoded.sequence);
+    read(stream, eventCount);
+
+    if (!stream) {
+        return false;
+    }
+
+    decoded.events.resize(eventCount);
+    for (auto& event : decoded.events) {
+        if (!ReadEvent(stream, event)) {
+            return false;
+        }
+    }
+
+    batch = std::move(decoded);
+    return true;
+}
+
+ReplicationSequencer::ReplicationSequencer(std::chrono::milliseconds gapTimeout, std::size_t maxPending)
+    : gapTimeout_{gapTimeout}
+    , maxPending_{maxPending} {}
+
+void ReplicationSequencer::Receive(ReplicationBatch batch, Clock::time_point now, const Visitor& visitor) {
+    auto inserted = origins_.emplace(batch.origin, OriginState{});
+    auto& state = inserted.first->second;
+    if (inserted.second) {
+        state.next = batch.sequence;
+    }
+
+    if (batch.sequence < state.next || state.pending.count(batch.sequence) != 0) {
+        ++dropped_;
+        return;
+    }
+
+    if (batch.sequence > state.next) {
+        if (state.pending.empty()) {
+            state.gapSince = now;
+        }
+
+        state.pending.emplace(batch.sequence, std::move(batch));
+        if (state.pending.size() > maxPending_) {
+            SkipGap(state, now, visitor);
+        }
+
+        return;
+    }
+
+    ++state.next;
+    visitor(batch);
+    Drain(state, now, visitor);
+}
+
+void ReplicationSequencer::Expire(Clock::time_point now, const Visitor& visitor) {
+    for (auto& entry : origins_) {
+        auto& state = entry.second;
+        if (!state.pending.empty() && now - state.gapSince >= gapTimeout_) {
+            SkipGap(state, now, visitor);
+        }
+    }
+}
+
+void ReplicationSequencer::Drain(OriginState& state, Clock::time_point now, const Visitor& visitor) {
+    while (!state.pending.empty() && state.pending.begin()->first == state.next) {
+        auto batch = std::move(state.pending.begin()->second);
+        state.pending.erase(state.pending.begin());
+        ++state.next;
+        visitor(batch);
+    }
+
+    // Whatever still waits is behind a gap, timed from the last progress.
+    if (!state.pending.empty()) {
+        state.gapSince = now;
+    }
+}
+
+void ReplicationSequencer::SkipGap(OriginState& state, Clock::time_point now, const Visitor& visitor) {
+    auto resumeAt = state.pending.begin()->first;
+    LOG(WARNING) << "Skipping " << (resumeAt - state.next) << " replication batches that never arrived";
+
+    skipped_ += resumeAt - state.next;
+    state.next = resumeAt;
+    Drain(state, now, visitor);
+}
+
+struct ClusterReplicator::Impl {
+    Impl(const std::string& address, uint16_t port)
+        : socket{ioContext, boost::asio::ip::udp::endpoint{boost::asio::ip::make_address(address), port}} {
+        socket.non_blocking(true);
+    }
+
+    boost::asio::io_context ioContext;
+    boost::asio::ip::udp::socket socket;
+    std::vector<boost::asio::ip::udp::endpoint> peers;
+    std::array<char, 65536> buffer;
+    ReplicationSequencer sequencer{kGapTimeout, kMaxPendingBatches};
+    std::vector<std::string> queued;
+    uint64_t origin = DrawOrigin();
+    uint64_t nextSequence = 0;
+};
+
+ClusterReplicator::ClusterReplicator(GatewayNode* node, const StationChatConfig& config)
+    : node_{node}
+    , address_{config.gatewayAddress}
+    , port_{config.gatewayPort}
+    , portOffset_{config.gatewayReplicationPortOffset} {
+    if (portOffset_ == 0) {
+        return;
+    }
+
+    // Only cluster gateways send here, so the port is not opened on any
+    // other interface.
+    auto bindAddress = config.gatewayAddress;
+    for (const auto& endpoint : config.gatewayCluster) {
+        if (endpoint.Matches(address_, port_)) {
+            bindAddress = endpoint.GetHostAddress();
+        }
+    }
+
+    impl_ = std::make_unique<Impl>(bindAddress, ReplicationPort(port_));
+    SetCluster(config.gatewayCluster);
+}
+
+void ClusterReplicator::SetCluster(const std::vector<GatewayClusterEndpoint>& cluster) {
+    if (!impl_) {
+        return;
+    }
+
+    std::vector<boost::asio::ip::udp::endpoint> peers;
+    auto protocol = impl_->socket.local_endpoint().protocol();
+
+    // Names were resolved with the configuration, so this never blocks and
+    // throws before any peer changes.
+    for (const auto& endpoint : cluster) {
+        if (endpoint.Matches(address_, port_)) {
+            continue;
+        }
+
+        auto port = ReplicationPort(endpoint.port);
+
+        boost::system::error_code error;
+        auto address = boost::asio::ip::make_address(endpoint.GetHostAddress(), error);
+        if (error || boost::asio::ip::udp::endpoint{address, port}.protocol() != protocol) {
+            LOG(WARNING) << "No usable address for " << endpoint.address << "; it gets no cluster replication";
+            continue;
+        }
+
+        peers.emplace_back(address, port);
+    }
+
+    impl_->peers = std::move(peers);
+    LOG(INFO) << "Replicating room and presence state to " << impl_->peers.size() << " cluster gateways";
+}
+
+uint16_t ClusterReplicator::ReplicationPort(uint16_t gatewayPort) const {
+    uint32_t port = static_cast<uint32_t>(gatewayPort) + portOffset_;
+    if (port > 65535) {
+        throw std::runtime_error{
+            "gateway_replication_port_offset moves port " + std::to_string(gatewayPort) + " out of range"};
+    }
+
+    return static_cast<uint16_t>(port);
+}
+
+ClusterReplicator::~ClusterReplicator() {}
+
+uint16_t ClusterReplicator::GetPort() const { return impl_ ? impl_->socket.local_endpoint().port() : 0; }
+
+void ClusterReplicator::AvatarLoggedIn(const ChatAvatar* avatar) {
+    // A player who moved over from another gateway is now hosted here.
+    remoteAvatars_.erase(avatar);
+
+    ReplicationEvent event;
+    event.type = ReplicationEventType::AVATAR_LOGIN;
+    event.avatarName = avatar->GetName();
+    event.avatarAddress = avatar->GetAddress();
+    event.userId = avatar->GetUserId();
+    event.avatarAttributes = avatar->GetAttributes();
+    event.loginLocation = avatar->GetLoginLocation();
+    Queue(std::move(event));
+}
+
+void ClusterReplicator::AvatarLoggedOut(const ChatAvatar* avatar) {
+    remoteAvatars_.erase(avatar);
+
+    ReplicationEvent event;
+    event.type = ReplicationEventType::AVATAR_LOGOUT;
+    event.avatarName = avatar->GetName();
+    event.avatarAddress = avatar->GetAddress();
+    Queue(std::move(event));
+}
+
+void ClusterReplicator::RoomCreated(const ChatRoom* room) {
+    ReplicationEvent event;
+    event.type = ReplicationEventType::ROOM_CREATE;
+    event.avatarName = room->GetCreatorName();
+    event.avatarAddress = room->GetCreatorAddress();
+    event.roomAddress = room->GetRoomAddress();
+    event.roomName = room->GetRoomName();
+    event.roomTopic = room->GetRoomTopic();
+    event.roomPassword = room->GetRoomPassword();
+    event.roomAttributes = room->GetRoomAttributes();
+    event.maxRoomSize = room->GetMaxRoomSize();
+    Queue(std::move(event));
+}
+
+void ClusterReplicator::RoomDestroyed(const ChatRoom* room, const ChatAvatar* srcAvatar) {
+    ReplicationEvent event;
+    event.type = ReplicationEventType::ROOM_DESTROY;
+    event.avatarName = srcAvatar->GetName();
+    event.avatarAddress = srcAvatar->GetAddress();
+    event.roomAddress = room->GetRoomAddress();
+    Queue(std::move(event));
+}
+
+void ClusterReplicator::RoomEntered(const ChatRoom* room, const ChatAvatar* avatar) {
+    ReplicationEvent event;
+    event.type = ReplicationEventType::ROOM_ENTER;
+    event.avatarName = avatar->GetName();
+    event.avatarAddress = avatar->GetAddress();
+    event.roomAddress = room->GetRoomAddress();
+    Queue(std::move(event));
+}
+
+void ClusterReplicator::RoomLeft(const ChatRoom* room, const ChatAvatar* avatar) {
+    ReplicationEvent event;
+    event.type = ReplicationEventType::ROOM_LEAVE;
+    event.avatarName = avatar->GetName();
+    event.avatarAddress = avatar->GetAddress();
+    event.roomAddress = room->GetRoomAddress();
+    Queue(std::move(event));
+}
+
+void ClusterReplicator::RoomMessageSent(
+    const ChatRoom* room, const ChatAvatar* srcAvatar, const std::u16string& message, const std::u16string& oob) {
+    ReplicationEvent event;
+    event.type = ReplicationEventType::ROOM_MESSAGE;
+    event.avatarName = srcAvatar->GetName();
+    event.avatarAddress = srcAvatar->GetAddress();
+    event.roomAddress = room->GetRoomAddress();
+    event.message = message;
+    event.oob = oob;
+    Queue(std::move(event));
+}
+
+void ClusterReplicator::Queue(ReplicationEvent event) {
+    if (!impl_ || impl_->peers.empty()) {
+        return;
+    }
+
+    impl_->queued.push_back(EncodeEvent(event));
+}
+
+void ClusterReplicator::Tick() {
+    if (!impl_) {
+        return;
+    }
+
+    Flush();
+
+    auto apply = [this](const ReplicationBatch& batch) {
+        for (const auto& event : batch.events) {
+            Receive(event);
+        }
+    };
+
+    boost::asio::ip::udp::endpoint sender;
+    auto skipped = impl_->sequencer.GetSkippedCount();
+    auto now = std::chrono::steady_clock::now();
+
+    // Stops once the socket would block; any other error is retried next tick.
+    for (std::size_t datagrams = 0; datagrams < kMaxDatagramsPerTick; ++datagrams) {
+        boost::system::error_code error;
+        auto received = impl_->socket.receive_from(boost::asio::buffer(impl_->buffer), sender, 0, error);
+        if (error) {
+            break;
+        }
+
+        // Batches create avatars and speak for them, so only the replication
+        // sockets of cluster gateways are listened to.
+        const auto& peers = impl_->peers;
+        if (std::find(std::begin(peers), std::end(peers), sender) == std::end(peers)) {
+            GetReplicationMetrics().datagramsRejected.Increment();
+            continue;
+        }
+
+        ReplicationBatch batch;
+        if (DecodeReplicationBatch(impl_->buffer.data(), received, batch) && batch.origin != impl_->origin) {
+            impl_->sequencer.Receive(std::move(batch), now, apply);
+        }
+    }
+
+    impl_->sequencer.Expire(now, apply);
+    GetReplicationMetrics().batchesSkipped.Increment(impl_->sequencer.GetSkippedCount() - skipped);
+}
+
+void ClusterReplicator::Flush() {
+    auto& queued = impl_->queued;
+    auto& metrics = GetReplicationMetrics();
+    metrics.eventsSent.Increment(queued.size());
+
+    std::size_t first = 0;
+    while (first < queued.size()) {
+        std::size_t last = first;
+        std::size_t size = kBatchHeaderBytes;
+        do {
+            size += queued[last].size();
+            ++last;
+        } while (last < queued.size() && last - first < 65535 && size + queued[last].size() <= kMaxBatchBytes);
+
+        std::ostringstream stream;
+        WriteHeader(stream, impl_->origin, impl_->nextSequence++, static_cast<uint16_t>(last - first));
+        for (auto i = first; i < last; ++i) {
+            stream << queued[i];
+        }
+
+        auto datagram = stream.str();
+        for (const auto& peer : impl_->peers) {
+            // A full send buffer or an unreachable gateway costs this batch,
+            // which the receiver skips once its gap times out.
+            boost::system::error_code ignored;
+            impl_->socket.send_to(boost::asio::buffer(datagram), peer, 0, ignored);
+        }
+
+        metrics.batchesSent.Increment(impl_->peers.size());
+        first = last;
+    }
+
+    queued.clear();
+}
+
+void ClusterReplicator::Receive(const ReplicationEvent& event) {
+    if (waiting_.size() >= kMaxWaitingEvents) {
+        LOG(WARNING) << "Dropping replicated change; too many are waiting for an avatar lookup";
+        return;
+    }
+
+    waiting_.push_back(event);
+    ApplyWaiting();
+}
+
+void ClusterReplicator::ApplyWaiting() {
+    while (!lookingUp_ && !waiting_.empty()) {
+        if (NeedsLookup(waiting_.front())) {
+            LookUpAvatar(waiting_.front());
+            return;
+        }
+
+        Apply(waiting_.front());
+        waiting_.pop_front();
+    }
+}
+
+bool ClusterReplicator::NeedsLookup(const ReplicationEvent& event) const {
+    switch (event.type) {
+    case ReplicationEventType::AVATAR_LOGOUT:
+    case ReplicationEventType::ROOM_LEAVE:
+        // Only an avatar this gateway already holds can leave.
+        return false;
+    default:
+        return node_->GetAvatarService()->GetCachedAvatar(event.avatarName, event.avatarAddress) == nullptr;
+    }
+}
+
+void ClusterReplicator::LookUpAvatar(const ReplicationEvent& event) {
+    lookingUp_ = true;
+
+    AvatarKey key{event.avatarName, event.avatarAddress};
+    bool create = event.type == ReplicationEventType::AVATAR_LOGIN;
+
+    StoredAvatar newAvatar;
+    newAvatar.userId = event.userId;
+    newAvatar.name = event.avatarName;
+    newAvatar.address = event.avatarAddress;
+    newAvatar.attributes = event.avatarAttributes;
+
+    struct Found {
+        boost::optional<StoredAvatar> avatar;
+        bool created = false;
+    };
+
+    auto found = std::make_shared<Found>();
+
+    // Events wait behind the lookup, in order, rather than stalling the tick
+    // on the database.
+    node_->GetDatabaseExecutor().Post(0,
+        [key, create, newAvatar, found](ChatStorage& storage) {
+            found->avatar = storage.FindAvatar(key.name, key.address);
+            if (!found->avatar && create) {
+                auto avatar = newAvatar;
+                avatar.avatarId = storage.InsertAvatar(avatar);
+                found->avatar = std::move(avatar);
+                found->created = true;
+            }
+        },
+        [this, found](std::exception_ptr error) {
+            lookingUp_ = false;
+
+            const auto& event = waiting_.front();
+            auto avatarService = node_->GetAvatarService();
+
+            if (error) {
+                LOG(WARNING) << "Cannot look up replicated avatar " << FromWideString(event.avatarName) << "@"
+                             << FromWideString(event.avatarAddress);
+            } else if (found->avatar && !avatarService->GetCachedAvatar(event.avatarName, event.avatarAddress)) {
+                const auto& stored = *found->avatar;
+                if (found->created) {
+                    avatarService->AdoptCreatedAvatar(stored, event.loginLocation);
+                } else {
+                    avatarService->AdoptStoredAvatar(
+                        stored.avatarId, stored.userId, stored.name, stored.address, stored.attributes);
+                }
+            }
+
+            Apply(event);
+            waiting_.pop_front();
+            ApplyWaiting();
+        });
+}
+
+void ClusterReplicator::Apply(const ReplicationEvent& event) {
+    GetReplicationMetrics().eventsApplied.Increment();
+
+    switch (event.type) {
+    case ReplicationEventType::AVATAR_LOGIN:
+        ApplyLogin(event);
+        break;
+    case ReplicationEventType::AVATAR_LOGOUT:
+        ApplyLogout(event);
+        break;
+    case ReplicationEventType::ROOM_CREATE:
+        ApplyRoomCreate(event);
+        break;
+    case ReplicationEventType::ROOM_DESTROY:
+        ApplyRoomDestroy(event);
+        break;
+    case ReplicationEventType::ROOM_ENTER:
+        ApplyRoomEnter(event);
+        break;
+    case ReplicationEventType::ROOM_LEAVE:
+        ApplyRoomLeave(event);
+        break;
+    case ReplicationEventType::ROOM_MESSAGE:
+        ApplyRoomMessage(event);
+        break;
+    }
+}
+
+void ClusterReplicator::ApplyLogin(const ReplicationEvent& event) {
+    auto avatarService = node_->GetAvatarService();
+    auto avatar = FindAvatar(event);
+    if (!avatar) {
+        return;
+    }
+
+    // A login through this gateway is newer than anything replicated to it.
+    if (avatar->IsOnline()) {
+        return;
+    }
+
+    remoteAvatars_.insert(avatar);
+    avatarService->LoginAvatar(avatar);
+
+    for (auto onlineAvatar : avatarService->GetOnlineAvatars()) {
+        if (!IsRemote(onlineAvatar) && onlineAvatar->IsFriend(avatar)) {
+            node_->SendTo(onlineAvatar->GetAddressId(),
+                MFriendLogin{avatar, avatar->GetAddress(), onlineAvatar->GetAvatarId(), avatar->GetStatusMessage()},
+                SendPriority::DEFERRABLE);
+        }
+    }
+}
+
+void ClusterReplicator::ApplyLogout(const ReplicationEvent& event) {
+    auto avatarService = node_->GetAvatarService();
+    auto avatar = avatarService->GetCachedAvatar(event.avatarName, event.avatarAddress);
+    if (!avatar || !IsRemote(avatar)) {
+        return;
+    }
+
+    auto roomService = node_->GetRoomService();
+    for (auto room : roomService->GetJoinedRooms(avatar)) {
+        auto addresses = LocalAddresses(room);
+        room->LeaveRoom(avatar);
+
+        for (auto address : addresses) {
+            node_->SendTo(address, MLeaveRoom{avatar->GetAvatarId(), room->GetRoomId()});
+        }
+    }
+
+    for (auto onlineAvatar : avatarService->GetOnlineAvatars()) {
+        if (!IsRemote(onlineAvatar) && onlineAvatar->IsFriend(avatar)) {
+            node_->SendTo(onlineAvatar->GetAddressId(),
+                MFriendLogout{avatar, avatar->GetAddress(), onlineAvatar->GetAvatarId()}, SendPriority::DEFERRABLE);
+        }
+    }
+
+    remoteAvatars_.erase(avatar);
+    avatarService->LogoutAvatar(avatar);
+}
+
+void ClusterReplicator::ApplyRoomCreate(const ReplicationEvent& event) {
+    auto roomService = node_->GetRoomService();
+    if (roomService->RoomExists(event.roomAddress)) {
+        return;
+    }
+
+    auto creator = FindAvatar(event);
+    if (!creator) {
+        return;
+    }
+
+    auto baseAddress = event.roomAddress.substr(0, event.roomAddress.size() - event.roomName.size() - 1);
+    roomService->AddMirroredRoom(creator, event.roomName, event.roomTopic, event.roomPassword, event.roomAttributes,
+        event.maxRoomSize, baseAddress, event.avatarAddress);
+}
+
+void ClusterReplicator::ApplyRoomDestroy(const ReplicationEvent& event) {
+    auto roomService = node_->GetRoomService();
+    auto room = roomService->GetRoom(event.roomAddress);
+    if (!room) {
+        return;
+    }
+
+    auto addresses = LocalAddresses(room);
+    auto roomId = room->GetRoomId();
+
+    roomService->RemoveMirroredRoom(room);
+
+    auto srcAvatar = FindAvatar(event);
+    if (!srcAvatar) {
+        return;
+    }
+
+    for (auto address : addresses) {
+        node_->SendTo(address, MDestroyRoom{srcAvatar, roomId});
+    }
+}
+
+void ClusterReplicator::ApplyRoomEnter(const ReplicationEvent& event) {
+    auto room = node_->GetRoomService()->GetRoom(event.roomAddress);
+    auto avatar = FindAvatar(event);
+    if (!room || !avatar || room->IsInRoom(avatar)) {
+        return;
+    }
+
+    room->AddRemoteMember(avatar);
+
+    for (auto address : LocalAddresses(room)) {
+        node_->SendTo(address, MEnterRoom{avatar, room->GetRoomId()});
+    }
+}
+
+void ClusterReplicator::ApplyRoomLeave(const ReplicationEvent& event) {
+    auto room = node_->GetRoomService()->GetRoom(event.roomAddress);
+    auto avatar = node_->GetAvatarService()->GetCachedAvatar(event.avatarName, event.avatarAddress);
+    if (!room || !avatar || !room->IsInRoom(avatar)) {
+        return;
+    }
+
+    auto addresses = LocalAddresses(room);
+    room->LeaveRoom(avatar);
+
+    for (auto address : addresses) {
+        node_->SendTo(address, MLeaveRoom{avatar->GetAvatarId(), room->GetRoomId()});
+    }
+}
+
+void ClusterReplicator::ApplyRoomMessage(const ReplicationEvent& event) {
+    auto room = node_->GetRoomService()->GetRoom(event.roomAddress);
+    auto avatar = FindAvatar(event);
+    if (!room || !avatar) {
+        return;
+    }
+
+    auto messageId = room->GetNextMessageId();
+    for (auto address : LocalAddresses(room)) {
+        node_->SendTo(
+            address, MRoomMessage{avatar, room->GetRoomId(), room->GetAvatarIds(avatar), event.message, event.oob,
+                         messageId});
+    }
+}
+
+ChatAvatar* ClusterReplicator::FindAvatar(const ReplicationEvent& event) {
+    auto avatar = node_->GetAvatarService()->GetCachedAvatar(event.avatarName, event.avatarAddress);
+    if (!avatar) {
+        LOG(WARNING) << "Ignoring replicated change for unknown avatar " << FromWideString(event.avatarName) << "@"
+                     << FromWideString(event.avatarAddress);
+    }
+
+    return avatar;
+}
+
+std::vector<AddressId> ClusterReplicator::LocalAddresses(const ChatRoom* room) const {
+    std::vector<AddressId> addresses;
+
+    for (auto avatar : room->GetAvatars()) {
+        auto address = avatar->GetAddressId();
+        if (!IsRemote(avatar)
+            && std::find(std::begin(addresses), std::end(addresses), address) == std::end(addresses)) {
+            addresses.push_back(address);
+        }
+    }
+
+    return addresses;
+}
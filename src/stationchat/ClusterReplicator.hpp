@@ -0,0 +1,197 @@
+#pragma once
+
+#include "AddressTable.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+class ChatAvatar;
+class ChatRoom;
+class GatewayNode;
+struct GatewayClusterEndpoint;
+struct StationChatConfig;
+
+enum class ReplicationEventType : uint8_t {
+    AVATAR_LOGIN = 1,
+    AVATAR_LOGOUT,
+    ROOM_CREATE,
+    ROOM_DESTROY,
+    ROOM_ENTER,
+    ROOM_LEAVE,
+    ROOM_MESSAGE
+};
+
+/** One change made through the gateway that hosts the avatar. Avatar and room
+ * ids are local to each gateway, so avatars travel by name and address and
+ * rooms by their full room address. Fields a type does not use stay empty.
+ */
+struct ReplicationEvent {
+    ReplicationEventType type{ReplicationEventType::AVATAR_LOGIN};
+    std::u16string avatarName;
+    std::u16string avatarAddress;
+    uint32_t userId{0};
+    uint32_t avatarAttributes{0};
+    std::u16string loginLocation;
+    std::u16string roomAddress;
+    std::u16string roomName;
+    std::u16string roomTopic;
+    std::u16string roomPassword;
+    uint32_t roomAttributes{0};
+    uint32_t maxRoomSize{0};
+    std::u16string message;
+    std::u16string oob;
+};
+
+/** Events sent together in one datagram. Sequence numbers count the batches
+ * of one origin, a random id drawn each time a gateway starts.
+ */
+struct ReplicationBatch {
+    uint64_t origin{0};
+    uint64_t sequence{0};
+    std::vector<ReplicationEvent> events;
+};
+
+std::string EncodeReplicationBatch(const ReplicationBatch& batch);
+
+/** Unpacks a datagram, returning false for anything that is not a complete
+ * batch of a known version.
+ */
+bool DecodeReplicationBatch(const char* data, std::size_t length, ReplicationBatch& batch);
+
+/** Restores the send order of each origin's batches. A batch that arrives
+ * early waits for the ones before it; once a gap has been open for longer
+ * than the gap timeout, or too many batches wait behind it, the missing
+ * batches are given up on. Duplicates and late arrivals are dropped.
+ */
+class ReplicationSequencer {
+public:
+    using Clock = std::chrono::steady_clock;
+    using Visitor = std::function<void(const ReplicationBatch&)>;
+
+    ReplicationSequencer(std::chrono::milliseconds gapTimeout, std::size_t maxPending);
+
+    /** Hands the batch, and any waiting batches it completes, to the visitor.
+     * The first batch seen from an origin sets where its sequence starts.
+     */
+    void Receive(ReplicationBatch batch, Clock::time_point now, const Visitor& visitor);
+
+    /** Skips gaps that have outlived the gap timeout.
+     */
+    void Expire(Clock::time_point now, const Visitor& visitor);
+
+    uint64_t GetSkippedCount() const { return skipped_; }
+    uint64_t GetDroppedCount() const { return dropped_; }
+
+private:
+    struct OriginState {
+        uint64_t next = 0;
+        std::map<uint64_t, ReplicationBatch> pending;
+        Clock::time_point gapSince{};
+    };
+
+    void Drain(OriginState& state, Clock::time_point now, const Visitor& visitor);
+    void SkipGap(OriginState& state, Clock::time_point now, const Visitor& visitor);
+
+    const std::chrono::milliseconds gapTimeout_;
+    const std::size_t maxPending_;
+    std::unordered_map<uint64_t, OriginState> origins_;
+    uint64_t skipped_ = 0;
+    uint64_t dropped_ = 0;
+};
+
+/** Keeps room membership, room messages and presence in step across the
+ * gateways of a cluster. Changes requested by this gateway's game servers are
+ * queued as events and sent to every other cluster gateway in batches once
+ * per tick. Batches from other gateways are applied to the local services in
+ * the order they were sent, and the resulting updates go to this gateway's
+ * game servers only, as the sending gateway has already notified its own.
+ *
+ * Avatars logged in elsewhere are held online here as remote avatars. Batches
+ * travel as UDP datagrams to each gateway's port plus
+ * gateway_replication_port_offset; a batch that never arrives is skipped, so
+ * replicated state is corrected by the next change rather than retransmitted.
+ * With an offset of 0 every call is a no-op.
+ */
+class ClusterReplicator {
+public:
+    ClusterReplicator(GatewayNode* node, const StationChatConfig& config);
+    ~ClusterReplicator();
+
+    ClusterReplicator(const ClusterReplicator&) = delete;
+    ClusterReplicator& operator=(const ClusterReplicator&) = delete;
+
+    bool IsEnabled() const { return impl_ != nullptr; }
+
+    /** Replaces the gateways events are sent to; this gateway is left out.
+     */
+    void SetCluster(const std::vector<GatewayClusterEndpoint>& cluster);
+
+    void AvatarLoggedIn(const ChatAvatar* avatar);
+    void AvatarLoggedOut(const ChatAvatar* avatar);
+    void RoomCreated(const ChatRoom* room);
+    void RoomDestroyed(const ChatRoom* room, const ChatAvatar* srcAvatar);
+    void RoomEntered(const ChatRoom* room, const ChatAvatar* avatar);
+    void RoomLeft(const ChatRoom* room, const ChatAvatar* avatar);
+    void RoomMessageSent(
+        const ChatRoom* room, const ChatAvatar* srcAvatar, const std::u16string& message, const std::u16string& oob);
+
+    /** Sends the events queued since the last call and applies the batches
+     * received from other gateways. Called once per gateway tick.
+     */
+    void Tick();
+
+    /** True for avatars that are logged in through another gateway.
+     */
+    bool IsRemote(const ChatAvatar* avatar) const { return remoteAvatars_.count(avatar) != 0; }
+    std::size_t GetRemoteAvatarCount() const { return remoteAvatars_.size(); }
+
+    /** Port batches are received on; 0 when replication is disabled.
+     */
+    uint16_t GetPort() const;
+
+private:
+    void Queue(ReplicationEvent event);
+    void Flush();
+
+    /** Applies a received event, after any that are still waiting. Events
+     * naming an avatar this gateway has not cached wait for it to be read,
+     * or for a login created, by the database executor.
+     */
+    void Receive(const ReplicationEvent& event);
+    void ApplyWaiting();
+    bool NeedsLookup(const ReplicationEvent& event) const;
+    void LookUpAvatar(const ReplicationEvent& event);
+    void Apply(const ReplicationEvent& event);
+    void ApplyLogin(const ReplicationEvent& event);
+    void ApplyLogout(const ReplicationEvent& event);
+    void ApplyRoomCreate(const ReplicationEvent& event);
+    void ApplyRoomDestroy(const ReplicationEvent& event);
+    void ApplyRoomEnter(const ReplicationEvent& event);
+    void ApplyRoomLeave(const ReplicationEvent& event);
+    void ApplyRoomMessage(const ReplicationEvent& event);
+
+    uint16_t ReplicationPort(uint16_t gatewayPort) const;
+    ChatAvatar* FindAvatar(const ReplicationEvent& event);
+    std::vector<AddressId> LocalAddresses(const ChatRoom* room) const;
+
+    // Keeps boost::asio out of every translation unit that includes the node.
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+
+    GatewayNode* node_;
+    std::string address_;
+    uint16_t port_;
+    uint16_t portOffset_;
+    std::unordered_set<const ChatAvatar*> remoteAvatars_;
+    std::deque<ReplicationEvent> waiting_;
+    bool lookingUp_ = false;
+};
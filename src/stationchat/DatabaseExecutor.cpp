@@ -0,0 +1,143 @@
+#include "DatabaseExecutor.hpp"
+
+#include "ChatStorage.hpp"
+#include "Metrics.hpp"
+
+#include "easylogging++.h"
+
+namespace {
+
+struct DatabaseExecutorMetrics {
+    MetricHistogram& queueWait = GetMetricsRegistry().Histogram("stationchat_db_queue_wait_microseconds",
+        "Time database work waited for a worker after a handler awaited it");
+    MetricHistogram& completionWait = GetMetricsRegistry().Histogram("stationchat_db_completion_wait_microseconds",
+        "Time from posting database work to its completion running on the gateway thread");
+};
+
+DatabaseExecutorMetrics& GetDatabaseExecutorMetrics() {
+    static DatabaseExecutorMetrics metrics;
+    return metrics;
+}
+
+std::chrono::microseconds Since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+}
+
+} // namespace
+
+DatabaseExecutor::DatabaseExecutor(uint32_t workers, const StorageFactory& factory, ChatStorage* inlineStorage)
+    : inlineStorage_{inlineStorage} {
+    for (uint32_t i = 0; i < workers; ++i) {
+        auto worker = std::make_unique<Worker>();
+        worker->storage = factory();
+        workers_.push_back(std::move(worker));
+    }
+
+    for (auto& worker : workers_) {
+        worker->thread = std::thread{&DatabaseExecutor::Run, this, std::ref(*worker)};
+    }
+}
+
+DatabaseExecutor::~DatabaseExecutor() {
+    for (auto& worker : workers_) {
+        {
+            std::lock_guard<std::mutex> lock(worker->mutex);
+            worker->stopping = true;
+        }
+
+        worker->wake.notify_one();
+    }
+
+    for (auto& worker : workers_) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+}
+
+void DatabaseExecutor::Post(uint32_t key, Work work, Completion completion) {
+    Task task;
+    task.work = std::move(work);
+    task.completion = std::move(completion);
+    task.queuedAt = std::chrono::steady_clock::now();
+
+    if (workers_.empty()) {
+        Execute(task, *inlineStorage_);
+
+        std::lock_guard<std::mutex> lock(completedMutex_);
+        completed_.push_back(std::move(task));
+        return;
+    }
+
+    auto& worker = *workers_[key % workers_.size()];
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.queue.push_back(std::move(task));
+    }
+
+    worker.wake.notify_one();
+}
+
+std::size_t DatabaseExecutor::RunCompletions() {
+    std::vector<Task> completed;
+    {
+        std::lock_guard<std::mutex> lock(completedMutex_);
+        if (completed_.empty()) {
+            return 0;
+        }
+
+        completed.swap(completed_);
+    }
+
+    auto& metrics = GetDatabaseExecutorMetrics();
+    for (auto& task : completed) {
+        metrics.completionWait.Observe(Since(task.queuedAt));
+
+        // A completion that throws must not take the rest of the tick with it.
+        try {
+            task.completion(task.error);
+        } catch (const std::exception& e) {
+            LOG(ERROR) << "Database work completion failed: " << e.what();
+        } catch (...) {
+            LOG(ERROR) << "Database work completion failed with an unknown exception";
+        }
+    }
+
+    return completed.size();
+}
+
+void DatabaseExecutor::Run(Worker& worker) {
+    while (true) {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lock(worker.mutex);
+            worker.wake.wait(lock, [&worker]() { return worker.stopping || !worker.queue.empty(); });
+
+            // Queued writes are finished before stopping; only their
+            // completions are lost.
+            if (worker.queue.empty()) {
+                return;
+            }
+
+            task = std::move(worker.queue.front());
+            worker.queue.pop_front();
+        }
+
+        GetDatabaseExecutorMetrics().queueWait.Observe(Since(task.queuedAt));
+        Execute(task, *worker.storage);
+
+        std::lock_guard<std::mutex> lock(completedMutex_);
+        completed_.push_back(std::move(task));
+    }
+}
+
+void DatabaseExecutor::Execute(Task& task, ChatStorage& storage) {
+    try {
+        task.work(storage);
+    } catch (...) {
+        task.error = std::current_exception();
+    }
+
+    // Whatever the work captured is released on the thread that ran it.
+    task.work = nullptr;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ChatStorage;
+
+/** Runs database work away from the gateway thread. Each worker thread owns
+ * a storage connection of its own, and work is handed to a worker by key so
+ * that work posted under one key runs in the order it was posted. Completions
+ * are queued back and run on the gateway thread by RunCompletions.
+ *
+ * Without workers the work runs straight away on the posting thread against
+ * the gateway's own storage, and only the completion waits for the next
+ * RunCompletions; the in-memory backend works this way, as it cannot be
+ * shared between threads.
+ */
+class DatabaseExecutor {
+public:
+    using StorageFactory = std::function<std::unique_ptr<ChatStorage>()>;
+    using Work = std::function<void(ChatStorage& storage)>;
+
+    /** Receives the exception the work threw, if any.
+     */
+    using Completion = std::function<void(std::exception_ptr error)>;
+
+    /** Opens one storage per worker up front, so a database that cannot be
+     * reached fails startup the way the gateway's own connection does.
+     */
+    DatabaseExecutor(uint32_t workers, const StorageFactory& factory, ChatStorage* inlineStorage);
+
+    /** Work that is already queued still runs; completions are dropped.
+     */
+    ~DatabaseExecutor();
+
+    DatabaseExecutor(const DatabaseExecutor&) = delete;
+    DatabaseExecutor& operator=(const DatabaseExecutor&) = delete;
+
+    void Post(uint32_t key, Work work, Completion completion);
+
+    /** Runs the completions of finished work and returns how many ran. A
+     * completion that throws is logged and does not stop the others.
+     */
+    std::size_t RunCompletions();
+
+    std::size_t GetWorkerCount() const { return workers_.size(); }
+
+private:
+    struct Task {
+        Work work;
+        Completion completion;
+        std::exception_ptr error;
+        std::chrono::steady_clock::time_point queuedAt;
+    };
+
+    struct Worker {
+        std::unique_ptr<ChatStorage> storage;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::deque<Task> queue;
+        bool stopping = false;
+        std::thread thread;
+    };
+
+    void Run(Worker& worker);
+    void Execute(Task& task, ChatStorage& storage);
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    ChatStorage* inlineStorage_;
+
+    std::mutex completedMutex_;
+    std::vector<Task> completed_;
+};
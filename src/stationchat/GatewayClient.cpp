@@ -4,10 +4,14 @@
 #include "ChatAvatarService.hpp"
 #include "ChatEnums.hpp"
 #include "ChatRoomService.hpp"
+#include "DatabaseExecutor.hpp"
 #include "GatewayNode.hpp"
+#include "LoginPipeline.hpp"
 #include "Message.hpp"
 #include "PersistentMessageService.hpp"
 #include "MariaDB.hpp"
+#include "Metrics.hpp"
+#include "RequestMetrics.hpp"
 #include "StationChatConfig.hpp"
 #include "UdpLibrary.hpp"
 
@@ -46,159 +50,416 @@
 
 #include "easylogging++.h"
 
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <stdexcept>
+
 GatewayClient::GatewayClient(UdpConnection* connection, GatewayNode* node)
-    : NodeClient(connection)
+    : NodeClient(connection, CaptureSource::GATEWAY)
     , node_{node}
     , avatarService_{node->GetAvatarService()}
-    , roomService_{node->GetRoomService()}
-    , messageService_{node->GetMessageService()} {
+    , roomService_{node->GetRoomService()} {
     connection->SetHandler(this);
+
+    ApplySendQueueLimits();
 }
 
 GatewayClient::~GatewayClient() {}
 
+void GatewayClient::ApplySendQueueLimits() {
+    auto& config = node_->GetConfig();
+
+    SendQueueLimits limits;
+    limits.highWatermarkBytes = config.sendQueueHighWatermarkKb * 1024;
+    limits.lowWatermarkBytes = config.sendQueueLowWatermarkKb * 1024;
+    limits.maxDeferredMessages = config.sendQueueMaxDeferredMessages;
+    limits.maxDeferredBytes = config.sendQueueMaxDeferredKb * 1024;
+    limits.disconnectBytes = config.sendQueueDisconnectKb * 1024;
+    SetSendQueueLimits(limits);
+}
+
+namespace {
+
+struct FanoutMetrics {
+    explicit FanoutMetrics(const std::string& update)
+        : messages{GetMetricsRegistry().Counter("stationchat_fanout_messages_total",
+              "Messages queued by fan-out updates", "update=\"" + update + "\"")}
+        , duration{GetMetricsRegistry().Histogram("stationchat_fanout_duration_microseconds",
+              "Time to queue a fan-out update for all of its recipients", "update=\"" + update + "\"")} {}
+
+    MetricCounter& messages;
+    MetricHistogram& duration;
+};
+
+} // namespace
+
+template <ChatRequestType RequestTypeV, typename HandlerT>
+struct RequestRoute {
+    static constexpr ChatRequestType type = RequestTypeV;
+    using Handler = HandlerT;
+};
+
+template <typename... RoutesT>
+struct RequestRoutes {};
+
+// Adding a request handler only takes a new entry here.
+using GatewayRoutes = RequestRoutes<
+    RequestRoute<ChatRequestType::LOGINAVATAR, LoginAvatar>,
+    RequestRoute<ChatRequestType::LOGOUTAVATAR, LogoutAvatar>,
+    RequestRoute<ChatRequestType::CREATEROOM, CreateRoom>,
+    RequestRoute<ChatRequestType::DESTROYROOM, DestroyRoom>,
+    RequestRoute<ChatRequestType::SENDINSTANTMESSAGE, SendInstantMessage>,
+    RequestRoute<ChatRequestType::SENDROOMMESSAGE, SendRoomMessage>,
+    RequestRoute<ChatRequestType::ADDFRIEND, AddFriend>,
+    RequestRoute<ChatRequestType::REMOVEFRIEND, RemoveFriend>,
+    RequestRoute<ChatRequestType::FRIENDSTATUS, FriendStatus>,
+    RequestRoute<ChatRequestType::ADDIGNORE, AddIgnore>,
+    RequestRoute<ChatRequestType::REMOVEIGNORE, RemoveIgnore>,
+    RequestRoute<ChatRequestType::ENTERROOM, EnterRoom>,
+    RequestRoute<ChatRequestType::LEAVEROOM, LeaveRoom>,
+    RequestRoute<ChatRequestType::ADDMODERATOR, AddModerator>,
+    RequestRoute<ChatRequestType::REMOVEMODERATOR, RemoveModerator>,
+    RequestRoute<ChatRequestType::ADDBAN, AddBan>,
+    RequestRoute<ChatRequestType::REMOVEBAN, RemoveBan>,
+    RequestRoute<ChatRequestType::ADDINVITE, AddInvite>,
+    RequestRoute<ChatRequestType::REMOVEINVITE, RemoveInvite>,
+    RequestRoute<ChatRequestType::KICKAVATAR, KickAvatar>,
+    RequestRoute<ChatRequestType::GETROOM, GetRoom>,
+    RequestRoute<ChatRequestType::GETROOMSUMMARIES, GetRoomSummaries>,
+    RequestRoute<ChatRequestType::SENDPERSISTENTMESSAGE, SendPersistentMessage>,
+    RequestRoute<ChatRequestType::GETPERSISTENTHEADERS, GetPersistentHeaders>,
+    RequestRoute<ChatRequestType::GETPERSISTENTMESSAGE, GetPersistentMessage>,
+    RequestRoute<ChatRequestType::UPDATEPERSISTENTMESSAGE, UpdatePersistentMessage>,
+    RequestRoute<ChatRequestType::UPDATEPERSISTENTMESSAGES, UpdatePersistentMessages>,
+    RequestRoute<ChatRequestType::IGNORESTATUS, IgnoreStatus>,
+    RequestRoute<ChatRequestType::FAILOVER_RELOGINAVATAR, FailoverReLoginAvatar>,
+    RequestRoute<ChatRequestType::SETAPIVERSION, SetApiVersion>,
+    RequestRoute<ChatRequestType::SETAVATARATTRIBUTES, SetAvatarAttributes>,
+    RequestRoute<ChatRequestType::GETANYAVATAR, GetAnyAvatar>>;
+
+struct GatewayRequestDispatch {
+    using HandlerFn = void (*)(GatewayClient*, std::istringstream&);
+
+    template <typename RouteT>
+    static void Invoke(GatewayClient* client, std::istringstream& istream) {
+        client->HandleIncomingMessage<typename RouteT::Handler>(istream, RouteT::type);
+    }
+};
+
+template <typename RoutesT>
+struct DispatchTable;
+
+template <typename... RoutesT>
+struct DispatchTable<RequestRoutes<RoutesT...>> {
+    static constexpr std::size_t MaxType() {
+        std::size_t maxType = 0;
+        for (auto type : {static_cast<std::size_t>(RoutesT::type)...}) {
+            maxType = type > maxType ? type : maxType;
+        }
+        return maxType;
+    }
+
+    static constexpr std::size_t kSize = MaxType() + 1;
+    static_assert(kSize <= RequestMetrics::kRequestTypeSlots, "request type exceeds the metrics table");
+
+    struct Entries {
+        GatewayRequestDispatch::HandlerFn handlers[kSize];
+    };
+
+    static constexpr Entries Build() {
+        Entries entries{};
+        const std::size_t types[] = {static_cast<std::size_t>(RoutesT::type)...};
+        const GatewayRequestDispatch::HandlerFn handlers[] = {&GatewayRequestDispatch::Invoke<RoutesT>...};
+
+        for (std::size_t i = 0; i < sizeof...(RoutesT); ++i) {
+            // Evaluating the throw makes a duplicate route a compile error.
+            entries.handlers[types[i]] = entries.handlers[types[i]] == nullptr
+                ? handlers[i]
+                : throw std::logic_error("duplicate request route");
+        }
+
+        return entries;
+    }
+
+    static constexpr Entries kEntries = Build();
+
+    static GatewayRequestDispatch::HandlerFn Find(ChatRequestType type) {
+        auto index = static_cast<std::size_t>(type);
+        return index < kSize ? kEntries.handlers[index] : nullptr;
+    }
+};
+
+template <typename... RoutesT>
+constexpr typename DispatchTable<RequestRoutes<RoutesT...>>::Entries DispatchTable<RequestRoutes<RoutesT...>>::kEntries;
+
 void GatewayClient::OnIncoming(std::istringstream& istream) {
     ChatRequestType request_type = ::read<ChatRequestType>(istream);
 
-    switch (request_type) {
-    case ChatRequestType::LOGINAVATAR:
-        HandleIncomingMessage<LoginAvatar>(istream);
-        break;
-    case ChatRequestType::LOGOUTAVATAR:
-        HandleIncomingMessage<LogoutAvatar>(istream);
-        break;
-    case ChatRequestType::CREATEROOM:
-        HandleIncomingMessage<CreateRoom>(istream);
-        break;
-    case ChatRequestType::DESTROYROOM:
-        HandleIncomingMessage<DestroyRoom>(istream);
-        break;
-    case ChatRequestType::SENDINSTANTMESSAGE:
-        HandleIncomingMessage<SendInstantMessage>(istream);
-        break;
-    case ChatRequestType::SENDROOMMESSAGE:
-        HandleIncomingMessage<SendRoomMessage>(istream);
-        break;
-    case ChatRequestType::ADDFRIEND:
-        HandleIncomingMessage<AddFriend>(istream);
-        break;
-    case ChatRequestType::REMOVEFRIEND:
-        HandleIncomingMessage<RemoveFriend>(istream);
-        break;
-    case ChatRequestType::FRIENDSTATUS:
-        HandleIncomingMessage<FriendStatus>(istream);
-        break;
-    case ChatRequestType::ADDIGNORE:
-        HandleIncomingMessage<AddIgnore>(istream);
-        break;
-    case ChatRequestType::REMOVEIGNORE:
-        HandleIncomingMessage<RemoveIgnore>(istream);
-        break;
-    case ChatRequestType::ENTERROOM:
-        HandleIncomingMessage<EnterRoom>(istream);
-        break;
-    case ChatRequestType::LEAVEROOM:
-        HandleIncomingMessage<LeaveRoom>(istream);
-        break;
-    case ChatRequestType::ADDMODERATOR:
-        HandleIncomingMessage<AddModerator>(istream);
-        break;
-    case ChatRequestType::REMOVEMODERATOR:
-        HandleIncomingMessage<RemoveModerator>(istream);
-        break;
-    case ChatRequestType::ADDBAN:
-        HandleIncomingMessage<AddBan>(istream);
-        break;
-    case ChatRequestType::REMOVEBAN:
-        HandleIncomingMessage<RemoveBan>(istream);
-        break;
-    case ChatRequestType::ADDINVITE:
-        HandleIncomingMessage<AddInvite>(istream);
-        break;
-    case ChatRequestType::REMOVEINVITE:
-        HandleIncomingMessage<RemoveInvite>(istream);
-        break;
-    case ChatRequestType::KICKAVATAR:
-        HandleIncomingMessage<KickAvatar>(istream);
-        break;
-    case ChatRequestType::GETROOM:
-        HandleIncomingMessage<GetRoom>(istream);
-        break;
-    case ChatRequestType::GETROOMSUMMARIES:
-        HandleIncomingMessage<GetRoomSummaries>(istream);
-        break;
-    case ChatRequestType::SENDPERSISTENTMESSAGE:
-        HandleIncomingMessage<SendPersistentMessage>(istream);
-        break;
-    case ChatRequestType::GETPERSISTENTHEADERS:
-        HandleIncomingMessage<GetPersistentHeaders>(istream);
-        break;
-    case ChatRequestType::GETPERSISTENTMESSAGE:
-        HandleIncomingMessage<GetPersistentMessage>(istream);
-        break;
-    case ChatRequestType::UPDATEPERSISTENTMESSAGE:
-        HandleIncomingMessage<UpdatePersistentMessage>(istream);
-        break;
-    case ChatRequestType::UPDATEPERSISTENTMESSAGES:
-        HandleIncomingMessage<UpdatePersistentMessages>(istream);
-        break;
-    case ChatRequestType::IGNORESTATUS:
-        HandleIncomingMessage<IgnoreStatus>(istream);
-        break;
-    case ChatRequestType::FAILOVER_RELOGINAVATAR:
-        HandleIncomingMessage<FailoverReLoginAvatar>(istream);
-        break;
-    case ChatRequestType::SETAPIVERSION:
-        HandleIncomingMessage<SetApiVersion>(istream);
-        break;
-    case ChatRequestType::SETAVATARATTRIBUTES:
-        HandleIncomingMessage<SetAvatarAttributes>(istream);
-        break;
-    case ChatRequestType::GETANYAVATAR:
-        HandleIncomingMessage<GetAnyAvatar>(istream);
-        break;
-    default:
+    auto handler = DispatchTable<GatewayRoutes>::Find(request_type);
+    if (handler == nullptr) {
+        if (kRequestMetricsEnabled) {
+            node_->GetRequestMetrics().RecordUnknown();
+        }
+
         LOG(INFO) << "Unknown request type received: " << static_cast<uint16_t>(request_type);
-        break;
+        return;
+    }
+
+    handler(this, istream);
+}
+
+ChatResultCode GatewayClient::ResultOf(std::exception_ptr error) {
+    try {
+        std::rethrow_exception(error);
+    } catch (const ChatResultException& e) {
+        LOG(ERROR) << "ChatAPI Result Exception: [" << ToString(e.code) << "] " << e.message;
+        return e.code;
+    } catch (const MariaDBException& e) {
+        LOG(ERROR) << "Database Error: [" << e.code << "] " << e.message;
+        return ChatResultCode::DATABASE;
+    } catch (const std::exception& e) {
+        LOG(ERROR) << "Request failed: " << e.what();
+        return ChatResultCode::DATABASE;
+    } catch (...) {
+        LOG(ERROR) << "Request failed with an unknown exception";
+        return ChatResultCode::DATABASE;
+    }
+}
+
+void GatewayClient::RecordRequest(ChatRequestType type, ChatResultCode result, Clock::time_point start) {
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start);
+    node_->GetRequestMetrics().Record(type, result != ChatResultCode::SUCCESS, elapsed);
+}
+
+void GatewayClient::PostDatabaseWork(std::function<void(ChatStorage&)> work, std::function<void()> deliver) {
+    auto resume = Suspend(std::move(deliver));
+    node_->GetDatabaseExecutor().Post(current_->orderingKey, std::move(work), std::move(resume));
+}
+
+void GatewayClient::AwaitLogin(const LoginRequest& login, std::function<void(ChatAvatar* avatar)> then) {
+    auto avatar = std::make_shared<ChatAvatar*>(nullptr);
+    auto resume = Suspend([avatar, then]() { then(*avatar); });
+
+    node_->GetLoginPipeline().Submit(login, [avatar, resume](ChatAvatar* loggedIn, std::exception_ptr error) {
+        *avatar = loggedIn;
+        resume(error);
+    });
+}
+
+std::function<void(std::exception_ptr error)> GatewayClient::Suspend(std::function<void()> deliver) {
+    if (!current_ || current_->awaiting) {
+        throw std::logic_error("Awaiting needs an awaiting handler and one await per step");
+    }
+
+    current_->awaiting = true;
+
+    auto request = current_;
+    std::weak_ptr<bool> alive = alive_;
+    return [this, alive, request, deliver](std::exception_ptr error) {
+        if (!alive.expired()) {
+            Resume(request, error, deliver);
+        }
+    };
+}
+
+uint32_t GatewayClient::OrderingKey(const ReqLoginAvatar& request, int) {
+    if (request.name.compare(u"SYSTEM") == 0) {
+        return 0;
+    }
+
+    return NameOrderingKey(request.name, request.address);
+}
+
+uint32_t GatewayClient::OrderingKey(const ReqFailoverReLoginAvatar& request, int) {
+    return request.name.compare(u"SYSTEM") == 0 ? 0 : NameOrderingKey(request.name, request.address);
+}
+
+uint32_t GatewayClient::NameOrderingKey(const std::u16string& name, const std::u16string& address) {
+    std::hash<std::u16string> hash;
+
+    // The high bit keeps these apart from avatar ids.
+    return 0x80000000u | static_cast<uint32_t>(hash(name) * 31 + hash(address));
+}
+
+uint32_t GatewayClient::AvatarOrderingKey(uint32_t key) const {
+    if (key == 0 || IsNameOrderingKey(key)) {
+        return key;
+    }
+
+    auto avatar = avatarService_->GetCachedAvatar(key);
+    if (avatar) {
+        return NameOrderingKey(avatar->GetName(), avatar->GetAddress());
+    }
+
+    return IsLoginPending() ? 0 : key;
+}
+
+void GatewayClient::BeginAwaiting(const std::shared_ptr<AwaitingRequest>& request) {
+    ++awaitingByKey_[request->orderingKey];
+    ++awaitingCount_;
+
+    if (IsNameOrderingKey(request->orderingKey)) {
+        ++pendingLoginKeys_;
+    }
+
+    current_ = request;
+}
+
+void GatewayClient::EndAwaiting(const std::shared_ptr<AwaitingRequest>& request, std::exception_ptr error) {
+    current_.reset();
+
+    if (!error && request->awaiting) {
+        return;
+    }
+
+    request->finished = true;
+
+    auto count = awaitingByKey_.find(request->orderingKey);
+    if (--count->second == 0) {
+        awaitingByKey_.erase(count);
+    }
+
+    --awaitingCount_;
+
+    if (IsNameOrderingKey(request->orderingKey)) {
+        --pendingLoginKeys_;
     }
+
+    request->respond(error);
+}
+
+void GatewayClient::Resume(
+    const std::shared_ptr<AwaitingRequest>& request, std::exception_ptr error, const std::function<void()>& deliver) {
+    // A continuation that threw after awaiting again has already responded.
+    if (request->finished) {
+        return;
+    }
+
+    if (!error) {
+        request->awaiting = false;
+        current_ = request;
+
+        try {
+            deliver();
+        } catch (...) {
+            error = std::current_exception();
+        }
+    }
+
+    EndAwaiting(request, error);
+    StartDeferred();
+}
+
+bool GatewayClient::IsAwaiting(uint32_t key) const {
+    if (awaitingCount_ == 0) {
+        return false;
+    }
+
+    return key == 0 || awaitingByKey_.count(key) != 0 || awaitingByKey_.count(0) != 0;
+}
+
+void GatewayClient::Defer(uint32_t key, std::function<void()> start) {
+    deferred_.push_back(DeferredRequest{key, std::move(start)});
+    if (IsNameOrderingKey(key)) {
+        ++pendingLoginKeys_;
+    }
+
+    StartDeferred();
+}
+
+void GatewayClient::StartDeferred() {
+    // A request also waits behind earlier requests for its avatar that are
+    // still waiting themselves, so it cannot overtake them.
+    std::vector<uint32_t> waitingKeys;
+    bool waitingUnkeyed = false;
+
+    auto iter = std::begin(deferred_);
+    while (iter != std::end(deferred_)) {
+        auto key = iter->orderingKey;
+        bool blocked = waitingUnkeyed || IsAwaiting(key)
+            || (key == 0 ? !waitingKeys.empty()
+                         : std::find(std::begin(waitingKeys), std::end(waitingKeys), key) != std::end(waitingKeys));
+
+        if (blocked) {
+            if (key == 0) {
+                waitingUnkeyed = true;
+            } else {
+                waitingKeys.push_back(key);
+            }
+
+            ++iter;
+            continue;
+        }
+
+        if (IsNameOrderingKey(key)) {
+            --pendingLoginKeys_;
+        }
+
+        auto start = std::move(iter->start);
+        iter = deferred_.erase(iter);
+        start();
+    }
+}
+
+void GatewayClient::OnResponseSent(const SetApiVersion*) {
+    // The handshake response itself is always sent unbatched; batching only
+    // applies to messages after it.
+    EnableBatching((capabilities_ & StationChatConfig::kCapabilityBatchedPackets)
+            ? node_->GetConfig().maxBatchedPacketSize
+            : 0);
 }
 
 void GatewayClient::SendFriendLoginUpdate(
     const ChatAvatar* srcAvatar, const ChatAvatar* destAvatar) {
-    node_->SendTo(
-        srcAvatar->GetAddress(), MFriendLogin{destAvatar, destAvatar->GetAddress(),
-                                     srcAvatar->GetAvatarId(), destAvatar->GetStatusMessage()});
+    node_->SendTo(srcAvatar->GetAddressId(),
+        MFriendLogin{destAvatar, destAvatar->GetAddress(), srcAvatar->GetAvatarId(), destAvatar->GetStatusMessage()},
+        SendPriority::DEFERRABLE);
 }
 
 void GatewayClient::SendFriendLoginUpdates(const ChatAvatar* avatar) {
+    static FanoutMetrics metrics{"friend_login"};
+    ScopedMetricTimer timer{metrics.duration};
+
     auto as = node_->GetAvatarService();
     auto& onlineAvatars = as->GetOnlineAvatars();
     for (auto onlineAvatar : onlineAvatars) {
         if (onlineAvatar->IsFriend(avatar)) {
             SendFriendLoginUpdate(onlineAvatar, avatar);
+            metrics.messages.Increment();
         }
     }
 
     for (auto& contact : avatar->GetFriendList()) {
         if (contact.frnd->IsOnline()) {
             Send(MFriendLogin{contact.frnd, contact.frnd->GetAddress(), avatar->GetAvatarId(),
-                contact.frnd->GetStatusMessage()});
+                     contact.frnd->GetStatusMessage()},
+                SendPriority::DEFERRABLE);
+            metrics.messages.Increment();
         }
     }
 }
 
 void GatewayClient::SendFriendLogoutUpdates(const ChatAvatar* avatar) {
+    static FanoutMetrics metrics{"friend_logout"};
+    ScopedMetricTimer timer{metrics.duration};
+
     auto& onlineAvatars = avatarService_->GetOnlineAvatars();
     for (auto onlineAvatar : onlineAvatars) {
         if (onlineAvatar->IsFriend(avatar)) {
-            node_->SendTo(onlineAvatar->GetAddress(),
-                MFriendLogout{avatar, avatar->GetAddress(), onlineAvatar->GetAvatarId()});
+            node_->SendTo(onlineAvatar->GetAddressId(),
+                MFriendLogout{avatar, avatar->GetAddress(), onlineAvatar->GetAvatarId()}, SendPriority::DEFERRABLE);
+            metrics.messages.Increment();
         }
     }
 }
 
 void GatewayClient::SendDestroyRoomUpdate(
-    const ChatAvatar* srcAvatar, uint32_t roomId, std::vector<std::u16string> targets) {
+    const ChatAvatar* srcAvatar, uint32_t roomId, std::vector<AddressId> targets) {
+    static FanoutMetrics metrics{"destroy_room"};
+    ScopedMetricTimer timer{metrics.duration};
+    metrics.messages.Increment(targets.size());
+
     for (auto& address : targets) {
         node_->SendTo(address, MDestroyRoom{srcAvatar, roomId});
     }
@@ -206,13 +467,18 @@ void GatewayClient::SendDestroyRoomUpdate(
 
 void GatewayClient::SendInstantMessageUpdate(const ChatAvatar* srcAvatar,
     const ChatAvatar* destAvatar, const std::u16string& message, const std::u16string& oob) {
-    node_->SendTo(destAvatar->GetAddress(),
+    node_->SendTo(destAvatar->GetAddressId(),
         MInstantMessage{srcAvatar, destAvatar->GetAvatarId(), message, oob});
 }
 
 void GatewayClient::SendRoomMessageUpdate(const ChatAvatar* srcAvatar, const ChatRoom* room,
     uint32_t messageId, const std::u16string& message, const std::u16string& oob) {
+    static FanoutMetrics metrics{"room_message"};
+    ScopedMetricTimer timer{metrics.duration};
+
     auto connectedAddresses = room->GetConnectedAddresses();
+    metrics.messages.Increment(connectedAddresses.size());
+
     for (auto& address : connectedAddresses) {
         node_->SendTo(address, MRoomMessage{srcAvatar, room->GetRoomId(), room->GetAvatarIds(srcAvatar),
                                    message, oob, messageId});
@@ -220,13 +486,23 @@ void GatewayClient::SendRoomMessageUpdate(const ChatAvatar* srcAvatar, const Cha
 }
 
 void GatewayClient::SendEnterRoomUpdate(const ChatAvatar* srcAvatar, const ChatRoom* room) {
-    for (const auto& address : room->GetConnectedAddresses()) {
+    static FanoutMetrics metrics{"enter_room"};
+    ScopedMetricTimer timer{metrics.duration};
+
+    auto connectedAddresses = room->GetConnectedAddresses();
+    metrics.messages.Increment(connectedAddresses.size());
+
+    for (const auto& address : connectedAddresses) {
         node_->SendTo(address, MEnterRoom{srcAvatar, room->GetRoomId()});
     }
 }
 
 void GatewayClient::SendLeaveRoomUpdate(
-    const std::vector<std::u16string>& addresses, uint32_t srcAvatarId, uint32_t roomId) {
+    const std::vector<AddressId>& addresses, uint32_t srcAvatarId, uint32_t roomId) {
+    static FanoutMetrics metrics{"leave_room"};
+    ScopedMetricTimer timer{metrics.duration};
+    metrics.messages.Increment(addresses.size());
+
     for (const auto& address : addresses) {
         node_->SendTo(address, MLeaveRoom{srcAvatarId, roomId});
     }
@@ -236,12 +512,16 @@ void GatewayClient::SendPersistentMessageUpdate(
     const ChatAvatar* destAvatar, const PersistentHeader& header) {
     if (destAvatar) {
         node_->SendTo(
-            destAvatar->GetAddress(), MPersistentMessage{destAvatar->GetAvatarId(), header});
+            destAvatar->GetAddressId(), MPersistentMessage{destAvatar->GetAvatarId(), header});
     }
 }
 
-void GatewayClient::SendKickAvatarUpdate(const std::vector<std::u16string>& addresses,
+void GatewayClient::SendKickAvatarUpdate(const std::vector<AddressId>& addresses,
     const ChatAvatar* srcAvatar, const ChatAvatar* destAvatar, const ChatRoom* room) {
+    static FanoutMetrics metrics{"kick_avatar"};
+    ScopedMetricTimer timer{metrics.duration};
+    metrics.messages.Increment(addresses.size());
+
     for (const auto& address : addresses) {
         node_->SendTo(address,
             MKickAvatar{srcAvatar, destAvatar, room->GetRoomName(), room->GetRoomAddress()});
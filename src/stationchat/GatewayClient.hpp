@@ -1,19 +1,39 @@
 
 #pragma once
 
+#include "AddressTable.hpp"
 #include "ChatEnums.hpp"
 #include "NodeClient.hpp"
 #include "MariaDB.hpp"
+#include "RequestMetrics.hpp"
 #include "easylogging++.h"
 
+#include <boost/optional.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+
 class ChatAvatar;
 class ChatAvatarService;
 class ChatRoom;
 class ChatRoomService;
 class GatewayNode;
-class PersistentMessageService;
+class ChatStorage;
 class UdpConnection;
+struct LoginRequest;
+struct ReqFailoverReLoginAvatar;
+struct ReqLoginAvatar;
 
+class SetApiVersion;
+
+struct GatewayRequestDispatch;
 struct PersistentHeader;
 
 struct ReqSetAvatarAttributes;
@@ -26,44 +46,252 @@ public:
 
     GatewayNode* GetNode() { return node_; }
 
+    /** Records the capabilities agreed on during SETAPIVERSION; 0 for legacy clients.
+     */
+    void SetNegotiatedCapabilities(uint32_t capabilities) { capabilities_ = capabilities; }
+    uint32_t GetNegotiatedCapabilities() const { return capabilities_; }
+
+    /** Requests ordered by an avatar name, logins among them, that are
+     * awaiting or deferred; requests for uncached avatars wait while any are.
+     */
+    uint32_t GetPendingLoginCount() const { return pendingLoginKeys_; }
+
+    /** Sets the send queue limits from the node's current configuration.
+     */
+    void ApplySendQueueLimits();
+
     void SendFriendLoginUpdate(const ChatAvatar* srcAvatar, const ChatAvatar* destAvatar);
     void SendFriendLoginUpdates(const ChatAvatar* avatar);
     void SendFriendLogoutUpdates(const ChatAvatar* avatar);
-    void SendDestroyRoomUpdate(const ChatAvatar* srcAvatar, uint32_t roomId, std::vector<std::u16string> targets);
+    void SendDestroyRoomUpdate(const ChatAvatar* srcAvatar, uint32_t roomId, std::vector<AddressId> targets);
     void SendInstantMessageUpdate(const ChatAvatar* srcAvatar, const ChatAvatar* destAvatar, const std::u16string& message, const std::u16string& oob);
     void SendRoomMessageUpdate(const ChatAvatar* srcAvatar, const ChatRoom* room, uint32_t messageId, const std::u16string& message, const std::u16string& oob);
     void SendEnterRoomUpdate(const ChatAvatar* srcAvatar, const ChatRoom* room);
-    void SendLeaveRoomUpdate(const std::vector<std::u16string>& addresses, uint32_t srcAvatarId, uint32_t roomId);
+    void SendLeaveRoomUpdate(const std::vector<AddressId>& addresses, uint32_t srcAvatarId, uint32_t roomId);
     void SendPersistentMessageUpdate(const ChatAvatar* destAvatar, const PersistentHeader& header);
-    void SendKickAvatarUpdate(const std::vector<std::u16string>& addresses, const ChatAvatar* srcAvatar, const ChatAvatar* destAvatar, const ChatRoom* room);
+    void SendKickAvatarUpdate(const std::vector<AddressId>& addresses, const ChatAvatar* srcAvatar, const ChatAvatar* destAvatar, const ChatRoom* room);
+
+    /** The co_await of handlers that declare kAwaitsDatabase: runs work on a
+     * database worker with a connection of its own, then continues on the
+     * gateway thread with then(result), or then() for work returning void.
+     * A continuation may await again. The response is sent once the last
+     * continuation returns; an exception thrown by the work or a continuation
+     * becomes its result code, as it would for a synchronous handler.
+     */
+    template <typename WorkT, typename ThenT>
+    void AwaitDatabase(WorkT work, ThenT then) {
+        using ResultT = decltype(work(std::declval<ChatStorage&>()));
+
+        auto result = std::make_shared<AwaitedResult<ResultT>>();
+        PostDatabaseWork([result, work](ChatStorage& storage) mutable { result->Run(work, storage); },
+            [result, then]() mutable { result->Deliver(then); });
+    }
+
+    /** Awaits the login pipeline the same way, continuing with then(avatar)
+     * once the avatar is resolved, loaded and marked online.
+     */
+    void AwaitLogin(const LoginRequest& login, std::function<void(ChatAvatar* avatar)> then);
 
 private:
+    friend struct GatewayRequestDispatch;
+
+    using Clock = std::chrono::steady_clock;
+
+    template <typename ResultT>
+    struct AwaitedResult {
+        template <typename WorkT>
+        void Run(WorkT& work, ChatStorage& storage) { value = work(storage); }
+
+        template <typename ThenT>
+        void Deliver(ThenT& then) { then(std::move(*value)); }
+
+        boost::optional<ResultT> value;
+    };
+
+    /** A request whose handler awaited the database and has not responded.
+     */
+    struct AwaitingRequest {
+        uint32_t orderingKey = 0;
+        bool awaiting = false;
+        bool finished = false;
+        std::function<void(std::exception_ptr error)> respond;
+    };
+
+    struct DeferredRequest {
+        uint32_t orderingKey;
+        std::function<void()> start;
+    };
+
+    template <typename HandlerT, typename = void>
+    struct AwaitsDatabase : std::false_type {};
+
+    template <typename HandlerT>
+    struct AwaitsDatabase<HandlerT, decltype(void(HandlerT::kAwaitsDatabase))>
+        : std::integral_constant<bool, HandlerT::kAwaitsDatabase> {};
+
     void OnIncoming(std::istringstream& istream) override;
 
+    // Requests for one avatar are answered in the order they arrived. The
+    // avatar is the request's srcAvatarId or avatarId; requests naming
+    // neither are ordered against every other request on the connection.
+    template <typename RequestT>
+    static auto OrderingKey(const RequestT& request, int) -> decltype(request.srcAvatarId) {
+        return request.srcAvatarId;
+    }
+
+    template <typename RequestT>
+    static auto OrderingKey(const RequestT& request, long) -> decltype(request.avatarId) {
+        return request.avatarId;
+    }
+
+    template <typename RequestT>
+    static uint32_t OrderingKey(const RequestT&, ...) { return 0; }
+
+    // Logins are ordered by the name they log in, as the avatar id is not
+    // known yet; the SYSTEM avatar's login loads the rooms every other
+    // request relies on, so it is ordered against all of them.
+    static uint32_t OrderingKey(const ReqLoginAvatar& request, int);
+    static uint32_t OrderingKey(const ReqFailoverReLoginAvatar& request, int);
+    static uint32_t NameOrderingKey(const std::u16string& name, const std::u16string& address);
+
+    /** Turns an avatar id key into the key of the avatar's name, so requests
+     * for an avatar wait behind a login for it that is still under way. An
+     * avatar that is not cached may be the one a login is resolving, so while
+     * any login is under way its requests are ordered against all others.
+     */
+    uint32_t AvatarOrderingKey(uint32_t key) const;
+    bool IsLoginPending() const { return pendingLoginKeys_ != 0; }
+    static bool IsNameOrderingKey(uint32_t key) { return (key & 0x80000000u) != 0; }
+
     template<typename HandlerT, typename StreamT>
-    void HandleIncomingMessage(StreamT& istream) {
+    void HandleIncomingMessage(StreamT& istream, ChatRequestType type) {
         typedef typename HandlerT::RequestType RequestT;
-        typedef typename HandlerT::ResponseType ResponseT;
+
+        auto start = kRequestMetricsEnabled ? Clock::now() : Clock::time_point{};
 
         RequestT request;
         read(istream, request);
-        ResponseT response(request.track);
+
+        uint32_t key = AvatarOrderingKey(OrderingKey(request, 0));
+        if (deferred_.empty() && !IsAwaiting(key)) {
+            Start<HandlerT>(request, type, start, key, AwaitsDatabase<HandlerT>{});
+            return;
+        }
+
+        Defer(key, [this, request, type, start, key]() {
+            Start<HandlerT>(request, type, start, key, AwaitsDatabase<HandlerT>{});
+        });
+    }
+
+    template <typename HandlerT>
+    void Start(const typename HandlerT::RequestType& request, ChatRequestType type, Clock::time_point start,
+        uint32_t, std::false_type) {
+        typename HandlerT::ResponseType response(request.track);
 
         try {
             HandlerT(this, request, response);
-        } catch (const ChatResultException& e) {
-            response.result = e.code;
-            LOG(ERROR) << "ChatAPI Result Exception: [" << ToString(e.code) << "] " << e.message;
-        } catch (const MariaDBException& e) {
-            response.result = ChatResultCode::DATABASE;
-            LOG(ERROR) << "Database Error: [" << e.code << "] " << e.message;
+        } catch (...) {
+            response.result = ResultOf(std::current_exception());
+        }
+
+        Respond<HandlerT>(response, type, start);
+    }
+
+    template <typename HandlerT>
+    void Start(const typename HandlerT::RequestType& request, ChatRequestType type, Clock::time_point start,
+        uint32_t key, std::true_type) {
+        struct State {
+            explicit State(const typename HandlerT::RequestType& request_)
+                : request{request_}
+                , response{request_.track} {}
+
+            typename HandlerT::RequestType request;
+            typename HandlerT::ResponseType response;
+        };
+
+        auto state = std::make_shared<State>(request);
+        auto awaiting = std::make_shared<AwaitingRequest>();
+        awaiting->orderingKey = key;
+        awaiting->respond = [this, state, type, start](std::exception_ptr error) {
+            if (error) {
+                state->response.result = ResultOf(error);
+            }
+
+            Respond<HandlerT>(state->response, type, start);
+        };
+
+        BeginAwaiting(awaiting);
+
+        std::exception_ptr error;
+        try {
+            HandlerT(this, state->request, state->response);
+        } catch (...) {
+            error = std::current_exception();
         }
 
+        EndAwaiting(awaiting, error);
+    }
+
+    template <typename HandlerT, typename ResponseT>
+    void Respond(const ResponseT& response, ChatRequestType type, Clock::time_point start) {
         Send(response);
+        OnResponseSent(static_cast<const HandlerT*>(nullptr));
+
+        if (kRequestMetricsEnabled) {
+            RecordRequest(type, response.result, start);
+        }
     }
-    
+
+    /** Maps an exception escaping a handler to its result code; errors that
+     * are neither chat nor database errors are reported as DATABASE.
+     */
+    static ChatResultCode ResultOf(std::exception_ptr error);
+
+    void RecordRequest(ChatRequestType type, ChatResultCode result, Clock::time_point start);
+    void PostDatabaseWork(std::function<void(ChatStorage&)> work, std::function<void()> deliver);
+
+    /** Marks the running handler or continuation as awaiting and returns what
+     * resumes it: deliver runs unless the awaited work failed.
+     */
+    std::function<void(std::exception_ptr error)> Suspend(std::function<void()> deliver);
+    void BeginAwaiting(const std::shared_ptr<AwaitingRequest>& request);
+    void EndAwaiting(const std::shared_ptr<AwaitingRequest>& request, std::exception_ptr error);
+    void Resume(const std::shared_ptr<AwaitingRequest>& request, std::exception_ptr error,
+        const std::function<void()>& deliver);
+    bool IsAwaiting(uint32_t key) const;
+    void Defer(uint32_t key, std::function<void()> start);
+    void StartDeferred();
+
+    // Hooks for handlers that change connection state once their response is
+    // on the wire; overload resolution picks them at compile time.
+    void OnResponseSent(const void*) {}
+    void OnResponseSent(const SetApiVersion*);
+
     GatewayNode* node_;
     ChatAvatarService* avatarService_;
     ChatRoomService* roomService_;
-    PersistentMessageService* messageService_;
+    uint32_t capabilities_ = 0;
+
+    // The handler or continuation currently running that may await.
+    std::shared_ptr<AwaitingRequest> current_;
+    std::unordered_map<uint32_t, uint32_t> awaitingByKey_;
+    uint32_t awaitingCount_ = 0;
+    std::deque<DeferredRequest> deferred_;
+
+    // Awaiting and deferred requests ordered by an avatar name, as every
+    // login is.
+    uint32_t pendingLoginKeys_ = 0;
+
+    // Completions of database work check it before touching a client that
+    // has since disconnected.
+    std::shared_ptr<bool> alive_ = std::make_shared<bool>(true);
+};
+
+template <>
+struct GatewayClient::AwaitedResult<void> {
+    template <typename WorkT>
+    void Run(WorkT& work, ChatStorage& storage) { work(storage); }
+
+    template <typename ThenT>
+    void Deliver(ThenT& then) { then(); }
 };
@@ -0,0 +1,169 @@
+#include "GatewayLoadChannel.hpp"
+
+#include "Serialization.hpp"
+#include "StationChatConfig.hpp"
+
+#include "easylogging++.h"
+
+#include <boost/asio.hpp>
+
+#include <algorithm>
+#include <array>
+#include <sstream>
+#include <unordered_map>
+
+namespace {
+
+constexpr uint32_t kLoadReportMagic = 0x534c4452; // "SLDR"
+constexpr uint16_t kLoadReportVersion = 1;
+
+} // namespace
+
+std::string EncodeGatewayLoadReport(const GatewayLoadReport& report) {
+    std::ostringstream stream;
+    write(stream, kLoadReportMagic);
+    write(stream, kLoadReportVersion);
+    write(stream, report.address);
+    write(stream, report.port);
+    write(stream, report.onlineAvatars);
+    write(stream, report.connections);
+    write(stream, report.queuedBytes);
+    write(stream, report.tickMicros);
+    return stream.str();
+}
+
+bool DecodeGatewayLoadReport(const char* data, std::size_t length, GatewayLoadReport& report) {
+    std::istringstream stream{std::string{data, length}};
+
+    uint32_t magic = 0;
+    uint16_t version = 0;
+    read(stream, magic);
+    read(stream, version);
+
+    if (!stream || magic != kLoadReportMagic || version != kLoadReportVersion) {
+        return false;
+    }
+
+    GatewayLoadReport decoded;
+    read(stream, decoded.address);
+    read(stream, decoded.port);
+    read(stream, decoded.onlineAvatars);
+    read(stream, decoded.connections);
+    read(stream, decoded.queuedBytes);
+    read(stream, decoded.tickMicros);
+
+    if (!stream || decoded.address.empty() || decoded.port == 0) {
+        return false;
+    }
+
+    report = std::move(decoded);
+    return true;
+}
+
+struct GatewayLoadPublisher::Impl {
+    boost::asio::io_context ioContext;
+    boost::asio::ip::udp::socket socketV4{ioContext};
+    boost::asio::ip::udp::socket socketV6{ioContext};
+    std::vector<boost::asio::ip::udp::endpoint> targets;
+};
+
+GatewayLoadPublisher::GatewayLoadPublisher(const std::vector<GatewayClusterEndpoint>& cluster, uint16_t port)
+    : impl_{std::make_unique<Impl>()} {
+    for (const auto& endpoint : cluster) {
+        boost::system::error_code error;
+        auto address = boost::asio::ip::make_address(endpoint.GetHostAddress(), error);
+        if (error) {
+            LOG(WARNING) << "No address for " << endpoint.address << "; it gets no gateway load reports";
+            continue;
+        }
+
+        // Several gateways on one host share that host's registrar.
+        boost::asio::ip::udp::endpoint target{address, port};
+        if (std::find(std::begin(impl_->targets), std::end(impl_->targets), target) == std::end(impl_->targets)) {
+            impl_->targets.push_back(target);
+        }
+    }
+
+    for (const auto& target : impl_->targets) {
+        auto& socket = target.address().is_v4() ? impl_->socketV4 : impl_->socketV6;
+        if (!socket.is_open()) {
+            socket.open(target.protocol());
+            socket.non_blocking(true);
+        }
+    }
+}
+
+GatewayLoadPublisher::~GatewayLoadPublisher() {}
+
+void GatewayLoadPublisher::Publish(const GatewayLoadReport& report) {
+    auto datagram = EncodeGatewayLoadReport(report);
+
+    for (const auto& target : impl_->targets) {
+        auto& socket = target.address().is_v4() ? impl_->socketV4 : impl_->socketV6;
+
+        // A full send buffer or an unreachable registrar only costs one report.
+        boost::system::error_code ignored;
+        socket.send_to(boost::asio::buffer(datagram), target, 0, ignored);
+    }
+}
+
+struct GatewayLoadListener::Impl {
+    Impl(const std::string& address, uint16_t port)
+        : socket{ioContext, boost::asio::ip::udp::endpoint{boost::asio::ip::make_address(address), port}} {
+        socket.non_blocking(true);
+    }
+
+    boost::asio::io_context ioContext;
+    boost::asio::ip::udp::socket socket;
+    std::unordered_map<std::string, boost::asio::ip::address> hosts;
+};
+
+GatewayLoadListener::GatewayLoadListener(const std::string& address, uint16_t port)
+    : impl_{std::make_unique<Impl>(address, port)} {}
+
+GatewayLoadListener::~GatewayLoadListener() {}
+
+void GatewayLoadListener::SetCluster(const std::vector<GatewayClusterEndpoint>& cluster) {
+    impl_->hosts.clear();
+
+    for (const auto& endpoint : cluster) {
+        boost::system::error_code error;
+        auto address = boost::asio::ip::make_address(endpoint.GetHostAddress(), error);
+        if (error) {
+            LOG(WARNING) << "Ignoring load reports for " << endpoint.address << ", whose host did not resolve";
+            continue;
+        }
+
+        impl_->hosts[endpoint.address] = address;
+    }
+}
+
+void GatewayLoadListener::Poll(const std::function<void(const GatewayLoadReport&)>& visitor) {
+    std::array<char, 512> buffer;
+    boost::asio::ip::udp::endpoint sender;
+
+    // Stops once the socket would block.
+    for (;;) {
+        boost::system::error_code error;
+        auto received = impl_->socket.receive_from(boost::asio::buffer(buffer), sender, 0, error);
+        // Anything else, such as a reset reported for an earlier datagram on
+        // Windows, is left for the next tick to retry.
+        if (error) {
+            return;
+        }
+
+        GatewayLoadReport report;
+        if (!DecodeGatewayLoadReport(buffer.data(), received, report)) {
+            continue;
+        }
+
+        // A gateway only speaks for itself; anyone else could steer logins
+        // by reporting a gateway idle.
+        auto host = impl_->hosts.find(report.address);
+        if (host != std::end(impl_->hosts) && host->second == sender.address()) {
+            visitor(report);
+        }
+    }
+}
+
+uint16_t GatewayLoadListener::GetPort() const { return impl_->socket.local_endpoint().port(); }
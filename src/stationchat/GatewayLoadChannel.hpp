@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct GatewayClusterEndpoint;
+
+/** Live load of one gateway, as published to the registrars of its cluster.
+ * The address and port are the gateway's advertised endpoint and identify it
+ * in the registrar's cluster view.
+ */
+struct GatewayLoadReport {
+    std::string address;
+    uint16_t port{0};
+    uint32_t onlineAvatars{0};
+    uint32_t connections{0};
+    uint64_t queuedBytes{0};
+    uint32_t tickMicros{0};
+};
+
+/** Packs a report into a single datagram.
+ */
+std::string EncodeGatewayLoadReport(const GatewayLoadReport& report);
+
+/** Unpacks a datagram, returning false for anything that is not a complete
+ * report of a known version.
+ */
+bool DecodeGatewayLoadReport(const char* data, std::size_t length, GatewayLoadReport& report);
+
+/** Sends load reports over UDP to the registrar load port on every host in
+ * the cluster. Reports are fire-and-forget; a lost one is replaced by the
+ * next.
+ */
+class GatewayLoadPublisher {
+public:
+    GatewayLoadPublisher(const std::vector<GatewayClusterEndpoint>& cluster, uint16_t port);
+    ~GatewayLoadPublisher();
+
+    GatewayLoadPublisher(const GatewayLoadPublisher&) = delete;
+    GatewayLoadPublisher& operator=(const GatewayLoadPublisher&) = delete;
+
+    void Publish(const GatewayLoadReport& report);
+
+private:
+    // Keeps boost::asio out of every translation unit that owns a publisher.
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+/** Receives load reports on a non-blocking UDP socket, polled from the
+ * registrar tick so that no extra thread is needed.
+ */
+class GatewayLoadListener {
+public:
+    GatewayLoadListener(const std::string& address, uint16_t port);
+    ~GatewayLoadListener();
+
+    GatewayLoadListener(const GatewayLoadListener&) = delete;
+    GatewayLoadListener& operator=(const GatewayLoadListener&) = delete;
+
+    /** Accepts reports only about these gateways, and only when they come
+     * from the gateway's own host. Until it is called nothing is accepted.
+     */
+    void SetCluster(const std::vector<GatewayClusterEndpoint>& cluster);
+
+    /** Hands every report received since the last poll to the visitor.
+     * Malformed datagrams and reports from any other host are dropped.
+     */
+    void Poll(const std::function<void(const GatewayLoadReport&)>& visitor);
+
+    /** Port the listener is bound to, which differs from the requested port
+     * when that was 0.
+     */
+    uint16_t GetPort() const;
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
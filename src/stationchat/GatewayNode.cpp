@@ -3,27 +3,107 @@
 
 #include "ChatAvatarService.hpp"
 #include "ChatRoomService.hpp"
-#include "MariaDB.hpp"
+#include "ChatStateSnapshot.hpp"
+#include "ClusterReplicator.hpp"
+#include "DatabaseExecutor.hpp"
+#include "GatewayLoadChannel.hpp"
+#include "InMemoryChatStorage.hpp"
+#include "LoginPipeline.hpp"
+#include "MariaDBChatStorage.hpp"
+#include "Metrics.hpp"
 #include "PersistentMessageService.hpp"
 #include "StationChatConfig.hpp"
 #include "WebsiteIntegrationService.hpp"
 
+#include "easylogging++.h"
+
+namespace {
+
+struct GatewayGauges {
+    MetricGauge& clients = GetMetricsRegistry().Gauge("stationchat_gateway_clients", "Connected game servers");
+    MetricGauge& onlineAvatars = GetMetricsRegistry().Gauge("stationchat_online_avatars", "Avatars logged in");
+    MetricGauge& cachedAvatars = GetMetricsRegistry().Gauge("stationchat_cached_avatars", "Avatars held in the cache");
+    MetricGauge& cachedAvatarBytes =
+        GetMetricsRegistry().Gauge("stationchat_cached_avatar_bytes", "Approximate memory held by cached avatars");
+    MetricGauge& queuedLogins =
+        GetMetricsRegistry().Gauge("stationchat_logins_queued", "Logins waiting for a place in the login pipeline");
+    MetricGauge& inFlightLogins =
+        GetMetricsRegistry().Gauge("stationchat_logins_in_flight", "Logins between the queue and their response");
+    MetricGauge& queuedBytes =
+        GetMetricsRegistry().Gauge("stationchat_send_queue_bytes", "Bytes queued to all game servers");
+    MetricGauge& deferredMessages = GetMetricsRegistry().Gauge(
+        "stationchat_send_queue_deferred_messages", "Presence updates held back for congested game servers");
+    MetricGauge& congestedClients =
+        GetMetricsRegistry().Gauge("stationchat_send_queue_congested_clients", "Game servers over the high watermark");
+};
+
+} // namespace
+
 GatewayNode::GatewayNode(StationChatConfig& config)
     : Node(this, config.gatewayAddress, config.gatewayPort, config.bindToIp)
     , config_{config} {
-    auto connectionString = config.BuildDatabaseConnectionString();
-    if (mariadb_open(connectionString.c_str(), &db_) != MARIADB_OK) {
-        throw std::runtime_error("Can't open database: " + std::string{mariadb_errmsg(db_)});
+    if (config_.storageBackend == "memory") {
+        LOG(INFO) << "Using in-memory chat storage; nothing is persisted across restarts";
+        storage_ = std::make_unique<InMemoryChatStorage>();
+    } else if (config_.storageBackend == "mariadb") {
+        auto storage = std::make_unique<MariaDBChatStorage>(config.BuildDatabaseConnectionString());
+        db_ = storage->GetConnection();
+        storage_ = std::move(storage);
+    } else {
+        throw std::runtime_error("Unknown storage backend: " + config_.storageBackend);
+    }
+
+    // Database workers each open a connection of their own; the in-memory
+    // store has nothing to connect to and runs awaited work inline.
+    uint32_t databaseWorkers = db_ ? config_.databaseWorkers : 0;
+    databaseExecutor_ = std::make_unique<DatabaseExecutor>(databaseWorkers,
+        [connectionString = config_.BuildDatabaseConnectionString()]() -> std::unique_ptr<ChatStorage> {
+            return std::make_unique<MariaDBChatStorage>(connectionString);
+        },
+        storage_.get());
+
+    if (databaseWorkers != 0) {
+        LOG(INFO) << "Running awaited database work on " << databaseWorkers << " workers";
+    }
+
+    avatarService_ = std::make_unique<ChatAvatarService>(storage_.get(), storage_.get());
+    avatarService_->SetCacheLimits(config_.avatarCacheMaxEntries,
+        static_cast<std::size_t>(config_.avatarCacheMaxMegabytes) * 1024 * 1024);
+    roomService_ = std::make_unique<ChatRoomService>(avatarService_.get(), storage_.get());
+    messageService_ = std::make_unique<PersistentMessageService>(storage_.get());
+
+    // The website tables live alongside the chat schema.
+    if (db_) {
+        websiteIntegrationService_ = std::make_unique<WebsiteIntegrationService>(db_, config_);
+    }
+
+    replicator_ = std::make_unique<ClusterReplicator>(this, config_);
+
+    loginPipeline_ = std::make_unique<LoginPipeline>(this);
+    loginPipeline_->SetLimits(config_.loginConcurrency, config_.loginBatchSize);
+
+    if (config_.gatewayLoadReportPort != 0) {
+        loadPublisher_ = std::make_unique<GatewayLoadPublisher>(config_.gatewayCluster, config_.gatewayLoadReportPort);
     }
 
-    avatarService_ = std::make_unique<ChatAvatarService>(db_);
-    roomService_ = std::make_unique<ChatRoomService>(avatarService_.get(), db_);
-    messageService_ = std::make_unique<PersistentMessageService>(db_);
+    RestoreSnapshot();
 
-    websiteIntegrationService_ = std::make_unique<WebsiteIntegrationService>(db_, config_);
+    auto& timers = GetTimers();
+    timers.SetLagHistogram(&GetMetricsRegistry().Histogram("stationapi_timer_lag_microseconds",
+        "Time from when a node timer was due to when it fired", "node=\"gateway\""));
+    timers.SchedulePeriodic(std::chrono::seconds(1), [this]() { EnforceAvatarCacheLimits(); });
+    timers.SchedulePeriodic(std::chrono::seconds(1), [this]() { PublishGauges(); });
+    timers.SchedulePeriodic(std::chrono::seconds(60), [this]() { ReportSendQueues(); });
+    ScheduleConfiguredTimers();
 }
 
-GatewayNode::~GatewayNode() { mariadb_close(db_); }
+GatewayNode::~GatewayNode() {
+    if (pendingSnapshotWrite_.valid()) {
+        pendingSnapshotWrite_.wait();
+    }
+
+    snapshotReconciler_.reset();
+}
 
 ChatAvatarService* GatewayNode::GetAvatarService() { return avatarService_.get(); }
 
@@ -39,8 +119,214 @@ WebsiteIntegrationService* GatewayNode::GetWebsiteIntegrationService() {
 
 StationChatConfig& GatewayNode::GetConfig() { return config_; }
 
-void GatewayNode::RegisterClientAddress(const std::u16string & address, GatewayClient * client) {
-    clientAddressMap_[address] = client;
+void GatewayNode::SetWebsiteIntegrationService(std::unique_ptr<WebsiteIntegrationService> service) {
+    websiteIntegrationService_ = std::move(service);
+}
+
+void GatewayNode::RegisterClientAddress(AddressId address, GatewayClient* client) {
+    clientRegistry_.Register(address, client);
+}
+
+void GatewayNode::Reconfigure() {
+    // The cluster settings are the only ones that can be rejected, so they
+    // are checked first and nothing changes when they are.
+    std::unique_ptr<GatewayLoadPublisher> loadPublisher;
+    if (loadPublisher_) {
+        loadPublisher = std::make_unique<GatewayLoadPublisher>(config_.gatewayCluster, config_.gatewayLoadReportPort);
+    }
+
+    replicator_->SetCluster(config_.gatewayCluster);
+    if (loadPublisher) {
+        loadPublisher_ = std::move(loadPublisher);
+    }
+
+    avatarService_->SetCacheLimits(config_.avatarCacheMaxEntries,
+        static_cast<std::size_t>(config_.avatarCacheMaxMegabytes) * 1024 * 1024);
+    EnforceAvatarCacheLimits();
+
+    loginPipeline_->SetLimits(config_.loginConcurrency, config_.loginBatchSize);
+
+    ForEachClient([](GatewayClient* client) { client->ApplySendQueueLimits(); });
+
+    ScheduleConfiguredTimers();
+
+    LOG(INFO) << "Gateway reconfigured for " << GetClientCount() << " connected game servers";
+}
+
+void GatewayNode::OnClientDisconnected(GatewayClient* client) {
+    clientRegistry_.RemoveClient(client);
+}
+
+void GatewayNode::SaveSnapshot() {
+    if (config_.snapshotFile.empty()) {
+        return;
+    }
+
+    if (pendingSnapshotWrite_.valid()) {
+        pendingSnapshotWrite_.wait();
+    }
+
+    auto data = ChatStateSnapshot::Capture(*avatarService_, *roomService_);
+    if (ChatStateSnapshot::WriteFile(config_.snapshotFile, data)) {
+        LOG(INFO) << "Wrote state snapshot " << config_.snapshotFile << " (" << data.size() << " bytes)";
+    } else {
+        LOG(ERROR) << "Failed to write state snapshot " << config_.snapshotFile;
+    }
+}
+
+void GatewayNode::OnTick() {
+    databaseExecutor_->RunCompletions();
+    loginPipeline_->Pump();
+    replicator_->Tick();
+    ProcessSnapshotReconciliation();
+
+    // The gap between ticks covers request handling as well as this node's
+    // own housekeeping, so it is the latency a newly placed login would see.
+    auto now = std::chrono::steady_clock::now();
+    if (lastTickTime_ != std::chrono::steady_clock::time_point{}) {
+        longestTick_ = std::max(longestTick_, now - lastTickTime_);
+    }
+
+    lastTickTime_ = now;
 }
 
-void GatewayNode::OnTick() {}
+void GatewayNode::ScheduleConfiguredTimers() {
+    auto& timers = GetTimers();
+    timers.Cancel(loadReportTimer_);
+    timers.Cancel(snapshotTimer_);
+    loadReportTimer_ = 0;
+    snapshotTimer_ = 0;
+
+    if (loadPublisher_) {
+        auto interval = std::chrono::milliseconds(std::max<uint32_t>(config_.gatewayLoadReportIntervalMs, 1));
+        loadReportTimer_ = timers.SchedulePeriodic(interval, [this]() { PublishLoad(); });
+    }
+
+    if (!config_.snapshotFile.empty() && config_.snapshotIntervalSeconds > 0) {
+        snapshotTimer_ = timers.SchedulePeriodic(
+            std::chrono::seconds(config_.snapshotIntervalSeconds), [this]() { WriteSnapshotAsync(); });
+    }
+}
+
+void GatewayNode::EnforceAvatarCacheLimits() {
+    if (avatarService_->RefreshCacheUsage()) {
+        std::unordered_set<const ChatAvatar*> pinned;
+        roomService_->CollectReferencedAvatars(pinned);
+        loginPipeline_->CollectReferencedAvatars(pinned);
+        avatarService_->EvictIdleAvatars(pinned);
+    }
+}
+
+void GatewayNode::PublishGauges() {
+    static GatewayGauges gauges;
+
+    int64_t queuedBytes = 0;
+    int64_t deferredMessages = 0;
+    int64_t congestedClients = 0;
+
+    ForEachClient([&](GatewayClient* client) {
+        queuedBytes += client->GetQueuedBytes();
+        deferredMessages += client->GetDeferredCount();
+        congestedClients += client->IsCongested() ? 1 : 0;
+    });
+
+    gauges.clients.Set(GetClientCount());
+    gauges.onlineAvatars.Set(avatarService_->GetOnlineAvatars().size());
+    gauges.cachedAvatars.Set(avatarService_->GetResidentCount());
+    gauges.cachedAvatarBytes.Set(avatarService_->GetResidentBytes());
+    gauges.queuedLogins.Set(loginPipeline_->GetQueuedCount());
+    gauges.inFlightLogins.Set(loginPipeline_->GetInFlightCount());
+    gauges.queuedBytes.Set(queuedBytes);
+    gauges.deferredMessages.Set(deferredMessages);
+    gauges.congestedClients.Set(congestedClients);
+}
+
+void GatewayNode::PublishLoad() {
+    GatewayLoadReport report;
+    report.address = config_.gatewayAddress;
+    report.port = config_.gatewayPort;
+    // Avatars replicated from other gateways are hosted, and counted, there.
+    report.onlineAvatars = static_cast<uint32_t>(
+        avatarService_->GetOnlineAvatars().size() - replicator_->GetRemoteAvatarCount());
+    report.connections = static_cast<uint32_t>(GetClientCount());
+    report.tickMicros = static_cast<uint32_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(longestTick_).count());
+
+    ForEachClient([&report](GatewayClient* client) { report.queuedBytes += client->GetQueuedBytes(); });
+
+    loadPublisher_->Publish(report);
+    longestTick_ = std::chrono::steady_clock::duration{};
+}
+
+void GatewayNode::ReportSendQueues() {
+    ForEachClient([](GatewayClient* client) {
+        if (!client->IsCongested() && client->GetDeferredCount() == 0) {
+            return;
+        }
+
+        auto connection = client->GetConnection();
+        LOG(WARNING) << "Send queue backlog for " << connection->GetDestinationIp().GetAddress(nullptr) << ":"
+                     << connection->GetDestinationPort() << " - queued bytes: " << client->GetQueuedBytes()
+                     << ", deferred: " << client->GetDeferredCount() << " (" << client->GetDeferredBytes()
+                     << " bytes), dropped: " << client->GetDroppedCount()
+                     << ", congestion events: " << client->GetCongestionCount();
+    });
+}
+
+void GatewayNode::RestoreSnapshot() {
+    if (config_.snapshotFile.empty()) {
+        return;
+    }
+
+    // Restored avatars are reconciled against the database, which an
+    // in-memory store starts without.
+    if (!db_) {
+        LOG(INFO) << "Skipping state snapshot restore with the " << config_.storageBackend << " storage backend";
+        return;
+    }
+
+    std::vector<SnapshotContacts> restoredContacts;
+    if (ChatStateSnapshot::Restore(config_.snapshotFile, *avatarService_, *roomService_, restoredContacts)) {
+        snapshotReconciler_ = std::make_unique<SnapshotReconciler>(
+            config_.BuildDatabaseConnectionString(), std::move(restoredContacts));
+    }
+}
+
+void GatewayNode::ProcessSnapshotReconciliation() {
+    if (!snapshotReconciler_) {
+        return;
+    }
+
+    // Check for completion before draining so the final batch is not missed.
+    bool finished = snapshotReconciler_->IsFinished();
+
+    std::vector<ReconciledAvatar> results;
+    snapshotReconciler_->TakeResults(results);
+
+    for (const auto& reconciled : results) {
+        ChatStateSnapshot::ApplyReconciliation(reconciled, *avatarService_);
+    }
+
+    if (finished) {
+        snapshotReconciler_.reset();
+    }
+}
+
+void GatewayNode::WriteSnapshotAsync() {
+    if (pendingSnapshotWrite_.valid()
+        && pendingSnapshotWrite_.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        LOG(WARNING) << "Skipping state snapshot, previous write is still in progress";
+        return;
+    }
+
+    if (pendingSnapshotWrite_.valid() && !pendingSnapshotWrite_.get()) {
+        LOG(ERROR) << "Failed to write state snapshot " << config_.snapshotFile;
+    }
+
+    // Capturing touches the services and stays on the gateway thread; only the
+    // file write is handed off.
+    pendingSnapshotWrite_ = std::async(std::launch::async,
+        [path = config_.snapshotFile, data = ChatStateSnapshot::Capture(*avatarService_, *roomService_)]() {
+            return ChatStateSnapshot::WriteFile(path, data);
+        });
+}
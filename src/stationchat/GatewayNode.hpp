@@ -1,15 +1,24 @@
 
 #pragma once
 
+#include "ClientRegistry.hpp"
 #include "Node.hpp"
 #include "GatewayClient.hpp"
+#include "RequestMetrics.hpp"
 
-#include <map>
+#include <chrono>
+#include <future>
 #include <memory>
 
 class ChatAvatarService;
 class ChatRoomService;
+class ChatStorage;
+class ClusterReplicator;
+class DatabaseExecutor;
+class GatewayLoadPublisher;
+class LoginPipeline;
 class PersistentMessageService;
+class SnapshotReconciler;
 class WebsiteIntegrationService;
 struct StationChatConfig;
 struct MariaDBConnection;
@@ -23,26 +32,69 @@ public:
     ChatRoomService* GetRoomService();
     PersistentMessageService* GetMessageService();
     WebsiteIntegrationService* GetWebsiteIntegrationService();
+    ClusterReplicator& GetReplicator() { return *replicator_; }
+    DatabaseExecutor& GetDatabaseExecutor() { return *databaseExecutor_; }
+    LoginPipeline& GetLoginPipeline() { return *loginPipeline_; }
     StationChatConfig& GetConfig();
+    RequestMetrics& GetRequestMetrics() { return requestMetrics_; }
 
-    void RegisterClientAddress(const std::u16string& address, GatewayClient* client);
+    void RegisterClientAddress(AddressId address, GatewayClient* client);
+
+    /** Applies reloadable settings changed in the configuration since
+     * startup to the caches, the connected game servers and the cluster
+     * channels. Existing connections are kept.
+     *
+     * Cluster hosts are taken as already resolved. Throws, with nothing
+     * changed, when the cluster settings are rejected.
+     */
+    void Reconfigure();
+
+    /** Synchronously writes the warm-restart snapshot, if one is configured.
+     */
+    void SaveSnapshot();
 
     template<typename MessageT>
-    void SendTo(const std::u16string& address, const MessageT& message) {
-        auto find_iter = clientAddressMap_.find(address);
-        if (find_iter != std::end(clientAddressMap_)) {
-            find_iter->second->Send(message);
+    void SendTo(AddressId address, const MessageT& message, SendPriority priority = SendPriority::CRITICAL) {
+        auto client = clientRegistry_.Find(address);
+        if (client && client->GetConnection()->GetStatus() == UdpConnection::cStatusConnected) {
+            client->Send(message, priority);
         }
     }
 
+protected:
+    /** Replaces the website integration the node opened on its database.
+     */
+    void SetWebsiteIntegrationService(std::unique_ptr<WebsiteIntegrationService> service);
+
 private:
     void OnTick() override;
+    void OnClientDisconnected(GatewayClient* client) override;
+    void RestoreSnapshot();
+    void ProcessSnapshotReconciliation();
+    void ScheduleConfiguredTimers();
+    void WriteSnapshotAsync();
+    void EnforceAvatarCacheLimits();
+    void ReportSendQueues();
+    void PublishGauges();
+    void PublishLoad();
 
+    std::unique_ptr<ChatStorage> storage_;
+    std::unique_ptr<DatabaseExecutor> databaseExecutor_;
     std::unique_ptr<ChatAvatarService> avatarService_;
     std::unique_ptr<ChatRoomService> roomService_;
     std::unique_ptr<PersistentMessageService> messageService_;
     std::unique_ptr<WebsiteIntegrationService> websiteIntegrationService_;
-    std::map<std::u16string, GatewayClient*> clientAddressMap_;
+    std::unique_ptr<ClusterReplicator> replicator_;
+    std::unique_ptr<LoginPipeline> loginPipeline_;
+    ClientRegistry<AddressId, GatewayClient> clientRegistry_;
+    RequestMetrics requestMetrics_;
     StationChatConfig& config_;
-    MariaDBConnection* db_;
+    MariaDBConnection* db_ = nullptr;
+    std::unique_ptr<SnapshotReconciler> snapshotReconciler_;
+    std::future<bool> pendingSnapshotWrite_;
+    TimerWheel::TimerId snapshotTimer_ = 0;
+    std::unique_ptr<GatewayLoadPublisher> loadPublisher_;
+    TimerWheel::TimerId loadReportTimer_ = 0;
+    std::chrono::steady_clock::time_point lastTickTime_;
+    std::chrono::steady_clock::duration longestTick_{};
 };
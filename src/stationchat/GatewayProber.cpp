@@ -0,0 +1,184 @@
+#include "GatewayProber.hpp"
+
+#include "ChatEnums.hpp"
+#include "Serialization.hpp"
+
+#include <algorithm>
+#include <sstream>
+
+namespace {
+
+constexpr std::chrono::milliseconds kPollInterval{5};
+
+} // namespace
+
+GatewayProber::GatewayProber(std::vector<GatewayClusterEndpoint> targets, std::chrono::milliseconds interval,
+    std::chrono::milliseconds timeout, ResultHandler handler)
+    : interval_{interval}
+    , timeout_{timeout}
+    , handler_{std::move(handler)}
+    , pendingTargets_{std::move(targets)}
+    , hasPendingTargets_{true} {
+    UdpManager::Params params;
+    udpManager_ = new UdpManager(&params);
+
+    thread_ = std::thread([this]() { Run(); });
+}
+
+GatewayProber::~GatewayProber() {
+    running_ = false;
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+
+    for (auto& target : targets_) {
+        Drop(target);
+    }
+
+    udpManager_->Release();
+}
+
+void GatewayProber::SetTargets(std::vector<GatewayClusterEndpoint> targets) {
+    std::lock_guard<std::mutex> lock(pendingMutex_);
+    pendingTargets_ = std::move(targets);
+    hasPendingTargets_ = true;
+}
+
+void GatewayProber::Run() {
+    while (running_) {
+        ApplyPendingTargets();
+
+        udpManager_->GiveTime();
+
+        auto now = std::chrono::steady_clock::now();
+        for (auto& target : targets_) {
+            Probe(target, now);
+        }
+
+        std::this_thread::sleep_for(kPollInterval);
+    }
+}
+
+void GatewayProber::ApplyPendingTargets() {
+    std::vector<GatewayClusterEndpoint> endpoints;
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex_);
+        if (!hasPendingTargets_) {
+            return;
+        }
+
+        endpoints.swap(pendingTargets_);
+        hasPendingTargets_ = false;
+    }
+
+    std::vector<Target> targets;
+    targets.reserve(endpoints.size());
+
+    for (const auto& endpoint : endpoints) {
+        auto existing = std::find_if(std::begin(targets_), std::end(targets_),
+            [&endpoint](const Target& target) { return target.endpoint.Matches(endpoint.address, endpoint.port); });
+
+        if (existing == std::end(targets_)) {
+            Target target;
+            target.endpoint = endpoint;
+            targets.push_back(target);
+        } else {
+            targets.push_back(*existing);
+            existing->connection = nullptr;
+        }
+    }
+
+    for (auto& removed : targets_) {
+        Drop(removed);
+    }
+
+    targets_ = std::move(targets);
+}
+
+void GatewayProber::Probe(Target& target, std::chrono::steady_clock::time_point now) {
+    if (target.track == 0) {
+        if (now < target.nextProbeAt) {
+            return;
+        }
+
+        target.nextProbeAt = now + interval_;
+        target.startedAt = now;
+        target.sent = false;
+        target.track = ++nextTrack_ == 0 ? ++nextTrack_ : nextTrack_;
+
+        if (target.connection == nullptr) {
+            target.connection = udpManager_->EstablishConnection(target.endpoint.address.c_str(), target.endpoint.port,
+                static_cast<int>(timeout_.count()));
+            if (target.connection != nullptr) {
+                target.connection->SetHandler(this);
+            }
+        }
+    }
+
+    if (target.connection == nullptr || target.connection->GetStatus() == UdpConnection::cStatusDisconnected) {
+        Finish(target, false, std::chrono::microseconds{0});
+        Drop(target);
+        return;
+    }
+
+    // The request waits for the connection to finish negotiating, and the
+    // round trip only counts from when it is actually sent.
+    if (!target.sent && target.connection->GetStatus() == UdpConnection::cStatusConnected) {
+        std::ostringstream stream{std::ios::out | std::ios::binary};
+        uint32_t version = StationChatConfig::kLegacyApiVersion;
+        write(stream, ChatRequestType::SETAPIVERSION);
+        write(stream, target.track);
+        write(stream, version);
+
+        auto request = stream.str();
+        target.sentAt = now;
+        target.sent = true;
+        target.connection->Send(cUdpChannelReliable1, request.data(), static_cast<uint32_t>(request.size()));
+    }
+
+    if (now - target.startedAt >= timeout_) {
+        Finish(target, false, std::chrono::microseconds{0});
+        Drop(target);
+    }
+}
+
+void GatewayProber::Finish(Target& target, bool reachable, std::chrono::microseconds rtt) {
+    target.track = 0;
+    handler_(target.endpoint, reachable, rtt);
+}
+
+void GatewayProber::Drop(Target& target) {
+    if (target.connection == nullptr) {
+        return;
+    }
+
+    target.connection->SetHandler(nullptr);
+    target.connection->Disconnect();
+    target.connection->Release();
+    target.connection = nullptr;
+}
+
+void GatewayProber::OnRoutePacket(UdpConnection* connection, const uchar* data, int length) {
+    auto target = std::find_if(std::begin(targets_), std::end(targets_),
+        [connection](const Target& candidate) { return candidate.connection == connection; });
+    if (target == std::end(targets_) || target->track == 0 || !target->sent) {
+        return;
+    }
+
+    std::istringstream stream{
+        std::string{reinterpret_cast<const char*>(data), static_cast<std::size_t>(length)}, std::ios::binary};
+
+    ChatResponseType type;
+    uint32_t track = 0;
+    read(stream, type);
+    read(stream, track);
+
+    // Any answer proves the gateway is serving requests, including one that
+    // rejects the requested version.
+    if (!stream || type != ChatResponseType::SETAPIVERSION || track != target->track) {
+        return;
+    }
+
+    auto rtt = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - target->sentAt);
+    Finish(*target, true, rtt);
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "StationChatConfig.hpp"
+#include "UdpLibrary.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/** Checks cluster gateways from a background thread the way a game server
+ * would reach them: over a UDP connection of its own, with a SETAPIVERSION
+ * round trip. Every probe ends in exactly one call to the result handler,
+ * made from the prober thread, with the round trip time on success.
+ *
+ * Connections are kept between probes and re-established after a timeout.
+ * Probes ask for the legacy protocol version so responses are never batched.
+ */
+class GatewayProber : public UdpConnectionHandler {
+public:
+    using ResultHandler
+        = std::function<void(const GatewayClusterEndpoint& endpoint, bool reachable, std::chrono::microseconds rtt)>;
+
+    GatewayProber(std::vector<GatewayClusterEndpoint> targets, std::chrono::milliseconds interval,
+        std::chrono::milliseconds timeout, ResultHandler handler);
+    ~GatewayProber();
+
+    GatewayProber(const GatewayProber&) = delete;
+    GatewayProber& operator=(const GatewayProber&) = delete;
+
+    /** Replaces the probed endpoints; state is kept for those that stay.
+     */
+    void SetTargets(std::vector<GatewayClusterEndpoint> targets);
+
+private:
+    struct Target {
+        GatewayClusterEndpoint endpoint;
+        UdpConnection* connection = nullptr;
+        uint32_t track = 0;
+        bool sent = false;
+        std::chrono::steady_clock::time_point startedAt{};
+        std::chrono::steady_clock::time_point sentAt{};
+        std::chrono::steady_clock::time_point nextProbeAt{};
+    };
+
+    void Run();
+    void ApplyPendingTargets();
+    void Probe(Target& target, std::chrono::steady_clock::time_point now);
+    void Finish(Target& target, bool reachable, std::chrono::microseconds rtt);
+    static void Drop(Target& target);
+
+    void OnRoutePacket(UdpConnection* connection, const uchar* data, int length) override;
+
+    const std::chrono::milliseconds interval_;
+    const std::chrono::milliseconds timeout_;
+    ResultHandler handler_;
+
+    // Owned by the prober thread.
+    UdpManager* udpManager_;
+    std::vector<Target> targets_;
+    uint32_t nextTrack_ = 0;
+
+    std::mutex pendingMutex_;
+    std::vector<GatewayClusterEndpoint> pendingTargets_;
+    bool hasPendingTargets_ = false;
+
+    std::atomic<bool> running_{true};
+    std::thread thread_;
+};
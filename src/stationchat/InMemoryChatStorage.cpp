@@ -0,0 +1,254 @@
+#include "InMemoryChatStorage.hpp"
+
+#include <algorithm>
+
+boost::optional<StoredAvatar> InMemoryChatStorage::FindAvatar(
+    const std::u16string& name, const std::u16string& address) {
+    auto find_iter = avatarsByName_.find(std::make_pair(name, address));
+    if (find_iter == std::end(avatarsByName_)) {
+        return boost::none;
+    }
+
+    return avatars_.at(find_iter->second);
+}
+
+boost::optional<StoredAvatar> InMemoryChatStorage::FindAvatar(uint32_t avatarId) {
+    auto find_iter = avatars_.find(avatarId);
+    if (find_iter == std::end(avatars_)) {
+        return boost::none;
+    }
+
+    return find_iter->second;
+}
+
+uint32_t InMemoryChatStorage::InsertAvatar(const StoredAvatar& avatar) {
+    auto avatarId = nextAvatarId_++;
+
+    auto& stored = avatars_[avatarId];
+    stored = avatar;
+    stored.avatarId = avatarId;
+
+    avatarsByName_[std::make_pair(stored.name, stored.address)] = avatarId;
+
+    return avatarId;
+}
+
+void InMemoryChatStorage::UpdateAvatar(const StoredAvatar& avatar) {
+    auto find_iter = avatars_.find(avatar.avatarId);
+    if (find_iter == std::end(avatars_)) {
+        return;
+    }
+
+    avatarsByName_.erase(std::make_pair(find_iter->second.name, find_iter->second.address));
+    find_iter->second = avatar;
+    avatarsByName_[std::make_pair(avatar.name, avatar.address)] = avatar.avatarId;
+}
+
+void InMemoryChatStorage::DeleteAvatar(uint32_t avatarId) {
+    auto find_iter = avatars_.find(avatarId);
+    if (find_iter == std::end(avatars_)) {
+        return;
+    }
+
+    avatarsByName_.erase(std::make_pair(find_iter->second.name, find_iter->second.address));
+    avatars_.erase(find_iter);
+
+    for (auto iter = std::begin(friends_); iter != std::end(friends_);) {
+        if (iter->first.first == avatarId || iter->first.second == avatarId) {
+            iter = friends_.erase(iter);
+        } else {
+            ++iter;
+        }
+    }
+
+    for (auto iter = std::begin(ignores_); iter != std::end(ignores_);) {
+        if (iter->first == avatarId || iter->second == avatarId) {
+            iter = ignores_.erase(iter);
+        } else {
+            ++iter;
+        }
+    }
+
+    for (auto& members : roomMembers_) {
+        for (auto iter = std::begin(members); iter != std::end(members);) {
+            if (iter->second == avatarId) {
+                iter = members.erase(iter);
+            } else {
+                ++iter;
+            }
+        }
+    }
+
+    std::vector<uint32_t> createdRooms;
+    for (const auto& room : rooms_) {
+        if (room.second.creatorId == avatarId) {
+            createdRooms.push_back(room.first);
+        }
+    }
+
+    for (auto roomDbId : createdRooms) {
+        DeleteRoom(roomDbId);
+    }
+
+    auto messages_iter = messagesByAvatar_.find(avatarId);
+    if (messages_iter != std::end(messagesByAvatar_)) {
+        for (auto messageId : messages_iter->second) {
+            messages_.erase(messageId);
+        }
+
+        messagesByAvatar_.erase(messages_iter);
+    }
+}
+
+void InMemoryChatStorage::ForEachFriend(uint32_t avatarId, const FriendVisitor& visitor) {
+    for (auto iter = friends_.lower_bound(std::make_pair(avatarId, 0u));
+         iter != std::end(friends_) && iter->first.first == avatarId; ++iter) {
+        auto avatar_iter = avatars_.find(iter->first.second);
+        if (avatar_iter != std::end(avatars_)) {
+            visitor(avatar_iter->second, iter->second);
+        }
+    }
+}
+
+void InMemoryChatStorage::ForEachIgnore(uint32_t avatarId, const IgnoreVisitor& visitor) {
+    for (auto iter = ignores_.lower_bound(std::make_pair(avatarId, 0u));
+         iter != std::end(ignores_) && iter->first == avatarId; ++iter) {
+        auto avatar_iter = avatars_.find(iter->second);
+        if (avatar_iter != std::end(avatars_)) {
+            visitor(avatar_iter->second);
+        }
+    }
+}
+
+void InMemoryChatStorage::InsertFriend(uint32_t avatarId, uint32_t friendId, const std::u16string& comment) {
+    friends_.emplace(std::make_pair(avatarId, friendId), comment);
+}
+
+void InMemoryChatStorage::UpdateFriendComment(uint32_t avatarId, uint32_t friendId, const std::u16string& comment) {
+    auto find_iter = friends_.find(std::make_pair(avatarId, friendId));
+    if (find_iter != std::end(friends_)) {
+        find_iter->second = comment;
+    }
+}
+
+void InMemoryChatStorage::DeleteFriend(uint32_t avatarId, uint32_t friendId) {
+    friends_.erase(std::make_pair(avatarId, friendId));
+}
+
+void InMemoryChatStorage::InsertIgnore(uint32_t avatarId, uint32_t ignoreId) {
+    ignores_.emplace(avatarId, ignoreId);
+}
+
+void InMemoryChatStorage::DeleteIgnore(uint32_t avatarId, uint32_t ignoreId) {
+    ignores_.erase(std::make_pair(avatarId, ignoreId));
+}
+
+void InMemoryChatStorage::ForEachRoom(const std::u16string& baseAddress, const RoomVisitor& visitor) {
+    for (const auto& room : rooms_) {
+        if (HasPrefix(room.second.roomAddress, baseAddress)) {
+            visitor(room.second);
+        }
+    }
+}
+
+void InMemoryChatStorage::ForEachRoomMember(
+    const std::u16string& baseAddress, RoomRole role, const MemberVisitor& visitor) {
+    for (const auto& member : GetMembers(role)) {
+        auto room_iter = rooms_.find(member.first);
+        auto avatar_iter = avatars_.find(member.second);
+
+        if (room_iter != std::end(rooms_) && avatar_iter != std::end(avatars_)
+            && HasPrefix(room_iter->second.roomAddress, baseAddress)) {
+            visitor(member.first, avatar_iter->second);
+        }
+    }
+}
+
+uint32_t InMemoryChatStorage::InsertRoom(const StoredRoom& room) {
+    auto roomDbId = nextRoomId_++;
+
+    auto& stored = rooms_[roomDbId];
+    stored = room;
+    stored.dbId = roomDbId;
+
+    return roomDbId;
+}
+
+void InMemoryChatStorage::DeleteRoom(uint32_t roomDbId) {
+    rooms_.erase(roomDbId);
+
+    for (auto& members : roomMembers_) {
+        members.erase(members.lower_bound(std::make_pair(roomDbId, 0u)),
+            members.lower_bound(std::make_pair(roomDbId + 1, 0u)));
+    }
+}
+
+void InMemoryChatStorage::InsertRoomMember(uint32_t roomId, RoomRole role, uint32_t avatarId) {
+    GetMembers(role).emplace(roomId, avatarId);
+}
+
+void InMemoryChatStorage::DeleteRoomMember(uint32_t roomId, RoomRole role, uint32_t avatarId) {
+    GetMembers(role).erase(std::make_pair(roomId, avatarId));
+}
+
+uint32_t InMemoryChatStorage::InsertMessage(const PersistentMessage& message) {
+    auto messageId = nextMessageId_++;
+
+    auto& stored = messages_[messageId];
+    stored = message;
+    stored.header.messageId = messageId;
+
+    messagesByAvatar_[message.header.avatarId].push_back(messageId);
+
+    return messageId;
+}
+
+std::vector<PersistentHeader> InMemoryChatStorage::GetMessageHeaders(uint32_t avatarId) {
+    std::vector<PersistentHeader> headers;
+
+    auto find_iter = messagesByAvatar_.find(avatarId);
+    if (find_iter == std::end(messagesByAvatar_)) {
+        return headers;
+    }
+
+    for (auto messageId : find_iter->second) {
+        const auto& header = messages_.at(messageId).header;
+        if (header.status == PersistentState::NEW || header.status == PersistentState::UNREAD
+            || header.status == PersistentState::READ) {
+            headers.push_back(header);
+        }
+    }
+
+    return headers;
+}
+
+boost::optional<PersistentMessage> InMemoryChatStorage::LoadMessage(uint32_t avatarId, uint32_t messageId) {
+    auto find_iter = messages_.find(messageId);
+    if (find_iter == std::end(messages_) || find_iter->second.header.avatarId != avatarId) {
+        return boost::none;
+    }
+
+    return find_iter->second;
+}
+
+void InMemoryChatStorage::UpdateMessageStatus(uint32_t avatarId, uint32_t messageId, PersistentState status) {
+    auto find_iter = messages_.find(messageId);
+    if (find_iter != std::end(messages_) && find_iter->second.header.avatarId == avatarId) {
+        find_iter->second.header.status = status;
+    }
+}
+
+void InMemoryChatStorage::BulkUpdateMessageStatus(
+    uint32_t avatarId, const std::u16string& category, PersistentState status) {
+    auto find_iter = messagesByAvatar_.find(avatarId);
+    if (find_iter == std::end(messagesByAvatar_)) {
+        return;
+    }
+
+    for (auto messageId : find_iter->second) {
+        auto& header = messages_.at(messageId).header;
+        if (header.category == category) {
+            header.status = status;
+        }
+    }
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "ChatStorage.hpp"
+
+#include <array>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <utility>
+
+/** Chat storage held entirely in process memory and lost on shutdown. Used
+ * for benchmarks, tests and local stand-in deployments that should not pay
+ * for, or depend on, a database server.
+ *
+ * Deleting an avatar or room removes the rows that reference it, matching the
+ * ON DELETE CASCADE constraints of the MariaDB schema.
+ */
+class InMemoryChatStorage : public ChatStorage {
+public:
+    boost::optional<StoredAvatar> FindAvatar(const std::u16string& name, const std::u16string& address) override;
+    boost::optional<StoredAvatar> FindAvatar(uint32_t avatarId) override;
+    uint32_t InsertAvatar(const StoredAvatar& avatar) override;
+    void UpdateAvatar(const StoredAvatar& avatar) override;
+    void DeleteAvatar(uint32_t avatarId) override;
+
+    void ForEachFriend(uint32_t avatarId, const FriendVisitor& visitor) override;
+    void ForEachIgnore(uint32_t avatarId, const IgnoreVisitor& visitor) override;
+    void InsertFriend(uint32_t avatarId, uint32_t friendId, const std::u16string& comment) override;
+    void UpdateFriendComment(uint32_t avatarId, uint32_t friendId, const std::u16string& comment) override;
+    void DeleteFriend(uint32_t avatarId, uint32_t friendId) override;
+    void InsertIgnore(uint32_t avatarId, uint32_t ignoreId) override;
+    void DeleteIgnore(uint32_t avatarId, uint32_t ignoreId) override;
+
+    void ForEachRoom(const std::u16string& baseAddress, const RoomVisitor& visitor) override;
+    void ForEachRoomMember(const std::u16string& baseAddress, RoomRole role, const MemberVisitor& visitor) override;
+    uint32_t InsertRoom(const StoredRoom& room) override;
+    void DeleteRoom(uint32_t roomDbId) override;
+    void InsertRoomMember(uint32_t roomId, RoomRole role, uint32_t avatarId) override;
+    void DeleteRoomMember(uint32_t roomId, RoomRole role, uint32_t avatarId) override;
+
+    uint32_t InsertMessage(const PersistentMessage& message) override;
+    std::vector<PersistentHeader> GetMessageHeaders(uint32_t avatarId) override;
+    boost::optional<PersistentMessage> LoadMessage(uint32_t avatarId, uint32_t messageId) override;
+    void UpdateMessageStatus(uint32_t avatarId, uint32_t messageId, PersistentState status) override;
+    void BulkUpdateMessageStatus(uint32_t avatarId, const std::u16string& category, PersistentState status) override;
+
+private:
+    using AvatarPair = std::pair<uint32_t, uint32_t>;
+    using MemberSet = std::set<AvatarPair>;
+
+    static bool HasPrefix(const std::u16string& value, const std::u16string& prefix) {
+        return value.compare(0, prefix.length(), prefix) == 0;
+    }
+
+    MemberSet& GetMembers(RoomRole role) { return roomMembers_[static_cast<std::size_t>(role)]; }
+
+    // Ordered by id so that visits follow insertion order, like the database.
+    std::map<uint32_t, StoredAvatar> avatars_;
+    std::map<std::pair<std::u16string, std::u16string>, uint32_t> avatarsByName_;
+    uint32_t nextAvatarId_ = 1;
+
+    std::map<AvatarPair, std::u16string> friends_;
+    MemberSet ignores_;
+
+    std::map<uint32_t, StoredRoom> rooms_;
+    uint32_t nextRoomId_ = 1;
+
+    // (room id, avatar id) pairs for each RoomRole.
+    std::array<MemberSet, 4> roomMembers_;
+
+    std::map<uint32_t, PersistentMessage> messages_;
+    std::unordered_map<uint32_t, std::vector<uint32_t>> messagesByAvatar_;
+    uint32_t nextMessageId_ = 1;
+};
@@ -0,0 +1,344 @@
+#include "LoginPipeline.hpp"
+
+#include "AsyncLog.hpp"
+#include "ChatAvatar.hpp"
+#include "ChatAvatarService.hpp"
+#include "ChatStorage.hpp"
+#include "ClusterReplicator.hpp"
+#include "DatabaseExecutor.hpp"
+#include "GatewayNode.hpp"
+#include "MariaDBChatStorage.hpp"
+#include "Metrics.hpp"
+#include "WebsiteIntegrationService.hpp"
+
+#include <algorithm>
+#include <unordered_map>
+
+namespace {
+
+struct LoginStageMetrics {
+    static MetricHistogram& Stage(const std::string& stage) {
+        return GetMetricsRegistry().Histogram("stationchat_login_stage_microseconds",
+            "Time logins spent in each stage of the login pipeline", "stage=\"" + stage + "\"");
+    }
+
+    MetricHistogram& queued = Stage("queued");
+    MetricHistogram& resolve = Stage("resolve");
+    MetricHistogram& contacts = Stage("contacts");
+    MetricHistogram& presence = Stage("presence");
+    MetricHistogram& notify = Stage("notify");
+};
+
+LoginStageMetrics& GetLoginStageMetrics() {
+    static LoginStageMetrics metrics;
+    return metrics;
+}
+
+// Executor key for the website's login records.
+constexpr uint32_t kWebsiteKey = 0;
+
+std::u16string ResolvingKey(const LoginRequest& request) { return request.name + u"@" + request.address; }
+
+} // namespace
+
+struct LoginPipeline::Login {
+    LoginRequest request;
+    Completion completion;
+    ChatAvatar* avatar = nullptr;
+    Clock::time_point stageStart;
+
+    // Records the stage that just ended; a stage a login skips is not
+    // recorded, and its time counts towards the next one.
+    void EndStage(MetricHistogram& stage) {
+        auto now = Clock::now();
+        stage.Observe(std::chrono::duration_cast<std::chrono::microseconds>(now - stageStart));
+        stageStart = now;
+    }
+};
+
+LoginPipeline::LoginPipeline(GatewayNode* node)
+    : node_{node} {}
+
+LoginPipeline::~LoginPipeline() {}
+
+void LoginPipeline::SetLimits(uint32_t maxInFlight, uint32_t maxBatch) {
+    maxInFlight_ = maxInFlight;
+    maxBatch_ = std::max<uint32_t>(maxBatch, 1);
+}
+
+void LoginPipeline::Submit(const LoginRequest& request, Completion completion) {
+    auto login = std::make_shared<Login>();
+    login->request = request;
+    login->completion = std::move(completion);
+    login->stageStart = Clock::now();
+
+    queued_.push_back(std::move(login));
+}
+
+void LoginPipeline::Pump() {
+    auto& metrics = GetLoginStageMetrics();
+
+    while (!queued_.empty() && (maxInFlight_ == 0 || inFlight_.size() < maxInFlight_)) {
+        auto login = std::move(queued_.front());
+        queued_.pop_front();
+
+        login->EndStage(metrics.queued);
+        inFlight_.insert(login);
+        awaitingResolve_.push_back(std::move(login));
+    }
+
+    if (awaitingResolve_.empty()) {
+        return;
+    }
+
+    auto avatarService = node_->GetAvatarService();
+
+    std::vector<LoginPtr> cached;
+    std::vector<LoginPtr> waiting;
+    std::vector<LoginPtr> batch;
+
+    for (auto& login : awaitingResolve_) {
+        login->avatar = avatarService->GetCachedAvatar(login->request.name, login->request.address);
+        if (login->avatar) {
+            cached.push_back(std::move(login));
+        } else if (!resolving_.insert(ResolvingKey(login->request)).second) {
+            waiting.push_back(std::move(login));
+        } else {
+            batch.push_back(std::move(login));
+
+            if (batch.size() == maxBatch_) {
+                Resolve(std::move(batch));
+                batch.clear();
+            }
+        }
+    }
+
+    awaitingResolve_.swap(waiting);
+
+    if (!batch.empty()) {
+        Resolve(std::move(batch));
+    }
+
+    Route(cached);
+}
+
+void LoginPipeline::CollectReferencedAvatars(std::unordered_set<const ChatAvatar*>& avatars) const {
+    for (const auto& login : inFlight_) {
+        if (login->avatar) {
+            avatars.insert(login->avatar);
+        }
+    }
+}
+
+void LoginPipeline::Resolve(std::vector<LoginPtr> batch) {
+    std::vector<AvatarKey> keys;
+    std::vector<StoredAvatar> newAvatars;
+    for (const auto& login : batch) {
+        keys.push_back(AvatarKey{login->request.name, login->request.address});
+
+        StoredAvatar avatar;
+        avatar.userId = login->request.userId;
+        avatar.name = login->request.name;
+        avatar.address = login->request.address;
+        avatar.attributes = login->request.attributes;
+        newAvatars.push_back(std::move(avatar));
+    }
+
+    struct Resolved {
+        std::vector<StoredAvatar> avatars;
+        std::vector<bool> created;
+    };
+
+    auto resolved = std::make_shared<Resolved>();
+
+    node_->GetDatabaseExecutor().Post(nextBatch_++,
+        [keys, newAvatars, resolved](ChatStorage& storage) {
+            auto found = storage.FindAvatars(keys);
+
+            std::vector<StoredAvatar> missing;
+            for (std::size_t i = 0; i < keys.size(); ++i) {
+                if (!found[i]) {
+                    missing.push_back(newAvatars[i]);
+                }
+            }
+
+            auto insertedIds = storage.InsertAvatars(missing);
+            auto nextInserted = std::begin(missing);
+            auto nextInsertedId = std::begin(insertedIds);
+
+            for (std::size_t i = 0; i < keys.size(); ++i) {
+                if (found[i]) {
+                    resolved->avatars.push_back(*found[i]);
+                    resolved->created.push_back(false);
+                } else {
+                    auto avatar = std::move(*nextInserted++);
+                    avatar.avatarId = *nextInsertedId++;
+                    resolved->avatars.push_back(std::move(avatar));
+                    resolved->created.push_back(true);
+                }
+            }
+        },
+        [this, batch, resolved](std::exception_ptr error) {
+            for (const auto& login : batch) {
+                resolving_.erase(ResolvingKey(login->request));
+            }
+
+            if (error) {
+                Fail(batch, error);
+                return;
+            }
+
+            auto avatarService = node_->GetAvatarService();
+            auto& metrics = GetLoginStageMetrics();
+
+            for (std::size_t i = 0; i < batch.size(); ++i) {
+                auto& login = batch[i];
+                const auto& stored = resolved->avatars[i];
+
+                if (resolved->created[i]) {
+                    ASYNC_LOG(INFO, "Login avatar did not exist, created a new one ", stored.name, "@",
+                        stored.address);
+                    login->avatar = avatarService->AdoptCreatedAvatar(stored, login->request.loginLocation);
+                } else {
+                    login->avatar = avatarService->AdoptStoredAvatar(
+                        stored.avatarId, stored.userId, stored.name, stored.address, stored.attributes);
+                }
+
+                login->EndStage(metrics.resolve);
+            }
+
+            Route(batch);
+        });
+}
+
+void LoginPipeline::Route(const std::vector<LoginPtr>& logins) {
+    auto avatarService = node_->GetAvatarService();
+
+    std::vector<LoginPtr> ready;
+    std::vector<LoginPtr> batch;
+
+    for (const auto& login : logins) {
+        if (avatarService->AreContactsLoaded(login->avatar)) {
+            ready.push_back(login);
+            continue;
+        }
+
+        batch.push_back(login);
+
+        if (batch.size() == maxBatch_) {
+            LoadContacts(std::move(batch));
+            batch.clear();
+        }
+    }
+
+    if (!batch.empty()) {
+        LoadContacts(std::move(batch));
+    }
+
+    if (!ready.empty()) {
+        PublishPresence(ready);
+    }
+}
+
+void LoginPipeline::LoadContacts(std::vector<LoginPtr> batch) {
+    std::vector<uint32_t> avatarIds;
+    for (const auto& login : batch) {
+        avatarIds.push_back(login->avatar->GetAvatarId());
+    }
+
+    auto contacts = std::make_shared<std::unordered_map<uint32_t, StoredContacts>>();
+
+    node_->GetDatabaseExecutor().Post(nextBatch_++,
+        [avatarIds, contacts](ChatStorage& storage) {
+            storage.ForEachFriendOf(avatarIds,
+                [&contacts](uint32_t ownerId, const StoredAvatar& avatar, const std::u16string& comment) {
+                    (*contacts)[ownerId].friends.emplace_back(avatar, comment);
+                });
+
+            storage.ForEachIgnoreOf(avatarIds, [&contacts](uint32_t ownerId, const StoredAvatar& avatar) {
+                (*contacts)[ownerId].ignores.push_back(avatar);
+            });
+        },
+        [this, batch, contacts](std::exception_ptr error) {
+            if (error) {
+                Fail(batch, error);
+                return;
+            }
+
+            auto avatarService = node_->GetAvatarService();
+            auto& metrics = GetLoginStageMetrics();
+
+            for (const auto& login : batch) {
+                avatarService->AdoptContacts(login->avatar, (*contacts)[login->avatar->GetAvatarId()]);
+                login->EndStage(metrics.contacts);
+            }
+
+            PublishPresence(batch);
+        });
+}
+
+void LoginPipeline::PublishPresence(std::vector<LoginPtr> logins) {
+    auto websiteIntegration = node_->GetWebsiteIntegrationService();
+    if (!websiteIntegration || !websiteIntegration->IsEnabled()) {
+        GoOnline(logins);
+        return;
+    }
+
+    std::vector<const ChatAvatar*> avatars;
+    for (const auto& login : logins) {
+        avatars.push_back(login->avatar);
+    }
+
+    // The website records the logins before the avatars go online, so a
+    // batch it fails to record is left offline. The records are all written
+    // under one key, as they may share the website's own connection.
+    node_->GetDatabaseExecutor().Post(kWebsiteKey,
+        [websiteIntegration, avatars](ChatStorage& storage) {
+            auto mariaDBStorage = dynamic_cast<MariaDBChatStorage*>(&storage);
+            websiteIntegration->RecordAvatarLogins(mariaDBStorage ? mariaDBStorage->GetConnection() : nullptr, avatars);
+        },
+        [this, logins](std::exception_ptr error) {
+            if (error) {
+                Fail(logins, error);
+                return;
+            }
+
+            GoOnline(logins);
+        });
+}
+
+void LoginPipeline::GoOnline(const std::vector<LoginPtr>& logins) {
+    auto avatarService = node_->GetAvatarService();
+    auto& metrics = GetLoginStageMetrics();
+
+    for (const auto& login : logins) {
+        avatarService->LoginAvatar(login->avatar);
+
+        if (login->avatar->GetName().compare(u"SYSTEM") != 0) {
+            node_->GetReplicator().AvatarLoggedIn(login->avatar);
+        }
+
+        login->EndStage(metrics.presence);
+    }
+
+    for (const auto& login : logins) {
+        Finish(login, nullptr);
+    }
+}
+
+void LoginPipeline::Fail(const std::vector<LoginPtr>& logins, std::exception_ptr error) {
+    for (const auto& login : logins) {
+        Finish(login, error);
+    }
+}
+
+void LoginPipeline::Finish(const LoginPtr& login, std::exception_ptr error) {
+    inFlight_.erase(login);
+
+    auto completion = std::move(login->completion);
+    completion(error ? nullptr : login->avatar, error);
+
+    if (!error) {
+        login->EndStage(GetLoginStageMetrics().notify);
+    }
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+class ChatAvatar;
+class GatewayNode;
+
+/** What a login needs to resolve an avatar, or create it if it is new.
+ */
+struct LoginRequest {
+    std::u16string name;
+    std::u16string address;
+    std::u16string loginLocation;
+    uint32_t userId = 0;
+    uint32_t attributes = 0;
+};
+
+/** Logs avatars in through four stages, so that logins for different avatars
+ * overlap instead of queueing behind each other on the gateway thread:
+ *
+ * - resolve: look the avatar up, inserting it if it is new;
+ * - contacts: load its friend and ignore lists;
+ * - presence: mark it online, for the website and the rest of the cluster;
+ * - notify: the caller's completion, which tells friends and game servers.
+ *
+ * The first two run on the database workers. Logins that reach a stage in the
+ * same tick share its queries, in batches of up to the batch size, and at
+ * most the concurrency limit of logins are past the queue at once. Avatars
+ * already cached with their contacts skip straight to presence.
+ *
+ * Only called from the gateway thread.
+ */
+class LoginPipeline {
+public:
+    using Completion = std::function<void(ChatAvatar* avatar, std::exception_ptr error)>;
+
+    explicit LoginPipeline(GatewayNode* node);
+    ~LoginPipeline();
+
+    LoginPipeline(const LoginPipeline&) = delete;
+    LoginPipeline& operator=(const LoginPipeline&) = delete;
+
+    /** Bounds the logins between the queue and their completion, where 0
+     * disables the bound, and the logins sharing one batch of queries.
+     */
+    void SetLimits(uint32_t maxInFlight, uint32_t maxBatch);
+
+    /** Queues a login; the completion runs as its notify stage, with the
+     * avatar or with the error that failed the login.
+     */
+    void Submit(const LoginRequest& request, Completion completion);
+
+    /** Admits queued logins and starts their stages; called once a tick after
+     * database completions have run.
+     */
+    void Pump();
+
+    /** Adds the avatars of logins in progress, which the cache must keep.
+     */
+    void CollectReferencedAvatars(std::unordered_set<const ChatAvatar*>& avatars) const;
+
+    std::size_t GetQueuedCount() const { return queued_.size(); }
+    std::size_t GetInFlightCount() const { return inFlight_.size(); }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Login;
+    using LoginPtr = std::shared_ptr<Login>;
+
+    void Resolve(std::vector<LoginPtr> batch);
+    void LoadContacts(std::vector<LoginPtr> batch);
+    void PublishPresence(std::vector<LoginPtr> logins);
+    void GoOnline(const std::vector<LoginPtr>& logins);
+    void Route(const std::vector<LoginPtr>& logins);
+    void Fail(const std::vector<LoginPtr>& logins, std::exception_ptr error);
+    void Finish(const LoginPtr& login, std::exception_ptr error);
+
+    GatewayNode* node_;
+    uint32_t maxInFlight_ = 0;
+    std::size_t maxBatch_ = 1;
+    uint32_t nextBatch_ = 0;
+
+    std::deque<LoginPtr> queued_;
+    std::vector<LoginPtr> awaitingResolve_;
+    std::unordered_set<LoginPtr> inFlight_;
+
+    // Names with a lookup in progress; another login for the same name waits
+    // for it, so that a new avatar is only inserted once.
+    std::unordered_set<std::u16string> resolving_;
+};
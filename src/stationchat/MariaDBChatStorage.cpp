@@ -0,0 +1,752 @@
+#include "MariaDBChatStorage.hpp"
+
+#include "MariaDB.hpp"
+#include "StringUtils.hpp"
+
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+struct RoleTable {
+    const char* insertSql;
+    const char* deleteSql;
+    const char* selectSql;
+};
+
+const RoleTable& GetRoleTable(RoomRole role) {
+    static const RoleTable kModerator{
+        "INSERT IGNORE INTO room_moderator (moderator_avatar_id, room_id) VALUES (@avatar_id, @room_id)",
+        "DELETE FROM room_moderator WHERE moderator_avatar_id = @avatar_id AND room_id = @room_id",
+        "SELECT m.room_id, a.id, a.user_id, a.name, a.address, a.attributes FROM room_moderator m "
+        "JOIN room r ON r.id = m.room_id JOIN avatar a ON a.id = m.moderator_avatar_id "
+        "WHERE r.room_address LIKE CONCAT(@baseAddress, '%')"};
+
+    static const RoleTable kAdministrator{
+        "INSERT IGNORE INTO room_administrator (admin_avatar_id, room_id) VALUES (@avatar_id, @room_id)",
+        "DELETE FROM room_administrator WHERE admin_avatar_id = @avatar_id AND room_id = @room_id",
+        "SELECT m.room_id, a.id, a.user_id, a.name, a.address, a.attributes FROM room_administrator m "
+        "JOIN room r ON r.id = m.room_id JOIN avatar a ON a.id = m.admin_avatar_id "
+        "WHERE r.room_address LIKE CONCAT(@baseAddress, '%')"};
+
+    static const RoleTable kBanned{
+        "INSERT IGNORE INTO room_ban (banned_avatar_id, room_id) VALUES (@avatar_id, @room_id)",
+        "DELETE FROM room_ban WHERE banned_avatar_id = @avatar_id AND room_id = @room_id",
+        "SELECT m.room_id, a.id, a.user_id, a.name, a.address, a.attributes FROM room_ban m "
+        "JOIN room r ON r.id = m.room_id JOIN avatar a ON a.id = m.banned_avatar_id "
+        "WHERE r.room_address LIKE CONCAT(@baseAddress, '%')"};
+
+    static const RoleTable kInvited{
+        "INSERT IGNORE INTO room_invite (invited_avatar_id, room_id) VALUES (@avatar_id, @room_id)",
+        "DELETE FROM room_invite WHERE invited_avatar_id = @avatar_id AND room_id = @room_id",
+        "SELECT m.room_id, a.id, a.user_id, a.name, a.address, a.attributes FROM room_invite m "
+        "JOIN room r ON r.id = m.room_id JOIN avatar a ON a.id = m.invited_avatar_id "
+        "WHERE r.room_address LIKE CONCAT(@baseAddress, '%')"};
+
+    switch (role) {
+    case RoomRole::MODERATOR:
+        return kModerator;
+    case RoomRole::ADMINISTRATOR:
+        return kAdministrator;
+    case RoomRole::BANNED:
+        return kBanned;
+    case RoomRole::INVITED:
+    default:
+        return kInvited;
+    }
+}
+
+MariaDBStatement* Prepare(MariaDBConnection* db, const char* sql) {
+    MariaDBStatement* stmt;
+
+    auto result = mariadb_prepare(db, sql, -1, &stmt, 0);
+    if (result != MARIADB_OK) {
+        throw MariaDBException{result, mariadb_errmsg(db)};
+    }
+
+    return stmt;
+}
+
+// Runs a statement that returns no rows and releases it.
+void Execute(MariaDBConnection* db, MariaDBStatement* stmt) {
+    auto result = mariadb_step(stmt);
+    mariadb_finalize(stmt);
+
+    if (result != MARIADB_DONE) {
+        throw MariaDBException{result, mariadb_errmsg(db)};
+    }
+}
+
+std::u16string ReadTextColumn(MariaDBStatement* stmt, int column) {
+    auto text = reinterpret_cast<const char*>(mariadb_column_text(stmt, column));
+    return text ? ToWideString(text) : std::u16string{};
+}
+
+// Reads the id, user_id, name, address, attributes columns starting at column.
+StoredAvatar ReadAvatarColumns(MariaDBStatement* stmt, int column) {
+    StoredAvatar avatar;
+    avatar.avatarId = mariadb_column_int(stmt, column);
+    avatar.userId = mariadb_column_int(stmt, column + 1);
+    avatar.name = ReadTextColumn(stmt, column + 2);
+    avatar.address = ReadTextColumn(stmt, column + 3);
+    avatar.attributes = mariadb_column_int(stmt, column + 4);
+    return avatar;
+}
+
+// Lists numbered parameters, "@name_0, @name_1, ...", for a batched query.
+std::string ParameterList(const std::string& name, std::size_t count) {
+    std::string list;
+    for (std::size_t i = 0; i < count; ++i) {
+        list += (i == 0 ? "@" : ", @") + name + "_" + std::to_string(i);
+    }
+
+    return list;
+}
+
+int ParameterIndex(MariaDBStatement* stmt, const std::string& name, std::size_t i) {
+    return mariadb_bind_parameter_index(stmt, ("@" + name + "_" + std::to_string(i)).c_str());
+}
+
+// Steps through the rows of a query and releases it.
+template <typename RowT>
+void ForEachRow(MariaDBConnection* db, MariaDBStatement* stmt, RowT row) {
+    int result;
+    while ((result = mariadb_step(stmt)) == MARIADB_ROW) {
+        row();
+    }
+
+    mariadb_finalize(stmt);
+
+    if (result != MARIADB_DONE) {
+        throw MariaDBException{result, mariadb_errmsg(db)};
+    }
+}
+
+// Reads the columns shared by the header and message queries.
+PersistentHeader ReadHeaderColumns(MariaDBStatement* stmt) {
+    PersistentHeader header;
+    header.messageId = mariadb_column_int(stmt, 0);
+    header.avatarId = mariadb_column_int(stmt, 1);
+    header.fromName = ReadTextColumn(stmt, 2);
+    header.fromAddress = ReadTextColumn(stmt, 3);
+    header.subject = ReadTextColumn(stmt, 4);
+    header.sentTime = mariadb_column_int(stmt, 5);
+    header.status = static_cast<PersistentState>(mariadb_column_int(stmt, 6));
+    header.folder = ReadTextColumn(stmt, 7);
+    header.category = ReadTextColumn(stmt, 8);
+    return header;
+}
+
+} // namespace
+
+MariaDBChatStorage::MariaDBChatStorage(const std::string& connectionString) {
+    if (mariadb_open(connectionString.c_str(), &db_) != MARIADB_OK) {
+        throw std::runtime_error("Can't open database: " + std::string{mariadb_errmsg(db_)});
+    }
+}
+
+MariaDBChatStorage::~MariaDBChatStorage() { mariadb_close(db_); }
+
+boost::optional<StoredAvatar> MariaDBChatStorage::FindAvatar(
+    const std::u16string& name, const std::u16string& address) {
+    boost::optional<StoredAvatar> avatar;
+
+    auto stmt = Prepare(db_, "SELECT id, user_id, name, address, attributes FROM avatar WHERE name = @name AND "
+                             "address = @address");
+
+    std::string nameStr = FromWideString(name);
+    std::string addressStr = FromWideString(address);
+
+    int nameIdx = mariadb_bind_parameter_index(stmt, "@name");
+    int addressIdx = mariadb_bind_parameter_index(stmt, "@address");
+
+    mariadb_bind_text(stmt, nameIdx, nameStr.c_str(), -1, 0);
+    mariadb_bind_text(stmt, addressIdx, addressStr.c_str(), -1, 0);
+
+    if (mariadb_step(stmt) == MARIADB_ROW) {
+        avatar = ReadAvatarColumns(stmt, 0);
+    }
+
+    mariadb_finalize(stmt);
+
+    return avatar;
+}
+
+boost::optional<StoredAvatar> MariaDBChatStorage::FindAvatar(uint32_t avatarId) {
+    boost::optional<StoredAvatar> avatar;
+
+    auto stmt = Prepare(db_, "SELECT id, user_id, name, address, attributes FROM avatar WHERE id = @avatar_id");
+
+    int avatarIdIdx = mariadb_bind_parameter_index(stmt, "@avatar_id");
+
+    mariadb_bind_int(stmt, avatarIdIdx, avatarId);
+
+    if (mariadb_step(stmt) == MARIADB_ROW) {
+        avatar = ReadAvatarColumns(stmt, 0);
+    }
+
+    mariadb_finalize(stmt);
+
+    return avatar;
+}
+
+std::vector<boost::optional<StoredAvatar>> MariaDBChatStorage::FindAvatars(const std::vector<AvatarKey>& keys) {
+    std::vector<boost::optional<StoredAvatar>> avatars(keys.size());
+    if (keys.empty()) {
+        return avatars;
+    }
+
+    // The keys are joined as a derived table, so names compare with the
+    // collation FindAvatar uses and each row says which key it answers.
+    std::string sql = "SELECT k.idx, a.id, a.user_id, a.name, a.address, a.attributes FROM (";
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+        auto index = std::to_string(i);
+        sql += (i == 0 ? "SELECT " : " UNION ALL SELECT ") + index + " AS idx, @name_" + index + " AS name, @address_"
+            + index + " AS address";
+    }
+
+    sql += ") k JOIN avatar a ON a.name = k.name AND a.address = k.address";
+
+    auto stmt = Prepare(db_, sql.c_str());
+
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+        auto nameStr = FromWideString(keys[i].name);
+        auto addressStr = FromWideString(keys[i].address);
+
+        mariadb_bind_text(stmt, ParameterIndex(stmt, "name", i), nameStr.c_str(), -1, 0);
+        mariadb_bind_text(stmt, ParameterIndex(stmt, "address", i), addressStr.c_str(), -1, 0);
+    }
+
+    ForEachRow(db_, stmt, [stmt, &avatars]() {
+        auto index = static_cast<std::size_t>(mariadb_column_int(stmt, 0));
+        if (index < avatars.size()) {
+            avatars[index] = ReadAvatarColumns(stmt, 1);
+        }
+    });
+
+    return avatars;
+}
+
+uint32_t MariaDBChatStorage::InsertAvatar(const StoredAvatar& avatar) {
+    auto stmt = Prepare(db_, "INSERT INTO avatar (user_id, name, address, attributes) VALUES (@user_id, @name, "
+                             "@address, @attributes)");
+
+    std::string nameStr = FromWideString(avatar.name);
+    std::string addressStr = FromWideString(avatar.address);
+
+    int userIdIdx = mariadb_bind_parameter_index(stmt, "@user_id");
+    int nameIdx = mariadb_bind_parameter_index(stmt, "@name");
+    int addressIdx = mariadb_bind_parameter_index(stmt, "@address");
+    int attributesIdx = mariadb_bind_parameter_index(stmt, "@attributes");
+
+    mariadb_bind_int(stmt, userIdIdx, avatar.userId);
+    mariadb_bind_text(stmt, nameIdx, nameStr.c_str(), -1, 0);
+    mariadb_bind_text(stmt, addressIdx, addressStr.c_str(), -1, 0);
+    mariadb_bind_int(stmt, attributesIdx, avatar.attributes);
+
+    Execute(db_, stmt);
+
+    return static_cast<uint32_t>(mariadb_last_insert_rowid(db_));
+}
+
+std::vector<uint32_t> MariaDBChatStorage::InsertAvatars(const std::vector<StoredAvatar>& avatars) {
+    if (avatars.size() <= 1) {
+        return AvatarStore::InsertAvatars(avatars);
+    }
+
+    std::string sql = "INSERT INTO avatar (user_id, name, address, attributes) VALUES ";
+    for (std::size_t i = 0; i < avatars.size(); ++i) {
+        auto index = std::to_string(i);
+        sql += (i == 0 ? "(@user_id_" : ", (@user_id_") + index + ", @name_" + index + ", @address_" + index
+            + ", @attributes_" + index + ")";
+    }
+
+    auto stmt = Prepare(db_, sql.c_str());
+
+    std::vector<AvatarKey> keys;
+    for (std::size_t i = 0; i < avatars.size(); ++i) {
+        const auto& avatar = avatars[i];
+        keys.push_back(AvatarKey{avatar.name, avatar.address});
+
+        auto nameStr = FromWideString(avatar.name);
+        auto addressStr = FromWideString(avatar.address);
+
+        mariadb_bind_int(stmt, ParameterIndex(stmt, "user_id", i), avatar.userId);
+        mariadb_bind_text(stmt, ParameterIndex(stmt, "name", i), nameStr.c_str(), -1, 0);
+        mariadb_bind_text(stmt, ParameterIndex(stmt, "address", i), addressStr.c_str(), -1, 0);
+        mariadb_bind_int(stmt, ParameterIndex(stmt, "attributes", i), avatar.attributes);
+    }
+
+    Execute(db_, stmt);
+
+    // Ids of a multi-row insert are only consecutive under some lock modes
+    // and increments, so they are read back in one query instead.
+    std::vector<uint32_t> avatarIds;
+    for (const auto& stored : FindAvatars(keys)) {
+        if (!stored) {
+            throw std::runtime_error("Inserted avatar is missing from the avatar table");
+        }
+
+        avatarIds.push_back(stored->avatarId);
+    }
+
+    return avatarIds;
+}
+
+void MariaDBChatStorage::UpdateAvatar(const StoredAvatar& avatar) {
+    auto stmt = Prepare(db_, "UPDATE avatar SET user_id = @user_id, name = @name, address = @address, "
+                             "attributes = @attributes "
+                             "WHERE id = @avatar_id");
+
+    std::string nameStr = FromWideString(avatar.name);
+    std::string addressStr = FromWideString(avatar.address);
+
+    int userIdIdx = mariadb_bind_parameter_index(stmt, "@user_id");
+    int nameIdx = mariadb_bind_parameter_index(stmt, "@name");
+    int addressIdx = mariadb_bind_parameter_index(stmt, "@address");
+    int attributesIdx = mariadb_bind_parameter_index(stmt, "@attributes");
+    int avatarIdIdx = mariadb_bind_parameter_index(stmt, "@avatar_id");
+
+    mariadb_bind_int(stmt, userIdIdx, avatar.userId);
+    mariadb_bind_text(stmt, nameIdx, nameStr.c_str(), -1, 0);
+    mariadb_bind_text(stmt, addressIdx, addressStr.c_str(), -1, 0);
+    mariadb_bind_int(stmt, attributesIdx, avatar.attributes);
+    mariadb_bind_int(stmt, avatarIdIdx, avatar.avatarId);
+
+    Execute(db_, stmt);
+}
+
+void MariaDBChatStorage::DeleteAvatar(uint32_t avatarId) {
+    auto stmt = Prepare(db_, "DELETE FROM avatar WHERE id = @avatar_id");
+
+    int avatarIdIdx = mariadb_bind_parameter_index(stmt, "@avatar_id");
+
+    mariadb_bind_int(stmt, avatarIdIdx, avatarId);
+
+    Execute(db_, stmt);
+}
+
+void MariaDBChatStorage::ForEachFriend(uint32_t avatarId, const FriendVisitor& visitor) {
+    auto stmt = Prepare(db_, "SELECT a.id, a.user_id, a.name, a.address, a.attributes, f.comment FROM friend f "
+                             "JOIN avatar a ON a.id = f.friend_avatar_id WHERE f.avatar_id = @avatar_id");
+
+    int avatarIdIdx = mariadb_bind_parameter_index(stmt, "@avatar_id");
+
+    mariadb_bind_int(stmt, avatarIdIdx, avatarId);
+
+    while (mariadb_step(stmt) == MARIADB_ROW) {
+        visitor(ReadAvatarColumns(stmt, 0), ReadTextColumn(stmt, 5));
+    }
+
+    mariadb_finalize(stmt);
+}
+
+void MariaDBChatStorage::ForEachIgnore(uint32_t avatarId, const IgnoreVisitor& visitor) {
+    auto stmt = Prepare(db_, "SELECT a.id, a.user_id, a.name, a.address, a.attributes FROM `ignore` i "
+                             "JOIN avatar a ON a.id = i.ignore_avatar_id WHERE i.avatar_id = @avatar_id");
+
+    int avatarIdIdx = mariadb_bind_parameter_index(stmt, "@avatar_id");
+
+    mariadb_bind_int(stmt, avatarIdIdx, avatarId);
+
+    while (mariadb_step(stmt) == MARIADB_ROW) {
+        visitor(ReadAvatarColumns(stmt, 0));
+    }
+
+    mariadb_finalize(stmt);
+}
+
+void MariaDBChatStorage::ForEachFriendOf(const std::vector<uint32_t>& avatarIds, const OwnedFriendVisitor& visitor) {
+    if (avatarIds.empty()) {
+        return;
+    }
+
+    auto sql = "SELECT f.avatar_id, a.id, a.user_id, a.name, a.address, a.attributes, f.comment FROM friend f "
+               "JOIN avatar a ON a.id = f.friend_avatar_id WHERE f.avatar_id IN ("
+        + ParameterList("avatar_id", avatarIds.size()) + ")";
+
+    auto stmt = Prepare(db_, sql.c_str());
+
+    for (std::size_t i = 0; i < avatarIds.size(); ++i) {
+        mariadb_bind_int(stmt, ParameterIndex(stmt, "avatar_id", i), avatarIds[i]);
+    }
+
+    ForEachRow(db_, stmt, [stmt, &visitor]() {
+        visitor(mariadb_column_int(stmt, 0), ReadAvatarColumns(stmt, 1), ReadTextColumn(stmt, 6));
+    });
+}
+
+void MariaDBChatStorage::ForEachIgnoreOf(const std::vector<uint32_t>& avatarIds, const OwnedIgnoreVisitor& visitor) {
+    if (avatarIds.empty()) {
+        return;
+    }
+
+    auto sql = "SELECT i.avatar_id, a.id, a.user_id, a.name, a.address, a.attributes FROM `ignore` i "
+               "JOIN avatar a ON a.id = i.ignore_avatar_id WHERE i.avatar_id IN ("
+        + ParameterList("avatar_id", avatarIds.size()) + ")";
+
+    auto stmt = Prepare(db_, sql.c_str());
+
+    for (std::size_t i = 0; i < avatarIds.size(); ++i) {
+        mariadb_bind_int(stmt, ParameterIndex(stmt, "avatar_id", i), avatarIds[i]);
+    }
+
+    ForEachRow(db_, stmt, [stmt, &visitor]() { visitor(mariadb_column_int(stmt, 0), ReadAvatarColumns(stmt, 1)); });
+}
+
+void MariaDBChatStorage::InsertFriend(uint32_t avatarId, uint32_t friendId, const std::u16string& comment) {
+    auto stmt = Prepare(db_, "INSERT INTO friend (avatar_id, friend_avatar_id, comment) VALUES (@avatar_id, "
+                             "@friend_avatar_id, @comment)");
+
+    int avatarIdIdx = mariadb_bind_parameter_index(stmt, "@avatar_id");
+    int friendAvatarIdIdx = mariadb_bind_parameter_index(stmt, "@friend_avatar_id");
+    int commentIdx = mariadb_bind_parameter_index(stmt, "@comment");
+
+    std::string commentStr = FromWideString(comment);
+
+    mariadb_bind_int(stmt, avatarIdIdx, avatarId);
+    mariadb_bind_int(stmt, friendAvatarIdIdx, friendId);
+    mariadb_bind_text(stmt, commentIdx, commentStr.c_str(), -1, 0);
+
+    Execute(db_, stmt);
+}
+
+void MariaDBChatStorage::UpdateFriendComment(uint32_t avatarId, uint32_t friendId, const std::u16string& comment) {
+    auto stmt = Prepare(db_, "UPDATE friend SET comment = @comment WHERE avatar_id = @avatar_id AND "
+                             "friend_avatar_id = @friend_avatar_id");
+
+    int commentIdx = mariadb_bind_parameter_index(stmt, "@comment");
+    int avatarIdIdx = mariadb_bind_parameter_index(stmt, "@avatar_id");
+    int friendAvatarIdIdx = mariadb_bind_parameter_index(stmt, "@friend_avatar_id");
+
+    std::string commentStr = FromWideString(comment);
+
+    mariadb_bind_text(stmt, commentIdx, commentStr.c_str(), -1, 0);
+    mariadb_bind_int(stmt, avatarIdIdx, avatarId);
+    mariadb_bind_int(stmt, friendAvatarIdIdx, friendId);
+
+    Execute(db_, stmt);
+}
+
+void MariaDBChatStorage::DeleteFriend(uint32_t avatarId, uint32_t friendId) {
+    auto stmt = Prepare(db_, "DELETE FROM friend WHERE avatar_id = @avatar_id AND friend_avatar_id = "
+                             "@friend_avatar_id");
+
+    int avatarIdIdx = mariadb_bind_parameter_index(stmt, "@avatar_id");
+    int friendAvatarIdIdx = mariadb_bind_parameter_index(stmt, "@friend_avatar_id");
+
+    mariadb_bind_int(stmt, avatarIdIdx, avatarId);
+    mariadb_bind_int(stmt, friendAvatarIdIdx, friendId);
+
+    Execute(db_, stmt);
+}
+
+void MariaDBChatStorage::InsertIgnore(uint32_t avatarId, uint32_t ignoreId) {
+    auto stmt = Prepare(db_, "INSERT INTO `ignore` (avatar_id, ignore_avatar_id) VALUES (@avatar_id, "
+                             "@ignore_avatar_id)");
+
+    int avatarIdIdx = mariadb_bind_parameter_index(stmt, "@avatar_id");
+    int ignoreAvatarIdIdx = mariadb_bind_parameter_index(stmt, "@ignore_avatar_id");
+
+    mariadb_bind_int(stmt, avatarIdIdx, avatarId);
+    mariadb_bind_int(stmt, ignoreAvatarIdIdx, ignoreId);
+
+    Execute(db_, stmt);
+}
+
+void MariaDBChatStorage::DeleteIgnore(uint32_t avatarId, uint32_t ignoreId) {
+    auto stmt = Prepare(db_, "DELETE FROM `ignore` WHERE avatar_id = @avatar_id AND ignore_avatar_id = "
+                             "@ignore_avatar_id");
+
+    int avatarIdIdx = mariadb_bind_parameter_index(stmt, "@avatar_id");
+    int ignoreAvatarIdIdx = mariadb_bind_parameter_index(stmt, "@ignore_avatar_id");
+
+    mariadb_bind_int(stmt, avatarIdIdx, avatarId);
+    mariadb_bind_int(stmt, ignoreAvatarIdIdx, ignoreId);
+
+    Execute(db_, stmt);
+}
+
+void MariaDBChatStorage::ForEachRoom(const std::u16string& baseAddress, const RoomVisitor& visitor) {
+    auto stmt = Prepare(db_, "SELECT id, creator_id, creator_name, creator_address, room_name, room_topic, "
+                             "room_password, room_prefix, room_address, room_attributes, room_max_size, "
+                             "room_message_id, created_at, node_level FROM room "
+                             "WHERE room_address LIKE CONCAT(@baseAddress, '%')");
+
+    auto baseAddressStr = FromWideString(baseAddress);
+
+    int baseAddressIdx = mariadb_bind_parameter_index(stmt, "@baseAddress");
+    mariadb_bind_text(stmt, baseAddressIdx, baseAddressStr.c_str(), -1, 0);
+    mariadb_stream_results(stmt);
+
+    int result;
+    while ((result = mariadb_step(stmt)) == MARIADB_ROW) {
+        StoredRoom room;
+        room.dbId = mariadb_column_int(stmt, 0);
+        room.creatorId = mariadb_column_int(stmt, 1);
+        room.creatorName = ReadTextColumn(stmt, 2);
+        room.creatorAddress = ReadTextColumn(stmt, 3);
+        room.roomName = ReadTextColumn(stmt, 4);
+        room.roomTopic = ReadTextColumn(stmt, 5);
+        room.roomPassword = ReadTextColumn(stmt, 6);
+        room.roomPrefix = ReadTextColumn(stmt, 7);
+        room.roomAddress = ReadTextColumn(stmt, 8);
+        room.roomAttributes = mariadb_column_int(stmt, 9);
+        room.maxRoomSize = mariadb_column_int(stmt, 10);
+        room.roomMessageId = mariadb_column_int(stmt, 11);
+        room.createTime = mariadb_column_int(stmt, 12);
+        room.nodeLevel = mariadb_column_int(stmt, 13);
+
+        visitor(room);
+    }
+
+    mariadb_finalize(stmt);
+
+    if (result != MARIADB_DONE) {
+        throw MariaDBException{result, mariadb_errmsg(db_)};
+    }
+}
+
+void MariaDBChatStorage::ForEachRoomMember(
+    const std::u16string& baseAddress, RoomRole role, const MemberVisitor& visitor) {
+    auto stmt = Prepare(db_, GetRoleTable(role).selectSql);
+
+    auto baseAddressStr = FromWideString(baseAddress);
+
+    int baseAddressIdx = mariadb_bind_parameter_index(stmt, "@baseAddress");
+    mariadb_bind_text(stmt, baseAddressIdx, baseAddressStr.c_str(), -1, 0);
+    mariadb_stream_results(stmt);
+
+    int result;
+    while ((result = mariadb_step(stmt)) == MARIADB_ROW) {
+        visitor(mariadb_column_int(stmt, 0), ReadAvatarColumns(stmt, 1));
+    }
+
+    mariadb_finalize(stmt);
+
+    if (result != MARIADB_DONE) {
+        throw MariaDBException{result, mariadb_errmsg(db_)};
+    }
+}
+
+uint32_t MariaDBChatStorage::InsertRoom(const StoredRoom& room) {
+    auto stmt = Prepare(db_, "INSERT INTO room (creator_id, creator_name, creator_address, room_name, "
+                             "room_topic, room_password, room_prefix, room_address, room_attributes, "
+                             "room_max_size, room_message_id, created_at, node_level) VALUES (@creator_id, "
+                             "@creator_name, @creator_address, @room_name, @room_topic, @room_password, "
+                             "@room_prefix, @room_address, @room_attributes, @room_max_size, @room_message_id, "
+                             "@created_at, @node_level)");
+
+    int creatorIdIdx = mariadb_bind_parameter_index(stmt, "@creator_id");
+    int creatorNameIdx = mariadb_bind_parameter_index(stmt, "@creator_name");
+    int creatorAddressIdx = mariadb_bind_parameter_index(stmt, "@creator_address");
+    int roomNameIdx = mariadb_bind_parameter_index(stmt, "@room_name");
+    int roomTopicIdx = mariadb_bind_parameter_index(stmt, "@room_topic");
+    int roomPasswordIdx = mariadb_bind_parameter_index(stmt, "@room_password");
+    int roomPrefixIdx = mariadb_bind_parameter_index(stmt, "@room_prefix");
+    int roomAddressIdx = mariadb_bind_parameter_index(stmt, "@room_address");
+    int roomAttributesIdx = mariadb_bind_parameter_index(stmt, "@room_attributes");
+    int roomMaxSizeIdx = mariadb_bind_parameter_index(stmt, "@room_max_size");
+    int roomMessageIdIdx = mariadb_bind_parameter_index(stmt, "@room_message_id");
+    int createdAtIdx = mariadb_bind_parameter_index(stmt, "@created_at");
+    int nodeLevelIdx = mariadb_bind_parameter_index(stmt, "@node_level");
+
+    mariadb_bind_int(stmt, creatorIdIdx, room.creatorId);
+
+    auto creatorName = FromWideString(room.creatorName);
+    mariadb_bind_text(stmt, creatorNameIdx, creatorName.c_str(), -1, 0);
+
+    auto creatorAddress = FromWideString(room.creatorAddress);
+    mariadb_bind_text(stmt, creatorAddressIdx, creatorAddress.c_str(), -1, 0);
+
+    auto roomName = FromWideString(room.roomName);
+    mariadb_bind_text(stmt, roomNameIdx, roomName.c_str(), -1, 0);
+
+    auto roomTopic = FromWideString(room.roomTopic);
+    mariadb_bind_text(stmt, roomTopicIdx, roomTopic.c_str(), -1, 0);
+
+    auto roomPassword = FromWideString(room.roomPassword);
+    mariadb_bind_text(stmt, roomPasswordIdx, roomPassword.c_str(), -1, 0);
+
+    auto roomPrefix = FromWideString(room.roomPrefix);
+    mariadb_bind_text(stmt, roomPrefixIdx, roomPrefix.c_str(), -1, 0);
+
+    auto roomAddress = FromWideString(room.roomAddress);
+    mariadb_bind_text(stmt, roomAddressIdx, roomAddress.c_str(), -1, 0);
+
+    mariadb_bind_int(stmt, roomAttributesIdx, room.roomAttributes);
+    mariadb_bind_int(stmt, roomMaxSizeIdx, room.maxRoomSize);
+    mariadb_bind_int(stmt, roomMessageIdIdx, room.roomMessageId);
+    mariadb_bind_int(stmt, createdAtIdx, room.createTime);
+    mariadb_bind_int(stmt, nodeLevelIdx, room.nodeLevel);
+
+    Execute(db_, stmt);
+
+    return static_cast<uint32_t>(mariadb_last_insert_rowid(db_));
+}
+
+void MariaDBChatStorage::DeleteRoom(uint32_t roomDbId) {
+    auto stmt = Prepare(db_, "DELETE FROM room WHERE id = @id");
+
+    int idIdx = mariadb_bind_parameter_index(stmt, "@id");
+    mariadb_bind_int(stmt, idIdx, roomDbId);
+
+    Execute(db_, stmt);
+}
+
+void MariaDBChatStorage::InsertRoomMember(uint32_t roomId, RoomRole role, uint32_t avatarId) {
+    auto stmt = Prepare(db_, GetRoleTable(role).insertSql);
+
+    int avatarIdIdx = mariadb_bind_parameter_index(stmt, "@avatar_id");
+    int roomIdIdx = mariadb_bind_parameter_index(stmt, "@room_id");
+
+    mariadb_bind_int(stmt, avatarIdIdx, avatarId);
+    mariadb_bind_int(stmt, roomIdIdx, roomId);
+
+    Execute(db_, stmt);
+}
+
+void MariaDBChatStorage::DeleteRoomMember(uint32_t roomId, RoomRole role, uint32_t avatarId) {
+    auto stmt = Prepare(db_, GetRoleTable(role).deleteSql);
+
+    int avatarIdIdx = mariadb_bind_parameter_index(stmt, "@avatar_id");
+    int roomIdIdx = mariadb_bind_parameter_index(stmt, "@room_id");
+
+    mariadb_bind_int(stmt, avatarIdIdx, avatarId);
+    mariadb_bind_int(stmt, roomIdIdx, roomId);
+
+    Execute(db_, stmt);
+}
+
+uint32_t MariaDBChatStorage::InsertMessage(const PersistentMessage& message) {
+    auto stmt = Prepare(db_, "INSERT INTO persistent_message (avatar_id, from_name, from_address, subject, "
+                             "sent_time, status, "
+                             "folder, category, message, oob) VALUES (@avatar_id, @from_name, @from_address, "
+                             "@subject, @sent_time, @status, @folder, @category, @message, @oob)");
+
+    int avatarIdIdx = mariadb_bind_parameter_index(stmt, "@avatar_id");
+    int fromNameIdx = mariadb_bind_parameter_index(stmt, "@from_name");
+    int fromAddressIdx = mariadb_bind_parameter_index(stmt, "@from_address");
+    int subjectIdx = mariadb_bind_parameter_index(stmt, "@subject");
+    int sentTimeIdx = mariadb_bind_parameter_index(stmt, "@sent_time");
+    int statusIdx = mariadb_bind_parameter_index(stmt, "@status");
+    int folderIdx = mariadb_bind_parameter_index(stmt, "@folder");
+    int categoryIdx = mariadb_bind_parameter_index(stmt, "@category");
+    int messageIdx = mariadb_bind_parameter_index(stmt, "@message");
+    int oobIdx = mariadb_bind_parameter_index(stmt, "@oob");
+
+    mariadb_bind_int(stmt, avatarIdIdx, message.header.avatarId);
+
+    std::string fromName = FromWideString(message.header.fromName);
+    mariadb_bind_text(stmt, fromNameIdx, fromName.c_str(), -1, 0);
+
+    std::string fromAddress = FromWideString(message.header.fromAddress);
+    mariadb_bind_text(stmt, fromAddressIdx, fromAddress.c_str(), -1, 0);
+
+    std::string subject = FromWideString(message.header.subject);
+    mariadb_bind_text(stmt, subjectIdx, subject.c_str(), -1, 0);
+
+    mariadb_bind_int(stmt, sentTimeIdx, message.header.sentTime);
+    mariadb_bind_int(stmt, statusIdx, static_cast<uint32_t>(message.header.status));
+
+    std::string folder = FromWideString(message.header.folder);
+    mariadb_bind_text(stmt, folderIdx, folder.c_str(), -1, 0);
+
+    std::string category = FromWideString(message.header.category);
+    mariadb_bind_text(stmt, categoryIdx, category.c_str(), -1, 0);
+
+    std::string msg = FromWideString(message.message);
+    mariadb_bind_text(stmt, messageIdx, msg.c_str(), -1, 0);
+
+    mariadb_bind_blob(stmt, oobIdx, reinterpret_cast<const uint8_t*>(message.oob.data()), message.oob.size() * 2,
+        MARIADB_STATIC);
+
+    Execute(db_, stmt);
+
+    return static_cast<uint32_t>(mariadb_last_insert_rowid(db_));
+}
+
+std::vector<PersistentHeader> MariaDBChatStorage::GetMessageHeaders(uint32_t avatarId) {
+    std::vector<PersistentHeader> headers;
+
+    auto stmt = Prepare(db_, "SELECT id, avatar_id, from_name, from_address, subject, sent_time, status, "
+                             "folder, category FROM persistent_message WHERE avatar_id = "
+                             "@avatar_id AND status IN (1, 2, 3)");
+
+    int avatarIdIdx = mariadb_bind_parameter_index(stmt, "@avatar_id");
+
+    mariadb_bind_int(stmt, avatarIdIdx, avatarId);
+
+    while (mariadb_step(stmt) == MARIADB_ROW) {
+        headers.push_back(ReadHeaderColumns(stmt));
+    }
+
+    mariadb_finalize(stmt);
+
+    return headers;
+}
+
+boost::optional<PersistentMessage> MariaDBChatStorage::LoadMessage(uint32_t avatarId, uint32_t messageId) {
+    boost::optional<PersistentMessage> message;
+
+    auto stmt = Prepare(db_, "SELECT id, avatar_id, from_name, from_address, subject, sent_time, status, "
+                             "folder, category, message, oob FROM persistent_message WHERE id = @message_id "
+                             "AND avatar_id = @avatar_id");
+
+    int messageIdIdx = mariadb_bind_parameter_index(stmt, "@message_id");
+    int avatarIdIdx = mariadb_bind_parameter_index(stmt, "@avatar_id");
+
+    mariadb_bind_int(stmt, messageIdIdx, messageId);
+    mariadb_bind_int(stmt, avatarIdIdx, avatarId);
+
+    if (mariadb_step(stmt) == MARIADB_ROW) {
+        message = PersistentMessage{};
+        message->header = ReadHeaderColumns(stmt);
+        message->message = ReadTextColumn(stmt, 9);
+
+        int size = mariadb_column_bytes(stmt, 10);
+        const uint8_t* data = reinterpret_cast<const uint8_t*>(mariadb_column_blob(stmt, 10));
+
+        message->oob.resize(size / 2);
+        for (int i = 0; i < size / 2; ++i) {
+            message->oob[i] = *reinterpret_cast<const uint16_t*>(data + i * 2);
+        }
+    }
+
+    mariadb_finalize(stmt);
+
+    return message;
+}
+
+void MariaDBChatStorage::UpdateMessageStatus(uint32_t avatarId, uint32_t messageId, PersistentState status) {
+    auto stmt = Prepare(db_, "UPDATE persistent_message SET status = @status WHERE id = @message_id AND "
+                             "avatar_id = @avatar_id");
+
+    int statusIdx = mariadb_bind_parameter_index(stmt, "@status");
+    int messageIdIdx = mariadb_bind_parameter_index(stmt, "@message_id");
+    int avatarIdIdx = mariadb_bind_parameter_index(stmt, "@avatar_id");
+
+    mariadb_bind_int(stmt, statusIdx, static_cast<uint32_t>(status));
+    mariadb_bind_int(stmt, messageIdIdx, messageId);
+    mariadb_bind_int(stmt, avatarIdIdx, avatarId);
+
+    Execute(db_, stmt);
+}
+
+void MariaDBChatStorage::BulkUpdateMessageStatus(
+    uint32_t avatarId, const std::u16string& category, PersistentState status) {
+    auto stmt = Prepare(db_, "UPDATE persistent_message SET status = @status WHERE avatar_id = @avatar_id AND "
+                             "category = @category");
+
+    int statusIdx = mariadb_bind_parameter_index(stmt, "@status");
+    int avatarIdIdx = mariadb_bind_parameter_index(stmt, "@avatar_id");
+    int categoryIdx = mariadb_bind_parameter_index(stmt, "@category");
+
+    std::string categoryStr = FromWideString(category);
+
+    mariadb_bind_int(stmt, statusIdx, static_cast<uint32_t>(status));
+    mariadb_bind_int(stmt, avatarIdIdx, avatarId);
+    mariadb_bind_text(stmt, categoryIdx, categoryStr.c_str(), -1, nullptr);
+
+    Execute(db_, stmt);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "ChatStorage.hpp"
+
+#include <string>
+
+struct MariaDBConnection;
+
+/** Chat storage backed by the MariaDB schema in extras/init_database.sql.
+ */
+class MariaDBChatStorage : public ChatStorage {
+public:
+    /** Opens the connection; throws std::runtime_error if that fails.
+     */
+    explicit MariaDBChatStorage(const std::string& connectionString);
+    ~MariaDBChatStorage();
+
+    MariaDBConnection* GetConnection() { return db_; }
+
+    boost::optional<StoredAvatar> FindAvatar(const std::u16string& name, const std::u16string& address) override;
+    boost::optional<StoredAvatar> FindAvatar(uint32_t avatarId) override;
+    std::vector<boost::optional<StoredAvatar>> FindAvatars(const std::vector<AvatarKey>& keys) override;
+    uint32_t InsertAvatar(const StoredAvatar& avatar) override;
+    std::vector<uint32_t> InsertAvatars(const std::vector<StoredAvatar>& avatars) override;
+    void UpdateAvatar(const StoredAvatar& avatar) override;
+    void DeleteAvatar(uint32_t avatarId) override;
+
+    void ForEachFriend(uint32_t avatarId, const FriendVisitor& visitor) override;
+    void ForEachIgnore(uint32_t avatarId, const IgnoreVisitor& visitor) override;
+    void ForEachFriendOf(const std::vector<uint32_t>& avatarIds, const OwnedFriendVisitor& visitor) override;
+    void ForEachIgnoreOf(const std::vector<uint32_t>& avatarIds, const OwnedIgnoreVisitor& visitor) override;
+    void InsertFriend(uint32_t avatarId, uint32_t friendId, const std::u16string& comment) override;
+    void UpdateFriendComment(uint32_t avatarId, uint32_t friendId, const std::u16string& comment) override;
+    void DeleteFriend(uint32_t avatarId, uint32_t friendId) override;
+    void InsertIgnore(uint32_t avatarId, uint32_t ignoreId) override;
+    void DeleteIgnore(uint32_t avatarId, uint32_t ignoreId) override;
+
+    void ForEachRoom(const std::u16string& baseAddress, const RoomVisitor& visitor) override;
+    void ForEachRoomMember(const std::u16string& baseAddress, RoomRole role, const MemberVisitor& visitor) override;
+    uint32_t InsertRoom(const StoredRoom& room) override;
+    void DeleteRoom(uint32_t roomDbId) override;
+    void InsertRoomMember(uint32_t roomId, RoomRole role, uint32_t avatarId) override;
+    void DeleteRoomMember(uint32_t roomId, RoomRole role, uint32_t avatarId) override;
+
+    uint32_t InsertMessage(const PersistentMessage& message) override;
+    std::vector<PersistentHeader> GetMessageHeaders(uint32_t avatarId) override;
+    boost::optional<PersistentMessage> LoadMessage(uint32_t avatarId, uint32_t messageId) override;
+    void UpdateMessageStatus(uint32_t avatarId, uint32_t messageId, PersistentState status) override;
+    void BulkUpdateMessageStatus(uint32_t avatarId, const std::u16string& category, PersistentState status) override;
+
+private:
+    MariaDBConnection* db_ = nullptr;
+};
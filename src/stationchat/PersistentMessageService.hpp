@@ -9,11 +9,11 @@
 #include <cstdint>
 #include <vector>
 
-struct MariaDBConnection;
+class MailStore;
 
 class PersistentMessageService {
 public:
-    explicit PersistentMessageService(MariaDBConnection* db);
+    explicit PersistentMessageService(MailStore* mailStore);
     ~PersistentMessageService();
 
     void StoreMessage(PersistentMessage& message);
@@ -29,5 +29,5 @@ public:
         uint32_t avatarId, const std::u16string& category, PersistentState newStatus);
 
 private:
-    MariaDBConnection* db_;
+    MailStore* mailStore_;
 };
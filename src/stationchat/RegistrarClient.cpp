@@ -11,7 +11,7 @@
 #include "easylogging++.h"
 
 RegistrarClient::RegistrarClient(UdpConnection* connection, RegistrarNode* node)
-    : NodeClient(connection)
+    : NodeClient(connection, CaptureSource::REGISTRAR)
     , node_{node} {
     connection->SetHandler(this);
 }
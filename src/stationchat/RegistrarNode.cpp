@@ -1,25 +1,199 @@
-
 #include "RegistrarNode.hpp"
 
+#include "Metrics.hpp"
 #include "StationChatConfig.hpp"
 
+#include "easylogging++.h"
+
 #include <algorithm>
 #include <chrono>
 #include <cstdint>
 #include <limits>
 #include <mutex>
+#include <random>
+#include <stdexcept>
 
 namespace {
 
 constexpr std::chrono::seconds kBaseBlacklistDuration{5};
 constexpr std::chrono::seconds kMaxBlacklistDuration{60};
 
+// How often blacklists that nobody has looked at since they ran out are
+// cleared, which also resets the backoff of gateways no login was sent to.
+constexpr std::chrono::seconds kBlacklistSweepInterval{1};
+
+// A gateway that has missed this many report intervals is no longer trusted
+// to describe its own load.
+constexpr uint32_t kStaleReportIntervals = 3;
+
+// Tick time and send queue backlog at which a gateway counts as twice as
+// busy as its avatar count alone suggests.
+constexpr double kTickBudgetMicros = 50000.0;
+constexpr double kQueueBudgetBytes = 1024.0 * 1024.0;
+
+// Smoothed probe latency that, like the budgets above, doubles a gateway's
+// load score.
+constexpr double kLatencyBudgetMicros = 20000.0;
+
+// A single lost probe is not enough to take a gateway out of rotation.
+constexpr uint32_t kProbeFailuresToDemote = 2;
+
+// Weight of the newest round trip in the smoothed latency, as a divisor.
+constexpr int64_t kLatencySmoothing = 4;
+
+// Longest round-robin cycle kept per view. Larger weight totals are scaled
+// down to fit, which only matters for extreme weight ratios.
+constexpr uint32_t kMaxScheduleLength = 65536;
+
+int64_t ToTicks(std::chrono::steady_clock::time_point time) { return time.time_since_epoch().count(); }
+
+uint32_t GreatestCommonDivisor(uint32_t lhs, uint32_t rhs) {
+    while (rhs != 0) {
+        auto remainder = lhs % rhs;
+        lhs = rhs;
+        rhs = remainder;
+    }
+
+    return lhs;
+}
+
+// Virtual nodes per unit of weight on the affinity ring, and the most the
+// ring holds; larger totals are scaled down, keeping at least one per entry.
+constexpr uint64_t kRingPointsPerWeight = 64;
+constexpr uint64_t kMaxRingPoints = 1 << 18;
+
+/** FNV-1a followed by the splitmix64 finalizer. Registrars in a cluster must
+ * agree on the ring, so this cannot be std::hash.
+ */
+uint64_t HashRingKey(const std::string& key) {
+    uint64_t hash = 14695981039346656037ull;
+    for (auto c : key) {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 1099511628211ull;
+    }
+
+    hash ^= hash >> 30;
+    hash *= 0xbf58476d1ce4e5b9ull;
+    hash ^= hash >> 27;
+    hash *= 0x94d049bb133111ebull;
+    hash ^= hash >> 31;
+    return hash;
+}
+
+template <typename EntriesT>
+std::vector<std::pair<uint64_t, uint32_t>> BuildRing(const EntriesT& entries) {
+    uint64_t totalWeight = 0;
+    for (const auto& entry : entries) {
+        totalWeight += entry.endpoint.weight;
+    }
+
+    std::vector<std::pair<uint64_t, uint32_t>> ring;
+
+    for (uint32_t index = 0; index < entries.size(); ++index) {
+        const auto& endpoint = entries[index].endpoint;
+
+        uint64_t points = endpoint.weight * kRingPointsPerWeight;
+        if (totalWeight * kRingPointsPerWeight > kMaxRingPoints) {
+            points = std::max<uint64_t>(1, endpoint.weight * kMaxRingPoints / totalWeight);
+        }
+
+        // Points depend only on the endpoint itself, so adding or removing
+        // a gateway leaves every other gateway's points where they were.
+        auto name = endpoint.address + ":" + std::to_string(endpoint.port) + "#";
+        for (uint64_t point = 0; point < points; ++point) {
+            ring.emplace_back(HashRingKey(name + std::to_string(point)), index);
+        }
+    }
+
+    std::sort(std::begin(ring), std::end(ring));
+    return ring;
+}
+
+template <typename EntriesT>
+std::vector<uint32_t> BuildSchedule(const EntriesT& entries) {
+    std::vector<uint32_t> weights;
+    uint32_t divisor = 0;
+    uint64_t totalWeight = 0;
+
+    for (const auto& entry : entries) {
+        weights.push_back(entry.endpoint.weight);
+        divisor = GreatestCommonDivisor(divisor, entry.endpoint.weight);
+        totalWeight += entry.endpoint.weight;
+    }
+
+    for (auto& weight : weights) {
+        weight /= divisor;
+        if (totalWeight / divisor > kMaxScheduleLength) {
+            auto scaled = static_cast<uint64_t>(weight) * kMaxScheduleLength * divisor / totalWeight;
+            weight = std::max<uint32_t>(1, static_cast<uint32_t>(scaled));
+        }
+    }
+
+    // Smooth weighted round-robin (as in nginx): every endpoint gains its
+    // weight, the highest is picked and pays back the total. Over one cycle
+    // each endpoint is chosen exactly weight times, interleaved rather than
+    // in bursts.
+    int64_t cycleWeight = 0;
+    for (auto weight : weights) {
+        cycleWeight += weight;
+    }
+
+    std::vector<int64_t> currentWeights(weights.size(), 0);
+    std::vector<uint32_t> schedule;
+    schedule.reserve(static_cast<std::size_t>(cycleWeight));
+
+    for (int64_t pick = 0; pick < cycleWeight; ++pick) {
+        std::size_t selected = 0;
+        for (std::size_t index = 0; index < weights.size(); ++index) {
+            currentWeights[index] += weights[index];
+            if (currentWeights[index] > currentWeights[selected]) {
+                selected = index;
+            }
+        }
+
+        currentWeights[selected] -= cycleWeight;
+        schedule.push_back(static_cast<uint32_t>(selected));
+    }
+
+    return schedule;
+}
+
 } // namespace
 
 RegistrarNode::RegistrarNode(StationChatConfig& config)
     : Node(this, config.registrarAddress, config.registrarPort, config.bindToIp)
-    , config_{config} {
+    , config_{config}
+    , selectionMode_{ParseSelectionMode(config.gatewaySelection)} {
     RebuildClusterView();
+
+    if (config_.gatewayLoadReportPort != 0) {
+        auto address = config_.bindToIp ? config_.registrarAddress : std::string{"0.0.0.0"};
+        loadListener_ = std::make_unique<GatewayLoadListener>(address, config_.gatewayLoadReportPort);
+        loadListener_->SetCluster(config_.gatewayCluster);
+        LOG(INFO) << "Registrar receiving gateway load reports @" << address << ":" << loadListener_->GetPort();
+    } else if (selectionMode_ == SelectionMode::LEAST_LOADED || selectionMode_ == SelectionMode::POWER_OF_TWO) {
+        LOG(WARNING) << "gateway_selection " << config_.gatewaySelection
+                     << " needs gateway_load_report_port; selecting by weight only";
+    }
+
+    if (config_.gatewayProbeIntervalMs != 0) {
+        std::vector<GatewayClusterEndpoint> targets;
+        for (const auto& entry : LoadView()->entries) {
+            targets.push_back(entry.endpoint);
+        }
+
+        prober_ = std::make_unique<GatewayProber>(std::move(targets),
+            std::chrono::milliseconds(config_.gatewayProbeIntervalMs),
+            std::chrono::milliseconds(config_.gatewayProbeTimeoutMs),
+            [this](const GatewayClusterEndpoint& endpoint, bool reachable, std::chrono::microseconds rtt) {
+                RecordProbeResult(endpoint.address, endpoint.port, reachable, rtt);
+            });
+        LOG(INFO) << "Probing cluster gateways every " << config_.gatewayProbeIntervalMs << "ms";
+    }
+
+    GetTimers().SetLagHistogram(&GetMetricsRegistry().Histogram("stationapi_timer_lag_microseconds",
+        "Time from when a node timer was due to when it fired", "node=\"registrar\""));
+    GetTimers().SchedulePeriodic(kBlacklistSweepInterval, [this]() { ExpireBlacklists(); });
 }
 
 RegistrarNode::~RegistrarNode() {}
@@ -28,222 +202,422 @@ StationChatConfig& RegistrarNode::GetConfig() {
     return config_;
 }
 
-GatewayClusterEndpoint RegistrarNode::SelectGatewayEndpoint(
-    const std::string& preferredAddress, uint16_t preferredPort) {
-    std::lock_guard<std::mutex> lock(endpointMutex_);
+void RegistrarNode::Reconfigure() {
+    selectionMode_ = ParseSelectionMode(config_.gatewaySelection);
+    RebuildClusterView();
 
-    if (weightedGatewayEndpoints_.empty()) {
-        return {config_.gatewayAddress, config_.gatewayPort, 1};
+    if (loadListener_) {
+        loadListener_->SetCluster(config_.gatewayCluster);
     }
 
-    PruneExpiredBlacklistLocked();
+    LOG(INFO) << "Registrar now selects among " << LoadView()->entries.size() << " cluster gateways by "
+              << config_.gatewaySelection;
+}
 
-    const bool hasPreferred = !preferredAddress.empty() && preferredPort != 0;
-    if (hasPreferred) {
-        if (auto* preferred = FindEndpointHealthLocked(preferredAddress, preferredPort)) {
-            if (!IsEndpointBlacklistedLocked(*preferred)) {
-                return preferred->endpoint;
-            }
-        }
+RegistrarNode::SelectionMode RegistrarNode::ParseSelectionMode(const std::string& name) {
+    if (name == "weighted") {
+        return SelectionMode::WEIGHTED;
+    } else if (name == "least_loaded") {
+        return SelectionMode::LEAST_LOADED;
+    } else if (name == "power_of_two") {
+        return SelectionMode::POWER_OF_TWO;
+    } else if (name == "affinity") {
+        return SelectionMode::AFFINITY;
     }
 
-    const auto index = nextGatewayIndex_.fetch_add(1, std::memory_order_relaxed);
-    const auto total = weightedGatewayEndpoints_.size();
+    throw std::runtime_error("Unknown gateway selection mode: " + name);
+}
 
-    GatewayClusterEndpoint selectedEndpoint{config_.gatewayAddress, config_.gatewayPort, 1};
-    bool found = false;
+GatewayClusterEndpoint RegistrarNode::SelectGatewayEndpoint(
+    const std::string& preferredAddress, uint16_t preferredPort, const std::string& affinityKey) {
+    auto view = LoadView();
+    if (!view || view->entries.empty()) {
+        return {config_.gatewayAddress, config_.gatewayPort, 1};
+    }
 
-    for (std::size_t offset = 0; offset < total; ++offset) {
-        const auto& candidate = weightedGatewayEndpoints_[(index + offset) % total];
-        EnsureEndpointEntryLocked(candidate);
-        auto* health = FindEndpointHealthLocked(candidate.address, candidate.port);
-        if (health == nullptr) {
-            selectedEndpoint = candidate;
-            found = true;
-            break;
-        }
+    const auto now = ToTicks(std::chrono::steady_clock::now());
 
-        if (!IsEndpointBlacklistedLocked(*health)) {
-            selectedEndpoint = candidate;
-            found = true;
-            break;
+    if (auto* preferred = FindEntry(*view, preferredAddress, preferredPort)) {
+        if (IsAvailable(*preferred->health, now)) {
+            return preferred->endpoint;
         }
     }
 
-    if (!found) {
-        auto best = std::min_element(endpointHealth_.begin(), endpointHealth_.end(),
-            [](const auto& lhs, const auto& rhs) {
-                return lhs.second.blacklistUntil < rhs.second.blacklistUntil;
-            });
+    const ClusterEntry* selected = nullptr;
+    const auto mode = selectionMode_.load(std::memory_order_relaxed);
+    if (mode == SelectionMode::AFFINITY) {
+        selected = SelectByAffinity(*view, affinityKey, now);
+    } else if (mode != SelectionMode::WEIGHTED) {
+        selected = SelectByLoad(*view, now);
+    }
 
-        if (best != endpointHealth_.end()) {
-            best->second.blacklistUntil = std::chrono::steady_clock::time_point{};
-            selectedEndpoint = best->second.endpoint;
-            found = true;
-        }
+    if (selected == nullptr) {
+        selected = SelectWeighted(*view, now);
     }
 
-    if (!found) {
-        selectedEndpoint = weightedGatewayEndpoints_[index % total];
+    if (selected != nullptr) {
+        selected->health->assignedSinceReport.fetch_add(1, std::memory_order_relaxed);
+        return selected->endpoint;
     }
 
-    return selectedEndpoint;
+    // Everything is blacklisted; give the endpoint closest to recovery
+    // another chance rather than refusing the login.
+    auto best = std::min_element(std::begin(view->entries), std::end(view->entries),
+        [](const ClusterEntry& lhs, const ClusterEntry& rhs) {
+            return lhs.health->blacklistUntil.load(std::memory_order_relaxed)
+                < rhs.health->blacklistUntil.load(std::memory_order_relaxed);
+        });
+
+    best->health->blacklistUntil.store(0, std::memory_order_relaxed);
+    return best->endpoint;
 }
 
-void RegistrarNode::OnTick() {}
+void RegistrarNode::ReportGatewayLoad(
+    const GatewayLoadReport& report, std::chrono::steady_clock::time_point receivedAt) {
+    auto view = LoadView();
+    auto* entry = view ? FindEntry(*view, report.address, report.port) : nullptr;
+    if (entry == nullptr) {
+        return;
+    }
 
-void RegistrarNode::RebuildClusterView() {
-    // Clamp weights to avoid exploding the weighted view if an extremely large
-    // value is configured. The registrar still honors relative weights while
-    // keeping the in-memory representation bounded.
-    static constexpr uint16_t kMaxWeight = 100;
-
-    std::vector<GatewayClusterEndpoint> weightedEndpoints;
-    std::vector<GatewayClusterEndpoint> uniqueEndpoints;
-
-    const auto appendEndpoint = [&weightedEndpoints, &uniqueEndpoints](const GatewayClusterEndpoint& endpoint) {
-        weightedEndpoints.push_back(endpoint);
-        if (std::none_of(uniqueEndpoints.begin(), uniqueEndpoints.end(),
-                [&endpoint](const GatewayClusterEndpoint& existing) {
-                    return existing.Matches(endpoint.address, endpoint.port);
-                })) {
-            uniqueEndpoints.push_back(endpoint);
-        }
-    };
+    auto& health = *entry->health;
+    const auto receivedTicks = ToTicks(receivedAt);
+
+    if (!HasFreshLoad(health, receivedTicks)) {
+        LOG(INFO) << "Gateway " << report.address << ":" << report.port << " is reporting load: "
+                  << report.onlineAvatars << " avatars, " << report.connections << " connections";
+    }
 
-    if (!config_.gatewayCluster.empty()) {
-        for (const auto& endpoint : config_.gatewayCluster) {
-            const auto weight = std::max<uint16_t>(static_cast<uint16_t>(1), endpoint.weight);
-            const auto repetitions = std::min<uint16_t>(weight, kMaxWeight);
-            for (uint16_t repeat = 0; repeat < repetitions; ++repeat) {
-                appendEndpoint(endpoint);
+    // Readers may briefly see fields from two consecutive reports, which is
+    // no worse than a report arriving a moment later.
+    health.onlineAvatars.store(report.onlineAvatars, std::memory_order_relaxed);
+    health.connections.store(report.connections, std::memory_order_relaxed);
+    health.queuedBytes.store(report.queuedBytes, std::memory_order_relaxed);
+    health.tickMicros.store(report.tickMicros, std::memory_order_relaxed);
+    health.assignedSinceReport.store(0, std::memory_order_relaxed);
+    health.loadReceivedAt.store(receivedTicks, std::memory_order_release);
+}
+
+void RegistrarNode::RecordProbeResult(
+    const std::string& address, uint16_t port, bool reachable, std::chrono::microseconds rtt) {
+    auto view = LoadView();
+    auto* entry = view ? FindEntry(*view, address, port) : nullptr;
+    if (entry == nullptr) {
+        return;
+    }
+
+    auto& health = *entry->health;
+
+    if (!reachable) {
+        auto failures = health.probeFailures.fetch_add(1, std::memory_order_relaxed) + 1;
+        if (failures >= kProbeFailuresToDemote) {
+            if (failures == kProbeFailuresToDemote) {
+                LOG(WARNING) << "Gateway " << address << ":" << port << " failed " << failures
+                             << " probes; taking it out of rotation";
             }
+
+            MarkFailure(health);
         }
+
+        return;
     }
 
-    if (weightedEndpoints.empty()) {
-        appendEndpoint({config_.gatewayAddress, config_.gatewayPort, 1});
+    // Results come from the single prober thread, so a plain read and write
+    // of the average cannot lose an update to another probe.
+    auto sample = static_cast<int64_t>(rtt.count());
+    auto latency = health.latencyMicros.load(std::memory_order_relaxed);
+    latency = latency == 0 ? std::max<int64_t>(sample, 1) : latency + (sample - latency) / kLatencySmoothing;
+    health.latencyMicros.store(std::max<int64_t>(latency, 1), std::memory_order_relaxed);
+
+    health.probeFailures.store(0, std::memory_order_relaxed);
+    if (health.blacklistUntil.load(std::memory_order_relaxed) != 0) {
+        LOG(INFO) << "Gateway " << address << ":" << port << " answered a probe; returning it to rotation";
+        MarkSuccess(health);
     }
+}
 
-    {
-        std::lock_guard<std::mutex> lock(endpointMutex_);
-        weightedGatewayEndpoints_ = std::move(weightedEndpoints);
-
-        EndpointHealthMap updatedHealth;
-        for (const auto& endpoint : uniqueEndpoints) {
-            const auto key = MakeEndpointKey(endpoint.address, endpoint.port);
-            const auto existing = endpointHealth_.find(key);
-            if (existing != endpointHealth_.end()) {
-                auto health = existing->second;
-                health.endpoint = endpoint;
-                updatedHealth.emplace(key, std::move(health));
-            } else {
-                updatedHealth.emplace(key, EndpointHealth{endpoint});
-            }
+void RegistrarNode::OnTick() {
+    if (loadListener_) {
+        loadListener_->Poll([this](const GatewayLoadReport& report) { ReportGatewayLoad(report); });
+    }
+}
+
+void RegistrarNode::ExpireBlacklists() {
+    auto view = LoadView();
+    const auto now = ToTicks(std::chrono::steady_clock::now());
+
+    for (const auto& entry : view->entries) {
+        if (ClearExpiredBlacklist(*entry.health, now)) {
+            LOG(INFO) << "Gateway " << entry.endpoint.address << ":" << entry.endpoint.port
+                      << " blacklist expired; returning it to rotation";
         }
+    }
+}
 
-        endpointHealth_.swap(updatedHealth);
+const RegistrarNode::ClusterEntry* RegistrarNode::SelectWeighted(const ClusterView& view, int64_t now) const {
+    if (std::none_of(std::begin(view.entries), std::end(view.entries),
+            [now](const ClusterEntry& entry) { return IsAvailable(*entry.health, now); })) {
+        return nullptr;
     }
 
-    nextGatewayIndex_.store(0, std::memory_order_relaxed);
+    // Slow gateways only take logins when every available one is slow.
+    const bool avoidSlow = std::any_of(std::begin(view.entries), std::end(view.entries),
+        [this, now](const ClusterEntry& entry) { return IsAvailable(*entry.health, now) && !IsSlow(*entry.health); });
+
+    // Walk the precomputed cycle from a shared cursor, passing over
+    // blacklisted endpoints; their share falls to whoever follows them.
+    const auto length = view.schedule.size();
+    const auto start = view.nextPick.fetch_add(1, std::memory_order_relaxed);
+
+    for (std::size_t offset = 0; offset < length; ++offset) {
+        const auto& entry = view.entries[view.schedule[(start + offset) % length]];
+        if (IsAvailable(*entry.health, now) && !(avoidSlow && IsSlow(*entry.health))) {
+            return &entry;
+        }
+    }
+
+    return nullptr;
 }
 
-void RegistrarNode::ReportGatewayFailure(const std::string& address, uint16_t port) {
-    if (address.empty() || port == 0) {
-        return;
+const RegistrarNode::ClusterEntry* RegistrarNode::SelectByLoad(const ClusterView& view, int64_t now) const {
+    std::size_t candidates = 0;
+
+    for (const auto& entry : view.entries) {
+        if (!IsAvailable(*entry.health, now)) {
+            continue;
+        }
+
+        // Comparing gateways we have heard from with ones we have not would
+        // favour whichever side the missing numbers happen to flatter.
+        if (!HasFreshLoad(*entry.health, now)) {
+            return nullptr;
+        }
+
+        ++candidates;
     }
 
-    std::lock_guard<std::mutex> lock(endpointMutex_);
-    if (auto* health = FindEndpointHealthLocked(address, port)) {
-        MarkFailureLocked(*health);
+    if (candidates == 0) {
+        return nullptr;
     }
+
+    // Avatars per unit of weight, counting logins handed out since the last
+    // report so that a burst does not all land on one gateway before it
+    // reports again. A lagging tick, a send queue backlog or slow probe
+    // round trips make a gateway count as proportionally busier.
+    const auto score = [](const ClusterEntry& entry) {
+        const auto& health = *entry.health;
+        double avatars = static_cast<double>(health.onlineAvatars.load(std::memory_order_relaxed))
+            + health.assignedSinceReport.load(std::memory_order_relaxed) + 1.0;
+        double pressure = 1.0 + health.tickMicros.load(std::memory_order_relaxed) / kTickBudgetMicros
+            + health.queuedBytes.load(std::memory_order_relaxed) / kQueueBudgetBytes
+            + health.latencyMicros.load(std::memory_order_relaxed) / kLatencyBudgetMicros;
+        return avatars * pressure / entry.endpoint.weight;
+    };
+
+    // Power of two choices: comparing two random gateways avoids every
+    // registrar in the cluster piling onto the same least loaded one between
+    // reports, while still steering clear of the busiest. With two or fewer
+    // candidates it is the same as picking the least loaded.
+    std::size_t firstRank = 0;
+    std::size_t secondRank = candidates;
+    if (selectionMode_ == SelectionMode::POWER_OF_TWO && candidates > 2) {
+        thread_local std::mt19937 random{std::random_device{}()};
+        std::uniform_int_distribution<std::size_t> pick{0, candidates - 1};
+        firstRank = pick(random);
+        do {
+            secondRank = pick(random);
+        } while (secondRank == firstRank);
+    }
+
+    const ClusterEntry* selected = nullptr;
+    double selectedScore = 0.0;
+    std::size_t rank = 0;
+
+    for (const auto& entry : view.entries) {
+        if (!IsAvailable(*entry.health, now)) {
+            continue;
+        }
+
+        bool considered = secondRank == candidates || rank == firstRank || rank == secondRank;
+        ++rank;
+
+        if (!considered) {
+            continue;
+        }
+
+        auto entryScore = score(entry);
+        if (selected == nullptr || entryScore < selectedScore) {
+            selected = &entry;
+            selectedScore = entryScore;
+        }
+    }
+
+    return selected;
 }
 
-void RegistrarNode::ReportGatewaySuccess(const std::string& address, uint16_t port) {
-    if (address.empty() || port == 0) {
-        return;
+const RegistrarNode::ClusterEntry* RegistrarNode::SelectByAffinity(
+    const ClusterView& view, const std::string& key, int64_t now) {
+    if (key.empty() || view.ring.empty()) {
+        return nullptr;
     }
 
-    std::lock_guard<std::mutex> lock(endpointMutex_);
-    if (auto* health = FindEndpointHealthLocked(address, port)) {
-        MarkSuccessLocked(*health);
+    // The first point clockwise from the key's hash owns it. While that
+    // gateway is out of rotation its keys spill to the next gateway on the
+    // ring and return once it recovers; nobody else's keys move.
+    auto point = HashRingKey(key);
+    auto start = std::lower_bound(std::begin(view.ring), std::end(view.ring),
+                     std::make_pair(point, uint32_t{0}))
+        - std::begin(view.ring);
+
+    for (std::size_t offset = 0; offset < view.ring.size(); ++offset) {
+        const auto& entry = view.entries[view.ring[(start + offset) % view.ring.size()].second];
+        if (IsAvailable(*entry.health, now)) {
+            return &entry;
+        }
     }
+
+    return nullptr;
 }
 
-bool RegistrarNode::IsEndpointBlacklistedLocked(const EndpointHealth& health) const {
-    if (health.blacklistUntil == std::chrono::steady_clock::time_point{}) {
+bool RegistrarNode::HasFreshLoad(const EndpointHealth& health, int64_t now) const {
+    auto receivedAt = health.loadReceivedAt.load(std::memory_order_acquire);
+    if (receivedAt == 0) {
         return false;
     }
 
-    return std::chrono::steady_clock::now() < health.blacklistUntil;
+    auto interval = std::chrono::milliseconds(std::max<uint32_t>(config_.gatewayLoadReportIntervalMs, 1));
+    auto staleAfter = std::chrono::duration_cast<std::chrono::steady_clock::duration>(interval * kStaleReportIntervals);
+    return now - receivedAt <= staleAfter.count();
 }
 
-void RegistrarNode::PruneExpiredBlacklistLocked() {
-    const auto now = std::chrono::steady_clock::now();
-    for (auto& [key, health] : endpointHealth_) {
-        if (health.blacklistUntil != std::chrono::steady_clock::time_point{}
-            && health.blacklistUntil <= now) {
-            health.blacklistUntil = std::chrono::steady_clock::time_point{};
-            health.failureCount = 0;
+bool RegistrarNode::IsSlow(const EndpointHealth& health) const {
+    auto latency = health.latencyMicros.load(std::memory_order_relaxed);
+    return config_.gatewayProbeSlowMs != 0 && latency > static_cast<int64_t>(config_.gatewayProbeSlowMs) * 1000;
+}
+
+void RegistrarNode::RebuildClusterView() {
+    std::vector<ClusterEntry> entries;
+
+    const auto appendEndpoint = [&entries](const GatewayClusterEndpoint& endpoint) {
+        auto existing = std::find_if(std::begin(entries), std::end(entries),
+            [&endpoint](const ClusterEntry& entry) { return entry.endpoint.Matches(endpoint.address, endpoint.port); });
+
+        if (existing == std::end(entries)) {
+            ClusterEntry entry;
+            entry.endpoint = endpoint;
+            entry.endpoint.weight = std::max<uint16_t>(static_cast<uint16_t>(1), endpoint.weight);
+            entries.push_back(std::move(entry));
+        } else {
+            auto totalWeight = static_cast<uint32_t>(existing->endpoint.weight)
+                + std::max<uint16_t>(static_cast<uint16_t>(1), endpoint.weight);
+            existing->endpoint.weight
+                = static_cast<uint16_t>(std::min<uint32_t>(totalWeight, std::numeric_limits<uint16_t>::max()));
         }
+    };
+
+    for (const auto& endpoint : config_.gatewayCluster) {
+        appendEndpoint(endpoint);
+    }
+
+    if (entries.empty()) {
+        appendEndpoint({config_.gatewayAddress, config_.gatewayPort, 1});
+    }
+
+    std::lock_guard<std::mutex> lock(rebuildMutex_);
+
+    // Health carries over for endpoints that stay in the cluster; selections
+    // still running against the previous view update the same state.
+    auto previous = LoadView();
+    for (auto& entry : entries) {
+        auto* existing = previous ? FindEntry(*previous, entry.endpoint.address, entry.endpoint.port) : nullptr;
+        entry.health = existing ? existing->health : std::make_shared<EndpointHealth>();
+    }
+
+    std::vector<GatewayClusterEndpoint> targets;
+    for (const auto& entry : entries) {
+        targets.push_back(entry.endpoint);
+    }
+
+    auto view = std::make_shared<ClusterView>();
+    view->schedule = BuildSchedule(entries);
+    view->ring = BuildRing(entries);
+    view->entries = std::move(entries);
+
+    std::atomic_store(&view_, std::shared_ptr<const ClusterView>{std::move(view)});
+
+    if (prober_) {
+        prober_->SetTargets(std::move(targets));
+    }
+}
+
+void RegistrarNode::ReportGatewayFailure(const std::string& address, uint16_t port) {
+    auto view = LoadView();
+    if (auto* entry = view ? FindEntry(*view, address, port) : nullptr) {
+        MarkFailure(*entry->health);
     }
 }
 
-RegistrarNode::EndpointHealth* RegistrarNode::FindEndpointHealthLocked(
-    const std::string& address, uint16_t port) {
+void RegistrarNode::ReportGatewaySuccess(const std::string& address, uint16_t port) {
+    auto view = LoadView();
+    if (auto* entry = view ? FindEntry(*view, address, port) : nullptr) {
+        MarkSuccess(*entry->health);
+    }
+}
+
+const RegistrarNode::ClusterEntry* RegistrarNode::FindEntry(
+    const ClusterView& view, const std::string& address, uint16_t port) {
     if (address.empty() || port == 0) {
         return nullptr;
     }
 
-    const auto key = MakeEndpointKey(address, port);
-    auto iter = endpointHealth_.find(key);
-    if (iter != endpointHealth_.end()) {
-        return &iter->second;
+    auto iter = std::find_if(std::begin(view.entries), std::end(view.entries),
+        [&address, port](const ClusterEntry& entry) { return entry.endpoint.Matches(address, port); });
+
+    return iter != std::end(view.entries) ? &*iter : nullptr;
+}
+
+bool RegistrarNode::IsAvailable(EndpointHealth& health, int64_t now) {
+    auto blacklistUntil = health.blacklistUntil.load(std::memory_order_relaxed);
+    if (blacklistUntil == 0) {
+        return true;
     }
 
-    for (const auto& endpoint : weightedGatewayEndpoints_) {
-        if (endpoint.Matches(address, port)) {
-            auto [insertedIter, _] = endpointHealth_.emplace(key, EndpointHealth{endpoint});
-            return &insertedIter->second;
-        }
+    if (blacklistUntil > now) {
+        return false;
     }
 
-    return nullptr;
+    ClearExpiredBlacklist(health, now);
+    return true;
 }
 
-void RegistrarNode::EnsureEndpointEntryLocked(const GatewayClusterEndpoint& endpoint) {
-    const auto key = MakeEndpointKey(endpoint.address, endpoint.port);
-    auto iter = endpointHealth_.find(key);
-    if (iter == endpointHealth_.end()) {
-        endpointHealth_.emplace(key, EndpointHealth{endpoint});
-    } else {
-        iter->second.endpoint = endpoint;
+bool RegistrarNode::ClearExpiredBlacklist(EndpointHealth& health, int64_t now) {
+    auto blacklistUntil = health.blacklistUntil.load(std::memory_order_relaxed);
+    if (blacklistUntil == 0 || blacklistUntil > now) {
+        return false;
+    }
+
+    // Whoever first sees the blacklist expire clears it along with the
+    // failure count that set it.
+    if (!health.blacklistUntil.compare_exchange_strong(blacklistUntil, 0, std::memory_order_relaxed)) {
+        return false;
     }
+
+    health.failureCount.store(0, std::memory_order_relaxed);
+    return true;
 }
 
-void RegistrarNode::MarkFailureLocked(EndpointHealth& health) {
-    const auto now = std::chrono::steady_clock::now();
-    const auto cappedFailures
-        = std::min<std::size_t>(health.failureCount + 1, static_cast<std::size_t>(std::numeric_limits<uint16_t>::max()));
-    health.failureCount = cappedFailures;
+void RegistrarNode::MarkFailure(EndpointHealth& health) {
+    auto failures = health.failureCount.fetch_add(1, std::memory_order_relaxed) + 1;
 
-    auto penalty = kBaseBlacklistDuration * static_cast<int64_t>(health.failureCount);
+    auto penalty = kBaseBlacklistDuration * static_cast<int64_t>(std::min<uint32_t>(failures, 1000));
     if (penalty > kMaxBlacklistDuration) {
         penalty = kMaxBlacklistDuration;
     }
 
-    health.blacklistUntil = now + penalty;
+    health.blacklistUntil.store(ToTicks(std::chrono::steady_clock::now() + penalty), std::memory_order_relaxed);
 }
 
-void RegistrarNode::MarkSuccessLocked(EndpointHealth& health) {
-    health.failureCount = 0;
-    health.blacklistUntil = std::chrono::steady_clock::time_point{};
+void RegistrarNode::MarkSuccess(EndpointHealth& health) {
+    health.failureCount.store(0, std::memory_order_relaxed);
+    health.blacklistUntil.store(0, std::memory_order_relaxed);
 }
-
-std::string RegistrarNode::MakeEndpointKey(const std::string& address, uint16_t port) {
-    std::string key = address;
-    key.push_back('#');
-    key += std::to_string(port);
-    return key;
-}
-
@@ -1,15 +1,19 @@
 
 #pragma once
 
+#include "GatewayLoadChannel.hpp"
+#include "GatewayProber.hpp"
 #include "Node.hpp"
 #include "RegistrarClient.hpp"
 #include "StationChatConfig.hpp"
 
 #include <atomic>
 #include <chrono>
+#include <cstdint>
+#include <memory>
 #include <mutex>
 #include <string>
-#include <unordered_map>
+#include <utility>
 #include <vector>
 
 class RegistrarNode : public Node<RegistrarNode, RegistrarClient> {
@@ -19,35 +23,103 @@ public:
 
     StationChatConfig& GetConfig();
 
-    GatewayClusterEndpoint SelectGatewayEndpoint(
-        const std::string& preferredAddress = {}, uint16_t preferredPort = 0);
+    /** Picks the gateway for a new login. A preferred endpoint is honored
+     * while it is available; in affinity mode the affinity key, normally the
+     * requesting game server's address, maps to the same gateway for as long
+     * as that gateway stays in the cluster.
+     */
+    GatewayClusterEndpoint SelectGatewayEndpoint(const std::string& preferredAddress = {}, uint16_t preferredPort = 0,
+        const std::string& affinityKey = {});
 
     void ReportGatewayFailure(const std::string& address, uint16_t port);
     void ReportGatewaySuccess(const std::string& address, uint16_t port);
 
+    /** Records the live load of a cluster gateway. Reports from endpoints
+     * outside the cluster are ignored.
+     */
+    void ReportGatewayLoad(const GatewayLoadReport& report,
+        std::chrono::steady_clock::time_point receivedAt = std::chrono::steady_clock::now());
+
+    /** Records the outcome of an active probe. Consecutive failures take an
+     * endpoint out of rotation and a success returns it; round trip times
+     * feed a smoothed latency used by selection.
+     */
+    void RecordProbeResult(const std::string& address, uint16_t port, bool reachable, std::chrono::microseconds rtt);
+
+    /** Picks up a changed gateway_cluster and gateway_selection from the
+     * configuration. The new cluster view replaces the old one in a single
+     * swap, and endpoints that stay keep their health and load. Called from
+     * the thread that ticks the node.
+     */
+    void Reconfigure();
+
 private:
-    void OnTick() override;
-    void RebuildClusterView();
+    enum class SelectionMode { WEIGHTED, LEAST_LOADED, POWER_OF_TWO, AFFINITY };
 
+    /** Health and reported load of one cluster endpoint. Shared between
+     * successive cluster views so that a rebuild keeps what was learned about
+     * endpoints that stay. Times are steady_clock ticks, 0 meaning unset.
+     */
     struct EndpointHealth {
+        std::atomic<uint32_t> failureCount{0};
+        std::atomic<int64_t> blacklistUntil{0};
+        std::atomic<uint32_t> onlineAvatars{0};
+        std::atomic<uint32_t> connections{0};
+        std::atomic<uint64_t> queuedBytes{0};
+        std::atomic<uint32_t> tickMicros{0};
+        std::atomic<int64_t> loadReceivedAt{0};
+        std::atomic<uint32_t> assignedSinceReport{0};
+        std::atomic<int64_t> latencyMicros{0};
+        std::atomic<uint32_t> probeFailures{0};
+    };
+
+    struct ClusterEntry {
         GatewayClusterEndpoint endpoint;
-        std::size_t failureCount{0};
-        std::chrono::steady_clock::time_point blacklistUntil{};
+        std::shared_ptr<EndpointHealth> health;
+    };
+
+    /** Immutable once published, apart from the health atomics and the
+     * round-robin cursor. Readers load the current view without locking and
+     * keep it alive for the duration of a selection.
+     */
+    struct ClusterView {
+        std::vector<ClusterEntry> entries;
+
+        // One full smooth weighted round-robin cycle as indexes into entries.
+        std::vector<uint32_t> schedule;
+        mutable std::atomic<uint64_t> nextPick{0};
+
+        // Consistent-hash ring of (point, index into entries), sorted by
+        // point, with virtual nodes in proportion to weight.
+        std::vector<std::pair<uint64_t, uint32_t>> ring;
     };
 
-    using EndpointHealthMap = std::unordered_map<std::string, EndpointHealth>;
+    void OnTick() override;
+    void ExpireBlacklists();
+    void RebuildClusterView();
+    static SelectionMode ParseSelectionMode(const std::string& name);
+
+    std::shared_ptr<const ClusterView> LoadView() const { return std::atomic_load(&view_); }
 
-    bool IsEndpointBlacklistedLocked(const EndpointHealth& health) const;
-    void PruneExpiredBlacklistLocked();
-    EndpointHealth* FindEndpointHealthLocked(const std::string& address, uint16_t port);
-    void EnsureEndpointEntryLocked(const GatewayClusterEndpoint& endpoint);
-    void MarkFailureLocked(EndpointHealth& health);
-    void MarkSuccessLocked(EndpointHealth& health);
-    static std::string MakeEndpointKey(const std::string& address, uint16_t port);
+    static const ClusterEntry* FindEntry(const ClusterView& view, const std::string& address, uint16_t port);
+    static bool IsAvailable(EndpointHealth& health, int64_t now);
+    static bool ClearExpiredBlacklist(EndpointHealth& health, int64_t now);
+    const ClusterEntry* SelectWeighted(const ClusterView& view, int64_t now) const;
+    const ClusterEntry* SelectByLoad(const ClusterView& view, int64_t now) const;
+    static const ClusterEntry* SelectByAffinity(const ClusterView& view, const std::string& key, int64_t now);
+    bool HasFreshLoad(const EndpointHealth& health, int64_t now) const;
+    bool IsSlow(const EndpointHealth& health) const;
+    static void MarkFailure(EndpointHealth& health);
+    static void MarkSuccess(EndpointHealth& health);
 
     StationChatConfig& config_;
-    std::vector<GatewayClusterEndpoint> weightedGatewayEndpoints_;
-    EndpointHealthMap endpointHealth_;
-    std::mutex endpointMutex_;
-    std::atomic<size_t> nextGatewayIndex_{0};
+    std::atomic<SelectionMode> selectionMode_;
+    std::shared_ptr<const ClusterView> view_;
+
+    // Serializes rebuilds against each other; selection never takes it.
+    std::mutex rebuildMutex_;
+    std::unique_ptr<GatewayLoadListener> loadListener_;
+
+    // Last, so that its thread stops before the state it reports into goes.
+    std::unique_ptr<GatewayProber> prober_;
 };
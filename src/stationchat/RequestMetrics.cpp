@@ -0,0 +1,39 @@
+
+#include "RequestMetrics.hpp"
+
+RequestMetrics::RequestMetrics(MetricsRegistry& registry)
+    : registry_{registry}
+    , unknownRequests_{registry.Counter(
+          "stationchat_unknown_requests_total", "Gateway requests with an unrecognized request type")} {}
+
+void RequestMetrics::Record(ChatRequestType type, bool failed, std::chrono::microseconds elapsed) {
+    auto& metrics = byType_[static_cast<uint16_t>(type)];
+    if (metrics.requests == nullptr) {
+        Register(type);
+    }
+
+    metrics.requests->Increment();
+    if (failed) {
+        metrics.errors->Increment();
+    }
+
+    metrics.latency->Observe(elapsed);
+}
+
+const RequestTypeMetrics* RequestMetrics::Get(ChatRequestType type) const {
+    auto& metrics = byType_[static_cast<uint16_t>(type)];
+    return metrics.requests ? &metrics : nullptr;
+}
+
+RequestTypeMetrics& RequestMetrics::Register(ChatRequestType type) {
+    auto labels = std::string{"type=\""} + ToString(type) + "\"";
+
+    auto& metrics = byType_[static_cast<uint16_t>(type)];
+    metrics.requests = &registry_.Counter("stationchat_requests_total", "Gateway requests handled", labels);
+    metrics.errors = &registry_.Counter(
+        "stationchat_request_errors_total", "Gateway requests answered with a result other than SUCCESS", labels);
+    metrics.latency = &registry_.Histogram("stationchat_request_duration_microseconds",
+        "Time to handle a gateway request and queue its response", labels);
+
+    return metrics;
+}
@@ -0,0 +1,48 @@
+
+#pragma once
+
+#include "ChatEnums.hpp"
+#include "Metrics.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+
+// Request instrumentation is compiled out entirely when the build disables it.
+#ifndef STATIONCHAT_REQUEST_METRICS
+#define STATIONCHAT_REQUEST_METRICS 1
+#endif
+
+constexpr bool kRequestMetricsEnabled = STATIONCHAT_REQUEST_METRICS != 0;
+
+struct RequestTypeMetrics {
+    MetricCounter* requests = nullptr;
+    MetricCounter* errors = nullptr;
+    MetricHistogram* latency = nullptr;
+};
+
+/** Per request type counters, error counts and latency histograms for the
+ * requests handled by a gateway, exported through a MetricsRegistry. The
+ * series for a request type are registered the first time it is recorded.
+ */
+class RequestMetrics {
+public:
+    // Large enough for every ChatRequestType value handled by the gateway.
+    static constexpr std::size_t kRequestTypeSlots = 128;
+
+    explicit RequestMetrics(MetricsRegistry& registry = GetMetricsRegistry());
+
+    void Record(ChatRequestType type, bool failed, std::chrono::microseconds elapsed);
+    void RecordUnknown() { unknownRequests_.Increment(); }
+
+    /** Returns null for request types that have not been recorded yet.
+     */
+    const RequestTypeMetrics* Get(ChatRequestType type) const;
+
+private:
+    RequestTypeMetrics& Register(ChatRequestType type);
+
+    MetricsRegistry& registry_;
+    MetricCounter& unknownRequests_;
+    std::array<RequestTypeMetrics, kRequestTypeSlots> byType_{};
+};
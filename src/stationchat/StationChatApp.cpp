@@ -1,19 +1,107 @@
 #include "StationChatApp.hpp"
 
+#include "Metrics.hpp"
+#include "PacketCapture.hpp"
+
 #include "easylogging++.h"
 
 StationChatApp::StationChatApp(StationChatConfig config)
     : config_{std::move(config)} {
     config_.NormalizeClusterGateways();
+    for (const auto& host : config_.ResolveClusterHosts()) {
+        LOG(WARNING) << "Cannot resolve cluster gateway host " << host;
+    }
 
     registrarNode_ = std::make_unique<RegistrarNode>(config_);
     LOG(INFO) << "Registrar listening @" << config_.registrarAddress << ":" << config_.registrarPort;
 
     gatewayNode_ = std::make_unique<GatewayNode>(config_);
     LOG(INFO) << "Gateway listening @" << config_.gatewayAddress << ":" << config_.gatewayPort;
+
+    if (config_.metricsPort != 0) {
+        metricsServer_ = std::make_unique<MetricsServer>(GetMetricsRegistry(), config_.metricsAddress,
+            config_.metricsPort, [this]() { reloadRequested_ = true; });
+        LOG(INFO) << "Metrics endpoint listening @" << config_.metricsAddress << ":" << metricsServer_->GetPort();
+    }
+
+    if (!config_.packetCaptureFile.empty()) {
+        GetPacketCapture().Start(
+            config_.packetCaptureFile, static_cast<uint64_t>(config_.packetCaptureMaxMb) * 1024 * 1024);
+    }
 }
 
 void StationChatApp::Tick() {
     registrarNode_->Tick();
     gatewayNode_->Tick();
+
+    if (pendingReload_.valid() && pendingReload_.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+        auto done = std::move(reloadDone_);
+        reloadDone_ = nullptr;
+        done(ApplyReload(pendingReload_.get()));
+    }
+}
+
+bool StationChatApp::Reload(const StationChatConfig& config, std::function<void(bool)> done) {
+    if (pendingReload_.valid()) {
+        LOG(WARNING) << "Ignoring the reload request; the previous one is still resolving cluster hosts";
+        return false;
+    }
+
+    for (const auto& name : config_.ListRestartOnlyChanges(config)) {
+        LOG(WARNING) << name << " changed; the new value takes effect after a restart";
+    }
+
+    auto candidate = config_;
+    candidate.ApplyReloadable(config);
+
+    // Name lookups can take seconds, which the tick loop cannot spare.
+    pendingReload_ = std::async(std::launch::async, &StationChatApp::ResolveCluster, std::move(candidate));
+    reloadDone_ = std::move(done);
+    return true;
+}
+
+StationChatApp::ResolvedConfig StationChatApp::ResolveCluster(StationChatConfig config) {
+    // The local gateway joins the cluster at the address it is running on.
+    config.NormalizeClusterGateways();
+
+    ResolvedConfig resolved;
+    resolved.unresolvedHosts = config.ResolveClusterHosts();
+    resolved.config = std::move(config);
+    return resolved;
+}
+
+bool StationChatApp::ApplyReload(ResolvedConfig resolved) {
+    for (const auto& host : resolved.unresolvedHosts) {
+        LOG(WARNING) << "Cannot resolve cluster gateway host " << host;
+    }
+
+    auto previous = config_;
+    config_ = std::move(resolved.config);
+
+    // Each node checks what it can reject before changing anything.
+    try {
+        gatewayNode_->Reconfigure();
+    } catch (const std::exception& e) {
+        LOG(ERROR) << "Keeping the current configuration: " << e.what();
+        config_ = previous;
+        return false;
+    }
+
+    try {
+        registrarNode_->Reconfigure();
+    } catch (const std::exception& e) {
+        LOG(ERROR) << "Keeping the current configuration: " << e.what();
+        config_ = previous;
+        gatewayNode_->Reconfigure();
+        return false;
+    }
+
+    LOG(INFO) << "Configuration reloaded";
+    return true;
+}
+
+void StationChatApp::Shutdown() {
+    isRunning_ = false;
+    gatewayNode_->SaveSnapshot();
+    GetPacketCapture().Stop();
 }
@@ -2,12 +2,17 @@
 #pragma once
 
 #include "GatewayNode.hpp"
+#include "MetricsServer.hpp"
 #include "RegistrarNode.hpp"
 #include "StationChatConfig.hpp"
 
+#include <atomic>
 #include <cstdint>
+#include <functional>
+#include <future>
 #include <memory>
 #include <string>
+#include <vector>
 
 class StationChatApp {
 public:
@@ -17,9 +22,47 @@ public:
 
     void Tick();
 
+    /** Applies the reloadable settings of a freshly parsed configuration
+     * between ticks, so no request sees a mix of old and new settings.
+     * Settings only read at startup are left as they are and named in the log.
+     *
+     * Cluster hosts are resolved on a worker thread first; a later tick
+     * applies everything at once and calls done with false, the previous
+     * settings still in place, when the nodes reject the new ones.
+     *
+     * Returns false if an earlier reload is still resolving.
+     */
+    bool Reload(const StationChatConfig& config, std::function<void(bool)> done);
+
+    bool IsReloadPending() const { return pendingReload_.valid(); }
+
+    const StationChatConfig& GetConfig() const { return config_; }
+    GatewayNode& GetGatewayNode() { return *gatewayNode_; }
+
+    /** True once after a reload was requested through the admin endpoint.
+     */
+    bool TakeReloadRequest() { return reloadRequested_.exchange(false); }
+
+    /** Stops the tick loop and persists any state needed for a warm restart.
+     */
+    void Shutdown();
+
 private:
+    struct ResolvedConfig {
+        StationChatConfig config;
+        std::vector<std::string> unresolvedHosts;
+    };
+
+    static ResolvedConfig ResolveCluster(StationChatConfig config);
+
+    bool ApplyReload(ResolvedConfig resolved);
+
     StationChatConfig config_;
+    std::future<ResolvedConfig> pendingReload_;
+    std::function<void(bool)> reloadDone_;
     bool isRunning_ = true;
+    std::atomic<bool> reloadRequested_{false};
     std::unique_ptr<GatewayNode> gatewayNode_;
-    std::unique_ptr<RegistrarNode> registrarNode_;    
+    std::unique_ptr<RegistrarNode> registrarNode_;
+    std::unique_ptr<MetricsServer> metricsServer_;
 };
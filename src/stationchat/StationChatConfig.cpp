@@ -1 +1,37 @@
 #include "StationChatConfig.hpp"
+
+#include <boost/asio.hpp>
+
+constexpr uint32_t StationChatConfig::kLegacyApiVersion;
+constexpr uint32_t StationChatConfig::kEnhancedApiVersion;
+constexpr uint32_t StationChatConfig::kCapabilityBatchedPackets;
+constexpr uint32_t StationChatConfig::kCapabilityMaskForV3;
+
+std::vector<std::string> StationChatConfig::ResolveClusterHosts() {
+    boost::asio::io_context ioContext;
+    boost::asio::ip::udp::resolver resolver{ioContext};
+    std::vector<std::string> unresolved;
+
+    for (auto& endpoint : gatewayCluster) {
+        boost::system::error_code error;
+        auto results = resolver.resolve(endpoint.address, "0", error);
+        if (error || results.empty()) {
+            endpoint.hostAddress.clear();
+            unresolved.push_back(endpoint.address);
+            continue;
+        }
+
+        // IPv4 is preferred, as the replication socket is bound to it.
+        auto address = results.begin()->endpoint().address();
+        for (const auto& result : results) {
+            if (result.endpoint().address().is_v4()) {
+                address = result.endpoint().address();
+                break;
+            }
+        }
+
+        endpoint.hostAddress = address.to_string();
+    }
+
+    return unresolved;
+}
@@ -14,9 +14,16 @@ struct GatewayClusterEndpoint {
     uint16_t port{0};
     uint16_t weight{1};
 
+    // Numeric address of the host, filled in by
+    // StationChatConfig::ResolveClusterHosts so that sockets and sender
+    // checks never wait on a name lookup.
+    std::string hostAddress;
+
     bool Matches(const std::string& otherAddress, uint16_t otherPort) const {
         return address == otherAddress && port == otherPort;
     }
+
+    const std::string& GetHostAddress() const { return hostAddress.empty() ? address : hostAddress; }
 };
 
 struct WebsiteIntegrationConfig {
@@ -64,23 +71,159 @@ struct StationChatConfig {
         return stream.str();
     }
 
-    // Maintain compatibility with existing Star Wars Galaxies chat clients,
-    // which expect protocol version 2 during the SETAPIVERSION handshake.
-    const uint32_t version = 2;
+    // Existing Star Wars Galaxies chat clients request protocol version 2
+    // during the SETAPIVERSION handshake and must keep seeing the exact V2
+    // wire format. Version 3 adds a capability mask to the response.
+    static constexpr uint32_t kLegacyApiVersion = 2;
+    static constexpr uint32_t kEnhancedApiVersion = 3;
+
+    // Outbound messages are packed into length-prefixed batches.
+    static constexpr uint32_t kCapabilityBatchedPackets = 1 << 0;
+    static constexpr uint32_t kCapabilityMaskForV3 = kCapabilityBatchedPackets;
+
+    bool ShouldAcceptApiVersion(uint32_t clientVersion) const {
+        return clientVersion >= apiMinVersion && clientVersion <= apiMaxVersion;
+    }
+
+    uint32_t ResolveApiVersionForClient(uint32_t clientVersion) const {
+        return ShouldAcceptApiVersion(clientVersion) ? clientVersion : apiDefaultVersion;
+    }
+
+    uint32_t CapabilityMaskForVersion(uint32_t negotiatedVersion) const {
+        if (negotiatedVersion < kEnhancedApiVersion) {
+            return 0;
+        }
+
+        uint32_t mask = kCapabilityMaskForV3;
+        if (maxBatchedPacketSize == 0) {
+            mask &= ~kCapabilityBatchedPackets;
+        }
+
+        return mask;
+    }
+
+    uint32_t apiMinVersion{kLegacyApiVersion};
+    uint32_t apiMaxVersion{kEnhancedApiVersion};
+    uint32_t apiDefaultVersion{kLegacyApiVersion};
+    uint32_t maxBatchedPacketSize{1400};
+    uint32_t sendQueueHighWatermarkKb{256};
+    uint32_t sendQueueLowWatermarkKb{64};
+    uint32_t sendQueueMaxDeferredMessages{10000};
+    uint32_t sendQueueMaxDeferredKb{1024};
+    uint32_t sendQueueDisconnectKb{16384};
+    std::string metricsAddress{"127.0.0.1"};
+    uint16_t metricsPort{0};
+    bool asyncLogging{true};
+    uint32_t logRequestSampleEvery{1};
+    uint32_t logRequestMaxPerSecond{0};
+    std::string packetCaptureFile;
+    uint32_t packetCaptureMaxMb{1024};
     std::string gatewayAddress{"192.168.88.7"};
     uint16_t gatewayPort{5001};
     std::string registrarAddress{"192.168.88.7"};
     uint16_t registrarPort{5000};
+    std::string storageBackend{"mariadb"};
     std::string chatDatabaseHost{"mysql73.unoeuro.com"};
     uint16_t chatDatabasePort{3306};
     std::string chatDatabaseUser{"swgplus_com"};
     std::string chatDatabasePassword;
     std::string chatDatabaseSchema{"swgplus_com_db"};
     std::string chatDatabaseSocket;
+
+    // Threads, each with a database connection of its own, that run the
+    // database work of handlers that await it; 0 runs that work inline.
+    uint32_t databaseWorkers{2};
+
+    // Logins past the queue at once, 0 for no bound, and how many of them
+    // share one batch of lookups.
+    uint32_t loginConcurrency{256};
+    uint32_t loginBatchSize{64};
     std::string loggerConfig;
     bool bindToIp{false};
     WebsiteIntegrationConfig websiteIntegration;
     std::vector<GatewayClusterEndpoint> gatewayCluster;
+    std::string gatewaySelection{"weighted"};
+    uint16_t gatewayLoadReportPort{0};
+    uint32_t gatewayLoadReportIntervalMs{1000};
+    uint32_t gatewayProbeIntervalMs{0};
+    uint32_t gatewayProbeTimeoutMs{1000};
+    uint32_t gatewayProbeSlowMs{250};
+    uint16_t gatewayReplicationPortOffset{0};
+    std::string snapshotFile;
+    uint32_t snapshotIntervalSeconds{300};
+    uint32_t avatarCacheMaxEntries{100000};
+    uint32_t avatarCacheMaxMegabytes{0};
+
+    /** Takes over the settings that can change while running: the cluster
+     * and how logins are spread over it, cache bounds, login pipeline limits,
+     * send queue and protocol tuning, and request log sampling.
+     */
+    void ApplyReloadable(const StationChatConfig& source) {
+        gatewayCluster = source.gatewayCluster;
+        gatewaySelection = source.gatewaySelection;
+        gatewayLoadReportIntervalMs = source.gatewayLoadReportIntervalMs;
+        gatewayProbeSlowMs = source.gatewayProbeSlowMs;
+        avatarCacheMaxEntries = source.avatarCacheMaxEntries;
+        avatarCacheMaxMegabytes = source.avatarCacheMaxMegabytes;
+        loginConcurrency = source.loginConcurrency;
+        loginBatchSize = source.loginBatchSize;
+        snapshotIntervalSeconds = source.snapshotIntervalSeconds;
+        apiMinVersion = source.apiMinVersion;
+        apiMaxVersion = source.apiMaxVersion;
+        apiDefaultVersion = source.apiDefaultVersion;
+        maxBatchedPacketSize = source.maxBatchedPacketSize;
+        sendQueueHighWatermarkKb = source.sendQueueHighWatermarkKb;
+        sendQueueLowWatermarkKb = source.sendQueueLowWatermarkKb;
+        sendQueueMaxDeferredMessages = source.sendQueueMaxDeferredMessages;
+        sendQueueMaxDeferredKb = source.sendQueueMaxDeferredKb;
+        sendQueueDisconnectKb = source.sendQueueDisconnectKb;
+        logRequestSampleEvery = source.logRequestSampleEvery;
+        logRequestMaxPerSecond = source.logRequestMaxPerSecond;
+        loggerConfig = source.loggerConfig;
+    }
+
+    /** Names the settings only read at startup that differ in another
+     * configuration, so a reload can say which changes it left out.
+     */
+    std::vector<std::string> ListRestartOnlyChanges(const StationChatConfig& other) const {
+        std::vector<std::string> changed;
+        auto check = [&changed](const char* name, bool same) {
+            if (!same) {
+                changed.push_back(name);
+            }
+        };
+
+        check("gateway_address", gatewayAddress == other.gatewayAddress);
+        check("gateway_port", gatewayPort == other.gatewayPort);
+        check("registrar_address", registrarAddress == other.registrarAddress);
+        check("registrar_port", registrarPort == other.registrarPort);
+        check("bind_to_ip", bindToIp == other.bindToIp);
+        check("storage_backend", storageBackend == other.storageBackend);
+        check("database_host", chatDatabaseHost == other.chatDatabaseHost);
+        check("database_port", chatDatabasePort == other.chatDatabasePort);
+        check("database_user", chatDatabaseUser == other.chatDatabaseUser);
+        check("database_password", chatDatabasePassword == other.chatDatabasePassword);
+        check("database_schema", chatDatabaseSchema == other.chatDatabaseSchema);
+        check("database_socket", chatDatabaseSocket == other.chatDatabaseSocket);
+        check("database_workers", databaseWorkers == other.databaseWorkers);
+        check("gateway_load_report_port", gatewayLoadReportPort == other.gatewayLoadReportPort);
+        check("gateway_probe_interval_ms", gatewayProbeIntervalMs == other.gatewayProbeIntervalMs);
+        check("gateway_probe_timeout_ms", gatewayProbeTimeoutMs == other.gatewayProbeTimeoutMs);
+        check("gateway_replication_port_offset", gatewayReplicationPortOffset == other.gatewayReplicationPortOffset);
+        check("snapshot_file", snapshotFile == other.snapshotFile);
+        check("metrics_address", metricsAddress == other.metricsAddress);
+        check("metrics_port", metricsPort == other.metricsPort);
+        check("async_logging", asyncLogging == other.asyncLogging);
+        check("packet_capture_file", packetCaptureFile == other.packetCaptureFile);
+        check("packet_capture_max_mb", packetCaptureMaxMb == other.packetCaptureMaxMb);
+        return changed;
+    }
+
+    /** Looks up the host of every cluster gateway, which may block on DNS.
+     * Returns the hosts that did not resolve; their endpoints keep the
+     * configured address.
+     */
+    std::vector<std::string> ResolveClusterHosts();
 
     void NormalizeClusterGateways() {
         for (auto& endpoint : gatewayCluster) {
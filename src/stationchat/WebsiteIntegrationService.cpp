@@ -52,7 +52,46 @@ std::string QuoteIdentifier(const std::string& identifier) {
     return quoted;
 }
 
-std::string BuildUserLinkSql(const std::string& table, bool includeCreatedAt, bool includeUpdatedAt) {
+// Repeats a VALUES row once per row of a multi-row insert, numbering its
+// parameters "@name_0", "@name_1" and so on. A single row is left as is.
+std::string ExpandRows(const std::string& values, std::size_t rows) {
+    if (rows == 1) {
+        return values;
+    }
+
+    std::string expanded;
+    for (std::size_t row = 0; row < rows; ++row) {
+        auto suffix = "_" + std::to_string(row);
+        if (row != 0) {
+            expanded += ", ";
+        }
+
+        bool inParameter = false;
+        for (auto ch : values) {
+            if (inParameter && ch != '_' && !std::isalnum(static_cast<unsigned char>(ch))) {
+                expanded += suffix;
+                inParameter = false;
+            }
+
+            inParameter = inParameter || ch == '@';
+            expanded += ch;
+        }
+
+        if (inParameter) {
+            expanded += suffix;
+        }
+    }
+
+    return expanded;
+}
+
+int ParameterIndex(MariaDBStatement* stmt, const std::string& name, std::size_t row, std::size_t rows) {
+    auto parameter = rows == 1 ? "@" + name : "@" + name + "_" + std::to_string(row);
+    return mariadb_bind_parameter_index(stmt, parameter.c_str());
+}
+
+std::string BuildUserLinkSql(
+    const std::string& table, bool includeCreatedAt, bool includeUpdatedAt, std::size_t rows = 1) {
     std::string columnList{"(user_id, avatar_id, avatar_name"};
     std::string values{"(@user_id, @avatar_id, @avatar_name"};
 
@@ -69,7 +108,7 @@ std::string BuildUserLinkSql(const std::string& table, bool includeCreatedAt, bo
     columnList += ')';
     values += ')';
 
-    std::string sql = "INSERT INTO " + QuoteIdentifier(table) + " " + columnList + " VALUES " + values
+    std::string sql = "INSERT INTO " + QuoteIdentifier(table) + " " + columnList + " VALUES " + ExpandRows(values, rows)
         + " ON DUPLICATE KEY UPDATE user_id = VALUES(user_id), avatar_name = VALUES(avatar_name)";
 
     if (includeUpdatedAt) {
@@ -83,7 +122,8 @@ std::string BuildUserLinkSql(const std::string& table, bool includeCreatedAt, bo
     return sql;
 }
 
-std::string BuildStatusSql(const std::string& table, bool includeCreatedAt, bool includeUpdatedAt) {
+std::string BuildStatusSql(
+    const std::string& table, bool includeCreatedAt, bool includeUpdatedAt, std::size_t rows = 1) {
     std::string columnList{"(avatar_id, user_id, avatar_name, is_online, last_login, last_logout"};
     std::string values{"(@avatar_id, @user_id, @avatar_name, @is_online, @last_login, @last_logout"};
 
@@ -100,7 +140,7 @@ std::string BuildStatusSql(const std::string& table, bool includeCreatedAt, bool
     columnList += ')';
     values += ')';
 
-    std::string sql = "INSERT INTO " + QuoteIdentifier(table) + " " + columnList + " VALUES " + values
+    std::string sql = "INSERT INTO " + QuoteIdentifier(table) + " " + columnList + " VALUES " + ExpandRows(values, rows)
         + " ON DUPLICATE KEY UPDATE user_id = VALUES(user_id), avatar_name = VALUES(avatar_name), "
           "is_online = VALUES(is_online), last_login = IF(VALUES(last_login) != 0, VALUES(last_login), last_login), "
           "last_logout = IF(VALUES(last_logout) != 0, VALUES(last_logout), last_logout)";
@@ -207,6 +247,11 @@ WebsiteIntegrationService::WebsiteIntegrationService(MariaDBConnection* db, cons
 
         db_ = integrationDb;
         ownsDatabase_ = true;
+
+        if (mariadb_open(connectionString.c_str(), &loginDb_) != MARIADB_OK) {
+            mariadb_close(db_);
+            throw std::runtime_error("Can't open website integration database connection");
+        }
     }
 
     userLinkTable_ = config.websiteIntegration.userLinkTable;
@@ -232,7 +277,9 @@ WebsiteIntegrationService::WebsiteIntegrationService(MariaDBConnection* db, cons
 WebsiteIntegrationService::~WebsiteIntegrationService() {
     if (ownsDatabase_) {
         mariadb_close(db_);
+        mariadb_close(loginDb_);
         db_ = nullptr;
+        loginDb_ = nullptr;
     }
 }
 
@@ -245,6 +292,18 @@ void WebsiteIntegrationService::RecordAvatarLogin(const ChatAvatar& avatar) {
     UpdateOnlineStatus(avatar, true);
 }
 
+void WebsiteIntegrationService::RecordAvatarLogins(
+    MariaDBConnection* db, const std::vector<const ChatAvatar*>& avatars) {
+    if (!enabled_) {
+        return;
+    }
+
+    auto connection = loginDb_ ? loginDb_ : db;
+
+    EnsureUserLinks(connection, avatars);
+    UpdateOnlineStatus(connection, avatars, true);
+}
+
 void WebsiteIntegrationService::RecordAvatarLogout(const ChatAvatar& avatar) {
     if (!enabled_) {
         return;
@@ -314,88 +373,123 @@ void WebsiteIntegrationService::RecordPersistentMessage(
     mariadb_finalize(stmt);
 }
 
-void WebsiteIntegrationService::EnsureUserLink(const ChatAvatar& avatar) {
+void WebsiteIntegrationService::EnsureUserLink(const ChatAvatar& avatar) { EnsureUserLinks(db_, {&avatar}); }
+
+void WebsiteIntegrationService::EnsureUserLinks(
+    MariaDBConnection* db, const std::vector<const ChatAvatar*>& allAvatars) {
     if (!enabled_) {
         return;
     }
 
-    if (avatar.GetUserId() == 0) {
+    std::vector<const ChatAvatar*> avatars;
+    for (auto avatar : allAvatars) {
+        if (avatar->GetUserId() != 0) {
+            avatars.push_back(avatar);
+        }
+    }
+
+    if (avatars.empty()) {
         return;
     }
 
+    auto rows = avatars.size();
+    auto sql = rows == 1
+        ? userLinkSql_
+        : BuildUserLinkSql(userLinkTable_, userLinkCreatedAt_.exists, userLinkUpdatedAt_.exists, rows);
+
     MariaDBStatement* stmt;
-    auto result = mariadb_prepare(db_, userLinkSql_.c_str(), -1, &stmt, 0);
+    auto result = mariadb_prepare(db, sql.c_str(), -1, &stmt, 0);
     if (result != MARIADB_OK) {
-        throw MariaDBException{result, mariadb_errmsg(db_)};
+        throw MariaDBException{result, mariadb_errmsg(db)};
     }
 
-    auto userIdIdx = mariadb_bind_parameter_index(stmt, "@user_id");
-    auto avatarIdIdx = mariadb_bind_parameter_index(stmt, "@avatar_id");
-    auto avatarNameIdx = mariadb_bind_parameter_index(stmt, "@avatar_name");
-    auto createdAtIdx = userLinkCreatedAt_.exists ? mariadb_bind_parameter_index(stmt, "@created_at") : -1;
-    auto updatedAtIdx = userLinkUpdatedAt_.exists ? mariadb_bind_parameter_index(stmt, "@updated_at") : -1;
-
     std::vector<std::string> ownedStrings;
 
-    auto avatarName = FromWideString(avatar.GetName());
     auto now = CurrentUnixTime();
 
-    mariadb_bind_int(stmt, userIdIdx, avatar.GetUserId());
-    mariadb_bind_int(stmt, avatarIdIdx, avatar.GetAvatarId());
-    mariadb_bind_text(stmt, avatarNameIdx, avatarName.c_str(), -1, 0);
-    BindTimestampParameter(stmt, createdAtIdx, userLinkCreatedAt_, now, ownedStrings);
-    BindTimestampParameter(stmt, updatedAtIdx, userLinkUpdatedAt_, now, ownedStrings);
+    for (std::size_t row = 0; row < rows; ++row) {
+        const auto& avatar = *avatars[row];
+
+        auto userIdIdx = ParameterIndex(stmt, "user_id", row, rows);
+        auto avatarIdIdx = ParameterIndex(stmt, "avatar_id", row, rows);
+        auto avatarNameIdx = ParameterIndex(stmt, "avatar_name", row, rows);
+        auto createdAtIdx = userLinkCreatedAt_.exists ? ParameterIndex(stmt, "created_at", row, rows) : -1;
+        auto updatedAtIdx = userLinkUpdatedAt_.exists ? ParameterIndex(stmt, "updated_at", row, rows) : -1;
+
+        auto avatarName = FromWideString(avatar.GetName());
+
+        mariadb_bind_int(stmt, userIdIdx, avatar.GetUserId());
+        mariadb_bind_int(stmt, avatarIdIdx, avatar.GetAvatarId());
+        mariadb_bind_text(stmt, avatarNameIdx, avatarName.c_str(), -1, 0);
+        BindTimestampParameter(stmt, createdAtIdx, userLinkCreatedAt_, now, ownedStrings);
+        BindTimestampParameter(stmt, updatedAtIdx, userLinkUpdatedAt_, now, ownedStrings);
+    }
 
     result = mariadb_step(stmt);
     if (result != MARIADB_DONE) {
         mariadb_finalize(stmt);
-        throw MariaDBException{result, mariadb_errmsg(db_)};
+        throw MariaDBException{result, mariadb_errmsg(db)};
     }
 
     mariadb_finalize(stmt);
 }
 
 void WebsiteIntegrationService::UpdateOnlineStatus(const ChatAvatar& avatar, bool isOnline) {
-    if (!enabled_) {
+    UpdateOnlineStatus(db_, std::vector<const ChatAvatar*>{&avatar}, isOnline);
+}
+
+void WebsiteIntegrationService::UpdateOnlineStatus(
+    MariaDBConnection* db, const std::vector<const ChatAvatar*>& avatars, bool isOnline) {
+    if (!enabled_ || avatars.empty()) {
         return;
     }
 
+    auto rows = avatars.size();
+    auto sql = rows == 1
+        ? statusSql_
+        : BuildStatusSql(onlineStatusTable_, statusCreatedAt_.exists, statusUpdatedAt_.exists, rows);
+
     MariaDBStatement* stmt;
-    auto result = mariadb_prepare(db_, statusSql_.c_str(), -1, &stmt, 0);
+    auto result = mariadb_prepare(db, sql.c_str(), -1, &stmt, 0);
     if (result != MARIADB_OK) {
-        throw MariaDBException{result, mariadb_errmsg(db_)};
+        throw MariaDBException{result, mariadb_errmsg(db)};
     }
 
-    auto avatarIdIdx = mariadb_bind_parameter_index(stmt, "@avatar_id");
-    auto userIdIdx = mariadb_bind_parameter_index(stmt, "@user_id");
-    auto avatarNameIdx = mariadb_bind_parameter_index(stmt, "@avatar_name");
-    auto onlineIdx = mariadb_bind_parameter_index(stmt, "@is_online");
-    auto loginIdx = mariadb_bind_parameter_index(stmt, "@last_login");
-    auto logoutIdx = mariadb_bind_parameter_index(stmt, "@last_logout");
-    auto updatedIdx = statusUpdatedAt_.exists ? mariadb_bind_parameter_index(stmt, "@updated_at") : -1;
-    auto createdIdx = statusCreatedAt_.exists ? mariadb_bind_parameter_index(stmt, "@created_at") : -1;
-
     std::vector<std::string> ownedStrings;
 
     auto now = CurrentUnixTime();
-    auto avatarName = FromWideString(avatar.GetName());
 
     auto loginTime = isOnline ? now : 0u;
     auto logoutTime = isOnline ? 0u : now;
 
-    mariadb_bind_int(stmt, avatarIdIdx, avatar.GetAvatarId());
-    mariadb_bind_int(stmt, userIdIdx, avatar.GetUserId());
-    mariadb_bind_text(stmt, avatarNameIdx, avatarName.c_str(), -1, 0);
-    mariadb_bind_int(stmt, onlineIdx, static_cast<uint32_t>(isOnline ? 1 : 0));
-    BindTimestampParameter(stmt, loginIdx, statusLoginAt_, loginTime, ownedStrings);
-    BindTimestampParameter(stmt, logoutIdx, statusLogoutAt_, logoutTime, ownedStrings);
-    BindTimestampParameter(stmt, updatedIdx, statusUpdatedAt_, now, ownedStrings);
-    BindTimestampParameter(stmt, createdIdx, statusCreatedAt_, now, ownedStrings);
+    for (std::size_t row = 0; row < rows; ++row) {
+        const auto& avatar = *avatars[row];
+
+        auto avatarIdIdx = ParameterIndex(stmt, "avatar_id", row, rows);
+        auto userIdIdx = ParameterIndex(stmt, "user_id", row, rows);
+        auto avatarNameIdx = ParameterIndex(stmt, "avatar_name", row, rows);
+        auto onlineIdx = ParameterIndex(stmt, "is_online", row, rows);
+        auto loginIdx = ParameterIndex(stmt, "last_login", row, rows);
+        auto logoutIdx = ParameterIndex(stmt, "last_logout", row, rows);
+        auto updatedIdx = statusUpdatedAt_.exists ? ParameterIndex(stmt, "updated_at", row, rows) : -1;
+        auto createdIdx = statusCreatedAt_.exists ? ParameterIndex(stmt, "created_at", row, rows) : -1;
+
+        auto avatarName = FromWideString(avatar.GetName());
+
+        mariadb_bind_int(stmt, avatarIdIdx, avatar.GetAvatarId());
+        mariadb_bind_int(stmt, userIdIdx, avatar.GetUserId());
+        mariadb_bind_text(stmt, avatarNameIdx, avatarName.c_str(), -1, 0);
+        mariadb_bind_int(stmt, onlineIdx, static_cast<uint32_t>(isOnline ? 1 : 0));
+        BindTimestampParameter(stmt, loginIdx, statusLoginAt_, loginTime, ownedStrings);
+        BindTimestampParameter(stmt, logoutIdx, statusLogoutAt_, logoutTime, ownedStrings);
+        BindTimestampParameter(stmt, updatedIdx, statusUpdatedAt_, now, ownedStrings);
+        BindTimestampParameter(stmt, createdIdx, statusCreatedAt_, now, ownedStrings);
+    }
 
     result = mariadb_step(stmt);
     if (result != MARIADB_DONE) {
         mariadb_finalize(stmt);
-        throw MariaDBException{result, mariadb_errmsg(db_)};
+        throw MariaDBException{result, mariadb_errmsg(db)};
     }
 
     mariadb_finalize(stmt);
@@ -13,13 +13,21 @@ struct MariaDBStatement;
 class WebsiteIntegrationService {
 public:
     WebsiteIntegrationService(MariaDBConnection* db, const StationChatConfig& config);
-    ~WebsiteIntegrationService();
+    virtual ~WebsiteIntegrationService();
 
     void RecordAvatarLogin(const ChatAvatar& avatar);
+
+    /** Records a batch of logins with one multi-row statement per table, so
+     * that a database worker can run it: on the worker's own connection, or
+     * on a connection kept for these calls when the website tables are in a
+     * separate database. Calls must therefore not overlap. Only the avatars'
+     * ids and names are read.
+     */
+    virtual void RecordAvatarLogins(MariaDBConnection* db, const std::vector<const ChatAvatar*>& avatars);
     void RecordAvatarLogout(const ChatAvatar& avatar);
     void RecordPersistentMessage(const ChatAvatar& destAvatar, const PersistentMessage& message);
 
-    bool IsEnabled() const { return enabled_; }
+    virtual bool IsEnabled() const { return enabled_; }
 
 private:
     struct ColumnInfo {
@@ -28,7 +36,9 @@ private:
     };
 
     void EnsureUserLink(const ChatAvatar& avatar);
+    void EnsureUserLinks(MariaDBConnection* db, const std::vector<const ChatAvatar*>& avatars);
     void UpdateOnlineStatus(const ChatAvatar& avatar, bool isOnline);
+    void UpdateOnlineStatus(MariaDBConnection* db, const std::vector<const ChatAvatar*>& avatars, bool isOnline);
     ColumnInfo InspectColumn(const std::string& table, const std::string& column);
     void BindTimestampParameter(
         MariaDBStatement* stmt, int index, const ColumnInfo& info, uint32_t timestamp, std::vector<std::string>& ownedStrings) const;
@@ -36,6 +46,7 @@ private:
     uint32_t CurrentUnixTime() const;
 
     MariaDBConnection* db_;
+    MariaDBConnection* loginDb_{nullptr};
     bool ownsDatabase_{false};
     bool enabled_{false};
     std::string userLinkTable_;
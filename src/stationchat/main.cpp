@@ -2,17 +2,21 @@
 #define ELPP_DEFAULT_LOG_FILE "var/log/swgchat.log"
 #include "easylogging++.h"
 
+#include "AsyncLog.hpp"
 #include "StationChatApp.hpp"
 
 #include <boost/algorithm/string.hpp>
 #include <boost/program_options.hpp>
 
+#include <algorithm>
 #include <chrono>
+#include <csignal>
 #include <cstdint>
 #include <fstream>
 #include <iostream>
 #include <limits>
 #include <stdexcept>
+#include <string>
 #include <thread>
 #include <vector>
 
@@ -117,23 +121,77 @@ GatewayClusterEndpoint ParseGatewayClusterEndpoint(const std::string& definition
 void SignalHandler(int sig);
 #endif
 
+namespace {
+
+volatile std::sig_atomic_t shutdownRequested = 0;
+volatile std::sig_atomic_t reloadRequested = 0;
+
+void ShutdownHandler(int) { shutdownRequested = 1; }
+
+void ReloadHandler(int) { reloadRequested = 1; }
+
+void ReloadConfiguration(StationChatApp& app, int argc, const char* argv[]) {
+    LOG(INFO) << "Reloading configuration";
+
+    // Nothing is applied unless the whole file parses and validates.
+    StationChatConfig config;
+    try {
+        config = BuildConfiguration(argc, argv);
+    } catch (const std::exception& e) {
+        LOG(ERROR) << "Keeping the current configuration: " << e.what();
+        return;
+    }
+
+    app.Reload(config, [config](bool applied) {
+        if (!applied) {
+            return;
+        }
+
+        el::Loggers::setDefaultConfigurations(config.loggerConfig, true);
+        AsyncLogger::Instance().SetRequestSampling(config.logRequestSampleEvery, config.logRequestMaxPerSecond);
+    });
+}
+
+} // namespace
+
 int main(int argc, const char* argv[]) {
 #ifdef __GNUC__
     signal(SIGSEGV, SignalHandler);
 #endif
+    signal(SIGINT, ShutdownHandler);
+    signal(SIGTERM, ShutdownHandler);
+#ifdef SIGHUP
+    signal(SIGHUP, ReloadHandler);
+#endif
 
     auto config = BuildConfiguration(argc, argv);
 
     el::Loggers::setDefaultConfigurations(config.loggerConfig, true);
     START_EASYLOGGINGPP(argc, argv);
 
+    AsyncLogger::Instance().SetRequestSampling(config.logRequestSampleEvery, config.logRequestMaxPerSecond);
+    if (config.asyncLogging) {
+        AsyncLogger::Instance().Start();
+    }
+
     StationChatApp app{config};
 
-    while (app.IsRunning()) {
+    while (app.IsRunning() && !shutdownRequested) {
         app.Tick();
+
+        if (reloadRequested || app.TakeReloadRequest()) {
+            reloadRequested = 0;
+            ReloadConfiguration(app, argc, argv);
+        }
+
         std::this_thread::sleep_for(std::chrono::milliseconds(1));
     }
 
+    LOG(INFO) << "Shutting down";
+    app.Shutdown();
+
+    AsyncLogger::Instance().Stop();
+
     return 0;
 }
 
@@ -166,6 +224,8 @@ StationChatConfig BuildConfiguration(int argc, const char* argv[]) {
             "port for registrar connections")
         ("bind_to_ip", po::value<bool>(&config.bindToIp)->default_value(false),
             "when set to true, binds to the config address; otherwise, binds on any interface")
+        ("storage_backend", po::value<std::string>(&config.storageBackend)->default_value("mariadb"),
+            "chat storage: mariadb, or memory to keep everything in process memory (nothing is persisted)")
         ("database_host", po::value<std::string>(&config.chatDatabaseHost)->default_value("mysql73.unoeuro.com"),
             "hostname or IP address of the MariaDB server")
         ("database_port", po::value<uint16_t>(&config.chatDatabasePort)->default_value(3306),
@@ -178,6 +238,13 @@ StationChatConfig BuildConfiguration(int argc, const char* argv[]) {
             "schema (database) name used by stationchat")
         ("database_socket", po::value<std::string>(&config.chatDatabaseSocket)->default_value(""),
             "optional UNIX socket path for local MariaDB connections")
+        ("database_workers", po::value<uint32_t>(&config.databaseWorkers)->default_value(2),
+            "threads with their own MariaDB connection that run mail and login database work off the gateway thread; "
+            "0 runs them inline")
+        ("login_concurrency", po::value<uint32_t>(&config.loginConcurrency)->default_value(256),
+            "logins in progress at once; further logins queue until one finishes; 0 disables the bound")
+        ("login_batch_size", po::value<uint32_t>(&config.loginBatchSize)->default_value(64),
+            "logins that share one avatar lookup and one contact list query")
         ("website_integration_enabled", po::value<bool>(&config.websiteIntegration.enabled)->default_value(true),
             "when true, publishes chat status information for consumption by the website")
         ("website_user_link_table", po::value<std::string>(&config.websiteIntegration.userLinkTable)->default_value("web_user_avatar"),
@@ -202,6 +269,60 @@ StationChatConfig BuildConfiguration(int argc, const char* argv[]) {
             "optional override for the website integration database socket path")
         ("gateway_cluster", po::value<std::vector<std::string>>(&clusterGateways)->multitoken()->composing(),
             "additional gateway endpoints in host:port[:weight] format for clustering; may be specified multiple times")
+        ("gateway_selection", po::value<std::string>(&config.gatewaySelection)->default_value("weighted"),
+            "how the registrar picks a cluster gateway: weighted, least_loaded, power_of_two or affinity")
+        ("gateway_load_report_port", po::value<uint16_t>(&config.gatewayLoadReportPort)->default_value(0),
+            "UDP port on which registrars receive gateway load reports and gateways send them; 0 disables reporting")
+        ("gateway_load_report_interval_ms", po::value<uint32_t>(&config.gatewayLoadReportIntervalMs)->default_value(1000),
+            "milliseconds between gateway load reports; reports older than three intervals are treated as stale")
+        ("gateway_probe_interval_ms", po::value<uint32_t>(&config.gatewayProbeIntervalMs)->default_value(0),
+            "milliseconds between SETAPIVERSION health probes of each cluster gateway; 0 disables probing")
+        ("gateway_probe_timeout_ms", po::value<uint32_t>(&config.gatewayProbeTimeoutMs)->default_value(1000),
+            "milliseconds a probe may take before it counts as a failure")
+        ("gateway_probe_slow_ms", po::value<uint32_t>(&config.gatewayProbeSlowMs)->default_value(250),
+            "smoothed probe round trip above which a gateway only takes logins when all others are slow; 0 disables")
+        ("gateway_replication_port_offset", po::value<uint16_t>(&config.gatewayReplicationPortOffset)->default_value(0),
+            "offset from each cluster gateway's port of the UDP port it replicates room and presence state on; 0 disables")
+        ("snapshot_file", po::value<std::string>(&config.snapshotFile)->default_value(""),
+            "path of the warm-restart state snapshot; leave empty to disable snapshots")
+        ("snapshot_interval", po::value<uint32_t>(&config.snapshotIntervalSeconds)->default_value(300),
+            "seconds between periodic state snapshots; 0 only writes the snapshot on shutdown")
+        ("avatar_cache_max_entries", po::value<uint32_t>(&config.avatarCacheMaxEntries)->default_value(100000),
+            "maximum number of cached avatars before idle ones are evicted; 0 disables the bound")
+        ("avatar_cache_max_mb", po::value<uint32_t>(&config.avatarCacheMaxMegabytes)->default_value(0),
+            "approximate memory bound for cached avatars in megabytes; 0 disables the bound")
+        ("api_min_version", po::value<uint32_t>(&config.apiMinVersion)->default_value(2),
+            "lowest SETAPIVERSION protocol version accepted from gateway clients")
+        ("api_max_version", po::value<uint32_t>(&config.apiMaxVersion)->default_value(3),
+            "highest SETAPIVERSION protocol version accepted from gateway clients")
+        ("api_default_version", po::value<uint32_t>(&config.apiDefaultVersion)->default_value(2),
+            "protocol version reported to clients requesting an unsupported version")
+        ("max_batched_packet_size", po::value<uint32_t>(&config.maxBatchedPacketSize)->default_value(1400),
+            "packet size limit in bytes when batching messages for clients that negotiated it; 0 disables batching")
+        ("send_queue_high_watermark_kb", po::value<uint32_t>(&config.sendQueueHighWatermarkKb)->default_value(256),
+            "backlog per connection at which presence updates start being deferred; 0 disables deferral")
+        ("send_queue_low_watermark_kb", po::value<uint32_t>(&config.sendQueueLowWatermarkKb)->default_value(64),
+            "backlog per connection below which deferred presence updates are released")
+        ("send_queue_max_deferred_messages", po::value<uint32_t>(&config.sendQueueMaxDeferredMessages)->default_value(10000),
+            "deferred presence updates kept per connection before the oldest are dropped; 0 disables the bound")
+        ("send_queue_max_deferred_kb", po::value<uint32_t>(&config.sendQueueMaxDeferredKb)->default_value(1024),
+            "deferred presence update bytes kept per connection before the oldest are dropped; 0 disables the bound")
+        ("send_queue_disconnect_kb", po::value<uint32_t>(&config.sendQueueDisconnectKb)->default_value(16384),
+            "backlog per connection at which a peer that stopped reading is disconnected; 0 never disconnects")
+        ("metrics_address", po::value<std::string>(&config.metricsAddress)->default_value("127.0.0.1"),
+            "address the Prometheus metrics endpoint binds to")
+        ("metrics_port", po::value<uint16_t>(&config.metricsPort)->default_value(0),
+            "port of the Prometheus metrics endpoint; 0 disables the endpoint")
+        ("async_logging", po::value<bool>(&config.asyncLogging)->default_value(true),
+            "formats and writes log lines on a background thread")
+        ("log_request_sample_every", po::value<uint32_t>(&config.logRequestSampleEvery)->default_value(1),
+            "logs one in this many per request lines per call site; 0 suppresses them")
+        ("log_request_max_per_second", po::value<uint32_t>(&config.logRequestMaxPerSecond)->default_value(0),
+            "upper bound on per request log lines each second; 0 is unlimited")
+        ("packet_capture_file", po::value<std::string>(&config.packetCaptureFile)->default_value(""),
+            "records incoming packets to this file for stationchat-replay; empty disables capture")
+        ("packet_capture_max_mb", po::value<uint32_t>(&config.packetCaptureMaxMb)->default_value(1024),
+            "size at which packet capture stops; 0 is unbounded")
         ;
 
     po::options_description cmdline_options;
@@ -241,7 +362,36 @@ StationChatConfig BuildConfiguration(int argc, const char* argv[]) {
         config.gatewayCluster.push_back(ParseGatewayClusterEndpoint(trimmed));
     }
 
-    config.NormalizeClusterGateways();
+    // StationChatApp adds the local gateway to the cluster, on reloads too.
+
+    if (config.apiMinVersion > config.apiMaxVersion) {
+        throw std::runtime_error("api_min_version must not be greater than api_max_version");
+    }
+
+    if (config.sendQueueLowWatermarkKb > config.sendQueueHighWatermarkKb) {
+        throw std::runtime_error("send_queue_low_watermark_kb must not be greater than send_queue_high_watermark_kb");
+    }
+
+    static const std::vector<std::string> selectionModes{"weighted", "least_loaded", "power_of_two", "affinity"};
+    if (std::find(std::begin(selectionModes), std::end(selectionModes), config.gatewaySelection)
+        == std::end(selectionModes)) {
+        throw std::runtime_error("Unknown gateway_selection: " + config.gatewaySelection);
+    }
+
+    // Every gateway, this one included, replicates on its own port plus the offset.
+    if (config.gatewayReplicationPortOffset != 0) {
+        auto checkReplicationPort = [&config](uint16_t port) {
+            if (static_cast<uint32_t>(port) + config.gatewayReplicationPortOffset > 65535) {
+                throw std::runtime_error("gateway_replication_port_offset moves port " + std::to_string(port)
+                    + " out of range");
+            }
+        };
+
+        checkReplicationPort(config.gatewayPort);
+        for (const auto& endpoint : config.gatewayCluster) {
+            checkReplicationPort(endpoint.port);
+        }
+    }
 
     return config;
 }
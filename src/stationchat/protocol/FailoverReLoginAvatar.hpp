@@ -6,8 +6,6 @@
 #include <cstdint>
 #include <string>
 
-class ChatAvatarService;
-class ChatRoomService;
 class GatewayClient;
 
 struct ReqFailoverReLoginAvatar{
@@ -37,11 +35,9 @@ public:
     using RequestType = ReqFailoverReLoginAvatar;
     using ResponseType = ResFailoverReLoginAvatar;
 
-    FailoverReLoginAvatar(GatewayClient* client, const RequestType& request, ResponseType& response);
+    static constexpr bool kAwaitsDatabase = true;
 
-private:
-    ChatAvatarService* avatarService_;
-    ChatRoomService* roomService_;
+    FailoverReLoginAvatar(GatewayClient* client, const RequestType& request, ResponseType& response);
 };
 
 template <typename StreamT>
@@ -6,7 +6,6 @@
 
 #include <vector>
 
-class PersistentMessageService;
 class GatewayClient;
 
 /** Begin GETPERSISTENTHEADERS */
@@ -55,8 +54,7 @@ public:
     using RequestType = ReqGetPersistentHeaders;
     using ResponseType = ResGetPersistentHeaders;
 
-    GetPersistentHeaders(GatewayClient* client, const RequestType& request, ResponseType& response);
+    static constexpr bool kAwaitsDatabase = true;
 
-private:
-    PersistentMessageService* messageService_;
+    GetPersistentHeaders(GatewayClient* client, const RequestType& request, ResponseType& response);
 };
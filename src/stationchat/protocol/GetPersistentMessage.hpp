@@ -4,7 +4,6 @@
 #include "ChatEnums.hpp"
 #include "PersistentMessage.hpp"
 
-class PersistentMessageService;
 class GatewayClient;
 
 /** Begin GETPERSISTENTMESSAGE */
@@ -53,8 +52,7 @@ public:
     using RequestType = ReqGetPersistentMessage;
     using ResponseType = ResGetPersistentMessage;
 
-    GetPersistentMessage(GatewayClient* client, const RequestType& request, ResponseType& response);
+    static constexpr bool kAwaitsDatabase = true;
 
-private:
-    PersistentMessageService* messageService_;
+    GetPersistentMessage(GatewayClient* client, const RequestType& request, ResponseType& response);
 };
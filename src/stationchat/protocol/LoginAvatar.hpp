@@ -4,8 +4,6 @@
 #include "ChatAvatar.hpp"
 #include "ChatEnums.hpp"
 
-class ChatAvatarService;
-class ChatRoomService;
 class GatewayClient;
 
 /** Begin LOGINAVATAR */
@@ -61,9 +59,7 @@ public:
     using RequestType = ReqLoginAvatar;
     using ResponseType = ResLoginAvatar;
 
-    LoginAvatar(GatewayClient* client, const RequestType& request, ResponseType& response);
+    static constexpr bool kAwaitsDatabase = true;
 
-private:
-    ChatAvatarService* avatarService_;
-    ChatRoomService* roomService_;
+    LoginAvatar(GatewayClient* client, const RequestType& request, ResponseType& response);
 };
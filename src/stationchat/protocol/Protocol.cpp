@@ -1,9 +1,13 @@
 #include "AddBan.hpp"
 
+#include "AsyncLog.hpp"
 #include "ChatAvatarService.hpp"
 #include "ChatRoomService.hpp"
+#include "ChatStorage.hpp"
+#include "ClusterReplicator.hpp"
 #include "GatewayClient.hpp"
 #include "GatewayNode.hpp"
+#include "LoginPipeline.hpp"
 #include "PersistentMessageService.hpp"
 #include "RegistrarClient.hpp"
 #include "RegistrarNode.hpp"
@@ -51,10 +55,8 @@
 AddBan::AddBan(GatewayClient* client, const RequestType& request, ResponseType& response)
     : avatarService_{client->GetNode()->GetAvatarService()}
     , roomService_{client->GetNode()->GetRoomService()} {
-    LOG(INFO) << "ADDBAN request received - adding ban for: "
-              << FromWideString(request.destAvatarName) << "@"
-              << FromWideString(request.destAvatarAddress) << " to "
-              << FromWideString(request.destRoomAddress);
+    REQUEST_LOG("ADDBAN request received - adding ban for: ", request.destAvatarName, "@", request.destAvatarAddress,
+        " to ", request.destRoomAddress);
 
     auto srcAvatar = avatarService_->GetAvatar(request.srcAvatarId);
     if (!srcAvatar) {
@@ -80,9 +82,8 @@ AddBan::AddBan(GatewayClient* client, const RequestType& request, ResponseType&
 
 AddFriend::AddFriend(GatewayClient* client, const RequestType& request, ResponseType& response)
     : avatarService_{client->GetNode()->GetAvatarService()} {
-    LOG(INFO) << "ADDFRIEND request received - adding: " << FromWideString(request.destName) << "@"
-              << FromWideString(request.destAddress) << " to " << request.srcAvatarId << "@"
-              << FromWideString(request.srcAddress);
+    REQUEST_LOG("ADDFRIEND request received - adding: ", request.destName, "@", request.destAddress, " to ",
+        request.srcAvatarId, "@", request.srcAddress);
     auto srcAvatar = avatarService_->GetAvatar(request.srcAvatarId);
     if (!srcAvatar) {
         throw ChatResultException{ChatResultCode::SRCAVATARDOESNTEXIST, std::to_string(request.srcAvatarId).c_str()};
@@ -102,9 +103,8 @@ AddFriend::AddFriend(GatewayClient* client, const RequestType& request, Response
 
 AddIgnore::AddIgnore(GatewayClient* client, const RequestType& request, ResponseType& response)
     : avatarService_{client->GetNode()->GetAvatarService()} {
-    LOG(INFO) << "ADDIGNORE request received - adding: " << FromWideString(request.destName) << "@"
-              << FromWideString(request.destAddress) << " to " << request.srcAvatarId << "@"
-              << FromWideString(request.srcAddress);
+    REQUEST_LOG("ADDIGNORE request received - adding: ", request.destName, "@", request.destAddress, " to ",
+        request.srcAvatarId, "@", request.srcAddress);
     auto srcAvatar = avatarService_->GetAvatar(request.srcAvatarId);
     if (!srcAvatar) {
         throw ChatResultException{ChatResultCode::SRCAVATARDOESNTEXIST, std::to_string(request.srcAvatarId).c_str()};
@@ -121,10 +121,8 @@ AddIgnore::AddIgnore(GatewayClient* client, const RequestType& request, Response
 AddInvite::AddInvite(GatewayClient* client, const RequestType& request, ResponseType& response)
     : avatarService_{client->GetNode()->GetAvatarService()}
     , roomService_{client->GetNode()->GetRoomService()} {
-    LOG(INFO) << "ADDINVITE request received - adding invitation for: "
-              << FromWideString(request.destAvatarName) << "@"
-              << FromWideString(request.destAvatarAddress) << " to "
-              << FromWideString(request.destRoomAddress);
+    REQUEST_LOG("ADDINVITE request received - adding invitation for: ", request.destAvatarName, "@",
+        request.destAvatarAddress, " to ", request.destRoomAddress);
 
     auto srcAvatar = avatarService_->GetAvatar(request.srcAvatarId);
     if (!srcAvatar) {
@@ -151,10 +149,8 @@ AddModerator::AddModerator(
     GatewayClient* client, const RequestType& request, ResponseType& response)
     : avatarService_{client->GetNode()->GetAvatarService()}
     , roomService_{client->GetNode()->GetRoomService()} {
-    LOG(INFO) << "ADDMODERATOR request recieved - adding: "
-              << FromWideString(request.destAvatarName) << "@"
-              << FromWideString(request.destAvatarAddress) << " to "
-              << FromWideString(request.destRoomAddress);
+    REQUEST_LOG("ADDMODERATOR request recieved - adding: ", request.destAvatarName, "@", request.destAvatarAddress,
+        " to ", request.destRoomAddress);
 
     auto srcAvatar = avatarService_->GetAvatar(request.srcAvatarId);
     if (!srcAvatar) {
@@ -180,13 +176,14 @@ AddModerator::AddModerator(
 CreateRoom::CreateRoom(GatewayClient* client, const RequestType& request, ResponseType& response)
     : avatarService_{client->GetNode()->GetAvatarService()}
     , roomService_{client->GetNode()->GetRoomService()} {
-    LOG(INFO) << "CREATEROOM request received - creator: " << request.creatorId << "@"
-              << FromWideString(request.srcAddress)
-              << " room: " << FromWideString(request.roomAddress);
+    REQUEST_LOG("CREATEROOM request received - creator: ", request.creatorId, "@", request.srcAddress, " room: ",
+        request.roomAddress);
 
     response.room = roomService_->CreateRoom(avatarService_->GetAvatar(request.creatorId),
         request.roomName, request.roomTopic, request.roomPassword, request.roomAttributes,
         request.roomMaxSize, request.roomAddress, request.srcAddress);
+
+    client->GetNode()->GetReplicator().RoomCreated(response.room);
 }
 
 DestroyAvatar::DestroyAvatar(
@@ -206,6 +203,8 @@ DestroyAvatar::DestroyAvatar(
         client->SendLeaveRoomUpdate(addresses, avatar->GetAvatarId(), room->GetRoomId());
     }
 
+    client->GetNode()->GetReplicator().AvatarLoggedOut(avatar);
+
     // Destroy avatar
     avatarService_->DestroyAvatar(avatar);
 }
@@ -213,9 +212,8 @@ DestroyAvatar::DestroyAvatar(
 DestroyRoom::DestroyRoom(GatewayClient* client, const RequestType& request, ResponseType& response)
     : avatarService_{client->GetNode()->GetAvatarService()}
     , roomService_{client->GetNode()->GetRoomService()} {
-    LOG(INFO) << "DESTROYROOM request received " << request.srcAvatarId << "@"
-              << FromWideString(request.srcAddress)
-              << " room: " << FromWideString(request.roomAddress);
+    REQUEST_LOG("DESTROYROOM request received ", request.srcAvatarId, "@", request.srcAddress, " room: ",
+        request.roomAddress);
 
     auto srcAvatar = avatarService_->GetAvatar(request.srcAvatarId);
     if (!srcAvatar) {
@@ -232,6 +230,7 @@ DestroyRoom::DestroyRoom(GatewayClient* client, const RequestType& request, Resp
 
     response.roomId = roomId;
 
+    client->GetNode()->GetReplicator().RoomDestroyed(room, srcAvatar);
     roomService_->DestroyRoom(room);
 
     client->SendDestroyRoomUpdate(srcAvatar, roomId, addresses);
@@ -240,9 +239,8 @@ DestroyRoom::DestroyRoom(GatewayClient* client, const RequestType& request, Resp
 EnterRoom::EnterRoom(GatewayClient* client, const RequestType& request, ResponseType& response)
     : avatarService_{client->GetNode()->GetAvatarService()}
     , roomService_{client->GetNode()->GetRoomService()} {
-    LOG(INFO) << "ENTERROOM request received - avatar: " << request.srcAvatarId << "@"
-              << FromWideString(request.srcAddress)
-              << " room: " << FromWideString(request.roomAddress);
+    REQUEST_LOG("ENTERROOM request received - avatar: ", request.srcAvatarId, "@", request.srcAddress, " room: ",
+        request.roomAddress);
 
     auto srcAvatar = avatarService_->GetAvatar(request.srcAvatarId);
     if (!srcAvatar) {
@@ -258,49 +256,40 @@ EnterRoom::EnterRoom(GatewayClient* client, const RequestType& request, Response
     response.room->EnterRoom(srcAvatar, request.roomPassword);
 
     client->SendEnterRoomUpdate(srcAvatar, response.room);
+    client->GetNode()->GetReplicator().RoomEntered(response.room, srcAvatar);
 }
 
 FailoverReLoginAvatar::FailoverReLoginAvatar(
-    GatewayClient* client, const RequestType& request, ResponseType& response)
-    : avatarService_{client->GetNode()->GetAvatarService()}
-    , roomService_{client->GetNode()->GetRoomService()} {
-    LOG(INFO) << "FAILOVER_RELOGINAVATAR request received " << FromWideString(request.name) << "@"
-              << FromWideString(request.address);
-
-    auto avatar = avatarService_->GetAvatar(request.name, request.address);
-    if (!avatar) {
-        LOG(INFO) << "Login avatar does not exist, creating a new one " << FromWideString(request.name) << "@"
-                  << FromWideString(request.address);
-        avatar = avatarService_->CreateAvatar(request.name, request.address, request.userId,
-            request.attributes, request.loginLocation);
-    }
-
-    CHECK_NOTNULL(avatar);
+    GatewayClient* client, const RequestType& request, ResponseType& response) {
+    REQUEST_LOG("FAILOVER_RELOGINAVATAR request received ", request.name, "@", request.address);
 
-    avatarService_->LoginAvatar(avatar);
+    LoginRequest login;
+    login.name = request.name;
+    login.address = request.address;
+    login.loginLocation = request.loginLocation;
+    login.userId = request.userId;
+    login.attributes = request.attributes;
 
-    auto websiteIntegration = client->GetNode()->GetWebsiteIntegrationService();
-    if (websiteIntegration) {
-        websiteIntegration->RecordAvatarLogin(*avatar);
-    }
+    client->AwaitLogin(login, [client, &request](ChatAvatar* avatar) {
+        auto roomService = client->GetNode()->GetRoomService();
 
-    if (avatar->GetName().compare(u"SYSTEM") == 0) {
-        client->GetNode()->RegisterClientAddress(avatar->GetAddress(), client);
-        roomService_->LoadRoomsFromStorage(request.address);
-    } else {
-        client->SendFriendLoginUpdates(avatar);
-    }
+        if (avatar->GetName().compare(u"SYSTEM") == 0) {
+            client->GetNode()->RegisterClientAddress(avatar->GetAddressId(), client);
+            roomService->LoadRoomsFromStorage(request.address);
+        } else {
+            client->SendFriendLoginUpdates(avatar);
+        }
 
-    for (auto room : roomService_->GetJoinedRooms(avatar)) {
-        client->SendEnterRoomUpdate(avatar, room);
-    }
+        for (auto room : roomService->GetJoinedRooms(avatar)) {
+            client->SendEnterRoomUpdate(avatar, room);
+        }
+    });
 }
 
 FriendStatus::FriendStatus(
     GatewayClient* client, const RequestType& request, ResponseType& response)
     : avatarService_{client->GetNode()->GetAvatarService()} {
-    LOG(INFO) << "FRIENDSTATUS request received - for " << request.srcAvatarId << "@"
-              << FromWideString(request.srcAddress);
+    REQUEST_LOG("FRIENDSTATUS request received - for ", request.srcAvatarId, "@", request.srcAddress);
 
     auto srcAvatar = avatarService_->GetAvatar(request.srcAvatarId);
     if (!srcAvatar) {
@@ -313,8 +302,7 @@ FriendStatus::FriendStatus(
 GetAnyAvatar::GetAnyAvatar(
     GatewayClient* client, const RequestType& request, ResponseType& response)
     : avatarService_{client->GetNode()->GetAvatarService()} {
-    LOG(INFO) << "GETANYAVATAR request received - avatar: " << FromWideString(request.name) << "@"
-              << FromWideString(request.address);
+    REQUEST_LOG("GETANYAVATAR request received - avatar: ", request.name, "@", request.address);
 
     auto avatar = avatarService_->GetAvatar(request.name, request.address);
     if (!avatar) {
@@ -327,27 +315,31 @@ GetAnyAvatar::GetAnyAvatar(
 }
 
 GetPersistentHeaders::GetPersistentHeaders(
-    GatewayClient* client, const RequestType& request, ResponseType& response)
-    : messageService_{client->GetNode()->GetMessageService()} {
-    LOG(INFO) << "GETPERSISTENTHEADERS request recieved - avatar: " << request.avatarId
-              << " category: " << FromWideString(request.category);
+    GatewayClient* client, const RequestType& request, ResponseType& response) {
+    REQUEST_LOG("GETPERSISTENTHEADERS request recieved - avatar: ", request.avatarId, " category: ", request.category);
 
-    response.headers = messageService_->GetMessageHeaders(request.avatarId);
+    client->AwaitDatabase(
+        [avatarId = request.avatarId](ChatStorage& storage) {
+            return PersistentMessageService{&storage}.GetMessageHeaders(avatarId);
+        },
+        [&response](std::vector<PersistentHeader> headers) { response.headers = std::move(headers); });
 }
 
 GetPersistentMessage::GetPersistentMessage(
-    GatewayClient* client, const RequestType& request, ResponseType& response)
-    : messageService_{client->GetNode()->GetMessageService()} {
-    LOG(INFO) << "GETPERSISTENTMESSAGE request received - avatar: " << request.srcAvatarId
-              << " message: " << request.messageId;
+    GatewayClient* client, const RequestType& request, ResponseType& response) {
+    REQUEST_LOG("GETPERSISTENTMESSAGE request received - avatar: ", request.srcAvatarId, " message: ",
+        request.messageId);
 
-    response.message
-        = messageService_->GetPersistentMessage(request.srcAvatarId, request.messageId);
+    client->AwaitDatabase(
+        [avatarId = request.srcAvatarId, messageId = request.messageId](ChatStorage& storage) {
+            return PersistentMessageService{&storage}.GetPersistentMessage(avatarId, messageId);
+        },
+        [&response](PersistentMessage message) { response.message = std::move(message); });
 }
 
 GetRoom::GetRoom(GatewayClient* client, const RequestType& request, ResponseType& response)
     : roomService_{client->GetNode()->GetRoomService()} {
-    LOG(INFO) << "GETROOM request received - room: " << FromWideString(request.roomAddress);
+    REQUEST_LOG("GETROOM request received - room: ", request.roomAddress);
 
     auto room = roomService_->GetRoom(request.roomAddress);
     if (!room) {
@@ -360,9 +352,8 @@ GetRoom::GetRoom(GatewayClient* client, const RequestType& request, ResponseType
 GetRoomSummaries::GetRoomSummaries(
     GatewayClient* client, const RequestType& request, ResponseType& response)
     : roomService_{client->GetNode()->GetRoomService()} {
-    LOG(INFO) << "GETROOMSUMMARIES request received - start node: "
-              << FromWideString(request.startNodeAddress)
-              << " filter: " << FromWideString(request.roomFilter);
+    REQUEST_LOG("GETROOMSUMMARIES request received - start node: ", request.startNodeAddress, " filter: ",
+        request.roomFilter);
 
     response.rooms = roomService_->GetRoomSummaries(request.startNodeAddress, request.roomFilter);
 }
@@ -370,8 +361,7 @@ GetRoomSummaries::GetRoomSummaries(
 IgnoreStatus::IgnoreStatus(
     GatewayClient* client, const RequestType& request, ResponseType& response)
     : avatarService_{client->GetNode()->GetAvatarService()} {
-    LOG(INFO) << "IGNORESTATUS request received - for " << request.srcAvatarId << "@"
-              << FromWideString(request.srcAddress);
+    REQUEST_LOG("IGNORESTATUS request received - for ", request.srcAvatarId, "@", request.srcAddress);
 
     auto srcAvatar = avatarService_->GetAvatar(request.srcAvatarId);
     if (!srcAvatar) {
@@ -384,9 +374,8 @@ IgnoreStatus::IgnoreStatus(
 KickAvatar::KickAvatar(GatewayClient* client, const RequestType& request, ResponseType& response)
     : avatarService_{client->GetNode()->GetAvatarService()}
     , roomService_{client->GetNode()->GetRoomService()} {
-    LOG(INFO) << "KICKAVATAR request received - kicking: " << FromWideString(request.destAvatarName)
-              << "@" << FromWideString(request.destAvatarAddress) << " from "
-              << FromWideString(request.destRoomAddress);
+    REQUEST_LOG("KICKAVATAR request received - kicking: ", request.destAvatarName, "@", request.destAvatarAddress,
+        " from ", request.destRoomAddress);
 
     auto srcAvatar = avatarService_->GetAvatar(request.srcAvatarId);
     if (!srcAvatar) {
@@ -409,6 +398,7 @@ KickAvatar::KickAvatar(GatewayClient* client, const RequestType& request, Respon
     room->KickAvatar(srcAvatar->GetAvatarId(), destAvatar);
 
     client->SendKickAvatarUpdate(addresses, srcAvatar, destAvatar, room);
+    client->GetNode()->GetReplicator().RoomLeft(room, destAvatar);
 }
 
 LeaveRoom::LeaveRoom(GatewayClient* client, const RequestType& request, ResponseType& response)
@@ -432,45 +422,35 @@ LeaveRoom::LeaveRoom(GatewayClient* client, const RequestType& request, Response
     room->LeaveRoom(srcAvatar);
 
     client->SendLeaveRoomUpdate(addresses, srcAvatar->GetAvatarId(), room->GetRoomId());
+    client->GetNode()->GetReplicator().RoomLeft(room, srcAvatar);
 }
 
-LoginAvatar::LoginAvatar(GatewayClient* client, const RequestType& request, ResponseType& response)
-    : avatarService_{client->GetNode()->GetAvatarService()}
-    , roomService_{client->GetNode()->GetRoomService()} {
-    LOG(INFO) << "LOGINAVATAR request received " << FromWideString(request.name) << "@"
-              << FromWideString(request.address);
-
-    auto avatar = avatarService_->GetAvatar(request.name, request.address);
-    if (!avatar) {
-        LOG(INFO) << "Login avatar does not exist, creating a new one "
-                  << FromWideString(request.name) << "@" << FromWideString(request.address);
-        avatar = avatarService_->CreateAvatar(request.name, request.address, request.userId,
-            request.loginAttributes, request.loginLocation);
-    }
-
-    CHECK_NOTNULL(avatar);
-
-    avatarService_->LoginAvatar(avatar);
+LoginAvatar::LoginAvatar(GatewayClient* client, const RequestType& request, ResponseType& response) {
+    REQUEST_LOG("LOGINAVATAR request received ", request.name, "@", request.address);
 
-    auto websiteIntegration = client->GetNode()->GetWebsiteIntegrationService();
-    if (websiteIntegration) {
-        websiteIntegration->RecordAvatarLogin(*avatar);
-    }
+    LoginRequest login;
+    login.name = request.name;
+    login.address = request.address;
+    login.loginLocation = request.loginLocation;
+    login.userId = request.userId;
+    login.attributes = request.loginAttributes;
 
-    if (avatar->GetName().compare(u"SYSTEM") == 0) {
-        client->GetNode()->RegisterClientAddress(avatar->GetAddress(), client);
-        roomService_->LoadRoomsFromStorage(request.address);
-    } else {
-        client->SendFriendLoginUpdates(avatar);
-    }
+    client->AwaitLogin(login, [client, &request, &response](ChatAvatar* avatar) {
+        if (avatar->GetName().compare(u"SYSTEM") == 0) {
+            client->GetNode()->RegisterClientAddress(avatar->GetAddressId(), client);
+            client->GetNode()->GetRoomService()->LoadRoomsFromStorage(request.address);
+        } else {
+            client->SendFriendLoginUpdates(avatar);
+        }
 
-    response.avatar = avatar;
+        response.avatar = avatar;
+    });
 }
 
 LogoutAvatar::LogoutAvatar(GatewayClient* client, const RequestType& request, ResponseType& response)
     : avatarService_{client->GetNode()->GetAvatarService()}
     , roomService_{client->GetNode()->GetRoomService()} {
-    LOG(INFO) << "LOGOUTAVATAR request received - avatar id:" << request.avatarId;
+    REQUEST_LOG("LOGOUTAVATAR request received - avatar id:", request.avatarId);
 
     auto avatar = avatarService_->GetAvatar(request.avatarId);
 
@@ -482,6 +462,7 @@ LogoutAvatar::LogoutAvatar(GatewayClient* client, const RequestType& request, Re
     }
 
     client->SendFriendLogoutUpdates(avatar);
+    client->GetNode()->GetReplicator().AvatarLoggedOut(avatar);
 
     avatarService_->LogoutAvatar(avatar);
 
@@ -498,7 +479,11 @@ RegistrarGetChatServer::RegistrarGetChatServer(
     const auto preferredPort = request.port;
     const bool hasPreferred = !preferredAddress.empty() && preferredPort != 0;
 
-    auto endpoint = node->SelectGatewayEndpoint(preferredAddress, preferredPort);
+    // Logins from one game server host stick to one gateway in affinity
+    // mode; the port is left out as it changes whenever the server restarts.
+    const std::string affinityKey = client->GetConnection()->GetDestinationIp().GetAddress(nullptr);
+
+    auto endpoint = node->SelectGatewayEndpoint(preferredAddress, preferredPort, affinityKey);
 
     if (hasPreferred) {
         if (endpoint.Matches(preferredAddress, preferredPort)) {
@@ -518,10 +503,8 @@ RegistrarGetChatServer::RegistrarGetChatServer(
 RemoveBan::RemoveBan(GatewayClient* client, const RequestType& request, ResponseType& response)
     : avatarService_{client->GetNode()->GetAvatarService()}
     , roomService_{client->GetNode()->GetRoomService()} {
-    LOG(INFO) << "REMOVEBAN request received - removing ban for: "
-              << FromWideString(request.destAvatarName) << "@"
-              << FromWideString(request.destAvatarAddress) << " from "
-              << FromWideString(request.destRoomAddress);
+    REQUEST_LOG("REMOVEBAN request received - removing ban for: ", request.destAvatarName, "@",
+        request.destAvatarAddress, " from ", request.destRoomAddress);
 
     auto srcAvatar = avatarService_->GetAvatar(request.srcAvatarId);
     if (!srcAvatar) {
@@ -547,9 +530,8 @@ RemoveBan::RemoveBan(GatewayClient* client, const RequestType& request, Response
 RemoveFriend::RemoveFriend(
     GatewayClient* client, const RequestType& request, ResponseType& response)
     : avatarService_{client->GetNode()->GetAvatarService()} {
-    LOG(INFO) << "REMOVEFRIEND request received - removing: " << FromWideString(request.destName)
-              << "@" << FromWideString(request.destAddress) << " from " << request.srcAvatarId
-              << "@" << FromWideString(request.srcAddress);
+    REQUEST_LOG("REMOVEFRIEND request received - removing: ", request.destName, "@", request.destAddress, " from ",
+        request.srcAvatarId, "@", request.srcAddress);
 
     auto srcAvatar = avatarService_->GetAvatar(request.srcAvatarId);
     if (!srcAvatar) {
@@ -566,9 +548,8 @@ RemoveFriend::RemoveFriend(
 
 RemoveIgnore::RemoveIgnore(GatewayClient* client, const RequestType& request, ResponseType& response)
     : avatarService_{client->GetNode()->GetAvatarService()} {
-    LOG(INFO) << "REMOVEIGNORE request received - removing: " << FromWideString(request.destName) << "@"
-              << FromWideString(request.destAddress) << " from " << request.srcAvatarId << "@"
-              << FromWideString(request.srcAddress);
+    REQUEST_LOG("REMOVEIGNORE request received - removing: ", request.destName, "@", request.destAddress, " from ",
+        request.srcAvatarId, "@", request.srcAddress);
 
     auto srcAvatar = avatarService_->GetAvatar(request.srcAvatarId);
     if (!srcAvatar) {
@@ -587,10 +568,8 @@ RemoveInvite::RemoveInvite(
     GatewayClient* client, const RequestType& request, ResponseType& response)
     : avatarService_{client->GetNode()->GetAvatarService()}
     , roomService_{client->GetNode()->GetRoomService()} {
-    LOG(INFO) << "REMOVEINVITE request received - removing invitation for: "
-              << FromWideString(request.destAvatarName) << "@"
-              << FromWideString(request.destAvatarAddress) << " to "
-              << FromWideString(request.destRoomAddress);
+    REQUEST_LOG("REMOVEINVITE request received - removing invitation for: ", request.destAvatarName, "@",
+        request.destAvatarAddress, " to ", request.destRoomAddress);
 
     auto srcAvatar = avatarService_->GetAvatar(request.srcAvatarId);
     if (!srcAvatar) {
@@ -616,8 +595,8 @@ RemoveInvite::RemoveInvite(
 RemoveModerator::RemoveModerator(GatewayClient* client, const RequestType& request, ResponseType& response)
     : avatarService_{client->GetNode()->GetAvatarService()}
     , roomService_{client->GetNode()->GetRoomService()} {
-    LOG(INFO) << "REMOVEMODERATOR request recieved - removing: " << FromWideString(request.destAvatarName) << "@"
-              << FromWideString(request.destAvatarAddress) << " from " << FromWideString(request.destRoomAddress);
+    REQUEST_LOG("REMOVEMODERATOR request recieved - removing: ", request.destAvatarName, "@", request.destAvatarAddress,
+        " from ", request.destRoomAddress);
 
     auto srcAvatar = avatarService_->GetAvatar(request.srcAvatarId);
     if (!srcAvatar) {
@@ -642,9 +621,8 @@ RemoveModerator::RemoveModerator(GatewayClient* client, const RequestType& reque
 SendInstantMessage::SendInstantMessage(
     GatewayClient* client, const RequestType& request, ResponseType& response)
     : avatarService_{client->GetNode()->GetAvatarService()} {
-    LOG(INFO) << "SENDINSTANTMESSAGE request received "
-              << " - from " << request.srcAvatarId << "@" << FromWideString(request.srcAddress) << " to "
-              << FromWideString(request.destName) << "@" << FromWideString(request.destAddress);
+    REQUEST_LOG("SENDINSTANTMESSAGE request received  - from ", request.srcAvatarId, "@", request.srcAddress, " to ",
+        request.destName, "@", request.destAddress);
 
     auto srcAvatar = avatarService_->GetAvatar(request.srcAvatarId);
     if (!srcAvatar) {
@@ -664,9 +642,8 @@ SendInstantMessage::SendInstantMessage(
 }
 
 SendPersistentMessage::SendPersistentMessage(GatewayClient* client, const RequestType& request, ResponseType& response)
-    : avatarService_{client->GetNode()->GetAvatarService()}
-    , messageService_{client->GetNode()->GetMessageService()} {
-    LOG(INFO) << "SENDPERSISTENTMESSAGE request received:";
+    : avatarService_{client->GetNode()->GetAvatarService()} {
+    REQUEST_LOG("SENDPERSISTENTMESSAGE request received:");
 
     auto destAvatar = avatarService_->GetAvatar(request.destName, request.destAddress);
     if (!destAvatar) {
@@ -699,25 +676,33 @@ SendPersistentMessage::SendPersistentMessage(GatewayClient* client, const Reques
     message.message = request.msg;
     message.oob = request.oob;
 
-    messageService_->StoreMessage(message);
+    client->AwaitDatabase(
+        [message](ChatStorage& storage) mutable {
+            PersistentMessageService{&storage}.StoreMessage(message);
+            return message;
+        },
+        [client, &response](PersistentMessage message) {
+            // The recipient is looked up again, as the cache may have evicted
+            // it while the message was being stored.
+            auto destAvatar = client->GetNode()->GetAvatarService()->GetAvatar(message.header.avatarId);
 
-    auto websiteIntegration = client->GetNode()->GetWebsiteIntegrationService();
-    if (websiteIntegration) {
-        websiteIntegration->RecordPersistentMessage(*destAvatar, message);
-    }
+            auto websiteIntegration = client->GetNode()->GetWebsiteIntegrationService();
+            if (websiteIntegration && destAvatar) {
+                websiteIntegration->RecordPersistentMessage(*destAvatar, message);
+            }
 
-    response.messageId = message.header.messageId;
+            response.messageId = message.header.messageId;
 
-    client->SendPersistentMessageUpdate(destAvatar, message.header);
+            client->SendPersistentMessageUpdate(destAvatar, message.header);
+        });
 }
 
 SendRoomMessage::SendRoomMessage(
     GatewayClient* client, const RequestType& request, ResponseType& response)
     : avatarService_{client->GetNode()->GetAvatarService()}
     , roomService_{client->GetNode()->GetRoomService()} {
-    LOG(INFO) << "SENDROOMMESSAGE request received "
-              << " - from " << request.srcAvatarId << "@" << FromWideString(request.srcAddress)
-              << " to " << FromWideString(request.destRoomAddress);
+    REQUEST_LOG("SENDROOMMESSAGE request received  - from ", request.srcAvatarId, "@", request.srcAddress, " to ",
+        request.destRoomAddress);
 
     auto srcAvatar = avatarService_->GetAvatar(request.srcAvatarId);
     if (!srcAvatar) {
@@ -733,20 +718,26 @@ SendRoomMessage::SendRoomMessage(
 
     client->SendRoomMessageUpdate(
         srcAvatar, room, room->GetNextMessageId(), request.message, request.oob);
+    client->GetNode()->GetReplicator().RoomMessageSent(room, srcAvatar, request.message, request.oob);
 }
 
 SetApiVersion::SetApiVersion(
     GatewayClient* client, const RequestType& request, ResponseType& response) {
-    LOG(INFO) << "SETAPIVERSION request received - version: " << request.version;
-    response.version = client->GetNode()->GetConfig().version;
-    response.result = (response.version == request.version)
+    REQUEST_LOG("SETAPIVERSION request received - version: ", request.version);
+    auto& config = client->GetNode()->GetConfig();
+    response.version = config.ResolveApiVersionForClient(request.version);
+    response.capabilityMask = config.CapabilityMaskForVersion(response.version);
+    response.result = config.ShouldAcceptApiVersion(request.version)
         ? ChatResultCode::SUCCESS
         : ChatResultCode::WRONGCHATSERVERFORREQUEST;
+
+    client->SetNegotiatedCapabilities(
+        response.result == ChatResultCode::SUCCESS ? response.capabilityMask : 0);
 }
 
 SetAvatarAttributes::SetAvatarAttributes(GatewayClient* client, const RequestType& request, ResponseType& response)
     : avatarService_{client->GetNode()->GetAvatarService()} {
-    LOG(INFO) << "SETAVATARATTRIBUTES request received - avatar: " << request.avatarId;
+    REQUEST_LOG("SETAVATARATTRIBUTES request received - avatar: ", request.avatarId);
 
     auto avatar = avatarService_->GetAvatar(request.avatarId);
     if (!avatar) {
@@ -764,17 +755,23 @@ SetAvatarAttributes::SetAvatarAttributes(GatewayClient* client, const RequestTyp
     }
 }
 
-UpdatePersistentMessage::UpdatePersistentMessage(GatewayClient* client, const RequestType& request, ResponseType& response)
-    : messageService_{client->GetNode()->GetMessageService()} {
-    LOG(INFO) << "UPDATEPERSISTENTMESSAGE request received";
-    messageService_->UpdateMessageStatus(
-        request.srcAvatarId, request.messageId, request.status);
+UpdatePersistentMessage::UpdatePersistentMessage(GatewayClient* client, const RequestType& request, ResponseType& response) {
+    REQUEST_LOG("UPDATEPERSISTENTMESSAGE request received");
+    client->AwaitDatabase(
+        [request](ChatStorage& storage) {
+            PersistentMessageService{&storage}.UpdateMessageStatus(
+                request.srcAvatarId, request.messageId, request.status);
+        },
+        []() {});
 }
 
 UpdatePersistentMessages::UpdatePersistentMessages(GatewayClient *client, const RequestType &request, ResponseType &response)
-    : messageService_{client->GetNode()->GetMessageService()}
 {
-    LOG(INFO) << "UPDATEPERSISTENTMESSAGES request received";
-    messageService_->BulkUpdateMessageStatus(
-            request.srcAvatarId, request.category, request.newStatus);
+    REQUEST_LOG("UPDATEPERSISTENTMESSAGES request received");
+    client->AwaitDatabase(
+        [request](ChatStorage& storage) {
+            PersistentMessageService{&storage}.BulkUpdateMessageStatus(
+                request.srcAvatarId, request.category, request.newStatus);
+        },
+        []() {});
 }
@@ -4,7 +4,6 @@
 #include "ChatEnums.hpp"
 
 class ChatAvatarService;
-class PersistentMessageService;
 class GatewayClient;
 
 /** Begin SENDPERSISTENTMESSAGE */
@@ -75,9 +74,10 @@ public:
     using RequestType = ReqSendPersistentMessage;
     using ResponseType = ResSendPersistentMessage;
 
+    static constexpr bool kAwaitsDatabase = true;
+
     SendPersistentMessage(GatewayClient* client, const RequestType& request, ResponseType& response);
 
 private:
     ChatAvatarService* avatarService_;
-    PersistentMessageService* messageService_;
 };
@@ -2,6 +2,7 @@
 #pragma once
 
 #include "ChatEnums.hpp"
+#include "StationChatConfig.hpp"
 
 class ChatAvatarService;
 class ChatRoomService;
@@ -32,6 +33,7 @@ struct ResSetApiVersion {
     uint32_t track;
     ChatResultCode result;
     uint32_t version;
+    uint32_t capabilityMask = 0;
 };
 
 template <typename StreamT>
@@ -40,6 +42,11 @@ void write(StreamT& ar, const ResSetApiVersion& data) {
     write(ar, data.track);
     write(ar, data.result);
     write(ar, data.version);
+
+    // V2 clients expect the original response layout byte for byte.
+    if (data.version >= StationChatConfig::kEnhancedApiVersion) {
+        write(ar, data.capabilityMask);
+    }
 }
 
 class SetApiVersion {
@@ -4,7 +4,6 @@
 #include "ChatEnums.hpp"
 #include "PersistentMessage.hpp"
 
-class PersistentMessageService;
 class GatewayClient;
 
 /** Begin UPDATEPERSISTENTMESSAGE */
@@ -49,8 +48,7 @@ public:
     using RequestType = ReqUpdatePersistentMessage;
     using ResponseType = ResUpdatePersistentMessage;
 
-    UpdatePersistentMessage(GatewayClient* client, const RequestType& request, ResponseType& response);
+    static constexpr bool kAwaitsDatabase = true;
 
-private:
-    PersistentMessageService* messageService_;
+    UpdatePersistentMessage(GatewayClient* client, const RequestType& request, ResponseType& response);
 };
@@ -12,7 +12,6 @@
 #include "ChatEnums.hpp"
 #include "PersistentMessage.hpp"
 
-class PersistentMessageService;
 class GatewayClient;
 
 /** Begin UpdatePersistentMessages Request */
@@ -59,9 +58,8 @@ public:
     using RequestType = ReqUpdatePersistentMessages;
     using ResponseType = ResUpdatePersistentMessages;
 
-    UpdatePersistentMessages(GatewayClient* client, const RequestType& request, ResponseType& response);
+    static constexpr bool kAwaitsDatabase = true;
 
-private:
-    PersistentMessageService* messageService_;
+    UpdatePersistentMessages(GatewayClient* client, const RequestType& request, ResponseType& response);
 };
 
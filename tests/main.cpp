@@ -1,2 +1,7 @@
 #define CATCH_CONFIG_MAIN
-#include "catch.hpp"
\ No newline at end of file
+#include "catch.hpp"
+
+#define ELPP_NO_DEFAULT_LOG_FILE
+#include "easylogging++.h"
+
+INITIALIZE_EASYLOGGINGPP
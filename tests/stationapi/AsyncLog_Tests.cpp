@@ -0,0 +1,62 @@
+#include "catch.hpp"
+
+#include "AsyncLog.hpp"
+
+#include <sstream>
+
+namespace {
+
+template <typename... Args>
+std::string RoundTrip(std::size_t capacity, const Args&... args) {
+    std::vector<char> payload(capacity);
+    asynclog::PayloadWriter writer{payload.data(), payload.size()};
+
+    int expand[] = {0, (asynclog::Argument<std::remove_cv_t<Args>>::Encode(writer, args), 0)...};
+    (void)expand;
+
+    std::ostringstream os;
+    asynclog::Decode<Args...>(os, payload.data(), writer.Size());
+    return os.str();
+}
+
+} // namespace
+
+SCENARIO("log arguments are captured and formatted later", "[asynclog]") {
+    GIVEN("a mix of argument types") {
+        std::u16string name = u"bob";
+        std::string address = "SWG+galaxy";
+        uint32_t id = 42;
+
+        THEN("they are formatted in order") {
+            REQUIRE(RoundTrip(240, "LOGINAVATAR ", name, "@", address, " id ", id, " ", true) ==
+                "LOGINAVATAR bob@SWG+galaxy id 42 true");
+        }
+
+        THEN("arguments past the end of the record are elided") {
+            REQUIRE(RoundTrip(sizeof(const char*) + 2 + 4, "prefix ", address, id) == "prefix SWG+...");
+        }
+    }
+}
+
+SCENARIO("per request log lines can be sampled", "[asynclog]") {
+    auto& logger = AsyncLogger::Instance();
+    std::atomic<uint32_t> calls{0};
+
+    WHEN("one in three lines is sampled") {
+        logger.SetRequestSampling(3, 0);
+
+        int logged = 0;
+        for (int i = 0; i < 9; ++i) {
+            logged += logger.ShouldLogRequest(calls) ? 1 : 0;
+        }
+
+        REQUIRE(logged == 3);
+    }
+
+    WHEN("sampling is set to zero") {
+        logger.SetRequestSampling(0, 0);
+        REQUIRE_FALSE(logger.ShouldLogRequest(calls));
+    }
+
+    logger.SetRequestSampling(1, 0);
+}
@@ -0,0 +1,118 @@
+#include "catch.hpp"
+
+#include "stationchat/ChatAvatar.hpp"
+#include "stationchat/ChatAvatarService.hpp"
+#include "stationchat/ChatRoom.hpp"
+#include "stationchat/ChatRoomService.hpp"
+#include "stationchat/InMemoryChatStorage.hpp"
+
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+
+std::vector<uint32_t> CreateAvatars(ChatAvatarService& avatarService, uint32_t count) {
+    std::vector<uint32_t> avatarIds;
+    for (uint32_t i = 0; i < count; ++i) {
+        auto name = u"avatar" + std::u16string(1, static_cast<char16_t>(u'a' + i));
+        avatarIds.push_back(avatarService.CreateAvatar(name, u"SWG+Test+Alpha", i + 1, 0, u"")->GetAvatarId());
+    }
+
+    return avatarIds;
+}
+
+} // namespace
+
+SCENARIO("the avatar cache evicts idle avatars over its limits", "[avatar_cache]") {
+    InMemoryChatStorage storage;
+    ChatAvatarService avatarService{&storage, &storage};
+
+    auto avatarIds = CreateAvatars(avatarService, 10);
+
+    WHEN("the cache is over its entry limit") {
+        // Using the oldest avatar makes it the most recently used one.
+        avatarService.GetAvatar(avatarIds[0]);
+        avatarService.SetCacheLimits(5, 0);
+
+        REQUIRE(avatarService.RefreshCacheUsage());
+        REQUIRE(avatarService.EvictIdleAvatars({}) == 5);
+
+        THEN("the least recently used avatars are evicted first") {
+            REQUIRE(avatarService.GetResidentCount() == 5);
+            REQUIRE_FALSE(avatarService.RefreshCacheUsage());
+            REQUIRE(avatarService.GetCachedAvatar(avatarIds[0]) != nullptr);
+            REQUIRE(avatarService.GetCachedAvatar(avatarIds[1]) == nullptr);
+            REQUIRE(avatarService.GetCachedAvatar(avatarIds[9]) != nullptr);
+            REQUIRE(avatarService.GetEvictedCount() == 5);
+        }
+    }
+
+    WHEN("the cache is over its byte limit") {
+        avatarService.RefreshCacheUsage();
+        auto limit = avatarService.GetResidentBytes() / 2;
+        avatarService.SetCacheLimits(0, limit);
+
+        REQUIRE(avatarService.RefreshCacheUsage());
+        REQUIRE(avatarService.EvictIdleAvatars({}) > 0);
+
+        THEN("it is brought back under 90% of the limit") {
+            REQUIRE(avatarService.GetResidentBytes() <= limit - limit / 10);
+            REQUIRE_FALSE(avatarService.RefreshCacheUsage());
+        }
+    }
+
+    WHEN("an avatar is destroyed") {
+        avatarService.RefreshCacheUsage();
+        auto bytes = avatarService.GetResidentBytes();
+
+        auto extra = avatarService.CreateAvatar(u"extra", u"SWG+Test+Alpha", 99, 0, u"");
+        avatarService.RefreshCacheUsage();
+        REQUIRE(avatarService.GetResidentBytes() > bytes);
+
+        avatarService.DestroyAvatar(extra);
+
+        THEN("its bytes no longer count against the cache") {
+            REQUIRE(avatarService.GetResidentBytes() == bytes);
+            avatarService.RefreshCacheUsage();
+            REQUIRE(avatarService.GetResidentBytes() == bytes);
+        }
+    }
+}
+
+SCENARIO("avatars in use survive eviction", "[avatar_cache]") {
+    InMemoryChatStorage storage;
+    ChatAvatarService avatarService{&storage, &storage};
+    ChatRoomService roomService{&avatarService, &storage};
+
+    auto avatarIds = CreateAvatars(avatarService, 6);
+
+    auto online = avatarService.GetAvatar(avatarIds[0]);
+    auto onlineFriend = avatarService.GetAvatar(avatarIds[1]);
+    auto pinned = avatarService.GetAvatar(avatarIds[2]);
+    auto roomCreator = avatarService.GetAvatar(avatarIds[3]);
+
+    online->AddFriend(onlineFriend);
+    avatarService.LoginAvatar(online);
+
+    roomService.CreateRoom(roomCreator, u"cantina", u"", u"", 0, 0, u"SWG+Test+Alpha", u"SWG+Test+Alpha");
+
+    std::unordered_set<const ChatAvatar*> referenced{pinned};
+    roomService.CollectReferencedAvatars(referenced);
+
+    avatarService.SetCacheLimits(1, 0);
+    REQUIRE(avatarService.RefreshCacheUsage());
+
+    WHEN("the cache evicts every avatar it can") {
+        REQUIRE(avatarService.EvictIdleAvatars(referenced) == 2);
+
+        THEN("online, pinned and room member avatars and friends of online avatars stay cached") {
+            REQUIRE(avatarService.GetCachedAvatar(avatarIds[0]) == online);
+            REQUIRE(avatarService.GetCachedAvatar(avatarIds[1]) == onlineFriend);
+            REQUIRE(avatarService.GetCachedAvatar(avatarIds[2]) == pinned);
+            REQUIRE(avatarService.GetCachedAvatar(avatarIds[3]) == roomCreator);
+            REQUIRE(avatarService.GetCachedAvatar(avatarIds[4]) == nullptr);
+            REQUIRE(avatarService.GetCachedAvatar(avatarIds[5]) == nullptr);
+        }
+    }
+}
@@ -0,0 +1,142 @@
+#include "catch.hpp"
+
+#include "stationchat/ChatAvatar.hpp"
+#include "stationchat/ChatAvatarService.hpp"
+#include "stationchat/ChatRoom.hpp"
+#include "stationchat/ChatRoomService.hpp"
+#include "stationchat/ChatStateSnapshot.hpp"
+#include "stationchat/InMemoryChatStorage.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::vector<char> ReadBytes(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::vector<char>{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+}
+
+void WriteBytes(const std::string& path, const std::vector<char>& data) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(data.data(), static_cast<std::streamsize>(data.size()));
+}
+
+} // namespace
+
+SCENARIO("chat state snapshots restore the cache they captured", "[snapshot]") {
+    std::string path = "chat_state_snapshot_test.bin";
+
+    InMemoryChatStorage storage;
+    ChatAvatarService avatarService{&storage, &storage};
+    ChatRoomService roomService{&avatarService, &storage};
+
+    auto alice = avatarService.CreateAvatar(u"alice", u"SWG+Test+Alpha", 1, 0, u"");
+    auto bob = avatarService.CreateAvatar(u"bob", u"SWG+Test+Alpha", 2, 0, u"");
+    auto carol = avatarService.CreateAvatar(u"carol", u"SWG+Test+Alpha", 3, 0, u"");
+    alice->AddFriend(bob, u"wingmate");
+    alice->AddIgnore(carol);
+
+    auto room = roomService.CreateRoom(alice, u"cantina", u"drinks", u"", 0, 0, u"SWG+Test+Alpha", u"SWG+Test+Alpha");
+    room->AddModerator(alice->GetAvatarId(), bob);
+    auto roomAddress = room->GetRoomAddress();
+
+    REQUIRE(ChatStateSnapshot::WriteFile(path, ChatStateSnapshot::Capture(avatarService, roomService)));
+
+    InMemoryChatStorage restoredStorage;
+    ChatAvatarService restoredAvatars{&restoredStorage, &restoredStorage};
+    ChatRoomService restoredRooms{&restoredAvatars, &restoredStorage};
+    std::vector<SnapshotContacts> contacts;
+
+    WHEN("the file is restored into empty services") {
+        REQUIRE(ChatStateSnapshot::Restore(path, restoredAvatars, restoredRooms, contacts));
+
+        THEN("avatars, contacts and rooms come back as they were") {
+            auto restoredAlice = restoredAvatars.GetAvatar(alice->GetAvatarId());
+            REQUIRE(restoredAlice != nullptr);
+            REQUIRE(restoredAlice->GetName() == u"alice");
+            REQUIRE(restoredAlice->GetUserId() == 1);
+
+            auto friends = restoredAlice->GetFriendList();
+            REQUIRE(friends.size() == 1);
+            REQUIRE(friends[0].frnd->GetAvatarId() == bob->GetAvatarId());
+            REQUIRE(friends[0].comment == u"wingmate");
+
+            auto ignores = restoredAlice->GetIgnoreList();
+            REQUIRE(ignores.size() == 1);
+            REQUIRE(ignores[0].ignored->GetAvatarId() == carol->GetAvatarId());
+
+            auto restoredRoom = restoredRooms.GetRoom(roomAddress);
+            REQUIRE(restoredRoom != nullptr);
+            REQUIRE(restoredRoom->GetRoomTopic() == u"drinks");
+            REQUIRE(restoredRoom->GetCreatorId() == alice->GetAvatarId());
+
+            auto moderators = restoredRoom->GetModerators();
+            REQUIRE(moderators.size() == room->GetModerators().size());
+            REQUIRE(restoredRoom->IsModerator(bob->GetAvatarId()));
+
+            REQUIRE(contacts.size() == 3);
+        }
+    }
+
+    WHEN("the file is truncated") {
+        auto data = ReadBytes(path);
+        data.resize(data.size() - 1);
+        WriteBytes(path, data);
+
+        THEN("it is rejected and the services are left empty") {
+            REQUIRE_FALSE(ChatStateSnapshot::Restore(path, restoredAvatars, restoredRooms, contacts));
+            REQUIRE(restoredAvatars.GetAvatar(alice->GetAvatarId()) == nullptr);
+            REQUIRE(restoredRooms.GetRoom(roomAddress) == nullptr);
+        }
+    }
+
+    WHEN("a byte after the header is corrupted") {
+        auto data = ReadBytes(path);
+        data.back() ^= 0x5a;
+        WriteBytes(path, data);
+
+        THEN("the checksum rejects it") {
+            REQUIRE_FALSE(ChatStateSnapshot::Restore(path, restoredAvatars, restoredRooms, contacts));
+            REQUIRE(restoredAvatars.GetAvatar(alice->GetAvatarId()) == nullptr);
+        }
+    }
+
+    WHEN("the file was written by another format version") {
+        auto data = ReadBytes(path);
+        uint32_t version = ChatStateSnapshot::kVersion + 1;
+        std::memcpy(data.data() + sizeof(uint32_t), &version, sizeof(version));
+        WriteBytes(path, data);
+
+        THEN("it is rejected") {
+            REQUIRE_FALSE(ChatStateSnapshot::Restore(path, restoredAvatars, restoredRooms, contacts));
+            REQUIRE(restoredAvatars.GetAvatar(alice->GetAvatarId()) == nullptr);
+        }
+    }
+
+    std::remove(path.c_str());
+}
+
+SCENARIO("avatars deleted while the gateway was down drop out of the cache lookups", "[snapshot]") {
+    InMemoryChatStorage storage;
+    ChatAvatarService avatarService{&storage, &storage};
+
+    auto alice = avatarService.CreateAvatar(u"alice", u"SWG+Test+Alpha", 1, 0, u"");
+    auto bob = avatarService.CreateAvatar(u"bob", u"SWG+Test+Alpha", 2, 0, u"");
+    alice->AddFriend(bob);
+
+    ReconciledAvatar reconciled;
+    reconciled.avatarId = bob->GetAvatarId();
+    reconciled.exists = false;
+
+    ChatStateSnapshot::ApplyReconciliation(reconciled, avatarService);
+
+    THEN("it is no longer found by id or name, nor listed as a friend") {
+        REQUIRE(avatarService.GetCachedAvatar(reconciled.avatarId) == nullptr);
+        REQUIRE(avatarService.GetCachedAvatar(u"bob", u"SWG+Test+Alpha") == nullptr);
+        REQUIRE(alice->GetFriendList().empty());
+    }
+}
@@ -0,0 +1,76 @@
+#include "catch.hpp"
+
+#include "ClientRegistry.hpp"
+
+#include <cstdint>
+
+namespace {
+
+struct FakeClient {
+    int id;
+};
+
+} // namespace
+
+SCENARIO("clients can be registered under multiple keys", "[registry]") {
+    GIVEN("a registry with one client registered under two keys") {
+        ClientRegistry<uint32_t, FakeClient> registry;
+        FakeClient first{1};
+
+        registry.Register(10, &first);
+        registry.Register(11, &first);
+
+        THEN("both keys resolve to the client") {
+            REQUIRE(registry.Find(10) == &first);
+            REQUIRE(registry.Find(11) == &first);
+            REQUIRE(registry.KeyCount() == 2);
+            REQUIRE(registry.ClientCount() == 1);
+        }
+
+        WHEN("registering the same key again") {
+            registry.Register(10, &first);
+
+            THEN("nothing changes") {
+                REQUIRE(registry.KeyCount() == 2);
+                REQUIRE(registry.Find(10) == &first);
+            }
+        }
+
+        WHEN("another client registers one of the keys") {
+            FakeClient second{2};
+            registry.Register(11, &second);
+
+            THEN("the key moves to the new client") {
+                REQUIRE(registry.Find(11) == &second);
+                REQUIRE(registry.Find(10) == &first);
+            }
+
+            AND_WHEN("the original client is removed") {
+                registry.RemoveClient(&first);
+
+                THEN("the moved key is kept") {
+                    REQUIRE(registry.Find(10) == nullptr);
+                    REQUIRE(registry.Find(11) == &second);
+                    REQUIRE(registry.ClientCount() == 1);
+                }
+            }
+        }
+
+        WHEN("the client is removed") {
+            registry.RemoveClient(&first);
+
+            THEN("none of its keys resolve") {
+                REQUIRE(registry.Find(10) == nullptr);
+                REQUIRE(registry.Find(11) == nullptr);
+                REQUIRE(registry.KeyCount() == 0);
+                REQUIRE(registry.ClientCount() == 0);
+            }
+        }
+
+        WHEN("an unknown key is looked up") {
+            THEN("no client is returned") {
+                REQUIRE(registry.Find(99) == nullptr);
+            }
+        }
+    }
+}
@@ -0,0 +1,184 @@
+#include "catch.hpp"
+
+#include "stationchat/ChatAvatar.hpp"
+#include "stationchat/ChatAvatarService.hpp"
+#include "stationchat/ChatRoom.hpp"
+#include "stationchat/ChatRoomService.hpp"
+#include "stationchat/ClusterReplicator.hpp"
+#include "stationchat/GatewayNode.hpp"
+#include "stationchat/StationChatConfig.hpp"
+
+#include <boost/asio.hpp>
+
+#include <chrono>
+#include <functional>
+#include <vector>
+
+namespace {
+
+ReplicationBatch MakeBatch(uint64_t sequence) {
+    ReplicationBatch batch;
+    batch.origin = 7;
+    batch.sequence = sequence;
+    return batch;
+}
+
+StationChatConfig MakeClusterConfig(uint16_t port) {
+    StationChatConfig config;
+    config.storageBackend = "memory";
+    config.gatewayAddress = "127.0.0.1";
+    config.gatewayPort = port;
+    config.gatewayCluster = {{"127.0.0.1", 45121, 1}, {"127.0.0.1", 45122, 1}};
+    config.gatewayReplicationPortOffset = 1000;
+    return config;
+}
+
+bool TickUntil(GatewayNode& first, GatewayNode& second, const std::function<bool()>& done) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (!done()) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+
+        first.Tick();
+        second.Tick();
+    }
+
+    return true;
+}
+
+} // namespace
+
+SCENARIO("replication batches survive encoding", "[replication]") {
+    ReplicationBatch batch = MakeBatch(42);
+
+    ReplicationEvent message;
+    message.type = ReplicationEventType::ROOM_MESSAGE;
+    message.avatarName = u"han";
+    message.avatarAddress = u"SWG+test";
+    message.roomAddress = u"SWG+test+cantina";
+    message.message = u"hello";
+    message.oob = u"oob";
+    batch.events.push_back(message);
+
+    ReplicationEvent login;
+    login.type = ReplicationEventType::AVATAR_LOGIN;
+    login.avatarName = u"leia";
+    login.avatarAddress = u"SWG+test";
+    login.userId = 9;
+    batch.events.push_back(login);
+
+    auto datagram = EncodeReplicationBatch(batch);
+
+    ReplicationBatch decoded;
+    REQUIRE(DecodeReplicationBatch(datagram.data(), datagram.size(), decoded));
+    REQUIRE(decoded.origin == 7);
+    REQUIRE(decoded.sequence == 42);
+    REQUIRE(decoded.events.size() == 2);
+    REQUIRE(decoded.events[0].message == u"hello");
+    REQUIRE(decoded.events[0].roomAddress == u"SWG+test+cantina");
+    REQUIRE(decoded.events[1].userId == 9);
+
+    REQUIRE_FALSE(DecodeReplicationBatch(datagram.data(), datagram.size() - 1, decoded));
+
+    // The first event's avatar name length, claiming far more than was sent.
+    datagram.replace(25, 4, 4, '\xff');
+    REQUIRE_FALSE(DecodeReplicationBatch(datagram.data(), datagram.size(), decoded));
+}
+
+SCENARIO("the replication sequencer restores send order", "[replication]") {
+    ReplicationSequencer sequencer{std::chrono::milliseconds(500), 4};
+    std::vector<uint64_t> delivered;
+    auto visitor = [&delivered](const ReplicationBatch& batch) { delivered.push_back(batch.sequence); };
+    auto now = std::chrono::steady_clock::now();
+
+    sequencer.Receive(MakeBatch(10), now, visitor);
+
+    WHEN("batches arrive out of order and twice") {
+        sequencer.Receive(MakeBatch(12), now, visitor);
+        sequencer.Receive(MakeBatch(11), now, visitor);
+        sequencer.Receive(MakeBatch(11), now, visitor);
+
+        THEN("they are delivered once, in order") {
+            REQUIRE((delivered == std::vector<uint64_t>{10, 11, 12}));
+            REQUIRE(sequencer.GetDroppedCount() == 1);
+        }
+    }
+
+    WHEN("a batch never arrives") {
+        sequencer.Receive(MakeBatch(12), now, visitor);
+        sequencer.Expire(now + std::chrono::milliseconds(100), visitor);
+        auto heldBack = delivered.size();
+        sequencer.Expire(now + std::chrono::milliseconds(600), visitor);
+        sequencer.Receive(MakeBatch(11), now, visitor);
+
+        THEN("the batches behind it wait out the gap timeout and the late one is dropped") {
+            REQUIRE(heldBack == 1);
+            REQUIRE((delivered == std::vector<uint64_t>{10, 12}));
+            REQUIRE(sequencer.GetSkippedCount() == 1);
+        }
+    }
+}
+
+SCENARIO("gateways on loopback share rooms and presence", "[replication]") {
+    auto firstConfig = MakeClusterConfig(45121);
+    auto secondConfig = MakeClusterConfig(45122);
+    GatewayNode first{firstConfig};
+    GatewayNode second{secondConfig};
+
+    REQUIRE(first.GetReplicator().GetPort() == 46121);
+
+    auto avatar = first.GetAvatarService()->CreateAvatar(u"han", u"SWG+test", 1, 0, u"");
+    first.GetAvatarService()->LoginAvatar(avatar);
+    first.GetReplicator().AvatarLoggedIn(avatar);
+
+    auto room = first.GetRoomService()->CreateRoom(avatar, u"cantina", u"", u"", 0, 0, u"SWG+test", u"SWG+test");
+    first.GetReplicator().RoomCreated(room);
+    room->EnterRoom(avatar, u"");
+    first.GetReplicator().RoomEntered(room, avatar);
+
+    auto mirroredRoom = [&second]() { return second.GetRoomService()->GetRoom(u"SWG+test+cantina"); };
+    auto mirroredAvatar = [&second]() { return second.GetAvatarService()->GetCachedAvatar(u"han", u"SWG+test"); };
+
+    REQUIRE(TickUntil(first, second, [&]() { return mirroredRoom() && mirroredRoom()->GetCurrentRoomSize() == 1; }));
+    REQUIRE(mirroredAvatar()->IsOnline());
+    REQUIRE(second.GetReplicator().IsRemote(mirroredAvatar()));
+    REQUIRE(mirroredRoom()->IsInRoom(mirroredAvatar()));
+
+    WHEN("a host outside the cluster sends a well-formed batch") {
+        ReplicationBatch forged;
+        forged.origin = 99;
+
+        ReplicationEvent login;
+        login.type = ReplicationEventType::AVATAR_LOGIN;
+        login.avatarName = u"vader";
+        login.avatarAddress = u"SWG+test";
+        forged.events.push_back(login);
+
+        auto datagram = EncodeReplicationBatch(forged);
+
+        boost::asio::io_context ioContext;
+        boost::asio::ip::udp::socket socket{ioContext, boost::asio::ip::udp::v4()};
+        socket.send_to(boost::asio::buffer(datagram),
+            {boost::asio::ip::make_address("127.0.0.1"), second.GetReplicator().GetPort()});
+
+        auto until = std::chrono::steady_clock::now() + std::chrono::milliseconds(200);
+        TickUntil(first, second, [until]() { return std::chrono::steady_clock::now() > until; });
+
+        THEN("it is dropped") {
+            REQUIRE(second.GetAvatarService()->GetCachedAvatar(u"vader", u"SWG+test") == nullptr);
+        }
+    }
+
+    WHEN("the avatar logs out of its own gateway") {
+        first.GetReplicator().AvatarLoggedOut(avatar);
+        room->LeaveRoom(avatar);
+        first.GetAvatarService()->LogoutAvatar(avatar);
+
+        THEN("the other gateway takes it offline and out of the room") {
+            REQUIRE(TickUntil(first, second, [&]() { return !mirroredAvatar()->IsOnline(); }));
+            REQUIRE(mirroredRoom()->GetCurrentRoomSize() == 0);
+            REQUIRE(second.GetReplicator().GetRemoteAvatarCount() == 0);
+        }
+    }
+}
@@ -0,0 +1,64 @@
+#include "catch.hpp"
+
+#include "stationchat/ChatEnums.hpp"
+#include "stationchat/DatabaseExecutor.hpp"
+#include "stationchat/InMemoryChatStorage.hpp"
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+SCENARIO("database work runs on workers and completes on the polling thread", "[database]") {
+    DatabaseExecutor executor{2, []() { return std::make_unique<InMemoryChatStorage>(); }, nullptr};
+    REQUIRE(executor.GetWorkerCount() == 2);
+
+    auto pollingThread = std::this_thread::get_id();
+    std::vector<int> order;
+    std::vector<std::thread::id> completedOn;
+    bool failed = false;
+
+    for (int i = 0; i < 20; ++i) {
+        executor.Post(7, [](ChatStorage&) {},
+            [&, i](std::exception_ptr) {
+                order.push_back(i);
+                completedOn.push_back(std::this_thread::get_id());
+            });
+    }
+
+    executor.Post(8, [](ChatStorage&) { throw ChatResultException{ChatResultCode::PMSGNOTFOUND}; },
+        [&failed](std::exception_ptr error) { failed = error != nullptr; });
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while ((order.size() < 20 || !failed) && std::chrono::steady_clock::now() < deadline) {
+        executor.RunCompletions();
+    }
+
+    std::vector<int> expected;
+    for (int i = 0; i < 20; ++i) {
+        expected.push_back(i);
+    }
+
+    REQUIRE(order == expected);
+    REQUIRE(failed);
+    for (auto id : completedOn) {
+        REQUIRE(id == pollingThread);
+    }
+}
+
+SCENARIO("a completion that throws does not stop the others", "[database]") {
+    InMemoryChatStorage storage;
+    DatabaseExecutor executor{0, []() { return std::make_unique<InMemoryChatStorage>(); }, &storage};
+
+    std::vector<int> completed;
+
+    executor.Post(1, [](ChatStorage&) { throw 42; },
+        [&completed](std::exception_ptr error) {
+            completed.push_back(1);
+            std::rethrow_exception(error);
+        });
+    executor.Post(2, [](ChatStorage&) {}, [](std::exception_ptr) { throw 7; });
+    executor.Post(3, [](ChatStorage&) {}, [&completed](std::exception_ptr) { completed.push_back(3); });
+
+    REQUIRE_NOTHROW(executor.RunCompletions());
+    REQUIRE((completed == std::vector<int>{1, 3}));
+}
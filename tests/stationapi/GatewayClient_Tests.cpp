@@ -0,0 +1,265 @@
+#include "catch.hpp"
+
+#include "Serialization.hpp"
+#include "UdpLibrary.hpp"
+
+#include "stationchat/ChatAvatarService.hpp"
+#include "stationchat/ChatEnums.hpp"
+#include "stationchat/GatewayClient.hpp"
+#include "stationchat/GatewayNode.hpp"
+#include "stationchat/PersistentMessageService.hpp"
+#include "stationchat/StationChatConfig.hpp"
+
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Response {
+    ChatResponseType type;
+    uint32_t track;
+    ChatResultCode result;
+    uint32_t headerCount;
+};
+
+class GameServer : public UdpConnectionHandler {
+public:
+    explicit GameServer(uint16_t gatewayPort) {
+        UdpManager::Params params;
+        manager_ = new UdpManager(&params);
+        connection_ = manager_->EstablishConnection("127.0.0.1", gatewayPort, 1000);
+        connection_->SetHandler(this);
+    }
+
+    ~GameServer() {
+        connection_->SetHandler(nullptr);
+        connection_->Disconnect();
+        connection_->Release();
+        manager_->Release();
+    }
+
+    void Tick() { manager_->GiveTime(); }
+
+    bool IsConnected() const { return connection_->GetStatus() == UdpConnection::cStatusConnected; }
+
+    void Send(const std::string& request) {
+        connection_->Send(cUdpChannelReliable1, request.data(), static_cast<uint32_t>(request.size()));
+    }
+
+    std::vector<Response> responses;
+
+private:
+    void OnRoutePacket(UdpConnection*, const uchar* data, int length) override {
+        std::istringstream stream{
+            std::string{reinterpret_cast<const char*>(data), static_cast<std::size_t>(length)}, std::ios::binary};
+
+        Response response{};
+        read(stream, response.type);
+        read(stream, response.track);
+        read(stream, response.result);
+        if (response.type == ChatResponseType::GETPERSISTENTHEADERS) {
+            read(stream, response.headerCount);
+        }
+
+        responses.push_back(response);
+    }
+
+    UdpManager* manager_;
+    UdpConnection* connection_;
+};
+
+std::string GetHeaders(uint32_t track, uint32_t avatarId) {
+    std::ostringstream stream{std::ios::out | std::ios::binary};
+    write(stream, ChatRequestType::GETPERSISTENTHEADERS);
+    write(stream, track);
+    write(stream, avatarId);
+    write(stream, std::u16string{});
+    return stream.str();
+}
+
+std::string DeleteMessage(uint32_t track, uint32_t avatarId, uint32_t messageId) {
+    std::ostringstream stream{std::ios::out | std::ios::binary};
+    write(stream, ChatRequestType::UPDATEPERSISTENTMESSAGE);
+    write(stream, track);
+    write(stream, avatarId);
+    write(stream, messageId);
+    write(stream, PersistentState::DELETED);
+    return stream.str();
+}
+
+std::string FriendStatus(uint32_t track, uint32_t avatarId) {
+    std::ostringstream stream{std::ios::out | std::ios::binary};
+    write(stream, ChatRequestType::FRIENDSTATUS);
+    write(stream, track);
+    write(stream, avatarId);
+    write(stream, std::u16string{u"SWG+test"});
+    return stream.str();
+}
+
+std::string LoginAvatar(uint32_t track, const std::u16string& name) {
+    std::ostringstream stream{std::ios::out | std::ios::binary};
+    write(stream, ChatRequestType::LOGINAVATAR);
+    write(stream, track);
+    write(stream, uint32_t{1});
+    write(stream, name);
+    write(stream, std::u16string{u"SWG+test"});
+    write(stream, std::u16string{});
+    write(stream, int32_t{0});
+    write(stream, int32_t{0});
+    return stream.str();
+}
+
+std::string LogoutAvatar(uint32_t track, uint32_t avatarId) {
+    std::ostringstream stream{std::ios::out | std::ios::binary};
+    write(stream, ChatRequestType::LOGOUTAVATAR);
+    write(stream, track);
+    write(stream, avatarId);
+    return stream.str();
+}
+
+/** Exposes the connected clients of a gateway.
+ */
+class InspectableGateway : public GatewayNode {
+public:
+    using GatewayNode::GatewayNode;
+    using GatewayNode::ForEachClient;
+};
+
+template <typename ConditionT>
+bool TickUntil(GatewayNode& gateway, GameServer& server, ConditionT done) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (!done()) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+
+        gateway.Tick();
+        server.Tick();
+    }
+
+    return true;
+}
+
+} // namespace
+
+SCENARIO("requests that await the database keep per-avatar order", "[gateway]") {
+    StationChatConfig config;
+    config.storageBackend = "memory";
+    config.gatewayAddress = "127.0.0.1";
+    config.gatewayPort = 45131;
+    GatewayNode gateway{config};
+
+    PersistentMessage message;
+    message.header.avatarId = 7;
+    message.header.status = PersistentState::NEW;
+    gateway.GetMessageService()->StoreMessage(message);
+
+    GameServer server{45131};
+    REQUIRE(TickUntil(gateway, server, [&server]() { return server.IsConnected(); }));
+
+    WHEN("an avatar reads its mail, deletes it and reads it again while another avatar is served") {
+        server.Send(GetHeaders(1, 7));
+        server.Send(DeleteMessage(2, 7, message.header.messageId));
+        server.Send(GetHeaders(3, 7));
+        server.Send(FriendStatus(4, 8));
+
+        REQUIRE(TickUntil(gateway, server, [&server]() { return server.responses.size() == 4; }));
+
+        THEN("the other avatar does not wait and the mail requests answer in the order sent") {
+            auto& responses = server.responses;
+            REQUIRE(responses[0].track == 4);
+            REQUIRE(responses[1].track == 1);
+            REQUIRE(responses[1].headerCount == 1);
+            REQUIRE(responses[2].track == 2);
+            REQUIRE(responses[2].result == ChatResultCode::SUCCESS);
+            REQUIRE(responses[3].track == 3);
+            REQUIRE(responses[3].headerCount == 0);
+        }
+    }
+}
+
+SCENARIO("logins are answered once the login pipeline publishes them", "[gateway]") {
+    StationChatConfig config;
+    config.storageBackend = "memory";
+    config.gatewayAddress = "127.0.0.1";
+    config.gatewayPort = 45134;
+    GatewayNode gateway{config};
+
+    GameServer server{45134};
+    REQUIRE(TickUntil(gateway, server, [&server]() { return server.IsConnected(); }));
+
+    // Only a cached avatar is known not to be one of the logins under way.
+    auto other = gateway.GetAvatarService()->CreateAvatar(u"gamma", u"SWG+test", 3, 0, u"");
+
+    server.Send(LoginAvatar(1, u"alpha"));
+    server.Send(LoginAvatar(2, u"beta"));
+    server.Send(FriendStatus(3, other->GetAvatarId()));
+
+    REQUIRE(TickUntil(gateway, server, [&server]() { return server.responses.size() == 3; }));
+
+    auto& responses = server.responses;
+    REQUIRE(responses[0].track == 3);
+    REQUIRE(responses[1].type == ChatResponseType::LOGINAVATAR);
+    REQUIRE(responses[1].result == ChatResultCode::SUCCESS);
+    REQUIRE(responses[2].result == ChatResultCode::SUCCESS);
+    REQUIRE(gateway.GetAvatarService()->GetOnlineAvatars().size() == 2);
+}
+
+SCENARIO("a logout sent right after a login waits for the login", "[gateway]") {
+    StationChatConfig config;
+    config.storageBackend = "memory";
+    config.gatewayAddress = "127.0.0.1";
+    config.gatewayPort = 45135;
+    InspectableGateway gateway{config};
+
+    GameServer server{45135};
+    REQUIRE(TickUntil(gateway, server, [&server]() { return server.IsConnected(); }));
+
+    server.Send(LoginAvatar(1, u"alpha"));
+    REQUIRE(TickUntil(gateway, server, [&server]() { return server.responses.size() == 1; }));
+
+    auto avatarService = gateway.GetAvatarService();
+    auto avatarId = avatarService->GetCachedAvatar(u"alpha", u"SWG+test")->GetAvatarId();
+
+    server.Send(LogoutAvatar(2, avatarId));
+    REQUIRE(TickUntil(gateway, server, [&server]() { return server.responses.size() == 2; }));
+    REQUIRE(avatarService->GetOnlineAvatars().empty());
+
+    WHEN("the avatar logs in and out again without waiting for the login") {
+        server.Send(LoginAvatar(3, u"alpha"));
+        server.Send(LogoutAvatar(4, avatarId));
+
+        REQUIRE(TickUntil(gateway, server, [&server]() { return server.responses.size() == 4; }));
+
+        THEN("the logout is answered after the login and the avatar ends up offline") {
+            auto& responses = server.responses;
+            REQUIRE(responses[2].type == ChatResponseType::LOGINAVATAR);
+            REQUIRE(responses[2].track == 3);
+            REQUIRE(responses[3].type == ChatResponseType::LOGOUTAVATAR);
+            REQUIRE(responses[3].track == 4);
+            REQUIRE(responses[3].result == ChatResultCode::SUCCESS);
+            REQUIRE(avatarService->GetOnlineAvatars().empty());
+        }
+    }
+
+    WHEN("another avatar's login is still under way") {
+        uint32_t pending = 0;
+        auto countPending = [&gateway, &pending]() {
+            pending = 0;
+            gateway.ForEachClient([&pending](GatewayClient* client) { pending += client->GetPendingLoginCount(); });
+            return pending;
+        };
+
+        server.Send(LoginAvatar(3, u"beta"));
+        REQUIRE(TickUntil(gateway, server, [&countPending]() { return countPending() == 1; }));
+
+        THEN("it counts as pending until it is answered") {
+            REQUIRE(server.responses.size() == 2);
+
+            REQUIRE(TickUntil(gateway, server, [&server]() { return server.responses.size() == 3; }));
+            REQUIRE(countPending() == 0);
+        }
+    }
+}
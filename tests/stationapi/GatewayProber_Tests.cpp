@@ -0,0 +1,49 @@
+#include "catch.hpp"
+
+#include "stationchat/GatewayNode.hpp"
+#include "stationchat/GatewayProber.hpp"
+#include "stationchat/StationChatConfig.hpp"
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <thread>
+
+SCENARIO("the gateway prober checks endpoints with a protocol round trip", "[registrar]") {
+    GIVEN("a gateway serving on one port and nothing on another") {
+        StationChatConfig config;
+        config.storageBackend = "memory";
+        config.gatewayAddress = "127.0.0.1";
+        config.gatewayPort = 45101;
+        GatewayNode gateway{config};
+
+        std::mutex resultMutex;
+        std::map<uint16_t, bool> results;
+
+        GatewayProber prober{{{"127.0.0.1", 45101, 1}, {"127.0.0.1", 45102, 1}}, std::chrono::milliseconds(50),
+            std::chrono::milliseconds(500),
+            [&](const GatewayClusterEndpoint& endpoint, bool reachable, std::chrono::microseconds) {
+                std::lock_guard<std::mutex> lock(resultMutex);
+                results.emplace(endpoint.port, reachable);
+            }};
+
+        WHEN("the gateway keeps ticking") {
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+            for (;;) {
+                gateway.Tick();
+
+                std::lock_guard<std::mutex> lock(resultMutex);
+                if (results.size() == 2 || std::chrono::steady_clock::now() > deadline) {
+                    break;
+                }
+            }
+
+            THEN("the serving gateway answers and the missing one fails") {
+                std::lock_guard<std::mutex> lock(resultMutex);
+                REQUIRE(results.size() == 2);
+                REQUIRE(results[45101]);
+                REQUIRE_FALSE(results[45102]);
+            }
+        }
+    }
+}
@@ -0,0 +1,136 @@
+#include "catch.hpp"
+
+#include "stationchat/ChatAvatar.hpp"
+#include "stationchat/ChatAvatarService.hpp"
+#include "stationchat/InMemoryChatStorage.hpp"
+#include "stationchat/PersistentMessageService.hpp"
+
+SCENARIO("chat services run against in-memory storage", "[storage]") {
+    GIVEN("services backed by an in-memory store") {
+        InMemoryChatStorage storage;
+        ChatAvatarService avatarService{&storage, &storage};
+        PersistentMessageService messageService{&storage};
+
+        auto alice = avatarService.CreateAvatar(u"alice", u"SWG+Test+Alpha", 1, 0, u"");
+        auto bob = avatarService.CreateAvatar(u"bob", u"SWG+Test+Alpha", 2, 0, u"");
+
+        THEN("created avatars are assigned ids and can be found again") {
+            REQUIRE(alice->GetAvatarId() != bob->GetAvatarId());
+
+            auto stored = storage.FindAvatar(u"bob", u"SWG+Test+Alpha");
+            REQUIRE(stored);
+            REQUIRE(stored->avatarId == bob->GetAvatarId());
+            REQUIRE(stored->userId == 2);
+        }
+
+        WHEN("a friend is persisted") {
+            avatarService.PersistFriend(alice->GetAvatarId(), bob->GetAvatarId(), u"wingmate");
+
+            THEN("the friend list is read back with its comment") {
+                std::vector<std::pair<uint32_t, std::u16string>> friends;
+                storage.ForEachFriend(alice->GetAvatarId(),
+                    [&friends](const StoredAvatar& avatar, const std::u16string& comment) {
+                        friends.emplace_back(avatar.avatarId, comment);
+                    });
+
+                REQUIRE(friends.size() == 1);
+                REQUIRE(friends[0].first == bob->GetAvatarId());
+                REQUIRE(friends[0].second == u"wingmate");
+            }
+
+            AND_WHEN("the friend's avatar is destroyed") {
+                auto bobId = bob->GetAvatarId();
+                avatarService.DestroyAvatar(bob);
+
+                THEN("the avatar and the rows referring to it are removed") {
+                    REQUIRE_FALSE(storage.FindAvatar(bobId));
+
+                    std::size_t friendCount = 0;
+                    storage.ForEachFriend(alice->GetAvatarId(),
+                        [&friendCount](const StoredAvatar&, const std::u16string&) { ++friendCount; });
+                    REQUIRE(friendCount == 0);
+                }
+            }
+        }
+
+        WHEN("a persistent message is stored") {
+            PersistentMessage message;
+            message.header.avatarId = bob->GetAvatarId();
+            message.header.fromName = u"alice";
+            message.header.subject = u"hello";
+            message.message = u"body";
+            messageService.StoreMessage(message);
+
+            THEN("it is listed and marked read once fetched") {
+                REQUIRE(message.header.messageId != 0);
+                REQUIRE(messageService.GetMessageHeaders(bob->GetAvatarId()).size() == 1);
+
+                auto fetched = messageService.GetPersistentMessage(bob->GetAvatarId(), message.header.messageId);
+                REQUIRE(fetched.message == u"body");
+                REQUIRE(fetched.header.status == PersistentState::NEW);
+                REQUIRE(storage.LoadMessage(bob->GetAvatarId(), message.header.messageId)->header.status
+                    == PersistentState::READ);
+            }
+
+            THEN("other avatars cannot fetch it") {
+                REQUIRE_THROWS_AS(messageService.GetPersistentMessage(alice->GetAvatarId(), message.header.messageId),
+                    ChatResultException);
+            }
+
+            AND_WHEN("it is moved to the trash") {
+                messageService.UpdateMessageStatus(
+                    bob->GetAvatarId(), message.header.messageId, PersistentState::TRASH);
+
+                THEN("it is no longer listed") {
+                    REQUIRE(messageService.GetMessageHeaders(bob->GetAvatarId()).empty());
+                }
+            }
+        }
+    }
+}
+
+SCENARIO("in-memory room storage filters by address", "[storage]") {
+    GIVEN("rooms under two base addresses with role members") {
+        InMemoryChatStorage storage;
+
+        StoredAvatar moderator;
+        moderator.name = u"mod";
+        moderator.address = u"SWG+Test+Alpha";
+        auto moderatorId = storage.InsertAvatar(moderator);
+
+        StoredRoom alphaRoom;
+        alphaRoom.roomAddress = u"SWG+Test+Alpha+general";
+        auto alphaId = storage.InsertRoom(alphaRoom);
+
+        StoredRoom betaRoom;
+        betaRoom.roomAddress = u"SWG+Test+Beta+general";
+        auto betaId = storage.InsertRoom(betaRoom);
+
+        storage.InsertRoomMember(alphaId, RoomRole::MODERATOR, moderatorId);
+        storage.InsertRoomMember(alphaId, RoomRole::MODERATOR, moderatorId);
+        storage.InsertRoomMember(betaId, RoomRole::MODERATOR, moderatorId);
+
+        THEN("only rooms and members under the requested address are visited") {
+            std::vector<uint32_t> rooms;
+            storage.ForEachRoom(u"SWG+Test+Alpha", [&rooms](const StoredRoom& room) { rooms.push_back(room.dbId); });
+
+            std::vector<uint32_t> memberRooms;
+            storage.ForEachRoomMember(u"SWG+Test+Alpha", RoomRole::MODERATOR,
+                [&memberRooms](uint32_t roomDbId, const StoredAvatar&) { memberRooms.push_back(roomDbId); });
+
+            REQUIRE(rooms == std::vector<uint32_t>{alphaId});
+            REQUIRE(memberRooms == std::vector<uint32_t>{alphaId});
+        }
+
+        WHEN("a room is deleted") {
+            storage.DeleteRoom(alphaId);
+
+            THEN("its role members go with it") {
+                std::size_t members = 0;
+                storage.ForEachRoomMember(
+                    u"SWG+Test", RoomRole::MODERATOR, [&members](uint32_t, const StoredAvatar&) { ++members; });
+                REQUIRE(members == 1);
+            }
+        }
+    }
+}
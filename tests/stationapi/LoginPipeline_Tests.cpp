@@ -0,0 +1,178 @@
+#include "catch.hpp"
+
+#include "stationchat/ChatAvatar.hpp"
+#include "stationchat/ChatAvatarService.hpp"
+#include "stationchat/DatabaseExecutor.hpp"
+#include "stationchat/GatewayNode.hpp"
+#include "stationchat/LoginPipeline.hpp"
+#include "stationchat/StationChatConfig.hpp"
+#include "stationchat/WebsiteIntegrationService.hpp"
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+
+LoginRequest MakeLogin(const std::u16string& name) {
+    LoginRequest login;
+    login.name = name;
+    login.address = u"SWG+test+server";
+    login.userId = 1;
+    return login;
+}
+
+StationChatConfig MakeConfig(uint16_t port) {
+    StationChatConfig config;
+    config.storageBackend = "memory";
+    config.gatewayAddress = "127.0.0.1";
+    config.gatewayPort = port;
+    return config;
+}
+
+/** Stands in for a website database that rejects every login it records.
+ */
+class FailingWebsiteIntegration : public WebsiteIntegrationService {
+public:
+    explicit FailingWebsiteIntegration(const StationChatConfig& config)
+        : WebsiteIntegrationService{nullptr, config} {}
+
+    bool IsEnabled() const override { return true; }
+
+    void RecordAvatarLogins(MariaDBConnection*, const std::vector<const ChatAvatar*>&) override {
+        throw std::runtime_error{"website database unavailable"};
+    }
+};
+
+class IntegratedGateway : public GatewayNode {
+public:
+    using GatewayNode::GatewayNode;
+    using GatewayNode::SetWebsiteIntegrationService;
+};
+
+} // namespace
+
+SCENARIO("logins queue behind the concurrency bound and share lookups", "[login]") {
+    auto config = MakeConfig(45132);
+    GatewayNode gateway{config};
+
+    auto& pipeline = gateway.GetLoginPipeline();
+    auto& executor = gateway.GetDatabaseExecutor();
+    pipeline.SetLimits(2, 64);
+
+    std::vector<ChatAvatar*> alphas;
+    ChatAvatar* beta = nullptr;
+
+    auto collect = [&alphas](ChatAvatar* avatar, std::exception_ptr error) {
+        REQUIRE(error == nullptr);
+        alphas.push_back(avatar);
+    };
+
+    pipeline.Submit(MakeLogin(u"alpha"), collect);
+    pipeline.Submit(MakeLogin(u"alpha"), collect);
+    pipeline.Submit(MakeLogin(u"beta"), [&beta](ChatAvatar* avatar, std::exception_ptr) { beta = avatar; });
+
+    pipeline.Pump();
+    REQUIRE(pipeline.GetInFlightCount() == 2);
+    REQUIRE(pipeline.GetQueuedCount() == 1);
+
+    // The second login for alpha waits for the first one's lookup, so the new
+    // avatar is only created once.
+    executor.RunCompletions();
+    REQUIRE(alphas.size() == 1);
+    REQUIRE(pipeline.GetInFlightCount() == 1);
+
+    pipeline.Pump();
+    REQUIRE(alphas.size() == 2);
+    REQUIRE(pipeline.GetQueuedCount() == 0);
+
+    executor.RunCompletions();
+    REQUIRE(beta != nullptr);
+    REQUIRE(pipeline.GetInFlightCount() == 0);
+
+    REQUIRE(alphas[0] == alphas[1]);
+    REQUIRE(alphas[0]->IsOnline());
+    REQUIRE(beta->IsOnline());
+    REQUIRE(beta != alphas[0]);
+}
+
+SCENARIO("a login for an avatar that is not cached loads its contacts", "[login]") {
+    auto config = MakeConfig(45133);
+    GatewayNode gateway{config};
+
+    auto avatarService = gateway.GetAvatarService();
+    auto& pipeline = gateway.GetLoginPipeline();
+    auto& executor = gateway.GetDatabaseExecutor();
+
+    auto avatar = avatarService->CreateAvatar(u"gamma", u"SWG+test+server", 1, 0, u"");
+    auto avatarId = avatar->GetAvatarId();
+    auto friendAvatar = avatarService->CreateAvatar(u"delta", u"SWG+test+server", 2, 0, u"");
+    avatarService->PersistFriend(avatarId, friendAvatar->GetAvatarId(), u"comment");
+
+    // Evicting the least recently used avatar drops gamma from the cache.
+    avatarService->SetCacheLimits(1, 0);
+    avatarService->RefreshCacheUsage();
+    REQUIRE(avatarService->EvictIdleAvatars({}) == 1);
+    REQUIRE(avatarService->GetCachedAvatar(avatarId) == nullptr);
+
+    ChatAvatar* loggedIn = nullptr;
+    pipeline.Submit(MakeLogin(u"gamma"), [&loggedIn](ChatAvatar* avatar, std::exception_ptr) { loggedIn = avatar; });
+
+    pipeline.Pump();
+
+    WHEN("the avatar is resolved") {
+        executor.RunCompletions();
+
+        THEN("its contact list is loaded before it is published") {
+            REQUIRE(loggedIn == nullptr);
+
+            std::unordered_set<const ChatAvatar*> pinned;
+            pipeline.CollectReferencedAvatars(pinned);
+            REQUIRE(pinned.size() == 1);
+
+            executor.RunCompletions();
+
+            REQUIRE(loggedIn != nullptr);
+            REQUIRE(loggedIn->GetAvatarId() == avatarId);
+            REQUIRE(loggedIn->IsOnline());
+            REQUIRE(loggedIn->GetFriendList().size() == 1);
+            REQUIRE(loggedIn->GetFriendList()[0].frnd == friendAvatar);
+        }
+    }
+}
+
+SCENARIO("logins the website integration fails to record are left offline", "[login]") {
+    auto config = MakeConfig(45136);
+    IntegratedGateway gateway{config};
+    gateway.SetWebsiteIntegrationService(std::make_unique<FailingWebsiteIntegration>(config));
+
+    auto avatarService = gateway.GetAvatarService();
+    auto& pipeline = gateway.GetLoginPipeline();
+    auto& executor = gateway.GetDatabaseExecutor();
+
+    std::vector<std::exception_ptr> errors;
+    auto collect = [&errors](ChatAvatar* avatar, std::exception_ptr error) {
+        REQUIRE(avatar == nullptr);
+        errors.push_back(error);
+    };
+
+    pipeline.Submit(MakeLogin(u"alpha"), collect);
+    pipeline.Submit(MakeLogin(u"beta"), collect);
+
+    pipeline.Pump();
+    executor.RunCompletions();
+
+    // The website records the batch on the executor too, after the contacts.
+    REQUIRE(errors.empty());
+    REQUIRE(pipeline.GetInFlightCount() == 2);
+
+    executor.RunCompletions();
+
+    REQUIRE(errors.size() == 2);
+    REQUIRE(errors[0] != nullptr);
+    REQUIRE(errors[1] != nullptr);
+    REQUIRE(pipeline.GetInFlightCount() == 0);
+    REQUIRE(avatarService->GetOnlineAvatars().empty());
+}
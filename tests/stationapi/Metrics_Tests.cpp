@@ -0,0 +1,137 @@
+#include "catch.hpp"
+
+#include "Metrics.hpp"
+#include "MetricsServer.hpp"
+
+#include <boost/asio.hpp>
+
+#include <atomic>
+#include <limits>
+#include <string>
+
+namespace {
+
+std::string Request(uint16_t port, const std::string& request) {
+    boost::asio::io_context ioContext;
+    boost::asio::ip::tcp::socket socket{ioContext};
+    socket.connect({boost::asio::ip::make_address("127.0.0.1"), port});
+    boost::asio::write(socket, boost::asio::buffer(request));
+
+    std::string response;
+    boost::system::error_code error;
+    char buffer[4096];
+    while (auto length = socket.read_some(boost::asio::buffer(buffer), error)) {
+        response.append(buffer, length);
+    }
+
+    return response;
+}
+
+} // namespace
+
+SCENARIO("histogram values are bucketed log-linearly", "[metrics]") {
+    GIVEN("values around bucket boundaries") {
+        THEN("small values are recorded exactly") {
+            REQUIRE(MetricHistogram::BucketFor(0) == 0);
+            REQUIRE(MetricHistogram::BucketFor(1) == 1);
+            REQUIRE(MetricHistogram::BucketUpperBound(0) == 0);
+            REQUIRE(MetricHistogram::BucketUpperBound(1) == 1);
+        }
+
+        THEN("every value falls in a bucket whose bounds contain it") {
+            for (uint64_t value : {2ull, 3ull, 4ull, 5ull, 6ull, 7ull, 8ull, 1000ull, 1024ull, 1025ull, 65535ull}) {
+                auto bucket = MetricHistogram::BucketFor(value);
+                REQUIRE(value <= MetricHistogram::BucketUpperBound(bucket));
+                REQUIRE(value > MetricHistogram::BucketUpperBound(bucket - 1));
+            }
+        }
+
+        THEN("each power of two is split into sub-buckets") {
+            REQUIRE(MetricHistogram::BucketFor(4) == MetricHistogram::BucketFor(5));
+            REQUIRE(MetricHistogram::BucketFor(6) == MetricHistogram::BucketFor(5) + 1);
+        }
+
+        THEN("values past the largest magnitude land in the overflow bucket") {
+            auto overflow = MetricHistogram::kBoundedBuckets;
+            REQUIRE(MetricHistogram::BucketFor(std::numeric_limits<uint64_t>::max()) == overflow);
+            REQUIRE(MetricHistogram::BucketUpperBound(overflow) == std::numeric_limits<uint64_t>::max());
+        }
+    }
+}
+
+SCENARIO("metrics registries export in the Prometheus text format", "[metrics]") {
+    GIVEN("a registry with one metric of each type") {
+        MetricsRegistry registry;
+
+        auto& counter = registry.Counter("test_requests_total", "Requests", "type=\"a\"");
+        auto& gauge = registry.Gauge("test_clients", "Clients");
+        auto& histogram = registry.Histogram("test_duration", "Duration");
+
+        counter.Increment(3);
+        gauge.Set(7);
+        histogram.Observe(5);
+
+        THEN("registering the same series again returns the existing metric") {
+            REQUIRE(&registry.Counter("test_requests_total", "Requests", "type=\"a\"") == &counter);
+            REQUIRE(&registry.Counter("test_requests_total", "Requests", "type=\"b\"") != &counter);
+        }
+
+        WHEN("the registry is rendered") {
+            auto text = registry.RenderPrometheus();
+
+            THEN("every series is present with its current value") {
+                REQUIRE(text.find("# TYPE test_requests_total counter\n") != std::string::npos);
+                REQUIRE(text.find("test_requests_total{type=\"a\"} 3\n") != std::string::npos);
+                REQUIRE(text.find("test_clients 7\n") != std::string::npos);
+                REQUIRE(text.find("test_duration_bucket{le=\"3\"} 0\n") != std::string::npos);
+                REQUIRE(text.find("test_duration_bucket{le=\"5\"} 1\n") != std::string::npos);
+                REQUIRE(text.find("test_duration_bucket{le=\"+Inf\"} 1\n") != std::string::npos);
+                REQUIRE(text.find("test_duration_sum 5\n") != std::string::npos);
+                REQUIRE(text.find("test_duration_count 1\n") != std::string::npos);
+            }
+        }
+    }
+}
+
+SCENARIO("the metrics server answers scrapes and reload requests", "[metrics]") {
+    MetricsRegistry registry;
+    registry.Gauge("test_clients", "Clients").Set(3);
+
+    std::atomic<int> reloads{0};
+
+    GIVEN("a server with a reload handler") {
+        MetricsServer server{registry, "127.0.0.1", 0, [&reloads]() { ++reloads; }};
+
+        WHEN("the reload endpoint is posted to") {
+            auto response = Request(server.GetPort(), "POST /-/reload HTTP/1.0\r\n\r\n");
+
+            THEN("the handler runs and the request is accepted") {
+                REQUIRE(response.compare(0, 21, "HTTP/1.0 202 Accepted") == 0);
+                REQUIRE(reloads == 1);
+            }
+        }
+
+        WHEN("any other path is requested") {
+            auto response = Request(server.GetPort(), "GET /metrics HTTP/1.0\r\n\r\n");
+
+            THEN("the metrics are returned and no reload is requested") {
+                REQUIRE(response.compare(0, 15, "HTTP/1.0 200 OK") == 0);
+                REQUIRE(response.find("test_clients 3\n") != std::string::npos);
+                REQUIRE(reloads == 0);
+            }
+        }
+    }
+
+    GIVEN("a server without a reload handler") {
+        MetricsServer server{registry, "127.0.0.1", 0};
+
+        WHEN("the reload endpoint is posted to") {
+            auto response = Request(server.GetPort(), "POST /-/reload HTTP/1.0\r\n\r\n");
+
+            THEN("it is served the metrics like any other request") {
+                REQUIRE(response.compare(0, 15, "HTTP/1.0 200 OK") == 0);
+                REQUIRE(response.find("test_clients 3\n") != std::string::npos);
+            }
+        }
+    }
+}
@@ -0,0 +1,255 @@
+#include "catch.hpp"
+
+#include "Serialization.hpp"
+#include "NodeClient.hpp"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+class TestClient : public NodeClient {
+public:
+    explicit TestClient(UdpConnection* connection)
+        : NodeClient(connection) {
+        connection->SetHandler(this);
+    }
+
+private:
+    void OnIncoming(std::istringstream& istream) override {}
+};
+
+/** Accepts loopback connections and records every packet they receive.
+ */
+class PacketRecorder : public UdpManagerHandler, public UdpConnectionHandler {
+public:
+    explicit PacketRecorder(uint16_t port) {
+        UdpManager::Params params;
+        params.handler = this;
+        params.port = port;
+        manager_ = new UdpManager(&params);
+    }
+
+    ~PacketRecorder() {
+        if (accepted_) {
+            accepted_->SetHandler(nullptr);
+            accepted_->Release();
+        }
+
+        manager_->Release();
+    }
+
+    void Tick() { manager_->GiveTime(); }
+
+    std::vector<std::string> packets;
+
+private:
+    void OnConnectRequest(UdpConnection* connection) override {
+        connection->AddRef();
+        connection->SetHandler(this);
+        accepted_ = connection;
+    }
+
+    void OnRoutePacket(UdpConnection*, const uchar* data, int length) override {
+        packets.emplace_back(reinterpret_cast<const char*>(data), static_cast<std::size_t>(length));
+    }
+
+    UdpManager* manager_;
+    UdpConnection* accepted_ = nullptr;
+};
+
+std::vector<uint32_t> ReadRecords(const std::string& packet) {
+    std::vector<uint32_t> values;
+    std::size_t offset = 0;
+    while (offset + sizeof(uint32_t) <= packet.size()) {
+        uint32_t length = 0;
+        std::memcpy(&length, packet.data() + offset, sizeof(length));
+        offset += sizeof(length);
+
+        REQUIRE(length == sizeof(uint32_t));
+        REQUIRE(offset + length <= packet.size());
+
+        uint32_t value = 0;
+        std::memcpy(&value, packet.data() + offset, sizeof(value));
+        offset += length;
+        values.push_back(value);
+    }
+
+    REQUIRE(offset == packet.size());
+    return values;
+}
+
+} // namespace
+
+SCENARIO("deferrable messages are held back while a peer is congested", "[nodeclient]") {
+    GIVEN("a client with send queue limits") {
+        auto connection = new UdpConnection();
+
+        SendQueueLimits limits;
+        limits.highWatermarkBytes = 1000;
+        limits.lowWatermarkBytes = 100;
+        limits.maxDeferredMessages = 2;
+
+        {
+            TestClient client{connection};
+            client.SetSendQueueLimits(limits);
+
+            WHEN("the backlog stays below the high watermark") {
+                connection->SimulatePendingBytes(500);
+                client.Send(uint32_t{1}, SendPriority::DEFERRABLE);
+
+                THEN("deferrable messages are sent immediately") {
+                    REQUIRE_FALSE(client.IsCongested());
+                    REQUIRE(client.GetDeferredCount() == 0);
+                }
+            }
+
+            WHEN("the backlog reaches the high watermark") {
+                connection->SimulatePendingBytes(1000);
+                client.Send(uint32_t{1});
+
+                THEN("the connection is congested") {
+                    REQUIRE(client.IsCongested());
+                    REQUIRE(client.GetCongestionCount() == 1);
+                }
+
+                AND_WHEN("more deferrable messages are sent than the queue holds") {
+                    client.Send(uint32_t{2}, SendPriority::DEFERRABLE);
+                    client.Send(uint32_t{3}, SendPriority::DEFERRABLE);
+                    client.Send(uint32_t{4}, SendPriority::DEFERRABLE);
+
+                    THEN("the oldest deferred message is dropped") {
+                        REQUIRE(client.GetDeferredCount() == 2);
+                        REQUIRE(client.GetDeferredBytes() == 2 * sizeof(uint32_t));
+                        REQUIRE(client.GetDroppedCount() == 1);
+                    }
+                }
+
+                AND_WHEN("the backlog drains only part of the way") {
+                    client.Send(uint32_t{2}, SendPriority::DEFERRABLE);
+                    connection->SimulatePendingBytes(500);
+                    client.Flush();
+
+                    THEN("deferred messages are still held") {
+                        REQUIRE(client.IsCongested());
+                        REQUIRE(client.GetDeferredCount() == 1);
+                    }
+                }
+
+                AND_WHEN("the backlog drains below the low watermark") {
+                    client.Send(uint32_t{2}, SendPriority::DEFERRABLE);
+                    connection->SimulatePendingBytes(0);
+                    client.Flush();
+
+                    THEN("deferred messages are released") {
+                        REQUIRE_FALSE(client.IsCongested());
+                        REQUIRE(client.GetDeferredCount() == 0);
+                    }
+                }
+            }
+        }
+
+        connection->Release();
+    }
+}
+
+SCENARIO("peers that stop reading are disconnected", "[nodeclient]") {
+    GIVEN("a client with a disconnect limit") {
+        auto connection = new UdpConnection();
+
+        SendQueueLimits limits;
+        limits.disconnectBytes = 4096;
+
+        {
+            TestClient client{connection};
+            client.SetSendQueueLimits(limits);
+
+            WHEN("the backlog reaches the limit") {
+                connection->SimulatePendingBytes(4096);
+                client.Send(uint32_t{1});
+
+                THEN("the connection is dropped") {
+                    REQUIRE(connection->GetStatus() == UdpConnection::cStatusDisconnected);
+                }
+            }
+        }
+
+        connection->Release();
+    }
+}
+
+SCENARIO("batching packs messages into length-prefixed records", "[nodeclient]") {
+    GIVEN("a batching client connected to a recording peer") {
+        PacketRecorder peer{45141};
+
+        UdpManager::Params params;
+        auto manager = new UdpManager(&params);
+        auto connection = manager->EstablishConnection("127.0.0.1", 45141);
+
+        {
+            TestClient client{connection};
+            client.EnableBatching(20);
+
+            WHEN("messages fit in one packet") {
+                client.Send(uint32_t{1});
+                client.Send(uint32_t{2});
+
+                THEN("they wait for a flush and go out as one packet of records") {
+                    REQUIRE(client.GetQueuedBytes() == 2 * (sizeof(uint32_t) + sizeof(uint32_t)));
+
+                    peer.Tick();
+                    REQUIRE(peer.packets.empty());
+
+                    client.Flush();
+                    peer.Tick();
+
+                    REQUIRE(peer.packets.size() == 1);
+                    REQUIRE(ReadRecords(peer.packets[0]) == (std::vector<uint32_t>{1, 2}));
+                    REQUIRE(client.GetQueuedBytes() == 0);
+                }
+            }
+
+            WHEN("a message would take the batch past the packet size") {
+                client.Send(uint32_t{1});
+                client.Send(uint32_t{2});
+                client.Send(uint32_t{3});
+                client.Flush();
+                peer.Tick();
+
+                THEN("the open batch is sent first and the message starts the next one") {
+                    REQUIRE(peer.packets.size() == 2);
+                    REQUIRE(ReadRecords(peer.packets[0]) == (std::vector<uint32_t>{1, 2}));
+                    REQUIRE(ReadRecords(peer.packets[1]) == (std::vector<uint32_t>{3}));
+                }
+            }
+
+            WHEN("a message is larger than the packet size") {
+                client.EnableBatching(6);
+                client.Send(uint32_t{7});
+                peer.Tick();
+
+                THEN("it is sent at once, alone in its batch") {
+                    REQUIRE(peer.packets.size() == 1);
+                    REQUIRE(ReadRecords(peer.packets[0]) == (std::vector<uint32_t>{7}));
+                }
+            }
+
+            WHEN("batching is turned off with messages queued") {
+                client.Send(uint32_t{1});
+                client.EnableBatching(0);
+                client.Send(uint32_t{2});
+                peer.Tick();
+
+                THEN("the open batch is flushed and later messages go out unframed") {
+                    REQUIRE(peer.packets.size() == 2);
+                    REQUIRE(ReadRecords(peer.packets[0]) == (std::vector<uint32_t>{1}));
+                    REQUIRE(peer.packets[1].size() == sizeof(uint32_t));
+                }
+            }
+        }
+
+        connection->Release();
+        manager->Release();
+    }
+}
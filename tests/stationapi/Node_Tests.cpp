@@ -0,0 +1,81 @@
+#include "catch.hpp"
+
+#include "Node.hpp"
+#include "NodeClient.hpp"
+
+#include <vector>
+
+namespace {
+
+class TestNode;
+
+class TestClient : public NodeClient {
+public:
+    TestClient(UdpConnection* connection, TestNode* node)
+        : NodeClient(connection) {
+        connection->SetHandler(this);
+    }
+
+private:
+    void OnIncoming(std::istringstream& istream) override {}
+};
+
+class TestNode : public Node<TestNode, TestClient> {
+public:
+    TestNode()
+        : Node(this, "127.0.0.1", 0) {}
+
+    std::vector<TestClient*> disconnected;
+
+private:
+    void OnTick() override {}
+    void OnClientDisconnected(TestClient* client) override { disconnected.push_back(client); }
+};
+
+} // namespace
+
+SCENARIO("nodes reap clients when their connection terminates", "[node]") {
+    GIVEN("a node with two connected clients") {
+        TestNode node;
+
+        UdpManager::Params params{};
+        params.handler = &node;
+        auto manager = new UdpManager(&params);
+
+        auto first = manager->CreateConnection();
+        auto second = manager->CreateConnection();
+
+        node.Tick();
+        REQUIRE(node.GetClientCount() == 2);
+
+        WHEN("one connection is terminated") {
+            first->Disconnect();
+
+            THEN("the client is kept until the next tick") {
+                REQUIRE(node.GetClientCount() == 2);
+            }
+
+            AND_WHEN("the node ticks") {
+                node.Tick();
+
+                THEN("only the terminated client is reaped") {
+                    REQUIRE(node.GetClientCount() == 1);
+                    REQUIRE(node.disconnected.size() == 1);
+                }
+
+                AND_WHEN("the node ticks again") {
+                    node.Tick();
+
+                    THEN("no further clients are reaped") {
+                        REQUIRE(node.GetClientCount() == 1);
+                        REQUIRE(node.disconnected.size() == 1);
+                    }
+                }
+            }
+        }
+
+        first->Release();
+        second->Release();
+        manager->Release();
+    }
+}
@@ -0,0 +1,71 @@
+#include "catch.hpp"
+
+#include "PacketCapture.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+SCENARIO("captured packets can be read back", "[capture]") {
+    GIVEN("a capture of two packets") {
+        std::string path = "packet_capture_test.bin";
+        const unsigned char first[] = {0x01, 0x00, 0xAA};
+        const unsigned char second[] = {0x05, 0x00, 0xBB, 0xCC};
+
+        PacketCapture capture;
+        capture.Start(path);
+        capture.Record(CaptureSource::GATEWAY, 7, first, sizeof(first));
+        capture.Record(CaptureSource::REGISTRAR, 9, second, sizeof(second));
+        capture.Stop();
+
+        THEN("the reader returns them in order with their connection ids") {
+            PacketCaptureReader reader{path};
+            CapturedPacket packet;
+
+            REQUIRE(reader.Next(packet));
+            REQUIRE(packet.connectionId == 7);
+            REQUIRE(packet.source == CaptureSource::GATEWAY);
+            REQUIRE(packet.data == std::vector<unsigned char>(std::begin(first), std::end(first)));
+
+            auto firstTimestamp = packet.timestamp;
+
+            REQUIRE(reader.Next(packet));
+            REQUIRE(packet.connectionId == 9);
+            REQUIRE(packet.source == CaptureSource::REGISTRAR);
+            REQUIRE(packet.data.size() == sizeof(second));
+            REQUIRE(packet.timestamp >= firstTimestamp);
+
+            REQUIRE_FALSE(reader.Next(packet));
+        }
+
+        WHEN("the capture has a size limit") {
+            PacketCapture limited;
+            limited.Start(path, 32);
+            limited.Record(CaptureSource::GATEWAY, 1, second, sizeof(second));
+            limited.Record(CaptureSource::GATEWAY, 1, second, sizeof(second));
+
+            THEN("capturing stops before the limit is exceeded") {
+                REQUIRE_FALSE(limited.IsCapturing());
+                REQUIRE(limited.GetBytesWritten() <= 32);
+
+                PacketCaptureReader reader{path};
+                CapturedPacket packet;
+                REQUIRE(reader.Next(packet));
+                REQUIRE_FALSE(reader.Next(packet));
+            }
+        }
+
+        std::remove(path.c_str());
+    }
+
+    GIVEN("a file that is not a capture") {
+        std::string path = "packet_capture_invalid.bin";
+        std::ofstream{path} << "not a capture";
+
+        THEN("the reader rejects it") {
+            REQUIRE_THROWS(PacketCaptureReader{path});
+        }
+
+        std::remove(path.c_str());
+    }
+}
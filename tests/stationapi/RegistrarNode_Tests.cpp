@@ -0,0 +1,401 @@
+#include "catch.hpp"
+
+#include "stationchat/RegistrarNode.hpp"
+
+#include <chrono>
+#include <array>
+#include <atomic>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+StationChatConfig MakeClusterConfig(std::vector<GatewayClusterEndpoint> cluster) {
+    StationChatConfig config;
+    config.registrarAddress = "127.0.0.1";
+    config.registrarPort = 0;
+    config.gatewayAddress = "10.0.0.1";
+    config.gatewayPort = 5001;
+    config.gatewayCluster = std::move(cluster);
+    return config;
+}
+
+GatewayLoadReport MakeLoadReport(const std::string& address, uint32_t onlineAvatars) {
+    GatewayLoadReport report;
+    report.address = address;
+    report.port = 5001;
+    report.onlineAvatars = onlineAvatars;
+    return report;
+}
+
+} // namespace
+
+SCENARIO("the registrar spreads logins over the cluster by weight", "[registrar]") {
+    GIVEN("a cluster weighted 1:2:1000") {
+        auto config = MakeClusterConfig({{"10.0.0.1", 5001, 1}, {"10.0.0.2", 5001, 2}, {"10.0.0.3", 5001, 1000}});
+        RegistrarNode node{config};
+
+        WHEN("one full round of selections is made") {
+            std::map<std::string, int> picks;
+            for (int i = 0; i < 1003; ++i) {
+                ++picks[node.SelectGatewayEndpoint().address];
+            }
+
+            THEN("every endpoint is picked exactly its weight") {
+                REQUIRE(picks["10.0.0.1"] == 1);
+                REQUIRE(picks["10.0.0.2"] == 2);
+                REQUIRE(picks["10.0.0.3"] == 1000);
+            }
+        }
+    }
+
+    GIVEN("a cluster selected from several threads at once") {
+        auto config = MakeClusterConfig({{"10.0.0.1", 5001, 1}, {"10.0.0.2", 5001, 2}, {"10.0.0.3", 5001, 1000}});
+        RegistrarNode node{config};
+
+        THEN("whole rounds still honor the weights exactly") {
+            std::array<std::atomic<int>, 3> picks{};
+            std::vector<std::thread> threads;
+            for (int thread = 0; thread < 4; ++thread) {
+                threads.emplace_back([&node, &picks]() {
+                    for (int i = 0; i < 1003; ++i) {
+                        auto address = node.SelectGatewayEndpoint().address;
+                        ++picks[address.back() - '1'];
+                    }
+                });
+            }
+
+            for (auto& thread : threads) {
+                thread.join();
+            }
+
+            REQUIRE(picks[0] == 4);
+            REQUIRE(picks[1] == 8);
+            REQUIRE(picks[2] == 4000);
+        }
+    }
+
+    GIVEN("a cluster weighted 1:2") {
+        auto config = MakeClusterConfig({{"10.0.0.1", 5001, 1}, {"10.0.0.2", 5001, 2}});
+        RegistrarNode node{config};
+
+        THEN("selections are interleaved rather than bursty") {
+            std::vector<std::string> sequence;
+            for (int i = 0; i < 6; ++i) {
+                sequence.push_back(node.SelectGatewayEndpoint().address);
+            }
+
+            std::vector<std::string> expected{"10.0.0.2", "10.0.0.1", "10.0.0.2", "10.0.0.2", "10.0.0.1", "10.0.0.2"};
+            REQUIRE(sequence == expected);
+        }
+
+        WHEN("an endpoint fails") {
+            node.ReportGatewayFailure("10.0.0.2", 5001);
+
+            THEN("it is skipped until it recovers") {
+                for (int i = 0; i < 4; ++i) {
+                    REQUIRE(node.SelectGatewayEndpoint().address == "10.0.0.1");
+                }
+            }
+
+            THEN("a preferred endpoint that is blacklisted is not honored") {
+                REQUIRE(node.SelectGatewayEndpoint("10.0.0.2", 5001).address == "10.0.0.1");
+            }
+        }
+
+        WHEN("every endpoint fails") {
+            node.ReportGatewayFailure("10.0.0.1", 5001);
+            node.ReportGatewayFailure("10.0.0.2", 5001);
+
+            THEN("an endpoint is still handed out") {
+                REQUIRE_FALSE(node.SelectGatewayEndpoint().address.empty());
+            }
+        }
+    }
+}
+
+SCENARIO("the registrar can place logins by reported gateway load", "[registrar]") {
+    GIVEN("an equally weighted cluster selecting the least loaded gateway") {
+        auto config = MakeClusterConfig({{"10.0.0.1", 5001, 1}, {"10.0.0.2", 5001, 1}, {"10.0.0.3", 5001, 1}});
+        config.gatewaySelection = "least_loaded";
+        RegistrarNode node{config};
+
+        WHEN("every gateway has reported recently") {
+            node.ReportGatewayLoad(MakeLoadReport("10.0.0.1", 300));
+            node.ReportGatewayLoad(MakeLoadReport("10.0.0.2", 100));
+            node.ReportGatewayLoad(MakeLoadReport("10.0.0.3", 102));
+
+            THEN("logins go to the lightest gateway until it catches up") {
+                std::vector<std::string> sequence;
+                for (int i = 0; i < 4; ++i) {
+                    sequence.push_back(node.SelectGatewayEndpoint().address);
+                }
+
+                std::vector<std::string> expected{"10.0.0.2", "10.0.0.2", "10.0.0.2", "10.0.0.3"};
+                REQUIRE(sequence == expected);
+            }
+        }
+
+        WHEN("one gateway's report is stale") {
+            auto longAgo = std::chrono::steady_clock::now() - std::chrono::minutes(5);
+            node.ReportGatewayLoad(MakeLoadReport("10.0.0.1", 0), longAgo);
+            node.ReportGatewayLoad(MakeLoadReport("10.0.0.2", 100));
+            node.ReportGatewayLoad(MakeLoadReport("10.0.0.3", 100));
+
+            THEN("selection falls back to the weights") {
+                std::map<std::string, int> picks;
+                for (int i = 0; i < 3; ++i) {
+                    ++picks[node.SelectGatewayEndpoint().address];
+                }
+
+                REQUIRE(picks.size() == 3);
+            }
+        }
+    }
+
+    GIVEN("a cluster using power of two choices") {
+        auto config = MakeClusterConfig({{"10.0.0.1", 5001, 1}, {"10.0.0.2", 5001, 1}, {"10.0.0.3", 5001, 1}});
+        config.gatewaySelection = "power_of_two";
+        RegistrarNode node{config};
+
+        node.ReportGatewayLoad(MakeLoadReport("10.0.0.1", 10000));
+        node.ReportGatewayLoad(MakeLoadReport("10.0.0.2", 10));
+        node.ReportGatewayLoad(MakeLoadReport("10.0.0.3", 10));
+
+        THEN("the busiest gateway is never picked") {
+            for (int i = 0; i < 50; ++i) {
+                REQUIRE(node.SelectGatewayEndpoint().address != "10.0.0.1");
+            }
+        }
+    }
+
+    GIVEN("an unknown selection mode") {
+        auto config = MakeClusterConfig({});
+        config.gatewaySelection = "random";
+
+        THEN("the registrar refuses to start") {
+            REQUIRE_THROWS_AS(RegistrarNode{config}, std::runtime_error);
+        }
+    }
+}
+
+SCENARIO("probe results move gateways in and out of rotation", "[registrar]") {
+    GIVEN("an equally weighted cluster of two") {
+        auto config = MakeClusterConfig({{"10.0.0.1", 5001, 1}, {"10.0.0.2", 5001, 1}});
+        RegistrarNode node{config};
+
+        WHEN("one probe of a gateway fails") {
+            node.RecordProbeResult("10.0.0.2", 5001, false, std::chrono::microseconds{0});
+
+            THEN("it stays in rotation") {
+                std::map<std::string, int> picks;
+                for (int i = 0; i < 2; ++i) {
+                    ++picks[node.SelectGatewayEndpoint().address];
+                }
+
+                REQUIRE(picks["10.0.0.2"] == 1);
+            }
+        }
+
+        WHEN("consecutive probes of a gateway fail") {
+            node.RecordProbeResult("10.0.0.2", 5001, false, std::chrono::microseconds{0});
+            node.RecordProbeResult("10.0.0.2", 5001, false, std::chrono::microseconds{0});
+
+            THEN("it is taken out of rotation") {
+                for (int i = 0; i < 4; ++i) {
+                    REQUIRE(node.SelectGatewayEndpoint().address == "10.0.0.1");
+                }
+            }
+
+            AND_WHEN("it answers a probe again") {
+                node.RecordProbeResult("10.0.0.2", 5001, true, std::chrono::microseconds{800});
+
+                THEN("it is returned to rotation") {
+                    std::map<std::string, int> picks;
+                    for (int i = 0; i < 2; ++i) {
+                        ++picks[node.SelectGatewayEndpoint().address];
+                    }
+
+                    REQUIRE(picks["10.0.0.2"] == 1);
+                }
+            }
+        }
+
+        WHEN("a gateway's smoothed round trip is over the slow threshold") {
+            node.RecordProbeResult("10.0.0.1", 5001, true, std::chrono::microseconds{1000});
+            node.RecordProbeResult("10.0.0.2", 5001, true, std::chrono::milliseconds{900});
+
+            THEN("logins avoid it while a faster gateway is available") {
+                for (int i = 0; i < 4; ++i) {
+                    REQUIRE(node.SelectGatewayEndpoint().address == "10.0.0.1");
+                }
+            }
+        }
+    }
+}
+
+SCENARIO("a reconfigured registrar picks up the new cluster", "[registrar]") {
+    GIVEN("a cluster of two with one gateway out of rotation") {
+        auto config = MakeClusterConfig({{"10.0.0.1", 5001, 1}, {"10.0.0.2", 5001, 1}});
+        RegistrarNode node{config};
+
+        node.RecordProbeResult("10.0.0.2", 5001, false, std::chrono::microseconds{0});
+        node.RecordProbeResult("10.0.0.2", 5001, false, std::chrono::microseconds{0});
+
+        WHEN("a third gateway is added and the cluster reloaded") {
+            config.gatewayCluster.push_back({"10.0.0.3", 5001, 2});
+            node.Reconfigure();
+
+            THEN("logins are spread over the new cluster and the failed gateway stays out") {
+                std::map<std::string, int> picks;
+                for (int i = 0; i < 6; ++i) {
+                    ++picks[node.SelectGatewayEndpoint().address];
+                }
+
+                REQUIRE(picks["10.0.0.1"] == 2);
+                REQUIRE(picks["10.0.0.2"] == 0);
+                REQUIRE(picks["10.0.0.3"] == 4);
+            }
+        }
+
+        WHEN("the selection mode is changed to one that does not exist") {
+            config.gatewaySelection = "fastest";
+
+            THEN("reconfiguring fails") {
+                REQUIRE_THROWS_AS(node.Reconfigure(), std::runtime_error);
+            }
+        }
+    }
+}
+
+SCENARIO("affinity mode pins game servers to gateways on a hash ring", "[registrar]") {
+    const auto serverKey
+        = [](int server) { return "192.168." + std::to_string(server / 256) + "." + std::to_string(server % 256); };
+
+    GIVEN("a cluster weighted 1:3") {
+        auto config = MakeClusterConfig({{"10.0.0.1", 5001, 1}, {"10.0.0.2", 5001, 3}});
+        config.gatewaySelection = "affinity";
+        RegistrarNode node{config};
+
+        THEN("a game server always lands on the same gateway") {
+            auto first = node.SelectGatewayEndpoint({}, 0, "192.168.0.7").address;
+            for (int i = 0; i < 10; ++i) {
+                REQUIRE(node.SelectGatewayEndpoint({}, 0, "192.168.0.7").address == first);
+            }
+        }
+
+        THEN("game servers are shared out roughly by weight") {
+            std::map<std::string, int> picks;
+            for (int server = 0; server < 4000; ++server) {
+                ++picks[node.SelectGatewayEndpoint({}, 0, serverKey(server)).address];
+            }
+
+            REQUIRE(picks["10.0.0.1"] > 750);
+            REQUIRE(picks["10.0.0.1"] < 1250);
+        }
+
+        WHEN("a game server's gateway is taken out of rotation") {
+            auto owner = node.SelectGatewayEndpoint({}, 0, "192.168.0.7");
+            node.ReportGatewayFailure(owner.address, owner.port);
+
+            THEN("it moves while the gateway is out and returns afterwards") {
+                REQUIRE(node.SelectGatewayEndpoint({}, 0, "192.168.0.7").address != owner.address);
+
+                node.ReportGatewaySuccess(owner.address, owner.port);
+                REQUIRE(node.SelectGatewayEndpoint({}, 0, "192.168.0.7").address == owner.address);
+            }
+        }
+    }
+
+    GIVEN("the same cluster before and after a gateway joins") {
+        auto before = MakeClusterConfig({{"10.0.0.1", 5001, 1}, {"10.0.0.2", 5001, 1}, {"10.0.0.3", 5001, 1}});
+        before.gatewaySelection = "affinity";
+        auto after = before;
+        after.gatewayCluster.push_back({"10.0.0.4", 5001, 1});
+
+        RegistrarNode beforeNode{before};
+        RegistrarNode afterNode{after};
+
+        THEN("only about the new gateway's share moves, and all of it to the new gateway") {
+            int moved = 0;
+            int movedElsewhere = 0;
+            for (int server = 0; server < 4000; ++server) {
+                auto oldGateway = beforeNode.SelectGatewayEndpoint({}, 0, serverKey(server)).address;
+                auto newGateway = afterNode.SelectGatewayEndpoint({}, 0, serverKey(server)).address;
+                if (oldGateway != newGateway) {
+                    ++moved;
+                    movedElsewhere += newGateway != "10.0.0.4" ? 1 : 0;
+                }
+            }
+
+            REQUIRE(movedElsewhere == 0);
+            REQUIRE(moved > 600);
+            REQUIRE(moved < 1400);
+        }
+    }
+}
+
+SCENARIO("gateway load reports travel over UDP", "[registrar]") {
+    GIVEN("a listener on a loopback port and a publisher aimed at it") {
+        GatewayLoadListener listener{"127.0.0.1", 0};
+        listener.SetCluster({{"127.0.0.1", 5001, 1}, {"10.0.0.1", 5001, 1}});
+        GatewayLoadPublisher publisher{{{"127.0.0.1", 5001, 1}}, listener.GetPort()};
+
+        auto receive = [&listener]() {
+            std::vector<GatewayLoadReport> received;
+            for (int attempt = 0; attempt < 20; ++attempt) {
+                listener.Poll([&received](const GatewayLoadReport& report) { received.push_back(report); });
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+
+            return received;
+        };
+
+        WHEN("a report is published") {
+            GatewayLoadReport sent = MakeLoadReport("127.0.0.1", 42);
+            sent.connections = 3;
+            sent.queuedBytes = 1ull << 33;
+            sent.tickMicros = 1500;
+            publisher.Publish(sent);
+
+            THEN("the listener decodes it") {
+                auto received = receive();
+
+                REQUIRE(received.size() == 1);
+                REQUIRE(received[0].address == "127.0.0.1");
+                REQUIRE(received[0].port == 5001);
+                REQUIRE(received[0].onlineAvatars == 42);
+                REQUIRE(received[0].connections == 3);
+                REQUIRE(received[0].queuedBytes == sent.queuedBytes);
+                REQUIRE(received[0].tickMicros == 1500);
+            }
+        }
+
+        WHEN("a report names a gateway on another host") {
+            publisher.Publish(MakeLoadReport("10.0.0.1", 0));
+
+            THEN("it is dropped") {
+                REQUIRE(receive().empty());
+            }
+        }
+
+        WHEN("a report names a gateway outside the cluster") {
+            publisher.Publish(MakeLoadReport("127.0.0.2", 0));
+
+            THEN("it is dropped") {
+                REQUIRE(receive().empty());
+            }
+        }
+    }
+
+    THEN("datagrams that are not reports are rejected") {
+        GatewayLoadReport report;
+        auto datagram = EncodeGatewayLoadReport(MakeLoadReport("10.0.0.1", 1));
+
+        REQUIRE(DecodeGatewayLoadReport(datagram.data(), datagram.size(), report));
+        REQUIRE_FALSE(DecodeGatewayLoadReport(datagram.data(), datagram.size() - 1, report));
+        REQUIRE_FALSE(DecodeGatewayLoadReport("garbage", 7, report));
+    }
+}
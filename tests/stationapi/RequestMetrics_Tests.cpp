@@ -0,0 +1,36 @@
+#include "catch.hpp"
+
+#include "stationchat/RequestMetrics.hpp"
+
+SCENARIO("request metrics are tracked per request type", "[metrics]") {
+    GIVEN("request metrics backed by a registry") {
+        MetricsRegistry registry;
+        RequestMetrics metrics{registry};
+
+        THEN("request types are only registered once recorded") {
+            REQUIRE(metrics.Get(ChatRequestType::LOGINAVATAR) == nullptr);
+        }
+
+        WHEN("requests of one type are recorded") {
+            metrics.Record(ChatRequestType::LOGINAVATAR, false, std::chrono::microseconds{10});
+            metrics.Record(ChatRequestType::LOGINAVATAR, true, std::chrono::microseconds{20});
+
+            THEN("counts, errors and latencies are attributed to that type only") {
+                auto login = metrics.Get(ChatRequestType::LOGINAVATAR);
+                REQUIRE(login != nullptr);
+                REQUIRE(login->requests->Value() == 2);
+                REQUIRE(login->errors->Value() == 1);
+                REQUIRE(login->latency->Count() == 2);
+                REQUIRE(login->latency->Sum() == 30);
+
+                REQUIRE(metrics.Get(ChatRequestType::LOGOUTAVATAR) == nullptr);
+            }
+
+            THEN("the series are labelled with the request type name") {
+                auto text = registry.RenderPrometheus();
+                REQUIRE(text.find("stationchat_requests_total{type=\"LOGINAVATAR\"} 2\n") != std::string::npos);
+                REQUIRE(text.find("stationchat_request_errors_total{type=\"LOGINAVATAR\"} 1\n") != std::string::npos);
+            }
+        }
+    }
+}
@@ -0,0 +1,171 @@
+#include "catch.hpp"
+
+#include "UdpLibrary.hpp"
+
+#include "stationchat/GatewayClient.hpp"
+#include "stationchat/GatewayNode.hpp"
+#include "stationchat/StationChatApp.hpp"
+#include "stationchat/StationChatConfig.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+namespace {
+
+/** Exposes the timers and clients a reconfiguration touches.
+ */
+class ReconfigurableGateway : public GatewayNode {
+public:
+    using GatewayNode::GatewayNode;
+    using GatewayNode::ForEachClient;
+    using GatewayNode::GetTimers;
+};
+
+/** Reloads and ticks until the new settings are applied or rejected.
+ */
+bool ReloadAndWait(StationChatApp& app, const StationChatConfig& config) {
+    bool finished = false;
+    bool applied = false;
+    REQUIRE(app.Reload(config, [&](bool result) {
+        finished = true;
+        applied = result;
+    }));
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (!finished && std::chrono::steady_clock::now() < deadline) {
+        app.Tick();
+    }
+
+    REQUIRE(finished);
+    return applied;
+}
+
+} // namespace
+
+SCENARIO("a reload the nodes reject leaves the running configuration in place", "[reload]") {
+    StationChatConfig config;
+    config.storageBackend = "memory";
+    config.registrarAddress = "127.0.0.1";
+    config.registrarPort = 45150;
+    config.gatewayAddress = "127.0.0.1";
+    config.gatewayPort = 45151;
+    config.gatewayReplicationPortOffset = 1000;
+
+    StationChatApp app{config};
+    REQUIRE(app.GetConfig().gatewayCluster.size() == 1);
+
+    WHEN("a cluster gateway's replication port is out of range") {
+        auto reloaded = config;
+        reloaded.loginConcurrency = 7;
+        reloaded.gatewayCluster = {{"127.0.0.1", 65000, 1}};
+
+        THEN("the reload fails and the previous settings are kept") {
+            REQUIRE_FALSE(ReloadAndWait(app, reloaded));
+            REQUIRE(app.GetConfig().loginConcurrency == config.loginConcurrency);
+            REQUIRE(app.GetConfig().gatewayCluster.size() == 1);
+        }
+    }
+
+    WHEN("the new settings are valid") {
+        auto reloaded = config;
+        reloaded.loginConcurrency = 7;
+        reloaded.gatewayCluster = {{"127.0.0.1", 45152, 1}};
+
+        THEN("they are applied") {
+            REQUIRE(ReloadAndWait(app, reloaded));
+            REQUIRE(app.GetConfig().loginConcurrency == 7);
+            REQUIRE(app.GetConfig().gatewayCluster.size() == 2);
+        }
+
+        THEN("nothing changes until a tick after the hosts are resolved, and other reloads wait their turn") {
+            bool applied = false;
+            REQUIRE(app.Reload(reloaded, [&](bool result) { applied = result; }));
+            REQUIRE(app.IsReloadPending());
+            REQUIRE(app.GetConfig().loginConcurrency == config.loginConcurrency);
+            REQUIRE_FALSE(app.Reload(reloaded, [](bool) {}));
+
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+            while (app.IsReloadPending() && std::chrono::steady_clock::now() < deadline) {
+                app.Tick();
+            }
+
+            REQUIRE(applied);
+            REQUIRE(app.GetConfig().loginConcurrency == 7);
+        }
+    }
+}
+
+SCENARIO("reconfiguring a gateway reschedules its timers and updates connected clients", "[reload]") {
+    std::string snapshotFile = "reconfigure_test.snapshot";
+
+    StationChatConfig config;
+    config.storageBackend = "memory";
+    config.gatewayAddress = "127.0.0.1";
+    config.gatewayPort = 45153;
+    config.snapshotFile = snapshotFile;
+    config.snapshotIntervalSeconds = 300;
+
+    {
+        ReconfigurableGateway gateway{config};
+
+        UdpManager::Params params;
+        auto manager = new UdpManager(&params);
+        auto connection = manager->EstablishConnection("127.0.0.1", 45153);
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (gateway.GetClientCount() == 0 && std::chrono::steady_clock::now() < deadline) {
+            gateway.Tick();
+        }
+
+        REQUIRE(gateway.GetClientCount() == 1);
+
+        auto pendingTimers = gateway.GetTimers().GetPendingCount();
+
+        WHEN("the configuration is reapplied unchanged") {
+            gateway.Reconfigure();
+
+            THEN("timers are replaced rather than added") {
+                REQUIRE(gateway.GetTimers().GetPendingCount() == pendingTimers);
+            }
+        }
+
+        WHEN("periodic snapshots are turned off") {
+            config.snapshotIntervalSeconds = 0;
+            gateway.Reconfigure();
+
+            THEN("the snapshot timer is cancelled") {
+                REQUIRE(gateway.GetTimers().GetPendingCount() == pendingTimers - 1);
+            }
+
+            AND_WHEN("they are turned back on") {
+                config.snapshotIntervalSeconds = 60;
+                gateway.Reconfigure();
+
+                THEN("the snapshot timer is scheduled again") {
+                    REQUIRE(gateway.GetTimers().GetPendingCount() == pendingTimers);
+                }
+            }
+        }
+
+        WHEN("the send queue limits change") {
+            config.sendQueueHighWatermarkKb = 512;
+            config.sendQueueDisconnectKb = 4096;
+            gateway.Reconfigure();
+
+            THEN("connected game servers use the new limits") {
+                gateway.ForEachClient([](GatewayClient* client) {
+                    REQUIRE(client->GetSendQueueLimits().highWatermarkBytes == 512 * 1024);
+                    REQUIRE(client->GetSendQueueLimits().disconnectBytes == 4096 * 1024);
+                });
+            }
+        }
+
+        connection->Disconnect();
+        connection->Release();
+        manager->Release();
+        gateway.Tick();
+    }
+
+    std::remove(snapshotFile.c_str());
+}
@@ -0,0 +1,84 @@
+#include "catch.hpp"
+
+#include "stationchat/StationChatConfig.hpp"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace {
+
+bool Contains(const std::vector<std::string>& names, const std::string& name) {
+    return std::find(std::begin(names), std::end(names), name) != std::end(names);
+}
+
+} // namespace
+
+SCENARIO("reloads take over only the reloadable settings", "[config]") {
+    StationChatConfig running;
+    running.gatewayPort = 5001;
+    running.storageBackend = "mariadb";
+
+    StationChatConfig reloaded = running;
+    reloaded.gatewayCluster = {{"10.0.0.2", 5001, 2}};
+    reloaded.gatewaySelection = "least_loaded";
+    reloaded.avatarCacheMaxEntries = 10;
+    reloaded.loginConcurrency = 8;
+    reloaded.loginBatchSize = 4;
+    reloaded.snapshotIntervalSeconds = 30;
+    reloaded.maxBatchedPacketSize = 512;
+    reloaded.sendQueueHighWatermarkKb = 512;
+    reloaded.logRequestSampleEvery = 10;
+
+    WHEN("only reloadable settings changed") {
+        THEN("no restart-only change is reported") {
+            REQUIRE(running.ListRestartOnlyChanges(reloaded).empty());
+        }
+
+        AND_WHEN("they are applied") {
+            running.ApplyReloadable(reloaded);
+
+            THEN("the running configuration carries the new values") {
+                REQUIRE(running.gatewayCluster.size() == 1);
+                REQUIRE(running.gatewayCluster[0].address == "10.0.0.2");
+                REQUIRE(running.gatewaySelection == "least_loaded");
+                REQUIRE(running.avatarCacheMaxEntries == 10);
+                REQUIRE(running.loginConcurrency == 8);
+                REQUIRE(running.loginBatchSize == 4);
+                REQUIRE(running.snapshotIntervalSeconds == 30);
+                REQUIRE(running.maxBatchedPacketSize == 512);
+                REQUIRE(running.sendQueueHighWatermarkKb == 512);
+                REQUIRE(running.logRequestSampleEvery == 10);
+            }
+        }
+    }
+
+    WHEN("settings read only at startup changed as well") {
+        reloaded.gatewayPort = 6001;
+        reloaded.storageBackend = "memory";
+        reloaded.databaseWorkers = 8;
+        reloaded.gatewayReplicationPortOffset = 100;
+
+        auto changed = running.ListRestartOnlyChanges(reloaded);
+
+        THEN("each of them is named") {
+            REQUIRE(changed.size() == 4);
+            REQUIRE(Contains(changed, "gateway_port"));
+            REQUIRE(Contains(changed, "storage_backend"));
+            REQUIRE(Contains(changed, "database_workers"));
+            REQUIRE(Contains(changed, "gateway_replication_port_offset"));
+        }
+
+        AND_WHEN("the reloadable settings are applied") {
+            running.ApplyReloadable(reloaded);
+
+            THEN("the restart-only settings keep their running values") {
+                REQUIRE(running.gatewayPort == 5001);
+                REQUIRE(running.storageBackend == "mariadb");
+                REQUIRE(running.databaseWorkers == StationChatConfig{}.databaseWorkers);
+                REQUIRE(running.gatewayReplicationPortOffset == 0);
+                REQUIRE(running.loginConcurrency == 8);
+            }
+        }
+    }
+}
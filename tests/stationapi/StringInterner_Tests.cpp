@@ -0,0 +1,64 @@
+#include "catch.hpp"
+
+#include "StringInterner.hpp"
+
+SCENARIO("strings can be interned as integer ids", "[strings]") {
+    GIVEN("an empty interner") {
+        StringInterner interner;
+
+        THEN("the empty string is already interned as id 0") {
+            StringInterner::Id id;
+            REQUIRE(interner.Find(u"", id));
+            REQUIRE(id == 0);
+            REQUIRE(interner.Resolve(0).empty());
+        }
+
+        WHEN("the same string is interned twice") {
+            auto first = interner.Intern(u"SWG+galaxy+Tatooine");
+            auto second = interner.Intern(std::u16string{u"SWG+galaxy+"} + u"Tatooine");
+
+            THEN("both calls return the same id") {
+                REQUIRE(first == second);
+                REQUIRE(interner.Size() == 2);
+            }
+
+            AND_THEN("the id resolves back to the original text") {
+                REQUIRE(interner.Resolve(first).compare(u"SWG+galaxy+Tatooine") == 0);
+            }
+        }
+
+        WHEN("different strings are interned") {
+            auto first = interner.Intern(u"SWG+galaxy+Tatooine");
+            auto second = interner.Intern(u"SWG+galaxy+Naboo");
+
+            THEN("they receive different ids") {
+                REQUIRE(first != second);
+            }
+        }
+
+        WHEN("many strings are interned") {
+            auto first = interner.Intern(u"first");
+            const auto& resolved = interner.Resolve(first);
+
+            for (int i = 0; i < 1000; ++i) {
+                interner.Intern(u"address " + std::u16string(1, static_cast<char16_t>(u'A' + i % 26))
+                    + std::u16string(1, static_cast<char16_t>(u'a' + i / 26)));
+            }
+
+            THEN("previously resolved references remain valid") {
+                REQUIRE(resolved.compare(u"first") == 0);
+                REQUIRE(interner.Intern(u"first") == first);
+            }
+        }
+
+        WHEN("a string that was never interned is looked up") {
+            StringInterner::Id id = 42;
+
+            THEN("it is not found and nothing is added") {
+                REQUIRE_FALSE(interner.Find(u"unknown", id));
+                REQUIRE(id == 42);
+                REQUIRE(interner.Size() == 1);
+            }
+        }
+    }
+}
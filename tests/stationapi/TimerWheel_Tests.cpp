@@ -0,0 +1,90 @@
+#include "catch.hpp"
+
+#include "Metrics.hpp"
+#include "TimerWheel.hpp"
+
+#include <chrono>
+#include <vector>
+
+SCENARIO("timers fire once they are due and not before", "[timers]") {
+    auto start = TimerWheel::Clock::now();
+    TimerWheel timers{std::chrono::milliseconds(10), start};
+    std::vector<int> fired;
+
+    timers.Schedule(std::chrono::milliseconds(25), [&fired]() { fired.push_back(1); });
+    timers.Schedule(std::chrono::milliseconds(5), [&fired]() { fired.push_back(2); });
+    auto cancelled = timers.Schedule(std::chrono::milliseconds(15), [&fired]() { fired.push_back(3); });
+
+    REQUIRE(timers.GetPendingCount() == 3);
+    REQUIRE(timers.Cancel(cancelled));
+    REQUIRE_FALSE(timers.Cancel(cancelled));
+
+    timers.Advance(start + std::chrono::milliseconds(9));
+    REQUIRE(fired.empty());
+
+    timers.Advance(start + std::chrono::milliseconds(20));
+    REQUIRE((fired == std::vector<int>{2}));
+
+    timers.Advance(start + std::chrono::milliseconds(30));
+    REQUIRE((fired == std::vector<int>{2, 1}));
+    REQUIRE(timers.GetPendingCount() == 0);
+}
+
+SCENARIO("timers beyond the first level cascade down on time", "[timers]") {
+    auto start = TimerWheel::Clock::now();
+    TimerWheel timers{std::chrono::milliseconds(10), start};
+    std::vector<std::chrono::milliseconds> delays{std::chrono::milliseconds(2570), std::chrono::minutes(3),
+        std::chrono::hours(3), std::chrono::hours(24 * 9)};
+    std::vector<TimerWheel::Clock::time_point> firedAt(delays.size());
+    auto now = start;
+
+    for (std::size_t i = 0; i < delays.size(); ++i) {
+        timers.Schedule(delays[i], [&firedAt, &now, i]() { firedAt[i] = now; });
+    }
+
+    // Step a second at a time so every level turns along the way.
+    while (timers.GetPendingCount() != 0 && now < start + std::chrono::hours(24 * 10)) {
+        now += std::chrono::seconds(1);
+        timers.Advance(now);
+    }
+
+    for (std::size_t i = 0; i < delays.size(); ++i) {
+        REQUIRE(firedAt[i] >= start + delays[i]);
+        REQUIRE(firedAt[i] < start + delays[i] + std::chrono::seconds(1));
+    }
+}
+
+SCENARIO("periodic timers re-arm until cancelled", "[timers]") {
+    auto start = TimerWheel::Clock::now();
+    TimerWheel timers{std::chrono::milliseconds(10), start};
+    MetricHistogram lag;
+    timers.SetLagHistogram(&lag);
+
+    int runs = 0;
+    TimerWheel::TimerId id = 0;
+    id = timers.SchedulePeriodic(std::chrono::milliseconds(100), [&]() {
+        if (++runs == 3) {
+            timers.Cancel(id);
+        }
+    });
+
+    for (int step = 1; step <= 50; ++step) {
+        timers.Advance(start + std::chrono::milliseconds(step * 10));
+    }
+
+    REQUIRE(runs == 3);
+    REQUIRE_FALSE(timers.IsScheduled(id));
+    REQUIRE(lag.Count() == 3);
+
+    WHEN("the node stalls for several periods") {
+        runs = 0;
+        id = timers.SchedulePeriodic(std::chrono::milliseconds(100), [&runs]() { ++runs; });
+        timers.Advance(start + std::chrono::milliseconds(1000));
+
+        THEN("the missed periods run once, late") {
+            REQUIRE(runs == 1);
+            REQUIRE(lag.Sum() >= 400000);
+            REQUIRE(timers.IsScheduled(id));
+        }
+    }
+}
@@ -0,0 +1,324 @@
+// Replays a packet capture written with packet_capture_file against a local
+// gateway node and reports throughput and per request type latency. Storage is
+// in-memory by default; with --storage mariadb requests run against the
+// database named in the configuration file, so point it at a scratch copy
+// rather than a live server's schema.
+//
+// usage: stationchat-replay <capture file> [--storage memory|mariadb] [--config swgchat.cfg] [--speed N]
+
+#include "easylogging++.h"
+
+#include "AsyncLog.hpp"
+#include "ChatEnums.hpp"
+#include "GatewayNode.hpp"
+#include "PacketCapture.hpp"
+#include "StationChatConfig.hpp"
+
+#include <boost/program_options.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+INITIALIZE_EASYLOGGINGPP
+
+namespace {
+
+struct ReplayOptions {
+    std::string captureFile;
+    std::string configFile;
+    double speed = 1.0;
+    bool verbose = false;
+};
+
+bool ParseOptions(int argc, const char* argv[], ReplayOptions& options, StationChatConfig& config) {
+    namespace po = boost::program_options;
+
+    po::options_description generic("Replay options");
+    generic.add_options()
+        ("help,h", "produces help message")
+        ("capture", po::value<std::string>(&options.captureFile), "packet capture to replay")
+        ("config,c", po::value<std::string>(&options.configFile)->default_value("etc/stationapi/swgchat.cfg"),
+            "configuration file providing the database settings for --storage mariadb")
+        ("storage", po::value<std::string>(&config.storageBackend)->default_value("memory"),
+            "chat storage to run against: memory, or mariadb for the database in the configuration file")
+        ("speed", po::value<double>(&options.speed)->default_value(1.0),
+            "replay speed relative to the capture; 0 replays as fast as possible")
+        ("verbose,v", po::bool_switch(&options.verbose), "keeps the gateway's logging enabled")
+        ;
+
+    po::options_description database("Database");
+    database.add_options()
+        ("database_host", po::value<std::string>(&config.chatDatabaseHost)->default_value("127.0.0.1"))
+        ("database_port", po::value<uint16_t>(&config.chatDatabasePort)->default_value(3306))
+        ("database_user", po::value<std::string>(&config.chatDatabaseUser)->default_value(""))
+        ("database_password", po::value<std::string>(&config.chatDatabasePassword)->default_value(""))
+        ("database_schema", po::value<std::string>(&config.chatDatabaseSchema)->default_value(""))
+        ("database_socket", po::value<std::string>(&config.chatDatabaseSocket)->default_value(""))
+        ;
+
+    po::positional_options_description positional;
+    positional.add("capture", 1);
+
+    po::variables_map vm;
+    po::store(po::command_line_parser(argc, argv).options(generic).positional(positional).run(), vm);
+    po::notify(vm);
+
+    if (vm.count("help") || options.captureFile.empty()) {
+        std::cout << "usage: stationchat-replay <capture file> [options]\n" << generic << "\n";
+        return false;
+    }
+
+    if (config.storageBackend == "mariadb") {
+        std::ifstream ifs(options.configFile.c_str());
+        if (!ifs) {
+            throw std::runtime_error("Cannot open configuration file: " + options.configFile);
+        }
+
+        po::store(po::parse_config_file(ifs, database, true), vm);
+        po::notify(vm);
+    }
+
+    if (options.speed < 0) {
+        throw std::runtime_error("speed must not be negative");
+    }
+
+    // The replayed gateway is never reachable from outside, and keeps away
+    // from the website tables and any warm-restart snapshot. The udp stub
+    // only connects within this process, so the port is free.
+    config.gatewayAddress = "127.0.0.1";
+    config.gatewayPort = 5001;
+    config.websiteIntegration.enabled = false;
+    config.snapshotFile.clear();
+
+    return true;
+}
+
+struct TypeLatency {
+    std::vector<uint32_t> samples;
+    uint64_t total = 0;
+};
+
+uint32_t Percentile(const std::vector<uint32_t>& sorted, double fraction) {
+    auto index = static_cast<std::size_t>(fraction * (sorted.size() - 1) + 0.5);
+    return sorted[index];
+}
+
+void PrintReport(std::map<uint16_t, TypeLatency>& latencies) {
+    std::cout << std::left << std::setw(28) << "request type" << std::right << std::setw(10) << "count"
+              << std::setw(10) << "mean us" << std::setw(10) << "p50 us" << std::setw(10) << "p99 us"
+              << std::setw(10) << "max us" << "\n";
+
+    for (auto& entry : latencies) {
+        auto& samples = entry.second.samples;
+        std::sort(std::begin(samples), std::end(samples));
+
+        std::cout << std::left << std::setw(28) << ToString(static_cast<ChatRequestType>(entry.first))
+                  << std::right << std::setw(10) << samples.size() << std::setw(10)
+                  << entry.second.total / samples.size() << std::setw(10) << Percentile(samples, 0.5)
+                  << std::setw(10) << Percentile(samples, 0.99) << std::setw(10) << samples.back() << "\n";
+    }
+}
+
+// Reads the track a request or response carries after its type; 0 when the
+// packet is too short to carry one.
+uint32_t ReadTrack(const unsigned char* data, std::size_t length) {
+    uint32_t track = 0;
+    if (length >= sizeof(uint16_t) + sizeof(track)) {
+        std::memcpy(&track, data + sizeof(uint16_t), sizeof(track));
+    }
+
+    return track;
+}
+
+/** Plays the capture to the gateway over loopback connections, one per
+ * captured game server, and times each request until the response carrying
+ * its track comes back. Handlers that await the database answer on a later
+ * tick, so timing only the hand-off would miss most of the work.
+ */
+class Replayer : public UdpConnectionHandler {
+public:
+    Replayer(const ReplayOptions& options, StationChatConfig& config)
+        : options_{options}
+        , node_{config}
+        , gatewayPort_{config.gatewayPort} {
+        UdpManager::Params params{};
+        manager_ = new UdpManager(&params);
+    }
+
+    ~Replayer() {
+        for (auto& entry : connections_) {
+            entry.second->SetHandler(nullptr);
+            entry.second->Disconnect();
+        }
+
+        node_.Tick();
+
+        for (auto& entry : connections_) {
+            entry.second->Release();
+        }
+
+        manager_->Release();
+    }
+
+    void Run() {
+        PacketCaptureReader reader{options_.captureFile};
+
+        uint64_t replayed = 0;
+        uint64_t skipped = 0;
+        uint64_t firstTimestamp = 0;
+        uint64_t lastTimestamp = 0;
+
+        CapturedPacket packet;
+        auto start = std::chrono::steady_clock::now();
+
+        while (reader.Next(packet)) {
+            // Registrar traffic only hands out the gateway's address.
+            if (packet.source != CaptureSource::GATEWAY || packet.data.size() < sizeof(uint16_t)) {
+                ++skipped;
+                continue;
+            }
+
+            if (replayed == 0) {
+                firstTimestamp = packet.timestamp;
+            }
+
+            lastTimestamp = packet.timestamp;
+
+            if (options_.speed > 0) {
+                auto offset = std::chrono::microseconds{
+                    static_cast<int64_t>((packet.timestamp - firstTimestamp) / options_.speed)};
+                auto due = start + offset;
+
+                // Keep the node ticking while waiting, as the server loop would.
+                while (std::chrono::steady_clock::now() < due) {
+                    Tick();
+                    auto nextTick = std::chrono::steady_clock::now() + std::chrono::milliseconds(1);
+                    std::this_thread::sleep_until(std::min(due, nextTick));
+                }
+            }
+
+            Send(packet);
+            ++replayed;
+
+            if (options_.speed == 0) {
+                Tick();
+            }
+        }
+
+        // Requests still waiting on the database get a few seconds to finish.
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (!outstanding_.empty() && std::chrono::steady_clock::now() < deadline) {
+            Tick();
+        }
+
+        std::chrono::duration<double> wallTime = std::chrono::steady_clock::now() - start;
+        double captureSeconds = (lastTimestamp - firstTimestamp) / 1e6;
+
+        std::cout << "packets replayed:     " << replayed << "\n"
+                  << "packets skipped:      " << skipped << "\n"
+                  << "requests unanswered:  " << outstanding_.size() << "\n"
+                  << "connections:          " << connections_.size() << "\n"
+                  << "capture duration:     " << captureSeconds << " s\n"
+                  << "replay duration:      " << wallTime.count() << " s\n"
+                  << "throughput:           " << static_cast<uint64_t>(replayed / std::max(wallTime.count(), 1e-9))
+                  << " requests/s\n\n";
+
+        if (!latencies_.empty()) {
+            PrintReport(latencies_);
+        }
+    }
+
+    void OnRoutePacket(UdpConnection* connection, const uchar* data, int length) override {
+        // Messages the gateway pushes unprompted carry track 0.
+        auto track = ReadTrack(data, static_cast<std::size_t>(length));
+        auto request = outstanding_.find(std::make_pair(connection, track));
+        if (track == 0 || request == std::end(outstanding_)) {
+            return;
+        }
+
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - request->second.sent);
+
+        auto& latency = latencies_[request->second.type];
+        latency.samples.push_back(static_cast<uint32_t>(elapsed.count()));
+        latency.total += elapsed.count();
+
+        outstanding_.erase(request);
+    }
+
+private:
+    struct Outstanding {
+        uint16_t type;
+        std::chrono::steady_clock::time_point sent;
+    };
+
+    void Send(const CapturedPacket& packet) {
+        auto& connection = connections_[packet.connectionId];
+        if (connection == nullptr) {
+            connection = manager_->EstablishConnection("127.0.0.1", gatewayPort_);
+            connection->SetHandler(this);
+        }
+
+        uint16_t type;
+        std::memcpy(&type, packet.data.data(), sizeof(type));
+
+        // Tracks are only unique per game server, as each numbers its own.
+        auto track = ReadTrack(packet.data.data(), packet.data.size());
+        if (track != 0) {
+            outstanding_[std::make_pair(connection, track)] = Outstanding{type, std::chrono::steady_clock::now()};
+        }
+
+        connection->Send(cUdpChannelReliable1, reinterpret_cast<const char*>(packet.data.data()),
+            static_cast<uint32_t>(packet.data.size()));
+    }
+
+    void Tick() {
+        node_.Tick();
+        manager_->GiveTime();
+    }
+
+    const ReplayOptions& options_;
+    GatewayNode node_;
+    uint16_t gatewayPort_;
+    UdpManager* manager_;
+    std::unordered_map<uint32_t, UdpConnection*> connections_;
+    std::map<std::pair<UdpConnection*, uint32_t>, Outstanding> outstanding_;
+    std::map<uint16_t, TypeLatency> latencies_;
+};
+
+} // namespace
+
+int main(int argc, const char* argv[]) {
+    ReplayOptions options;
+    StationChatConfig config;
+
+    try {
+        if (!ParseOptions(argc, argv, options, config)) {
+            return 0;
+        }
+
+        if (!options.verbose) {
+            el::Loggers::reconfigureAllLoggers(el::ConfigurationType::Enabled, "false");
+            AsyncLogger::Instance().SetRequestSampling(0, 0);
+        }
+
+        Replayer replayer{options, config};
+        replayer.Run();
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}